@@ -0,0 +1,125 @@
+
+#include <string>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <evhtp.h>
+#include "AccessLog.h"
+#include "Util.h"
+
+using namespace std;
+
+AccessLog::AccessLog(int fd, AccessLogFormat format, unsigned int sample,
+		     size_t queueSize)
+	: fd_(fd), format_(format), sample_(sample ? sample : 1),
+	  ring_(queueSize), dropped_(0), written_(0), running_(false),
+	  prefixSecs_(-1)
+{
+}
+
+AccessLog::~AccessLog()
+{
+	stop();
+}
+
+void AccessLog::start()
+{
+	if (running_)
+		return;
+
+	running_ = true;
+	thread_ = std::thread(&AccessLog::writerThread, this);
+}
+
+void AccessLog::stop()
+{
+	if (!running_)
+		return;
+
+	running_ = false;
+	thread_.join();
+}
+
+void AccessLog::writeOut(string& buf)
+{
+	const char *p = buf.data();
+	size_t len = buf.size();
+	while (len > 0) {
+		ssize_t rc = ::write(fd_, p, len);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			break;		// nowhere to report it; drop the block
+		}
+		p += rc;
+		len -= rc;
+	}
+	buf.clear();
+}
+
+void AccessLog::writerThread()
+{
+	string buf;
+	AccessRecord rec;
+
+	for (;;) {
+		bool running = running_.load();
+
+		// drain whatever is queued, into one buffer
+		uint64_t n = 0;
+		while (ring_.pop(rec)) {
+			if (format_ == ALOG_BINARY)
+				buf.append((const char *) &rec, sizeof(rec));
+			else
+				format(buf, rec);
+			n++;
+			if (buf.size() >= 65536)
+				writeOut(buf);
+		}
+
+		if (!buf.empty())
+			writeOut(buf);
+		if (n)
+			written_.fetch_add(n, std::memory_order_relaxed);
+
+		if (!running)
+			break;
+		if (!n)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+void AccessLog::format(string& s, const AccessRecord& rec)
+{
+	time_t secs = rec.tstamp / 1000000;
+	if (secs != prefixSecs_) {
+		prefixSecs_ = secs;
+		timePrefix_ = " - - [" + isoTimeStr(secs) + "] \"";
+	}
+
+	char tmp[32];
+	snprintf(tmp, sizeof(tmp), "\" ? %" PRId64 "\n", rec.contentLen);
+
+	s += rec.peer;
+	s += timePrefix_;
+	s += htparser_get_methodstr_m((htp_method) rec.method);
+	s += ' ';
+	s += rec.path;
+	s += tmp;
+}
+
+bool AccessLog::parseFormat(const std::string& name, AccessLogFormat& format)
+{
+	if (name == "off")
+		format = ALOG_OFF;
+	else if (name == "text")
+		format = ALOG_TEXT;
+	else if (name == "binary")
+		format = ALOG_BINARY;
+	else
+		return false;
+	return true;
+}
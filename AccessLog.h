@@ -0,0 +1,81 @@
+#ifndef __ACCESSLOG_H__
+#define __ACCESSLOG_H__
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "RingBuffer.h"
+
+enum AccessLogFormat {
+	ALOG_OFF,
+	ALOG_TEXT,		// one line per request
+	ALOG_BINARY,		// AccessRecords, as laid out here
+};
+
+// Fixed-size access log record, copied off the request as it finishes.
+// Paths longer than the record holds are truncated.
+struct AccessRecord {
+	uint64_t	tstamp;			// usec since epoch, at request
+	int64_t		contentLen;		// -1 if not given
+	uint8_t		method;			// htp_method
+	char		peer[47];		// numeric address, NUL-terminated
+	char		path[80];		// NUL-terminated
+};
+
+// Asynchronous HTTP access log.  Front-end loops push fixed-size
+// records into a lock-free ring, one in every `sample` requests; a
+// background thread formats and writes them to a file descriptor.
+// When the ring is full, records are dropped and counted rather than
+// stalling the loop.
+class AccessLog {
+public:
+	AccessLog(int fd, AccessLogFormat format, unsigned int sample = 1,
+		  size_t queueSize = 65536);
+	~AccessLog();
+
+	// front-end loops; false if this request is not sampled
+	bool sampled() {
+		static __thread unsigned int n = 0;
+		if (++n < sample_)
+			return false;
+		n = 0;
+		return true;
+	}
+	void push(const AccessRecord& rec) {
+		if (!ring_.push(rec))
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void start();
+	void stop();
+
+	uint64_t dropped() const {
+		return dropped_.load(std::memory_order_relaxed);
+	}
+	uint64_t written() const {
+		return written_.load(std::memory_order_relaxed);
+	}
+
+	static bool parseFormat(const std::string& name, AccessLogFormat& format);
+
+private:
+	int				fd_;
+	AccessLogFormat			format_;
+	unsigned int			sample_;
+	RingBuffer<AccessRecord>	ring_;
+	std::atomic<uint64_t>		dropped_;
+	std::atomic<uint64_t>		written_;
+	std::atomic<bool>		running_;
+	std::thread			thread_;
+
+	// " - - [<iso time>] ", reformatted when the second changes
+	time_t				prefixSecs_;
+	std::string			timePrefix_;
+
+	void writerThread();
+	void format(std::string& s, const AccessRecord& rec);
+	void writeOut(std::string& buf);
+};
+
+#endif // __ACCESSLOG_H__
@@ -0,0 +1,140 @@
+
+#include <string>
+#include <cstring>
+#include <stdio.h>
+#include <openssl/crypto.h>
+#include <univalue.h>
+#include "AuthStore.h"
+
+using namespace std;
+
+static const char authPrefix[] = "/auth/";
+
+enum {
+	HMAC_BLOCK	= SHA256_CBLOCK,
+};
+
+AuthKey::AuthKey(const string& user, const string& secret)
+	: user_(user)
+{
+	// keys longer than a block are hashed first (RFC 2104)
+	unsigned char key[HMAC_BLOCK];
+	memset(key, 0, sizeof(key));
+	if (secret.size() > HMAC_BLOCK)
+		SHA256((const unsigned char *) secret.data(), secret.size(), key);
+	else
+		memcpy(key, secret.data(), secret.size());
+
+	unsigned char pad[HMAC_BLOCK];
+	for (unsigned int i = 0; i < HMAC_BLOCK; i++)
+		pad[i] = key[i] ^ 0x36;
+	SHA256_Init(&inner_);
+	SHA256_Update(&inner_, pad, sizeof(pad));
+
+	for (unsigned int i = 0; i < HMAC_BLOCK; i++)
+		pad[i] = key[i] ^ 0x5c;
+	SHA256_Init(&outer_);
+	SHA256_Update(&outer_, pad, sizeof(pad));
+
+	OPENSSL_cleanse(key, sizeof(key));
+	OPENSSL_cleanse(pad, sizeof(pad));
+}
+
+void AuthKey::sign(const void *msg, size_t len,
+		   unsigned char mac[MAC_SIZE]) const
+{
+	unsigned char ihash[SHA256_DIGEST_LENGTH];
+
+	SHA256_CTX ctx = inner_;
+	SHA256_Update(&ctx, msg, len);
+	SHA256_Final(ihash, &ctx);
+
+	ctx = outer_;
+	SHA256_Update(&ctx, ihash, sizeof(ihash));
+	SHA256_Final(mac, &ctx);
+}
+
+bool AuthKey::verify(const void *msg, size_t len,
+		     const unsigned char mac[MAC_SIZE]) const
+{
+	unsigned char md[MAC_SIZE];
+	sign(msg, len, md);
+	return CRYPTO_memcmp(md, mac, MAC_SIZE) == 0;
+}
+
+static int hexVal(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+bool AuthKey::verifyHex(const void *msg, size_t len,
+			const char *hex, size_t hexLen) const
+{
+	if (hexLen != MAC_SIZE * 2)
+		return false;
+
+	unsigned char mac[MAC_SIZE];
+	for (unsigned int i = 0; i < MAC_SIZE; i++) {
+		int hi = hexVal(hex[i * 2]);
+		int lo = hexVal(hex[i * 2 + 1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		mac[i] = (hi << 4) | lo;
+	}
+
+	return verify(msg, len, mac);
+}
+
+void AuthStore::add(const string& user, const string& secret)
+{
+	keys_.erase(user);
+	keys_.insert(make_pair(user, AuthKey(user, secret)));
+}
+
+const AuthKey *AuthStore::find(const string& user) const
+{
+	unordered_map<string, AuthKey>::const_iterator it = keys_.find(user);
+	if (it == keys_.end())
+		return NULL;
+	return &it->second;
+}
+
+bool AuthStore::load(rocksdb::DB *db)
+{
+	const size_t prefixLen = strlen(authPrefix);
+	bool ok = true;
+
+	rocksdb::Iterator *it = db->NewIterator(rocksdb::ReadOptions());
+	for (it->Seek(authPrefix);
+	     it->Valid() && it->key().starts_with(authPrefix); it->Next()) {
+		string user = it->key().ToString().substr(prefixLen);
+
+		UniValue jval;
+		string secret;
+		if (jval.read(it->value().ToString())) {
+			if (jval.isStr())
+				secret = jval.get_str();
+			else if (jval.isObject() && jval["secret"].isStr())
+				secret = jval["secret"].get_str();
+		}
+		if (user.empty() || secret.empty()) {
+			fprintf(stderr, "%s%s: invalid credential\n",
+				authPrefix, user.c_str());
+			ok = false;
+			continue;
+		}
+
+		add(user, secret);
+	}
+	if (!it->status().ok())
+		ok = false;
+	delete it;
+
+	return ok;
+}
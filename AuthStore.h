@@ -0,0 +1,52 @@
+#ifndef __AUTHSTORE_H__
+#define __AUTHSTORE_H__
+
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include <openssl/sha.h>
+#include "rocksdb/db.h"
+
+// One API user's credential.  The HMAC-SHA256 key schedule -- the
+// hash state after the inner and outer padded key blocks -- is computed
+// once; each signature copies that state and hashes only the message.
+class AuthKey {
+public:
+	enum { MAC_SIZE = SHA256_DIGEST_LENGTH };
+
+	AuthKey(const std::string& user, const std::string& secret);
+
+	const std::string& user() const { return user_; }
+
+	void sign(const void *msg, size_t len, unsigned char mac[MAC_SIZE]) const;
+
+	// constant time, as far as the comparison goes
+	bool verify(const void *msg, size_t len,
+		    const unsigned char mac[MAC_SIZE]) const;
+	bool verifyHex(const void *msg, size_t len,
+		       const char *hex, size_t hexLen) const;
+
+private:
+	std::string		user_;
+	SHA256_CTX		inner_;
+	SHA256_CTX		outer_;
+};
+
+// API credentials, by user name; loaded at startup from the /auth/
+// records written by obdb --load-auth, and read-only after.  A record's
+// value is the user's secret, as a JSON string or an object's "secret".
+class AuthStore {
+public:
+	bool load(rocksdb::DB *db);
+	void add(const std::string& user, const std::string& secret);
+
+	// NULL if no such user
+	const AuthKey *find(const std::string& user) const;
+
+	size_t size() const { return keys_.size(); }
+
+private:
+	std::unordered_map<std::string, AuthKey>	keys_;
+};
+
+#endif // __AUTHSTORE_H__
@@ -0,0 +1,308 @@
+#ifndef __BINPROTO_H__
+#define __BINPROTO_H__
+
+#include <string>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/sha.h>
+
+// Binary order-entry protocol, over a persistent TCP session.
+//
+// Every message is a fixed-layout little-endian record, beginning with
+// a 4-byte header: u16 total length (header included), u8 type, u8
+// reserved (zero).  The first client message must be a login; after
+// that, orders may be pipelined without waiting for replies.
+//
+// Each order, cancel or modify is answered by an ack carrying the
+// client's reference and the engine order id.  Order events (accept,
+// fill, cancel, ...) follow as execution reports, keyed by order id.
+// Nothing is sent before the command's journal record is durable.
+
+enum {
+	BIN_HDR_SIZE		= 4,
+	BIN_MAX_MSG		= 64,
+	BIN_USER_SIZE		= 16,
+	BIN_SYMBOL_SIZE		= 16,
+	BIN_MAC_SIZE		= SHA256_DIGEST_LENGTH,
+
+	// client to server
+	BIN_LOGIN		= 'L',
+	BIN_NEW_ORDER		= 'O',
+	BIN_CANCEL		= 'X',
+	BIN_MODIFY		= 'M',
+	BIN_HEARTBEAT		= 'H',
+
+	// server to client
+	BIN_LOGIN_ACK		= 'l',
+	BIN_ACK			= 'k',
+	BIN_EXEC		= 'e',
+	BIN_HEARTBEAT_ACK	= 'h',
+
+	// message sizes, header included
+	BIN_LOGIN_SIZE		= BIN_HDR_SIZE + BIN_USER_SIZE + 8 + BIN_MAC_SIZE,
+	BIN_NEW_ORDER_SIZE	= BIN_HDR_SIZE + 8 + BIN_SYMBOL_SIZE + 4 + 12,
+	BIN_CANCEL_SIZE		= BIN_HDR_SIZE + 8 + 8,
+	BIN_MODIFY_SIZE		= BIN_HDR_SIZE + 8 + 8 + 4 + 4,
+	BIN_HEARTBEAT_SIZE	= BIN_HDR_SIZE,
+	BIN_LOGIN_ACK_SIZE	= BIN_HDR_SIZE + 4,
+	BIN_ACK_SIZE		= BIN_HDR_SIZE + 8 + 8 + 4,
+	BIN_EXEC_SIZE		= BIN_HDR_SIZE + 8 + 4 + 16,
+
+	// new order flags
+	BIN_F_BUY		= (1U << 0),
+	BIN_F_AON		= (1U << 1),
+	BIN_F_IOC		= (1U << 2),
+};
+
+// ack and login-ack status
+enum BinStatus {
+	BIN_OK			= 0,
+	BIN_ERR_AUTH		= 1,	// login refused
+	BIN_ERR_MSG		= 2,	// malformed field
+	BIN_ERR_SYMBOL		= 3,	// no such market
+	BIN_ERR_ORDER		= 4,	// no such live order
+	BIN_ERR_BUSY		= 5,	// shard queue full; not executed
+	BIN_ERR_STORE		= 6,	// not journaled; the shard has stopped
+};
+
+static inline void binPutU16(unsigned char *p, uint16_t v)
+{
+	p[0] = (unsigned char) v;
+	p[1] = (unsigned char) (v >> 8);
+}
+
+static inline void binPutU32(unsigned char *p, uint32_t v)
+{
+	for (unsigned int i = 0; i < 4; i++)
+		p[i] = (unsigned char) (v >> (i * 8));
+}
+
+static inline void binPutU64(unsigned char *p, uint64_t v)
+{
+	for (unsigned int i = 0; i < 8; i++)
+		p[i] = (unsigned char) (v >> (i * 8));
+}
+
+static inline uint16_t binGetU16(const unsigned char *p)
+{
+	return (uint16_t) (p[0] | (p[1] << 8));
+}
+
+static inline uint32_t binGetU32(const unsigned char *p)
+{
+	uint32_t v = 0;
+	for (unsigned int i = 0; i < 4; i++)
+		v |= ((uint32_t) p[i]) << (i * 8);
+	return v;
+}
+
+static inline uint64_t binGetU64(const unsigned char *p)
+{
+	uint64_t v = 0;
+	for (unsigned int i = 0; i < 8; i++)
+		v |= ((uint64_t) p[i]) << (i * 8);
+	return v;
+}
+
+static inline void binPutHdr(unsigned char *p, uint16_t len, uint8_t type)
+{
+	binPutU16(p, len);
+	p[2] = type;
+	p[3] = 0;
+}
+
+// fixed-width, NUL-padded text fields
+static inline void binPutStr(unsigned char *p, size_t width,
+			     const std::string& s)
+{
+	memset(p, 0, width);
+	memcpy(p, s.data(), std::min(s.size(), width));
+}
+
+static inline std::string binGetStr(const unsigned char *p, size_t width)
+{
+	size_t len = 0;
+	while (len < width && p[len])
+		len++;
+	return std::string((const char *) p, len);
+}
+
+//
+// Messages, in host form.  encode() writes exactly SIZE bytes,
+// header included; decode() expects a complete message of that size.
+//
+
+struct BinLogin {
+	enum {
+		TYPE = BIN_LOGIN, SIZE = BIN_LOGIN_SIZE,
+		MAC_INPUT_SIZE = BIN_USER_SIZE + 8,
+	};
+
+	std::string		user;
+	uint64_t		unixtime;
+	unsigned char		mac[BIN_MAC_SIZE];
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutStr(p + 4, BIN_USER_SIZE, user);
+		binPutU64(p + 20, unixtime);
+		memcpy(p + 28, mac, BIN_MAC_SIZE);
+	}
+	void decode(const unsigned char *p) {
+		user = binGetStr(p + 4, BIN_USER_SIZE);
+		unixtime = binGetU64(p + 20);
+		memcpy(mac, p + 28, BIN_MAC_SIZE);
+	}
+
+	// HMAC-SHA256 over the user and time fields, as sent
+	static void macInput(const std::string& user, uint64_t unixtime,
+			     unsigned char msg[MAC_INPUT_SIZE]) {
+		binPutStr(msg, BIN_USER_SIZE, user);
+		binPutU64(msg + BIN_USER_SIZE, unixtime);
+	}
+	static void sign(const std::string& user, uint64_t unixtime,
+			 const std::string& secret,
+			 unsigned char mac[BIN_MAC_SIZE]) {
+		unsigned char msg[MAC_INPUT_SIZE];
+		macInput(user, unixtime, msg);
+		HMAC(EVP_sha256(), secret.data(), secret.size(),
+		     msg, sizeof(msg), mac, NULL);
+	}
+};
+
+struct BinNewOrder {
+	enum { TYPE = BIN_NEW_ORDER, SIZE = BIN_NEW_ORDER_SIZE };
+
+	uint64_t		clientRef;
+	std::string		symbol;
+	uint32_t		flags;		// BIN_F_xxx
+	uint32_t		qty;
+	uint32_t		price;		// 0: market order
+	uint32_t		stopPrice;
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU64(p + 4, clientRef);
+		binPutStr(p + 12, BIN_SYMBOL_SIZE, symbol);
+		binPutU32(p + 28, flags);
+		binPutU32(p + 32, qty);
+		binPutU32(p + 36, price);
+		binPutU32(p + 40, stopPrice);
+	}
+	void decode(const unsigned char *p) {
+		clientRef = binGetU64(p + 4);
+		symbol = binGetStr(p + 12, BIN_SYMBOL_SIZE);
+		flags = binGetU32(p + 28);
+		qty = binGetU32(p + 32);
+		price = binGetU32(p + 36);
+		stopPrice = binGetU32(p + 40);
+	}
+};
+
+struct BinCancel {
+	enum { TYPE = BIN_CANCEL, SIZE = BIN_CANCEL_SIZE };
+
+	uint64_t		clientRef;
+	uint64_t		orderId;
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU64(p + 4, clientRef);
+		binPutU64(p + 12, orderId);
+	}
+	void decode(const unsigned char *p) {
+		clientRef = binGetU64(p + 4);
+		orderId = binGetU64(p + 12);
+	}
+};
+
+struct BinModify {
+	enum { TYPE = BIN_MODIFY, SIZE = BIN_MODIFY_SIZE };
+
+	uint64_t		clientRef;
+	uint64_t		orderId;
+	int32_t			qtyDelta;	// 0: unchanged
+	uint32_t		price;		// 0: unchanged
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU64(p + 4, clientRef);
+		binPutU64(p + 12, orderId);
+		binPutU32(p + 20, (uint32_t) qtyDelta);
+		binPutU32(p + 24, price);
+	}
+	void decode(const unsigned char *p) {
+		clientRef = binGetU64(p + 4);
+		orderId = binGetU64(p + 12);
+		qtyDelta = (int32_t) binGetU32(p + 20);
+		price = binGetU32(p + 24);
+	}
+};
+
+struct BinLoginAck {
+	enum { TYPE = BIN_LOGIN_ACK, SIZE = BIN_LOGIN_ACK_SIZE };
+
+	uint8_t			status;		// BinStatus
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU32(p + 4, status);
+	}
+	void decode(const unsigned char *p) {
+		status = (uint8_t) binGetU32(p + 4);
+	}
+};
+
+struct BinAck {
+	enum { TYPE = BIN_ACK, SIZE = BIN_ACK_SIZE };
+
+	uint64_t		clientRef;
+	uint64_t		orderId;	// 0 if none assigned
+	uint8_t			status;		// BinStatus
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU64(p + 4, clientRef);
+		binPutU64(p + 12, orderId);
+		binPutU32(p + 20, status);
+	}
+	void decode(const unsigned char *p) {
+		clientRef = binGetU64(p + 4);
+		orderId = binGetU64(p + 12);
+		status = (uint8_t) binGetU32(p + 20);
+	}
+};
+
+struct BinExec {
+	enum { TYPE = BIN_EXEC, SIZE = BIN_EXEC_SIZE };
+
+	uint64_t		orderId;
+	uint8_t			execType;	// orderentry::ExecType
+	uint32_t		qty;
+	uint32_t		price;
+	uint32_t		leaves;
+	uint32_t		filled;
+
+	void encode(unsigned char *p) const {
+		binPutHdr(p, SIZE, TYPE);
+		binPutU64(p + 4, orderId);
+		binPutU32(p + 12, execType);
+		binPutU32(p + 16, qty);
+		binPutU32(p + 20, price);
+		binPutU32(p + 24, leaves);
+		binPutU32(p + 28, filled);
+	}
+	void decode(const unsigned char *p) {
+		orderId = binGetU64(p + 4);
+		execType = (uint8_t) binGetU32(p + 12);
+		qty = binGetU32(p + 16);
+		price = binGetU32(p + 20);
+		leaves = binGetU32(p + 24);
+		filled = binGetU32(p + 28);
+	}
+};
+
+#endif // __BINPROTO_H__
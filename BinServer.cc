@@ -0,0 +1,477 @@
+#include <string>
+#include <memory>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <ctype.h>
+#include <assert.h>
+#include <syslog.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <event2/buffer.h>
+#include "BinServer.h"
+
+using namespace std;
+using namespace orderentry;
+
+enum {
+	MAX_CLIENT_DRIFT	= 20,	// max seconds client time may drift
+	LISTEN_BACKLOG		= 1024,
+};
+
+static bool validSymbol(const std::string& sym)
+{
+	if ((sym.size() == 0) || (sym.size() > BIN_SYMBOL_SIZE))
+		return false;
+
+	for (size_t i = 0; i < sym.size(); i++)
+		if (!isalpha(sym[i]) || !isupper(sym[i]))
+			return false;
+
+	return true;
+}
+
+//
+// Shard-side execution.  The ack is reported ahead of the order's own
+// events, so clients learn the order id before its first fill.
+//
+
+static ExecReport binAck(const EngineCmd& cmd, uint8_t status)
+{
+	ExecReport ack;
+	ack.session = cmd.session;
+	ack.type = EXEC_ACK;
+	ack.status = status;
+	ack.clientRef = cmd.clientRef;
+	ack.orderId = cmd.orderId;
+	return ack;
+}
+
+static void execBinOrderAdd(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
+	auto book = market.findBook(cmd.symbol);
+	if (!book) {
+		shard.on_exec(binAck(cmd, BIN_ERR_SYMBOL));
+		return;
+	}
+
+	OrderPtr order(new Order(market.nextOrderId(),
+		cmd.flag, cmd.qty, cmd.symbol, cmd.price, cmd.stopPrice,
+		(cmd.conditions & liquibook::book::oc_all_or_none) != 0,
+		(cmd.conditions & liquibook::book::oc_immediate_or_cancel) != 0));
+	order->setSession(cmd.session);
+
+	cmd.orderId = order->order_id();
+	shard.on_exec(binAck(cmd, BIN_OK));
+
+	market.orderSubmit(book, order, cmd.conditions);
+}
+
+static void execBinCancel(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
+	if (!market.orders().find(cmd.orderId)) {
+		shard.on_exec(binAck(cmd, BIN_ERR_ORDER));
+		return;
+	}
+
+	shard.on_exec(binAck(cmd, BIN_OK));
+	market.orderCancel(cmd.orderId);
+}
+
+static void execBinModify(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
+	if (!market.orders().find(cmd.orderId)) {
+		shard.on_exec(binAck(cmd, BIN_ERR_ORDER));
+		return;
+	}
+
+	shard.on_exec(binAck(cmd, BIN_OK));
+	market.orderModify(cmd.orderId, cmd.qtyDelta, cmd.price);
+}
+
+//
+// BinServer
+//
+
+BinServer::BinServer(struct event_base *base, Engine *engine,
+		     const AuthStore *auth, size_t queueSize)
+	: base_(base), engine_(engine), auth_(auth),
+	  listener_(NULL), nextSession_(0),
+	  ring_(queueSize), ev_(NULL), signaled_(false),
+	  nSessions_(0), nMessages_(0), nReports_(0)
+{
+	int rc = pipe2(fds_, O_NONBLOCK | O_CLOEXEC);
+	assert(rc == 0);
+
+	ev_ = event_new(base, fds_[0], EV_READ | EV_PERSIST, wakeCb, this);
+	event_add(ev_, NULL);
+}
+
+BinServer::~BinServer()
+{
+	if (listener_)
+		evconnlistener_free(listener_);
+
+	for (auto it = sessionMap_.begin(); it != sessionMap_.end(); ++it) {
+		bufferevent_free(it->second->bev);
+		delete it->second;
+	}
+
+	event_free(ev_);
+	close(fds_[0]);
+	close(fds_[1]);
+}
+
+bool BinServer::listen(const std::string& addr, unsigned int port)
+{
+	struct sockaddr_storage ss;
+	int sslen = sizeof(ss);
+	string addrPort = addr + ":" + to_string(port);
+	if (evutil_parse_sockaddr_port(addrPort.c_str(),
+				       (struct sockaddr *) &ss, &sslen) < 0)
+		return false;
+
+	listener_ = evconnlistener_new_bind(base_, acceptCb, this,
+		LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, LISTEN_BACKLOG,
+		(struct sockaddr *) &ss, sslen);
+	return (listener_ != NULL);
+}
+
+// shard threads: same wakeup scheme as CompletionQueue
+void BinServer::post(const std::vector<ExecReport>& reports)
+{
+	for (size_t i = 0; i < reports.size(); i++)
+		while (!ring_.push(reports[i]))
+			std::this_thread::yield();
+
+	if (!signaled_.exchange(true)) {
+		char ch = 0;
+		ssize_t rc = write(fds_[1], &ch, 1);
+		(void) rc;
+	}
+}
+
+void BinServer::wakeCb(evutil_socket_t fd, short events, void *arg)
+{
+	BinServer *srv = (BinServer *) arg;
+
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	// clear before draining; a post racing with us re-signals
+	srv->signaled_ = false;
+	srv->deliver();
+}
+
+// encode each report onto its session; reports for sessions that
+// have since disconnected are dropped
+void BinServer::deliver()
+{
+	ExecReport rep;
+	while (ring_.pop(rep)) {
+		auto it = sessionMap_.find(rep.session);
+		if (it == sessionMap_.end() || it->second->closing)
+			continue;
+
+		unsigned char buf[BIN_MAX_MSG];
+		size_t len;
+		if (rep.type == EXEC_ACK) {
+			BinAck ack;
+			ack.clientRef = rep.clientRef;
+			ack.orderId = rep.orderId;
+			ack.status = rep.status;
+			ack.encode(buf);
+			len = BinAck::SIZE;
+		} else {
+			BinExec exec;
+			exec.orderId = rep.orderId;
+			exec.execType = rep.type;
+			exec.qty = rep.qty;
+			exec.price = rep.price;
+			exec.leaves = rep.leaves;
+			exec.filled = rep.filled;
+			exec.encode(buf);
+			len = BinExec::SIZE;
+		}
+
+		bufferevent_write(it->second->bev, buf, len);
+		nReports_++;
+	}
+}
+
+void BinServer::acceptCb(struct evconnlistener *listener,
+			 evutil_socket_t fd, struct sockaddr *addr,
+			 int socklen, void *arg)
+{
+	BinServer *srv = (BinServer *) arg;
+
+	// small messages, each awaited by a client: send immediately
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	struct bufferevent *bev = bufferevent_socket_new(srv->base_, fd,
+		BEV_OPT_CLOSE_ON_FREE);
+	if (!bev) {
+		close(fd);
+		return;
+	}
+
+	// session ids are never 0, and never reused while live
+	do {
+		srv->nextSession_++;
+	} while (srv->nextSession_ == 0 ||
+		 srv->sessionMap_.count(srv->nextSession_));
+
+	Session *sess = new Session();
+	sess->srv = srv;
+	sess->id = srv->nextSession_;
+	sess->bev = bev;
+	sess->loggedIn = false;
+	sess->closing = false;
+	srv->sessionMap_[sess->id] = sess;
+	srv->nSessions_++;
+
+	bufferevent_setcb(bev, sessReadCb, sessWriteCb, sessEventCb, sess);
+	bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+void BinServer::sessReadCb(struct bufferevent *bev, void *arg)
+{
+	Session *sess = (Session *) arg;
+	BinServer *srv = sess->srv;
+	struct evbuffer *in = bufferevent_get_input(bev);
+
+	// pipelined: handle every complete message in the buffer
+	unsigned char msg[BIN_MAX_MSG];
+	while (evbuffer_get_length(in) >= BIN_HDR_SIZE) {
+		evbuffer_copyout(in, msg, BIN_HDR_SIZE);
+		uint16_t len = binGetU16(msg);
+		if (len < BIN_HDR_SIZE || len > BIN_MAX_MSG) {
+			srv->closeSession(sess, false);
+			return;
+		}
+		if (evbuffer_get_length(in) < len)
+			break;
+
+		evbuffer_remove(in, msg, len);
+		srv->nMessages_++;
+		if (!srv->dispatch(sess, msg, len)) {
+			srv->closeSession(sess, false);
+			return;
+		}
+	}
+}
+
+void BinServer::sessWriteCb(struct bufferevent *bev, void *arg)
+{
+	Session *sess = (Session *) arg;
+
+	if (sess->closing)
+		sess->srv->closeSession(sess, false);
+}
+
+void BinServer::sessEventCb(struct bufferevent *bev, short events, void *arg)
+{
+	Session *sess = (Session *) arg;
+
+	if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+		sess->srv->closeSession(sess, true);
+}
+
+// drop the session, after any pending output unless the connection
+// is already gone; resting orders stay on the book
+void BinServer::closeSession(Session *sess, bool now)
+{
+	sess->closing = true;
+	bufferevent_disable(sess->bev, EV_READ);
+
+	// sessWriteCb calls back once the output has drained
+	if (!now && evbuffer_get_length(bufferevent_get_output(sess->bev)) > 0)
+		return;
+
+	sessionMap_.erase(sess->id);
+	nSessions_--;
+	bufferevent_free(sess->bev);
+	delete sess;
+}
+
+bool BinServer::dispatch(Session *sess, const unsigned char *msg, size_t len)
+{
+	uint8_t type = msg[2];
+
+	// login first, and only once
+	if (!sess->loggedIn)
+		return (type == BIN_LOGIN) && (len == BinLogin::SIZE) &&
+		       login(sess, msg);
+
+	switch (type) {
+	case BIN_NEW_ORDER:
+		if (len != BinNewOrder::SIZE)
+			return false;
+		newOrder(sess, msg);
+		return true;
+
+	case BIN_CANCEL:
+		if (len != BinCancel::SIZE)
+			return false;
+		cancel(sess, msg);
+		return true;
+
+	case BIN_MODIFY:
+		if (len != BinModify::SIZE)
+			return false;
+		modify(sess, msg);
+		return true;
+
+	case BIN_HEARTBEAT: {
+		unsigned char buf[BIN_HEARTBEAT_SIZE];
+		binPutHdr(buf, BIN_HEARTBEAT_SIZE, BIN_HEARTBEAT_ACK);
+		bufferevent_write(sess->bev, buf, sizeof(buf));
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+bool BinServer::login(Session *sess, const unsigned char *msg)
+{
+	BinLogin req;
+	req.decode(msg);
+
+	// validate client clock within range
+	time_t now = time(NULL);
+	time_t clientTime = (time_t) req.unixtime;
+	time_t timeDiff = std::max(now, clientTime) - std::min(now, clientTime);
+
+	unsigned char signedMsg[BinLogin::MAC_INPUT_SIZE];
+	BinLogin::macInput(req.user, req.unixtime, signedMsg);
+	const AuthKey *key = auth_->find(req.user);
+
+	BinLoginAck ack;
+	ack.status = BIN_OK;
+	if (!key || timeDiff > MAX_CLIENT_DRIFT ||
+	    !key->verify(signedMsg, sizeof(signedMsg), req.mac))
+		ack.status = BIN_ERR_AUTH;
+
+	unsigned char buf[BinLoginAck::SIZE];
+	ack.encode(buf);
+	bufferevent_write(sess->bev, buf, sizeof(buf));
+
+	// refused: the caller closes the session, after the ack is sent
+	if (ack.status != BIN_OK) {
+		syslog(LOG_DAEMON|LOG_WARNING,
+		       "binary session %u: login refused", sess->id);
+		return false;
+	}
+
+	sess->loggedIn = true;
+	return true;
+}
+
+void BinServer::sendAck(Session *sess, uint64_t clientRef, uint8_t status)
+{
+	BinAck ack;
+	ack.clientRef = clientRef;
+	ack.orderId = 0;
+	ack.status = status;
+
+	unsigned char buf[BinAck::SIZE];
+	ack.encode(buf);
+	bufferevent_write(sess->bev, buf, sizeof(buf));
+}
+
+void BinServer::submit(Session *sess, unsigned int shard, EngineCmd *cmd)
+{
+	cmd->session = sess->id;
+
+	// no completion: the shard reports acks and events itself
+	if (!engine_->shard(shard).post(cmd)) {
+		uint64_t clientRef = cmd->clientRef;
+		delete cmd;
+		sendAck(sess, clientRef, BIN_ERR_BUSY);
+	}
+}
+
+void BinServer::newOrder(Session *sess, const unsigned char *msg)
+{
+	BinNewOrder req;
+	req.decode(msg);
+
+	if (!validSymbol(req.symbol) || req.qty == 0) {
+		sendAck(sess, req.clientRef, BIN_ERR_MSG);
+		return;
+	}
+
+	const liquibook::book::OrderConditions AON(liquibook::book::oc_all_or_none);
+	const liquibook::book::OrderConditions IOC(liquibook::book::oc_immediate_or_cancel);
+	const liquibook::book::OrderConditions NOC(liquibook::book::oc_no_conditions);
+
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execBinOrderAdd;
+	cmd->clientRef = req.clientRef;
+	cmd->symbol = req.symbol;
+	cmd->flag = (req.flags & BIN_F_BUY) != 0;
+	cmd->qty = req.qty;
+	cmd->price = req.price;
+	cmd->stopPrice = req.stopPrice;
+	cmd->conditions = ((req.flags & BIN_F_AON) ? AON : NOC) |
+			  ((req.flags & BIN_F_IOC) ? IOC : NOC);
+
+	submit(sess, engine_->shardForSymbol(req.symbol), cmd);
+}
+
+void BinServer::cancel(Session *sess, const unsigned char *msg)
+{
+	BinCancel req;
+	req.decode(msg);
+
+	// order ids carry their shard
+	unsigned int shard = orderIdShard(req.orderId);
+	if (req.orderId == 0 || shard >= engine_->shardCount()) {
+		sendAck(sess, req.clientRef, BIN_ERR_ORDER);
+		return;
+	}
+
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execBinCancel;
+	cmd->clientRef = req.clientRef;
+	cmd->orderId = req.orderId;
+
+	submit(sess, shard, cmd);
+}
+
+void BinServer::modify(Session *sess, const unsigned char *msg)
+{
+	BinModify req;
+	req.decode(msg);
+
+	unsigned int shard = orderIdShard(req.orderId);
+	if (req.orderId == 0 || shard >= engine_->shardCount()) {
+		sendAck(sess, req.clientRef, BIN_ERR_ORDER);
+		return;
+	}
+	if (req.qtyDelta == liquibook::book::SIZE_UNCHANGED &&
+	    req.price == liquibook::book::PRICE_UNCHANGED) {
+		sendAck(sess, req.clientRef, BIN_ERR_MSG);
+		return;
+	}
+
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execBinModify;
+	cmd->clientRef = req.clientRef;
+	cmd->orderId = req.orderId;
+	cmd->qtyDelta = req.qtyDelta;
+	cmd->price = req.price;
+
+	submit(sess, shard, cmd);
+}
@@ -0,0 +1,81 @@
+#ifndef __BINSERVER_H__
+#define __BINSERVER_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+#include "Engine.h"
+#include "BinProto.h"
+#include "RingBuffer.h"
+#include "AuthStore.h"
+
+// Binary order-entry listener (see BinProto.h).  Sessions live on one
+// event loop; commands go straight to the owning shard, and the shards'
+// execution reports come back through a queue drained on that loop.
+class BinServer : public ExecSink {
+public:
+	BinServer(struct event_base *base, Engine *engine,
+		  const AuthStore *auth, size_t queueSize);
+	~BinServer();
+
+	bool listen(const std::string& addr, unsigned int port);
+
+	// ExecSink; called from shard threads
+	virtual void post(const std::vector<orderentry::ExecReport>& reports);
+
+	uint64_t sessions() const { return nSessions_; }
+	uint64_t messages() const { return nMessages_; }
+	uint64_t reports() const { return nReports_; }
+
+private:
+	struct Session {
+		BinServer		*srv;
+		uint32_t		id;
+		struct bufferevent	*bev;
+		bool			loggedIn;
+		bool			closing;	// free once output drains
+	};
+
+	struct event_base	*base_;
+	Engine			*engine_;
+	const AuthStore		*auth_;
+	struct evconnlistener	*listener_;
+
+	uint32_t		nextSession_;
+	std::unordered_map<uint32_t, Session *> sessionMap_;
+
+	RingBuffer<orderentry::ExecReport> ring_;
+	int			fds_[2];
+	struct event		*ev_;
+	std::atomic<bool>	signaled_;
+
+	std::atomic<uint64_t>	nSessions_;
+	std::atomic<uint64_t>	nMessages_;
+	std::atomic<uint64_t>	nReports_;
+
+	bool dispatch(Session *sess, const unsigned char *msg, size_t len);
+	bool login(Session *sess, const unsigned char *msg);
+	void newOrder(Session *sess, const unsigned char *msg);
+	void cancel(Session *sess, const unsigned char *msg);
+	void modify(Session *sess, const unsigned char *msg);
+	void submit(Session *sess, unsigned int shard, EngineCmd *cmd);
+	void sendAck(Session *sess, uint64_t clientRef, uint8_t status);
+	void closeSession(Session *sess, bool now);
+	void deliver();
+
+	static void acceptCb(struct evconnlistener *listener,
+			     evutil_socket_t fd, struct sockaddr *addr,
+			     int socklen, void *arg);
+	static void sessReadCb(struct bufferevent *bev, void *arg);
+	static void sessWriteCb(struct bufferevent *bev, void *arg);
+	static void sessEventCb(struct bufferevent *bev, short events,
+				void *arg);
+	static void wakeCb(evutil_socket_t fd, short events, void *arg);
+};
+
+#endif // __BINSERVER_H__
@@ -0,0 +1,92 @@
+#ifndef __BOOKCACHE_H__
+#define __BOOKCACHE_H__
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+
+// Serialized order-book replies, per symbol and depth, reused until
+// the book changes.  Each book's version is bumped by its shard on
+// every change; a cached reply is served only while its version is
+// current.  Front-end threads read without a shard round trip.
+//
+// A client whose order was acknowledged always misses a reply cached
+// before that order: the shard bumps the version while executing,
+// before the acknowledgement is sent.
+class BookCache {
+public:
+	enum { MAX_DEPTH = 3 };		// /book depth=1..3
+
+	typedef std::shared_ptr<const std::string> Body;
+
+	class Entry {
+	public:
+		Entry() : version_(0) {}
+
+		// shard only
+		void bump() { version_.fetch_add(1, std::memory_order_release); }
+		uint64_t version() const {
+			return version_.load(std::memory_order_acquire);
+		}
+
+		bool get(unsigned int depth, Body& body) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			Slot& slot = slots_[depth - 1];
+			if (!slot.body || slot.version != version())
+				return false;
+			body = slot.body;
+			return true;
+		}
+
+		// reply built at version; dropped if the book has moved on
+		void put(unsigned int depth, uint64_t version, const Body& body) {
+			std::lock_guard<std::mutex> lk(mtx_);
+			if (version != this->version())
+				return;
+			Slot& slot = slots_[depth - 1];
+			slot.version = version;
+			slot.body = body;
+		}
+
+	private:
+		struct Slot {
+			uint64_t	version;
+			Body		body;
+
+			Slot() : version(0) {}
+		};
+
+		std::atomic<uint64_t>	version_;
+		std::mutex		mtx_;
+		Slot			slots_[MAX_DEPTH];
+	};
+
+	~BookCache() {
+		for (auto it = entries_.begin(); it != entries_.end(); ++it)
+			delete it->second;
+	}
+
+	// entries are never removed, so pointers stay valid
+	Entry *add(const std::string& symbol) {
+		std::lock_guard<std::mutex> lk(mtx_);
+		Entry *& ent = entries_[symbol];
+		if (!ent)
+			ent = new Entry();
+		return ent;
+	}
+
+	Entry *find(const std::string& symbol) {
+		std::lock_guard<std::mutex> lk(mtx_);
+		auto it = entries_.find(symbol);
+		return (it == entries_.end()) ? NULL : it->second;
+	}
+
+private:
+	std::mutex		mtx_;
+	std::unordered_map<std::string, Entry *> entries_;
+};
+
+#endif // __BOOKCACHE_H__
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <book/types.h>
+
+#include "PriceLevels.h"
+#include "BookUpdate.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace orderentry
+{
+
+/// @brief one depth slot: the level at some position on one side
+struct DepthSlot
+{
+    liquibook::book::Price price;
+    liquibook::book::Quantity qty;      // zero: slot empty
+    uint32_t orders;
+
+    bool operator == (const DepthSlot & rhs) const
+    {
+        return price == rhs.price && qty == rhs.qty && orders == rhs.orders;
+    }
+};
+
+/// @brief the top levels of a depth book, by position, as last
+/// published.  The number of levels is chosen when the book is added;
+/// slots are held in one array, bids then asks, so a book pays only
+/// for the depth it publishes.  Market orders are not shown.
+class BookDepth
+{
+public:
+    explicit BookDepth(unsigned int size)
+    : size_(size)
+    , change_(0)
+    , slots_(size * 2, DepthSlot())
+    {
+    }
+
+    /// @brief levels per side
+    unsigned int size() const { return size_; }
+    liquibook::book::ChangeId last_change() const { return change_; }
+
+    const DepthSlot * bids() const { return slots_.data(); }
+    const DepthSlot * asks() const { return slots_.data() + size_; }
+
+    /// @brief bring the slots up to date with the book's levels.  The
+    /// slots that changed are appended to updates, as records of one
+    /// new change id.
+    /// @return false if none changed
+    bool refresh(const PriceLevels & levels, std::vector<BookUpdate> & updates)
+    {
+        size_t first = updates.size();
+
+        // bids best first; market orders sort lowest, at price zero
+        auto bid = levels.bids().rbegin();
+        for(unsigned int i = 0; i < size_; ++i)
+        {
+            DepthSlot slot = DepthSlot();
+            if(bid != levels.bids().rend() && bid->first != 0)
+            {
+                slot.price = bid->first;
+                slot.qty = bid->second.qty;
+                slot.orders = bid->second.orders;
+                ++bid;
+            }
+            store(true, i, slot, updates, first);
+        }
+
+        auto ask = levels.asks().begin();
+        if(ask != levels.asks().end() && ask->first == 0)
+        {
+            ++ask;
+        }
+        for(unsigned int i = 0; i < size_; ++i)
+        {
+            DepthSlot slot = DepthSlot();
+            if(ask != levels.asks().end())
+            {
+                slot.price = ask->first;
+                slot.qty = ask->second.qty;
+                slot.orders = ask->second.orders;
+                ++ask;
+            }
+            store(false, i, slot, updates, first);
+        }
+
+        if(updates.size() == first)
+        {
+            return false;
+        }
+        ++change_;
+        for(size_t i = first; i < updates.size(); ++i)
+        {
+            updates[i].change = change_;
+            updates[i].more = (i + 1 < updates.size());
+        }
+        return true;
+    }
+
+private:
+    void store(bool isBuy, unsigned int level, const DepthSlot & slot,
+               std::vector<BookUpdate> & updates, size_t first)
+    {
+        DepthSlot & cur = slots_[(isBuy ? 0 : size_) + level];
+        if(cur == slot)
+        {
+            return;
+        }
+        cur = slot;
+
+        // start a record for this change, or continue it in another
+        if(updates.size() == first ||
+           updates.back().nLevels == BOOK_UPD_LEVELS)
+        {
+            updates.push_back(BookUpdate());
+        }
+        BookUpdate & update = updates.back();
+        BookLevelUpdate & lvl = update.levels[update.nLevels++];
+        lvl.level = level;
+        lvl.buy = isBuy;
+        lvl.price = slot.price;
+        lvl.qty = slot.qty;
+        lvl.orders = slot.orders;
+    }
+
+    unsigned int size_;
+    liquibook::book::ChangeId change_;
+    std::vector<DepthSlot> slots_;
+};
+
+} // namespace orderentry
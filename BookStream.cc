@@ -0,0 +1,319 @@
+#include <string>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <assert.h>
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include "BookStream.h"
+#include "JsonWriter.h"
+
+using namespace std;
+using namespace orderentry;
+
+enum {
+	STREAM_MAX_BACKLOG	= 1024 * 1024,	// unsent bytes per client
+};
+
+//
+// BookStream
+//
+
+BookStream::BookStream(struct event_base *base, BookFeed *feed,
+		       size_t queueSize)
+	: base_(base), feed_(feed), nSubs_(0),
+	  ring_(queueSize), ev_(NULL), signaled_(false), overrun_(false)
+{
+	int rc = pipe2(fds_, O_NONBLOCK | O_CLOEXEC);
+	assert(rc == 0);
+
+	ev_ = event_new(base, fds_[0], EV_READ | EV_PERSIST, wakeCb, this);
+	event_add(ev_, NULL);
+}
+
+// subscribers belong to their requests, which are gone by now
+BookStream::~BookStream()
+{
+	event_free(ev_);
+	close(fds_[0]);
+	close(fds_[1]);
+}
+
+BookSubscriber *BookStream::subscribe(evhtp_request_t *req,
+				      const std::string& symbol,
+				      unsigned int depth)
+{
+	BookSubscriber *sub = new BookSubscriber();
+	sub->hub = this;
+	sub->req = req;
+	sub->symbol = symbol;
+	sub->depth = depth;
+	sub->live = false;
+	sub->stale = false;
+	sub->change = 0;
+	sub->seq = 0;
+
+	subMap_[symbol].push_back(sub);
+	nSubs_++;
+	feed_->subscribed();
+
+	return sub;
+}
+
+void BookStream::release(BookSubscriber *sub)
+{
+	auto it = subMap_.find(sub->symbol);
+	assert(it != subMap_.end());
+
+	vector<BookSubscriber *>& subs = it->second;
+	subs.erase(std::find(subs.begin(), subs.end(), sub));
+	if (subs.empty())
+		subMap_.erase(it);
+
+	nSubs_--;
+	feed_->unsubscribed();
+	delete sub;
+}
+
+bool BookStream::start(BookSubscriber *sub, liquibook::book::ChangeId change,
+		       const std::string& snapshot)
+{
+	assert(sub->req && !sub->live && sub->seq == 0);
+
+	if (sub->stale)
+		return false;
+
+	sub->change = change;
+	sub->live = true;
+
+	evhtp_request_t *req = sub->req;
+	evhtp_headers_add_header(req->headers_out,
+		evhtp_header_new("Content-Type", "application/x-ndjson", 0, 0));
+	evhtp_send_reply_chunk_start(req, EVHTP_RES_OK);
+
+	sub->seq++;
+	struct evbuffer *buf = evbuffer_new();
+	evbuffer_add(buf, snapshot.c_str(), snapshot.size());
+	if (!sendMsg(sub, buf))
+		return true;
+
+	// changes that raced ahead of the snapshot
+	vector<BookUpdate> held;
+	held.swap(sub->held);
+	for (size_t i = 0; i < held.size(); ) {
+		size_t n = 1;
+		while (held[i + n - 1].more)
+			n++;
+		if (!send(sub, &held[i], n))
+			break;
+		i += n;
+	}
+
+	return true;
+}
+
+void BookStream::post(const std::vector<BookUpdate>& updates)
+{
+	if (nSubs_.load() == 0)
+		return;
+
+	for (size_t i = 0; i < updates.size(); i++) {
+		// never stall a shard on a slow loop; its clients resync
+		if (!ring_.push(updates[i])) {
+			overrun_ = true;
+			break;
+		}
+	}
+
+	if (!signaled_.exchange(true)) {
+		char ch = 0;
+		ssize_t rc = write(fds_[1], &ch, 1);
+		(void) rc;
+	}
+}
+
+void BookStream::wakeCb(evutil_socket_t fd, short events, void *arg)
+{
+	BookStream *hub = (BookStream *) arg;
+
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	// clear before draining; a post racing with us re-signals
+	hub->signaled_ = false;
+	hub->deliver();
+}
+
+void BookStream::deliver()
+{
+	BookUpdate upd;
+
+	// updates were dropped: every stream has a gap
+	if (overrun_.exchange(false)) {
+		while (ring_.pop(upd))
+			;
+		partial_.clear();
+
+		vector<BookSubscriber *> all;
+		for (auto it = subMap_.begin(); it != subMap_.end(); ++it)
+			all.insert(all.end(), it->second.begin(),
+				   it->second.end());
+
+		for (size_t i = 0; i < all.size(); i++) {
+			if (!all[i]->live)
+				all[i]->stale = true;
+			else if (all[i]->req)
+				end(all[i], "overrun");
+		}
+		return;
+	}
+
+	while (ring_.pop(upd)) {
+		if (upd.type != BOOK_UPD_DEPTH)
+			continue;
+
+		// a change in several records goes out once all are here;
+		// other shards' records may come between them
+		if (!upd.more && partial_.empty()) {
+			dispatch(&upd, 1);
+			continue;
+		}
+		vector<BookUpdate>& recs = partial_[upd.symbol];
+		recs.push_back(upd);
+		if (upd.more)
+			continue;
+		dispatch(recs.data(), recs.size());
+		partial_.erase(upd.symbol);
+	}
+}
+
+// one complete change, to the book's subscribers
+void BookStream::dispatch(const BookUpdate *recs, size_t n)
+{
+	auto it = subMap_.find(recs[0].symbol);
+	if (it == subMap_.end())
+		return;
+
+	// copy: ending a stream may release its subscriber
+	vector<BookSubscriber *> subs = it->second;
+	for (size_t i = 0; i < subs.size(); i++) {
+		BookSubscriber *sub = subs[i];
+		if (!sub->live)
+			sub->held.insert(sub->held.end(), recs, recs + n);
+		else if (sub->req)
+			send(sub, recs, n);
+	}
+}
+
+// one update message, holding the changed levels this subscriber
+// follows from the n records of one change; false if the stream ended
+bool BookStream::send(BookSubscriber *sub, const BookUpdate *recs, size_t n)
+{
+	if (recs[0].change <= sub->change)
+		return true;		// already in snapshot
+
+	unsigned int nLevels = 0;
+	for (size_t r = 0; r < n; r++)
+		for (unsigned int i = 0; i < recs[r].nLevels; i++)
+			if (recs[r].levels[i].level < sub->depth)
+				nLevels++;
+	if (nLevels == 0)
+		return true;
+
+	struct evbuffer *buf = evbuffer_new();
+	{
+		JsonWriter w(buf);
+		w.beginObject();
+		w.kv("type", "update");
+		w.kv("seq", sub->seq++);
+		w.kv("symbol", sub->symbol);
+		w.kv("change", (uint64_t) recs[0].change);
+		w.key("levels").beginArray();
+		for (size_t r = 0; r < n; r++) {
+			for (unsigned int i = 0; i < recs[r].nLevels; i++) {
+				const BookLevelUpdate& lvl = recs[r].levels[i];
+				if (lvl.level >= sub->depth)
+					continue;
+
+				w.beginObject();
+				w.kv("side", lvl.buy ? "bid" : "ask");
+				w.kv("level", lvl.level);
+				w.kv("price", lvl.price);
+				w.kv("qty", lvl.qty);
+				w.kv("orders", lvl.orders);
+				w.endObject();
+			}
+		}
+		w.endArray();
+		w.endObject();
+		w.end();
+	}
+
+	return sendMsg(sub, buf);
+}
+
+// sends one message, and frees buf
+bool BookStream::sendMsg(BookSubscriber *sub, struct evbuffer *buf)
+{
+	evhtp_send_reply_chunk(sub->req, buf);
+	evbuffer_free(buf);
+
+	// client is not keeping up; it resyncs from a new snapshot
+	struct bufferevent *bev = evhtp_connection_get_bev(sub->req->conn);
+	if (evbuffer_get_length(bufferevent_get_output(bev)) >
+	    STREAM_MAX_BACKLOG) {
+		end(sub, "backlog");
+		return false;
+	}
+
+	return true;
+}
+
+// final message, then end the reply; the request's fini hook
+// releases the subscriber, perhaps before this returns
+void BookStream::end(BookSubscriber *sub, const char *reason)
+{
+	evhtp_request_t *req = sub->req;
+	sub->req = NULL;
+
+	struct evbuffer *buf = evbuffer_new();
+	{
+		JsonWriter w(buf);
+		w.beginObject();
+		w.kv("type", "reset");
+		w.kv("seq", sub->seq++);
+		w.kv("reason", reason);
+		w.endObject();
+		w.end();
+	}
+	evhtp_send_reply_chunk(req, buf);
+	evbuffer_free(buf);
+
+	evhtp_send_reply_chunk_end(req);
+}
+
+//
+// BookFeed
+//
+
+// before the stream's loop can receive subscribers
+void BookFeed::addStream(BookStream *stream)
+{
+	std::lock_guard<std::mutex> lk(mtx_);
+
+	unsigned int n = nStreams_.load();
+	assert(n < MAX_STREAMS);
+	streams_[n] = stream;
+	nStreams_.store(n + 1);
+}
+
+void BookFeed::post(const std::vector<BookUpdate>& updates)
+{
+	if (publisher_)
+		publisher_->post(updates);
+
+	unsigned int n = nStreams_.load();
+	for (unsigned int i = 0; i < n; i++)
+		streams_[i]->post(updates);
+}
@@ -0,0 +1,121 @@
+#ifndef __BOOKSTREAM_H__
+#define __BOOKSTREAM_H__
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+#include <event2/event.h>
+#include <evhtp.h>
+#include "Engine.h"
+#include "BookUpdate.h"
+#include "RingBuffer.h"
+
+class BookStream;
+class BookFeed;
+
+// One streaming client of a depth book.  Owned by its request: the
+// request's fini hook releases it, even after the stream has ended.
+struct BookSubscriber {
+	BookStream		*hub;
+	evhtp_request_t		*req;		// NULL once stream has ended
+	std::string		symbol;
+	unsigned int		depth;		// levels per side
+	bool			live;		// snapshot sent
+	bool			stale;		// updates lost before snapshot
+	liquibook::book::ChangeId change;	// snapshot's change id
+	uint64_t		seq;		// next message sequence number
+	std::vector<orderentry::BookUpdate> held; // awaiting snapshot
+};
+
+// Streams depth-book changes to HTTP clients as chunked, newline-
+// delimited JSON.  Each front-end loop has its own BookStream, serving
+// the subscribers whose requests it accepted.
+//
+// A subscriber registers before its snapshot is queued to the book's
+// shard, so every later change reaches it; changes up to the snapshot
+// are dropped by change id.  Each message carries the subscriber's
+// own sequence number, starting from the snapshot at 0.
+class BookStream {
+public:
+	BookStream(struct event_base *base, BookFeed *feed, size_t queueSize);
+	~BookStream();
+
+	BookSubscriber *subscribe(evhtp_request_t *req,
+				  const std::string& symbol,
+				  unsigned int depth);
+
+	// snapshot message arrived, as of change; begin streaming.
+	// false if updates were lost meanwhile, and the caller must
+	// fail the request.
+	bool start(BookSubscriber *sub, liquibook::book::ChangeId change,
+		   const std::string& snapshot);
+
+	// request is finished; forget and free the subscriber
+	void release(BookSubscriber *sub);
+
+	size_t subscribers() const { return nSubs_; }
+
+	// from shard threads, through BookFeed
+	void post(const std::vector<orderentry::BookUpdate>& updates);
+
+private:
+	struct event_base	*base_;
+	BookFeed		*feed_;
+	std::unordered_map<std::string, std::vector<BookSubscriber *> > subMap_;
+	std::atomic<size_t>	nSubs_;
+
+	RingBuffer<orderentry::BookUpdate> ring_;
+	int			fds_[2];
+	struct event		*ev_;
+	std::atomic<bool>	signaled_;
+	std::atomic<bool>	overrun_;
+
+	// records of changes still arriving, by symbol
+	std::unordered_map<std::string,
+		std::vector<orderentry::BookUpdate> > partial_;
+
+	void deliver();
+	void dispatch(const orderentry::BookUpdate *recs, size_t n);
+	bool send(BookSubscriber *sub, const orderentry::BookUpdate *recs,
+		  size_t n);
+	bool sendMsg(BookSubscriber *sub, struct evbuffer *buf);
+	void end(BookSubscriber *sub, const char *reason);
+
+	static void wakeCb(evutil_socket_t fd, short events, void *arg);
+};
+
+// Fans the shards' updates out to every loop's BookStream, and to
+// the multicast publisher if any.  Loops register as they start;
+// without a publisher, updates are collected only while some
+// subscriber exists.
+class BookFeed : public BookSink {
+public:
+	enum { MAX_STREAMS = 257 };	// front-end threads, plus main loop
+
+	BookFeed() : publisher_(NULL), nStreams_(0), nSubs_(0) {}
+
+	void addStream(BookStream *stream);
+	void setPublisher(BookSink *publisher) { publisher_ = publisher; }
+
+	int subscribers() const { return nSubs_.load(); }
+	void subscribed() { nSubs_++; }
+	void unsubscribed() { nSubs_--; }
+
+	// BookSink; called from shard threads
+	virtual bool active() const {
+		return publisher_ || nSubs_.load() > 0;
+	}
+	virtual void post(const std::vector<orderentry::BookUpdate>& updates);
+
+private:
+	BookSink		*publisher_;	// set before engine start
+	std::mutex		mtx_;
+	BookStream		*streams_[MAX_STREAMS];
+	std::atomic<unsigned int> nStreams_;
+	std::atomic<int>	nSubs_;
+};
+
+#endif // __BOOKSTREAM_H__
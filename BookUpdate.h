@@ -0,0 +1,73 @@
+#ifndef __BOOKUPDATE_H__
+#define __BOOKUPDATE_H__
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <book/types.h>
+
+namespace orderentry
+{
+
+enum {
+	BOOK_SYMBOL_MAX		= 16,	// as validated at market creation
+	BOOK_DEPTH_DEFAULT	= 5,	// levels per side, unless chosen
+	BOOK_DEPTH_MAX		= 50,
+	BOOK_UPD_LEVELS		= BOOK_DEPTH_DEFAULT * 2, // slots per record
+
+	// update types
+	BOOK_UPD_DEPTH		= 0,
+	BOOK_UPD_TRADE		= 1,
+};
+
+// One depth slot, by position: level 0 is the best price on its side.
+// A slot left with zero quantity has been emptied.
+struct BookLevelUpdate {
+	uint8_t				level;
+	bool				buy;
+	liquibook::book::Price		price;
+	liquibook::book::Quantity	qty;
+	uint32_t			orders;
+};
+
+// Depth slots changed by one publish of a depth book, or one trade
+// in any book.  Change ids increase per book, so a subscriber holding
+// a snapshot taken at change N applies exactly the updates after N.
+//
+// Records are copied through every feed's queue, so each holds only
+// BOOK_UPD_LEVELS slots: enough for a book of the default depth.  A
+// change to more slots is carried by consecutive records of the same
+// change id, all but the last marked 'more'.
+struct BookUpdate {
+	uint8_t				type;		// BOOK_UPD_xxx
+	char				symbol[BOOK_SYMBOL_MAX + 1];
+	liquibook::book::ChangeId	change;
+	bool				more;		// change continues
+	uint8_t				nLevels;
+	BookLevelUpdate			levels[BOOK_UPD_LEVELS];
+	liquibook::book::Price		price;		// trade only
+	liquibook::book::Quantity	qty;		// trade only
+
+	BookUpdate()
+		: type(BOOK_UPD_DEPTH), change(0), more(false), nLevels(0),
+		  price(0), qty(0) {
+		memset(symbol, 0, sizeof(symbol));
+	}
+
+	void setSymbol(const std::string& sym) {
+		memset(symbol, 0, sizeof(symbol));
+		strncpy(symbol, sym.c_str(), BOOK_SYMBOL_MAX);
+	}
+};
+
+class BookUpdateListener {
+public:
+	virtual ~BookUpdateListener() {}
+
+	/// @brief depth levels changed, or a trade occurred
+	virtual void on_book_update(const BookUpdate & update) = 0;
+};
+
+} // namespace orderentry
+
+#endif // __BOOKUPDATE_H__
@@ -0,0 +1,517 @@
+
+#include <string>
+#include <chrono>
+#include <unistd.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <time.h>
+#include <assert.h>
+#include <event2/event.h>
+#include "Engine.h"
+#include "BinProto.h"
+
+using namespace std;
+using namespace orderentry;
+
+enum {
+	SHARD_BATCH_MAX		= 256,	// commands per journal commit
+};
+
+static int64_t monoUsec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+//
+// CompletionQueue
+//
+
+CompletionQueue::CompletionQueue(struct event_base *base, EngineDoneFn done,
+				 size_t queueSize)
+	: ring_(queueSize), done_(done), ev_(NULL), signaled_(false)
+{
+	int rc = pipe2(fds_, O_NONBLOCK | O_CLOEXEC);
+	assert(rc == 0);
+
+	ev_ = event_new(base, fds_[0], EV_READ | EV_PERSIST, readCb, this);
+	event_add(ev_, NULL);
+}
+
+CompletionQueue::~CompletionQueue()
+{
+	event_free(ev_);
+	close(fds_[0]);
+	close(fds_[1]);
+}
+
+void CompletionQueue::post(EngineCmd *cmd)
+{
+	while (!ring_.push(cmd))
+		std::this_thread::yield();
+
+	// one wakeup per drain, however many commands arrive
+	if (!signaled_.exchange(true)) {
+		char ch = 0;
+		ssize_t rc = write(fds_[1], &ch, 1);
+		(void) rc;
+	}
+}
+
+void CompletionQueue::readCb(evutil_socket_t fd, short events, void *arg)
+{
+	CompletionQueue *cq = (CompletionQueue *) arg;
+
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	// clear before draining; a post racing with us re-signals
+	cq->signaled_ = false;
+
+	EngineCmd *cmd;
+	while (cq->ring_.pop(cmd))
+		cq->done_(cmd);
+}
+
+//
+// MatchShard
+//
+
+static string shardSuffix(unsigned int index)
+{
+	return to_string(index);
+}
+
+MatchShard::MatchShard(unsigned int index, rocksdb::DB *db,
+		       JournalSyncPolicy policy, int64_t syncUsec,
+		       const std::string& snapshotFile, size_t queueSize)
+	: index_(index),
+	  journal_(db, policy, "/journal/" + shardSuffix(index) + "/"),
+	  syncUsec_((policy == JSYNC_INTERVAL) ? syncUsec : 0),
+	  snapshotFile_(snapshotFile + "." + shardSuffix(index)),
+	  ring_(queueSize), running_(false), sleeping_(false), failed_(false),
+	  snapPending_(false), snapBusy_(false),
+	  execSink_(NULL), bookSink_(NULL)
+{
+	market_.setOrderIdShard(index);
+}
+
+MatchShard::~MatchShard()
+{
+	stop();
+}
+
+// rebuild from newest snapshot plus journal tail, before start()
+bool MatchShard::recover(SnapshotInfo& info, uint64_t& nReplay)
+{
+	if (!journal_.open())
+		return false;
+
+	bool found;
+	if (!snapshotLoad(market_, snapshotFile_, found, info)) {
+		syslog(LOG_DAEMON|LOG_ERR, "%s: snapshot load failed",
+		       snapshotFile_.c_str());
+		return false;
+	}
+	journal_.resume(info.seq);
+
+	nReplay = 0;
+	if (!journal_.replay(info.seq, [this, &nReplay](const JournalRecord& rec) {
+			market_.replay(rec);
+			nReplay++;
+		}))
+		return false;
+
+	market_.setJournal(&journal_);
+	publishStats();
+	return true;
+}
+
+// runs on the shard thread, between batches: flush() has committed
+// the journal through lastSeq() and spilled what the batch evicted,
+// so the capture holds exactly the records up to that seq
+void MatchShard::takeSnapshot()
+{
+	// the batch's records were lost; the books are ahead of them
+	if (failed_)
+		return;
+
+	// one at a time: a slow disk skips intervals
+	if (snapBusy_) {
+		syslog(LOG_DAEMON|LOG_WARNING,
+		       "shard %u: previous snapshot still writing; skipped",
+		       index_);
+		return;
+	}
+	if (snapThread_.joinable())
+		snapThread_.join();
+
+	// checksum, write and sync on another thread, so matching
+	// carries on meanwhile
+	std::string data;
+	SnapshotInfo info;
+	snapshotCapture(market_, journal_.lastSeq(), data, info);
+
+	snapBusy_ = true;
+	snapThread_ = std::thread(&MatchShard::saveSnapshot, this,
+				  std::move(data), info);
+}
+
+// the journal it covers is dropped only once it is on disk
+void MatchShard::saveSnapshot(std::string data, SnapshotInfo info)
+{
+	if (snapshotSave(data, snapshotFile_, info)) {
+		journal_.trim(info.seq);
+		syslog(LOG_DAEMON|LOG_INFO,
+		       "shard %u snapshot at seq %llu: %llu books, %llu orders, "
+		       "%llu bytes",
+		       index_,
+		       (unsigned long long) info.seq,
+		       (unsigned long long) info.books,
+		       (unsigned long long) info.orders,
+		       (unsigned long long) info.bytes);
+	}
+
+	snapBusy_ = false;
+}
+
+void MatchShard::start()
+{
+	if (running_)
+		return;
+
+	running_ = true;
+	thread_ = std::thread(&MatchShard::run, this);
+}
+
+void MatchShard::stop()
+{
+	if (!running_)
+		return;
+
+	{
+		std::lock_guard<std::mutex> lk(mtx_);
+		running_ = false;
+		cv_.notify_one();
+	}
+	thread_.join();
+
+	// snapshots are only begun by the shard thread
+	if (snapThread_.joinable())
+		snapThread_.join();
+}
+
+bool MatchShard::post(EngineCmd *cmd)
+{
+	if (failed_ || !ring_.push(cmd))
+		return false;
+
+	// pairs with the fence in wait(): either the shard sees the
+	// command, or this thread sees the shard asleep
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (sleeping_.load()) {
+		std::lock_guard<std::mutex> lk(mtx_);
+		cv_.notify_one();
+	}
+	return true;
+}
+
+// before start()
+void MatchShard::setExecSink(ExecSink *sink)
+{
+	execSink_ = sink;
+	market_.setExecListener(sink ? this : NULL);
+}
+
+void MatchShard::on_exec(const orderentry::ExecReport& report)
+{
+	reports_.push_back(report);
+}
+
+// before start()
+void MatchShard::setBookSink(BookSink *sink)
+{
+	bookSink_ = sink;
+	market_.setBookUpdateListener(sink ? this : NULL);
+}
+
+void MatchShard::on_book_update(const orderentry::BookUpdate& update)
+{
+	if (bookSink_->active())
+		updates_.push_back(update);
+}
+
+void MatchShard::wait()
+{
+	std::unique_lock<std::mutex> lk(mtx_);
+	sleeping_ = true;
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (ring_.empty() && running_)
+		cv_.wait_for(lk, std::chrono::milliseconds(100));
+	sleeping_ = false;
+}
+
+// a command whose effects could not be journaled, or that was never
+// run because an earlier batch could not be: reported failed, with
+// nothing of it published
+void MatchShard::failCmd(EngineCmd *cmd,
+			 std::vector<orderentry::ExecReport>& acks)
+{
+	cmd->status = EVHTP_RES_SERVERR;
+	for (size_t i = 0; i < cmd->batch.size(); i++)
+		cmd->batch[i]->status = EVHTP_RES_SERVERR;
+
+	if (cmd->session) {
+		orderentry::ExecReport ack;
+		ack.session = cmd->session;
+		ack.type = orderentry::EXEC_ACK;
+		ack.status = BIN_ERR_STORE;
+		ack.clientRef = cmd->clientRef;
+		acks.push_back(ack);
+	}
+}
+
+void MatchShard::run()
+{
+	std::vector<EngineCmd *> done;
+	done.reserve(SHARD_BATCH_MAX);
+	int64_t batchStart = 0;
+
+	for (;;) {
+		EngineCmd *cmd;
+		bool more = false;
+		while (done.size() < SHARD_BATCH_MAX && ring_.pop(cmd)) {
+			if (done.empty())
+				batchStart = monoUsec();
+			// a record already lost fails the batch; run no more
+			if (cmd->exec && !failed_ && !journal_.failed())
+				cmd->exec(*this, *cmd);
+			done.push_back(cmd);
+			more = true;
+		}
+
+		if (!done.empty()) {
+			// interval policy: keep gathering until the window closes
+			if (syncUsec_ && more && running_ &&
+			    (done.size() < SHARD_BATCH_MAX) &&
+			    ((monoUsec() - batchStart) < syncUsec_))
+				continue;
+
+			flush(done);
+			if (snapPending_) {
+				snapPending_ = false;
+				takeSnapshot();
+			}
+			continue;
+		}
+
+		if (!running_ && ring_.empty())
+			break;
+
+		wait();
+	}
+
+	// every batch was committed by flush(); nothing should remain
+	if (!failed_ && !journal_.commit())
+		syslog(LOG_DAEMON|LOG_ERR,
+		       "shard %u: journal commit failed at shutdown", index_);
+	market_.archive().commitSpill();
+}
+
+// group commit, then acknowledge: no reply precedes its journal record.
+// A failed commit leaves the books ahead of the journal, so nothing of
+// the batch is published, every command in it fails, and the shard
+// stops matching: later commands fail without running.
+void MatchShard::flush(std::vector<EngineCmd *>& done)
+{
+	if (!failed_ && !journal_.commit()) {
+		syslog(LOG_DAEMON|LOG_ERR,
+		       "shard %u: journal commit failed; matching stopped",
+		       index_);
+		failed_ = true;
+	}
+	if (failed_) {
+		reports_.clear();
+		updates_.clear();
+
+		std::vector<orderentry::ExecReport> acks;
+		for (size_t i = 0; i < done.size(); i++)
+			failCmd(done[i], acks);
+		if (!acks.empty() && execSink_)
+			execSink_->post(acks);
+	}
+
+	publishStats();
+
+	if (!reports_.empty()) {
+		execSink_->post(reports_);
+		reports_.clear();
+	}
+	if (!updates_.empty()) {
+		bookSink_->post(updates_);
+		updates_.clear();
+	}
+
+	stats_.commands.fetch_add(done.size(), std::memory_order_relaxed);
+	stats_.batches.fetch_add(1, std::memory_order_relaxed);
+
+	for (size_t i = 0; i < done.size(); i++) {
+		EngineCmd *cmd = done[i];
+		if (cmd->cq)
+			cmd->cq->post(cmd);
+		else
+			delete cmd;
+	}
+	done.clear();
+
+	// orders the batch evicted from the archive; replies are sent
+	market_.archive().commitSpill();
+}
+
+void MatchShard::publishStats()
+{
+	const OrderArchive& archive = market_.archive();
+
+	stats_.liveOrders.store(market_.orders().size(), std::memory_order_relaxed);
+	stats_.liveIndexBytes.store(market_.liveIndexBytes(), std::memory_order_relaxed);
+	stats_.archived.store(archive.size(), std::memory_order_relaxed);
+	stats_.archivedBytes.store(archive.bytes(), std::memory_order_relaxed);
+	stats_.archiveIndexBytes.store(archive.indexBytes(), std::memory_order_relaxed);
+	stats_.evicted.store(archive.evicted(), std::memory_order_relaxed);
+	stats_.spilled.store(archive.spilled(), std::memory_order_relaxed);
+}
+
+//
+// Engine
+//
+
+Engine::Engine(rocksdb::DB *db, unsigned int nShards,
+	       JournalSyncPolicy policy, int64_t syncUsec,
+	       const std::string& snapshotFile, size_t queueSize)
+{
+	assert(nShards > 0 && nShards <= 256);
+
+	for (unsigned int i = 0; i < nShards; i++) {
+		shards_.push_back(new MatchShard(i, db, policy, syncUsec,
+						 snapshotFile, queueSize));
+		shards_[i]->market().setBookCache(&bookCache_);
+	}
+}
+
+Engine::~Engine()
+{
+	stop();
+	for (size_t i = 0; i < shards_.size(); i++)
+		delete shards_[i];
+}
+
+// FNV-1a; must not change, as it fixes which journal holds a symbol
+unsigned int Engine::shardForSymbol(const std::string& symbol) const
+{
+	uint32_t h = 2166136261U;
+	for (size_t i = 0; i < symbol.size(); i++) {
+		h ^= (unsigned char) symbol[i];
+		h *= 16777619U;
+	}
+
+	return h % shards_.size();
+}
+
+static int hexVal(char ch)
+{
+	if (ch >= '0' && ch <= '9')
+		return ch - '0';
+	if (ch >= 'a' && ch <= 'f')
+		return ch - 'a' + 10;
+	if (ch >= 'A' && ch <= 'F')
+		return ch - 'A' + 10;
+	return -1;
+}
+
+bool Engine::shardForOrder(const std::string& oid, unsigned int& shard) const
+{
+	OrderId id;
+	if (parseOrderId(oid, id)) {
+		shard = orderIdShard(id);
+
+	// compatibility-mode UUID: first byte is the shard
+	} else if (oid.size() == 36 && oid[8] == '-') {
+		int hi = hexVal(oid[0]), lo = hexVal(oid[1]);
+		if (hi < 0 || lo < 0)
+			return false;
+		shard = (hi << 4) | lo;
+	} else
+		return false;
+
+	return (shard < shards_.size());
+}
+
+void Engine::setEventLog(EventLog *log)
+{
+	for (size_t i = 0; i < shards_.size(); i++)
+		shards_[i]->market().setEventLog(log);
+}
+
+void Engine::setExecSink(ExecSink *sink)
+{
+	for (size_t i = 0; i < shards_.size(); i++)
+		shards_[i]->setExecSink(sink);
+}
+
+void Engine::setBookSink(BookSink *sink)
+{
+	for (size_t i = 0; i < shards_.size(); i++)
+		shards_[i]->setBookSink(sink);
+}
+
+void Engine::start()
+{
+	// symbol directory, from recovered state
+	for (size_t i = 0; i < shards_.size(); i++) {
+		vector<string> symbols;
+		shards_[i]->market().getSymbols(symbols);
+		for (auto it = symbols.begin(); it != symbols.end(); ++it)
+			addSymbol(*it);
+	}
+
+	for (size_t i = 0; i < shards_.size(); i++)
+		shards_[i]->start();
+}
+
+// drains queued commands, commits journals, joins threads
+void Engine::stop()
+{
+	for (size_t i = 0; i < shards_.size(); i++)
+		shards_[i]->stop();
+}
+
+static void execSnapshot(MatchShard& shard, EngineCmd& cmd)
+{
+	shard.snapshot();
+}
+
+void Engine::snapshot()
+{
+	for (size_t i = 0; i < shards_.size(); i++) {
+		EngineCmd *cmd = new EngineCmd();
+		cmd->exec = execSnapshot;
+
+		// busy shard: try again next interval
+		if (!shards_[i]->post(cmd))
+			delete cmd;
+	}
+}
+
+void Engine::addSymbol(const std::string& symbol)
+{
+	std::lock_guard<std::mutex> lk(symMtx_);
+	symbols_.insert(symbol);
+}
+
+void Engine::getSymbols(std::vector<std::string>& symbols)
+{
+	std::lock_guard<std::mutex> lk(symMtx_);
+	symbols.assign(symbols_.begin(), symbols_.end());
+}
@@ -0,0 +1,252 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include <string>
+#include <vector>
+#include <set>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <cstdint>
+#include <evhtp.h>
+#include <univalue.h>
+#include "Market.h"
+#include "RingBuffer.h"
+#include "Journal.h"
+#include "Snapshot.h"
+#include "BookCache.h"
+
+class MatchShard;
+class CompletionQueue;
+class JsonWriter;
+struct EngineCmd;
+
+typedef void (*EngineExecFn)(MatchShard& shard, EngineCmd& cmd);
+typedef void (*EngineDoneFn)(EngineCmd *cmd);
+typedef void (*EngineReplyFn)(JsonWriter& w, const EngineCmd& cmd);
+
+// One decoded client command.  Built by a front-end thread, executed
+// by the shard that owns the symbol or order, then handed back to the
+// front-end through its CompletionQueue.
+struct EngineCmd {
+	EngineExecFn		exec;		// runs on owning shard
+	evhtp_request_t		*req;		// NULL once client has gone
+	CompletionQueue		*cq;		// NULL: shard deletes cmd
+
+	// decoded input; fields used depend on exec
+	std::string		symbol;
+	std::string		oid;		// order id, as given by client
+	bool			flag;		// buy side; depth book; atomic;
+						// cancel/modify result
+	liquibook::book::Quantity qty;
+	liquibook::book::Price	price;
+	liquibook::book::Price	stopPrice;
+	liquibook::book::OrderConditions conditions;
+	int32_t			qtyDelta;
+	int64_t			depth;
+	orderentry::LadderSpec	ladder;		// market add
+	bool			pretty;		// indented reply
+
+	// binary order entry: owning session, and client's reference
+	uint32_t		session;
+	uint64_t		clientRef;
+	OrderId			orderId;
+
+	// batch: items run in client order, in one pass on one shard.
+	// The request-level command owns every item and waits for
+	// its per-shard parts, which only borrow them.
+	std::vector<EngineCmd *> batch;
+	EngineCmd		*parent;	// set on per-shard parts
+	unsigned int		pending;	// parts still on shards
+
+	// output.  The reply is, in order of preference: reply, written
+	// by writeReply on the front-end thread, or result.
+	int			status;		// EVHTP_RES_xxx
+	EngineReplyFn		writeReply;
+	UniValue		result;
+	BookCache::Body		reply;		// serialized result, if set
+	liquibook::book::ChangeId change;	// book snapshot's change id
+
+	EngineCmd()
+		: exec(NULL), req(NULL), cq(NULL), flag(false), qty(0),
+		  price(0), stopPrice(0), conditions(0), qtyDelta(0),
+		  depth(0), pretty(false), session(0), clientRef(0),
+		  orderId(0), parent(NULL), pending(0),
+		  status(EVHTP_RES_OK), writeReply(NULL), change(0) {}
+
+	// a request-level command owns its batch items
+	~EngineCmd() {
+		if (!parent)
+			for (size_t i = 0; i < batch.size(); i++)
+				delete batch[i];
+	}
+};
+
+// Per-front-end-thread queue of executed commands.  Shards post from
+// their own threads; a pipe wakes the owning event loop, which calls
+// done() for each command.
+class CompletionQueue {
+public:
+	CompletionQueue(struct event_base *base, EngineDoneFn done,
+			size_t queueSize = 65536);
+	~CompletionQueue();
+
+	void post(EngineCmd *cmd);
+
+private:
+	RingBuffer<EngineCmd *>	ring_;
+	EngineDoneFn		done_;
+	int			fds_[2];
+	struct event		*ev_;
+	std::atomic<bool>	signaled_;
+
+	static void readCb(evutil_socket_t fd, short events, void *arg);
+};
+
+// Engine counters, published by each shard after every batch so that
+// front-end threads can read them without touching the Market.
+struct ShardStats {
+	std::atomic<uint64_t>	commands;
+	std::atomic<uint64_t>	batches;
+	std::atomic<uint64_t>	liveOrders;
+	std::atomic<uint64_t>	liveIndexBytes;
+	std::atomic<uint64_t>	archived;
+	std::atomic<uint64_t>	archivedBytes;
+	std::atomic<uint64_t>	archiveIndexBytes;
+	std::atomic<uint64_t>	evicted;
+	std::atomic<uint64_t>	spilled;
+
+	ShardStats()
+		: commands(0), batches(0), liveOrders(0), liveIndexBytes(0),
+		  archived(0), archivedBytes(0), archiveIndexBytes(0),
+		  evicted(0), spilled(0) {}
+};
+
+// Receives each shard's execution reports once its journal batch is
+// durable.  Called from shard threads.
+class ExecSink {
+public:
+	virtual ~ExecSink() {}
+	virtual void post(const std::vector<orderentry::ExecReport>& reports) = 0;
+};
+
+// Receives each shard's depth-book updates once its journal batch is
+// durable.  Called from shard threads; active() lets a shard skip
+// collecting updates that nobody would receive.
+class BookSink {
+public:
+	virtual ~BookSink() {}
+	virtual bool active() const = 0;
+	virtual void post(const std::vector<orderentry::BookUpdate>& updates) = 0;
+};
+
+// A matching thread, owning a disjoint set of symbols: their books,
+// orders, journal and snapshot.  Commands for one shard execute in
+// arrival order, so per-symbol price-time priority is deterministic.
+class MatchShard : public orderentry::ExecListener,
+		   public orderentry::BookUpdateListener {
+public:
+	MatchShard(unsigned int index, rocksdb::DB *db,
+		   JournalSyncPolicy policy, int64_t syncUsec,
+		   const std::string& snapshotFile, size_t queueSize);
+	~MatchShard();
+
+	unsigned int index() const { return index_; }
+	orderentry::Market& market() { return market_; }
+	Journal& journal() { return journal_; }
+	const ShardStats& stats() const { return stats_; }
+
+	bool recover(SnapshotInfo& info, uint64_t& nReplay);
+
+	// on the shard thread: a snapshot once the current batch is
+	// committed
+	void snapshot() { snapPending_ = true; }
+
+	void start();
+	void stop();
+
+	// false if the queue is full, or the shard has stopped matching;
+	// the caller must not block, since the shard may itself be
+	// waiting on the caller's CompletionQueue
+	bool post(EngineCmd *cmd);
+
+	// execution reports, held until the batch is committed
+	void setExecSink(ExecSink *sink);
+	virtual void on_exec(const orderentry::ExecReport& report);
+
+	// depth-book updates, likewise held until commit
+	void setBookSink(BookSink *sink);
+	virtual void on_book_update(const orderentry::BookUpdate& update);
+
+private:
+	unsigned int		index_;
+	orderentry::Market	market_;
+	Journal			journal_;
+	int64_t			syncUsec_;
+	std::string		snapshotFile_;
+
+	RingBuffer<EngineCmd *>	ring_;
+	std::atomic<bool>	running_;
+	std::atomic<bool>	sleeping_;
+	std::atomic<bool>	failed_;	// journal commit failed
+	bool			snapPending_;	// after this batch's flush
+	std::thread		snapThread_;	// writing a snapshot
+	std::atomic<bool>	snapBusy_;
+	std::mutex		mtx_;
+	std::condition_variable	cv_;
+	std::thread		thread_;
+	ShardStats		stats_;
+	ExecSink		*execSink_;
+	std::vector<orderentry::ExecReport> reports_;
+	BookSink		*bookSink_;
+	std::vector<orderentry::BookUpdate> updates_;
+
+	void run();
+	void wait();
+	void flush(std::vector<EngineCmd *>& done);
+	void failCmd(EngineCmd *cmd, std::vector<orderentry::ExecReport>& acks);
+	void publishStats();
+	void takeSnapshot();
+	void saveSnapshot(std::string data, SnapshotInfo info);
+};
+
+// Partitions the market across matching shards, by symbol hash.
+// Order ids carry their shard in the top bits (see OrderId.h), so
+// cancel, modify and lookup route without a directory.
+class Engine {
+public:
+	Engine(rocksdb::DB *db, unsigned int nShards,
+	       JournalSyncPolicy policy, int64_t syncUsec,
+	       const std::string& snapshotFile, size_t queueSize);
+	~Engine();
+
+	size_t shardCount() const { return shards_.size(); }
+	MatchShard& shard(unsigned int i) { return *shards_[i]; }
+
+	unsigned int shardForSymbol(const std::string& symbol) const;
+	bool shardForOrder(const std::string& oid, unsigned int& shard) const;
+
+	void setEventLog(EventLog *log);
+	void setExecSink(ExecSink *sink);
+	void setBookSink(BookSink *sink);
+	void start();
+	void stop();
+	void snapshot();
+
+	// symbols of all shards, for listing without a round trip
+	void addSymbol(const std::string& symbol);
+	void getSymbols(std::vector<std::string>& symbols);
+
+	// order-book replies, readable without a round trip
+	BookCache& bookCache() { return bookCache_; }
+
+private:
+	std::vector<MatchShard *> shards_;
+	BookCache		bookCache_;
+
+	std::mutex		symMtx_;
+	std::set<std::string>	symbols_;
+};
+
+#endif // __ENGINE_H__
@@ -0,0 +1,340 @@
+
+#include <string>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+#include <sys/time.h>
+#include "EventLog.h"
+#include "Order.h"
+
+using namespace std;
+using namespace orderentry;
+
+static const char *stateNames[] = {
+	"Submitted",
+	"Rejected",
+	"Accepted",
+	"ModifyRequested",
+	"ModifyRejected",
+	"Modified",
+	"PartialFilled",
+	"Filled",
+	"CancelRequested",
+	"CancelRejected",
+	"Cancelled",
+	"Unknown",
+};
+
+static void copyStr(char *dest, size_t destSz, const std::string& src)
+{
+	size_t len = std::min(src.size(), destSz - 1);
+	memcpy(dest, src.data(), len);
+	dest[len] = 0;
+}
+
+EventRecord::EventRecord(EventType type_)
+	: type(type_), state(Order::Unknown), flags(0), orderId(0),
+	  qty(0), price(0), stopPrice(0), onMarket(0), filled(0), cost(0),
+	  arg1(0), arg2(0), arg3(0), delta(0), reason(NULL)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	tstamp = ((uint64_t) tv.tv_sec * 1000000) + tv.tv_usec;
+
+	symbol[0] = 0;
+}
+
+void EventRecord::setSymbol(const std::string& sym)
+{
+	copyStr(symbol, sizeof(symbol), sym);
+}
+
+void EventRecord::setOrder(const Order& order)
+{
+	setOrderId(order.order_id());
+	setSymbol(order.symbol());
+
+	if (order.is_buy())
+		flags |= EVF_BUY;
+	if (order.all_or_none())
+		flags |= EVF_AON;
+	if (order.immediate_or_cancel())
+		flags |= EVF_IOC;
+
+	qty = order.order_qty();
+	price = order.price();
+	stopPrice = order.stop_price();
+	onMarket = order.quantityOnMarket();
+	filled = order.quantityFilled();
+	cost = order.fillCost();
+	if (order.state() != Order::Unknown)
+		state = order.state();
+}
+
+EventLog::EventLog(std::ostream *out, size_t queueSize)
+	: out_(out), level_(EVLOG_INFO), ring_(queueSize),
+	  dropped_(0), written_(0), running_(false)
+{
+}
+
+EventLog::~EventLog()
+{
+	stop();
+}
+
+void EventLog::start()
+{
+	if (running_)
+		return;
+
+	running_ = true;
+	thread_ = std::thread(&EventLog::writerThread, this);
+}
+
+void EventLog::stop()
+{
+	if (!running_)
+		return;
+
+	running_ = false;
+	thread_.join();
+}
+
+void EventLog::writerThread()
+{
+	string buf;
+	EventRecord rec;
+
+	for (;;) {
+		bool running = running_.load();
+
+		// drain whatever is queued, formatting into one buffer
+		uint64_t n = 0;
+		while (ring_.pop(rec)) {
+			format(buf, rec);
+			n++;
+			if (buf.size() >= 65536) {
+				out_->write(buf.data(), buf.size());
+				buf.clear();
+			}
+		}
+
+		if (!buf.empty()) {
+			out_->write(buf.data(), buf.size());
+			buf.clear();
+		}
+		if (n) {
+			out_->flush();
+			written_.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		if (!running)
+			break;
+		if (!n)
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+static void appendOrder(string& s, const EventRecord& rec)
+{
+	char tmp[256];
+
+	snprintf(tmp, sizeof(tmp), "[#%" PRIu64 " %s %u %s",
+		 rec.orderId,
+		 (rec.flags & EVF_BUY) ? "BUY" : "SELL",
+		 rec.qty, rec.symbol);
+	s += tmp;
+
+	if (rec.price == 0)
+		s += " MKT";
+	else {
+		snprintf(tmp, sizeof(tmp), " $%u", rec.price);
+		s += tmp;
+	}
+	if (rec.stopPrice != 0) {
+		snprintf(tmp, sizeof(tmp), " STOP %u", rec.stopPrice);
+		s += tmp;
+	}
+	if (rec.flags & EVF_AON)
+		s += " AON";
+	if (rec.flags & EVF_IOC)
+		s += " IOC";
+	if (rec.onMarket != 0) {
+		snprintf(tmp, sizeof(tmp), " Open: %u", rec.onMarket);
+		s += tmp;
+	}
+	if (rec.filled != 0) {
+		snprintf(tmp, sizeof(tmp), " Filled: %u", rec.filled);
+		s += tmp;
+	}
+	if (rec.cost != 0) {
+		snprintf(tmp, sizeof(tmp), " Cost: %u", rec.cost);
+		s += tmp;
+	}
+
+	s += " Last Event:{";
+	s += stateNames[std::min((unsigned int) rec.state,
+				 (unsigned int) Order::Unknown)];
+	s += "}]";
+}
+
+static void appendQtyPrice(string& s, const EventRecord& rec)
+{
+	char tmp[64];
+
+	if (rec.delta != liquibook::book::SIZE_UNCHANGED) {
+		snprintf(tmp, sizeof(tmp), " QUANTITY  += %d", rec.delta);
+		s += tmp;
+	}
+	if (rec.arg3 != liquibook::book::PRICE_UNCHANGED) {
+		snprintf(tmp, sizeof(tmp), " PRICE %u", rec.arg3);
+		s += tmp;
+	}
+}
+
+void EventLog::format(std::string& s, const EventRecord& rec)
+{
+	char tmp[256];
+
+	snprintf(tmp, sizeof(tmp), "%llu.%06llu ",
+		 (unsigned long long) (rec.tstamp / 1000000),
+		 (unsigned long long) (rec.tstamp % 1000000));
+	s += tmp;
+
+	switch (rec.type) {
+	case EV_BOOK_ADDED:
+		s += (rec.flags & EVF_DEPTH) ?
+			"Create new depth order book for " :
+			"Create new order book for ";
+		s += rec.symbol;
+		if (rec.flags & EVF_DEPTH) {
+			snprintf(tmp, sizeof(tmp), " (%u levels)", rec.arg1);
+			s += tmp;
+		}
+		break;
+
+	case EV_ORDER_ADDING:
+		s += "ADDING order:  ";
+		appendOrder(s, rec);
+		break;
+
+	case EV_CANCEL_REQUESTED:
+		s += "Requesting Cancel: ";
+		appendOrder(s, rec);
+		break;
+
+	case EV_MODIFY_REQUESTED:
+		s += "Requested Modify";
+		appendQtyPrice(s, rec);
+		break;
+
+	case EV_ORDER_NOT_FOUND:
+		s += "--Can't find OrderID #";
+		s += orderIdStr(rec.orderId);
+		break;
+
+	case EV_ACCEPTED:
+		s += "\tEvent:Accepted: ";
+		appendOrder(s, rec);
+		break;
+
+	case EV_REJECTED:
+		s += "\tEvent:Rejected: ";
+		appendOrder(s, rec);
+		s += ' ';
+		s += rec.reason ? rec.reason : "";
+		break;
+
+	case EV_FILL:
+	case EV_FILL_MATCHED:
+		if (rec.type == EV_FILL)
+			s += (rec.flags & EVF_BUY) ?
+				"\tEvent:Fill-Bought: " : "\tEvent:Fill-Sold: ";
+		else
+			s += (rec.flags & EVF_BUY) ? "\tBought: " : "\tSold: ";
+		snprintf(tmp, sizeof(tmp), "%u Shares for %u ",
+			 rec.arg1, rec.arg2);
+		s += tmp;
+		appendOrder(s, rec);
+		break;
+
+	case EV_CANCELLED:
+		s += "\tEvent:Canceled: ";
+		appendOrder(s, rec);
+		break;
+
+	case EV_CANCEL_REJECTED:
+		s += "\tEvent:Cancel Reject: ";
+		appendOrder(s, rec);
+		s += ' ';
+		s += rec.reason ? rec.reason : "";
+		break;
+
+	case EV_REPLACED:
+		s += "\tEvent:Modify ";
+		appendQtyPrice(s, rec);
+		appendOrder(s, rec);
+		break;
+
+	case EV_REPLACE_REJECTED:
+		s += "\tEvent:Replace Reject: ";
+		appendOrder(s, rec);
+		s += ' ';
+		s += rec.reason ? rec.reason : "";
+		break;
+
+	case EV_TRADE:
+		snprintf(tmp, sizeof(tmp), "\tEvent:Trade: %u %s Cost %u",
+			 rec.arg1, rec.symbol, rec.arg2);
+		s += tmp;
+		break;
+
+	case EV_BOOK_CHANGE:
+		s += "\tEvent:Book Change:  ";
+		s += rec.symbol;
+		break;
+
+	case EV_BBO_CHANGE:
+	case EV_DEPTH_CHANGE:
+		snprintf(tmp, sizeof(tmp),
+			 "\tEvent:%s Change:  %s%s Change Id: %u Published: %u",
+			 (rec.type == EV_BBO_CHANGE) ? "BBO" : "Depth",
+			 rec.symbol,
+			 (rec.flags & EVF_CHANGED) ? " Changed" : " Unchanged",
+			 rec.arg1, rec.arg2);
+		s += tmp;
+		break;
+
+	case EV_DEPTH_LEVEL:
+		snprintf(tmp, sizeof(tmp),
+			 "\t%s Price %u Count: %u Quantity: %u Change id#: %u",
+			 (rec.flags & EVF_BUY) ? "BID" : "ASK",
+			 rec.price, rec.arg1, rec.arg2, rec.arg3);
+		s += tmp;
+		break;
+
+	default:
+		snprintf(tmp, sizeof(tmp), "unknown event %u", rec.type);
+		s += tmp;
+		break;
+	}
+
+	s += '\n';
+}
+
+bool EventLog::parseLevel(const std::string& name, EventLogLevel& level)
+{
+	if (name == "off")
+		level = EVLOG_OFF;
+	else if (name == "warn")
+		level = EVLOG_WARN;
+	else if (name == "info")
+		level = EVLOG_INFO;
+	else if (name == "debug")
+		level = EVLOG_DEBUG;
+	else
+		return false;
+
+	return true;
+}
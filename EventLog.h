@@ -0,0 +1,130 @@
+#ifndef __EVENTLOG_H__
+#define __EVENTLOG_H__
+
+#include <string>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include <ostream>
+#include <book/types.h>
+#include "RingBuffer.h"
+#include "OrderId.h"
+
+namespace orderentry {
+class Order;
+}
+
+enum EventLogLevel {
+	EVLOG_OFF,
+	EVLOG_WARN,		// rejects, lookup failures
+	EVLOG_INFO,		// order life cycle, trades
+	EVLOG_DEBUG,		// book, BBO and depth changes
+};
+
+enum EventType {
+	EV_BOOK_ADDED,
+	EV_ORDER_ADDING,
+	EV_CANCEL_REQUESTED,
+	EV_MODIFY_REQUESTED,
+	EV_ORDER_NOT_FOUND,
+	EV_ACCEPTED,
+	EV_REJECTED,
+	EV_FILL,
+	EV_FILL_MATCHED,
+	EV_CANCELLED,
+	EV_CANCEL_REJECTED,
+	EV_REPLACED,
+	EV_REPLACE_REJECTED,
+	EV_TRADE,
+	EV_BOOK_CHANGE,
+	EV_BBO_CHANGE,
+	EV_DEPTH_CHANGE,
+	EV_DEPTH_LEVEL,
+};
+
+enum {
+	EVF_BUY			= (1U << 0),
+	EVF_AON			= (1U << 1),
+	EVF_IOC			= (1U << 2),
+	EVF_DEPTH		= (1U << 3),	// book added: depth book
+	EVF_CHANGED		= (1U << 4),	// depth: changed since publish
+};
+
+// Fixed-size binary log record.  Everything the formatter needs is
+// copied in, so records never refer to live Market state.
+struct EventRecord {
+	uint64_t	tstamp;			// usec since epoch
+	uint8_t		type;
+	uint8_t		state;			// Order::State
+	uint16_t	flags;
+	OrderId		orderId;
+	char		symbol[20];
+
+	// order snapshot
+	liquibook::book::Quantity qty;
+	liquibook::book::Price	price;
+	liquibook::book::Price	stopPrice;
+	uint32_t	onMarket;
+	uint32_t	filled;
+	uint32_t	cost;
+
+	// event arguments
+	uint32_t	arg1;			// fill/trade qty, level count
+	uint32_t	arg2;			// fill/trade cost, level qty
+	uint32_t	arg3;			// change ids, level price
+	int32_t		delta;			// qty change
+	const char	*reason;		// static string, or NULL
+
+	EventRecord() : type(0) {}
+	explicit EventRecord(EventType type_);
+
+	void setOrder(const orderentry::Order& order);
+	void setSymbol(const std::string& sym);
+	void setOrderId(OrderId id) { orderId = id; }
+};
+
+// Asynchronous event log.  The matching thread pushes fixed-size
+// records into a lock-free ring; a background thread formats them
+// as text and writes them out.  When the ring is full, records are
+// dropped and counted rather than stalling the producer.
+class EventLog {
+public:
+	EventLog(std::ostream *out, size_t queueSize = 65536);
+	~EventLog();
+
+	void setLevel(EventLogLevel level) { level_ = level; }
+	bool enabled(EventLogLevel level) const {
+		return (level <= level_);
+	}
+
+	void push(const EventRecord& rec) {
+		if (!ring_.push(rec))
+			dropped_.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void start();
+	void stop();
+
+	uint64_t dropped() const {
+		return dropped_.load(std::memory_order_relaxed);
+	}
+	uint64_t written() const {
+		return written_.load(std::memory_order_relaxed);
+	}
+
+	static bool parseLevel(const std::string& name, EventLogLevel& level);
+
+private:
+	std::ostream			*out_;
+	EventLogLevel			level_;
+	RingBuffer<EventRecord>		ring_;
+	std::atomic<uint64_t>		dropped_;
+	std::atomic<uint64_t>		written_;
+	std::atomic<bool>		running_;
+	std::thread			thread_;
+
+	void writerThread();
+	void format(std::string& s, const EventRecord& rec);
+};
+
+#endif // __EVENTLOG_H__
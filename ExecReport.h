@@ -0,0 +1,51 @@
+#ifndef __EXECREPORT_H__
+#define __EXECREPORT_H__
+
+#include <cstdint>
+#include <book/types.h>
+#include "OrderId.h"
+
+namespace orderentry
+{
+
+enum ExecType {
+	EXEC_ACK		= 0,	// command received; status, clientRef
+	EXEC_ACCEPTED		= 1,
+	EXEC_REJECTED		= 2,
+	EXEC_FILL		= 3,
+	EXEC_CANCELLED		= 4,
+	EXEC_CANCEL_REJECTED	= 5,
+	EXEC_REPLACED		= 6,
+	EXEC_REPLACE_REJECTED	= 7,
+};
+
+// One order event, addressed to the binary order-entry session that
+// entered the order.  Produced on a matching shard, delivered once
+// the shard's journal batch is durable.
+struct ExecReport {
+	uint32_t			session;
+	uint8_t				type;		// ExecType
+	uint8_t				status;		// EXEC_ACK only
+	uint64_t			clientRef;	// EXEC_ACK only
+	OrderId				orderId;
+	liquibook::book::Quantity	qty;		// fill, or new order qty
+	liquibook::book::Price		price;		// fill, or new price
+	liquibook::book::Quantity	leaves;		// still on market
+	liquibook::book::Quantity	filled;		// cumulative
+
+	ExecReport()
+		: session(0), type(EXEC_ACK), status(0), clientRef(0),
+		  orderId(0), qty(0), price(0), leaves(0), filled(0) {}
+};
+
+class ExecListener {
+public:
+	virtual ~ExecListener() {}
+
+	/// @brief order event for an order owned by a session
+	virtual void on_exec(const ExecReport & report) = 0;
+};
+
+} // namespace orderentry
+
+#endif // __EXECREPORT_H__
@@ -0,0 +1,85 @@
+
+#include <assert.h>
+#include "HttpRouter.h"
+#include "srv.h"
+
+using namespace std;
+
+static bool inClass(HttpPathMatch match, char ch)
+{
+	switch (match) {
+	case PATH_SYMBOL:
+		return (ch >= 'A' && ch <= 'Z');
+	case PATH_ORDER_ID:
+		return (ch >= 'a' && ch <= 'z') ||
+		       (ch >= '0' && ch <= '9') || (ch == '-');
+	default:
+		return false;
+	}
+}
+
+int HttpRouter::child(unsigned int node, char ch) const
+{
+	const vector<Edge>& next = nodes_[node].next;
+	for (size_t i = 0; i < next.size(); i++)
+		if (next[i].ch == ch)
+			return next[i].node;
+	return -1;
+}
+
+void HttpRouter::add(const HttpApiEntry *ent)
+{
+	unsigned int node = 0;
+	for (const char *p = ent->path; *p; p++) {
+		int n = child(node, *p);
+		if (n < 0) {
+			Edge edge = { *p, (unsigned int) nodes_.size() };
+			nodes_[node].next.push_back(edge);
+			nodes_.push_back(Node());
+			n = edge.node;
+		}
+		node = n;
+	}
+
+	if (ent->match == PATH_EXACT) {
+		assert(!nodes_[node].exact);
+		nodes_[node].exact = ent;
+	} else {
+		assert(!nodes_[node].capture);
+		nodes_[node].capture = ent;
+	}
+}
+
+const HttpApiEntry *HttpRouter::route(const char *path, const char *& match,
+				      size_t& matchLen) const
+{
+	const HttpApiEntry *found = NULL;
+	const char *p = path;
+	int node = 0;
+
+	while (true) {
+		// a capture here: keep it, unless a longer path matches
+		const HttpApiEntry *cap = nodes_[node].capture;
+		if (cap && inClass(cap->match, *p)) {
+			const char *end = p;
+			while (inClass(cap->match, *end))
+				end++;
+			found = cap;
+			match = p;
+			matchLen = end - p;
+		}
+
+		if (!*p)
+			break;
+		node = child(node, *p++);
+		if (node < 0)
+			return found;
+	}
+
+	if (nodes_[node].exact) {
+		match = NULL;
+		matchLen = 0;
+		return nodes_[node].exact;
+	}
+	return found;
+}
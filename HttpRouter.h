@@ -0,0 +1,51 @@
+#ifndef __HTTPROUTER_H__
+#define __HTTPROUTER_H__
+
+#include <vector>
+#include <cstddef>
+
+struct HttpApiEntry;
+
+// how an API entry's path matches
+enum HttpPathMatch {
+	PATH_EXACT,			// the whole path
+	PATH_SYMBOL,			// the path, then [A-Z]+
+	PATH_ORDER_ID,			// the path, then [a-z0-9-]+
+};
+
+// Routes request paths to API entries through a trie of their paths,
+// built once at startup.  A capturing entry matches its path and one
+// or more chars of its class; the capture ends at the first char
+// outside the class, and the rest is ignored, as the regexes these
+// entries replace did.  An exact match wins over a capture, and a
+// longer capturing path over a shorter.
+class HttpRouter {
+public:
+	HttpRouter() : nodes_(1) {}
+
+	void add(const HttpApiEntry *ent);
+
+	// NULL if no entry matches; else the capture, within path
+	const HttpApiEntry *route(const char *path, const char *& match,
+				  size_t& matchLen) const;
+
+private:
+	struct Edge {
+		char			ch;
+		unsigned int		node;
+	};
+
+	struct Node {
+		std::vector<Edge>	next;		// few; scanned
+		const HttpApiEntry	*exact;		// path ends here
+		const HttpApiEntry	*capture;	// capture starts here
+
+		Node() : exact(NULL), capture(NULL) {}
+	};
+
+	std::vector<Node>	nodes_;
+
+	int child(unsigned int node, char ch) const;
+};
+
+#endif // __HTTPROUTER_H__
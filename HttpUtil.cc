@@ -6,8 +6,6 @@
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
-#include <openssl/sha.h>
-#include <openssl/hmac.h>
 #include <univalue.h>
 #include "HttpUtil.h"
 #include "Util.h"
@@ -64,51 +62,63 @@ std::string httpDateHdr(time_t t)
 	return formatTime("%a, %d %b %Y %H:%M:%S GMT", t);
 }
 
+// ?pretty=1: indented output, for people
+bool httpPretty(const evhtp_request_t *req)
+{
+	if (!req->uri || !req->uri->query)
+		return false;
+
+	const char *value = evhtp_kv_find(req->uri->query, "pretty");
+	return value && (*value == '1');
+}
+
 void httpJsonReply(evhtp_request_t *req, const UniValue& jval)
 {
-	string body = jval.write(2) + "\n";
+	string body = jval.write(httpPretty(req) ? 2 : 0);
+	evbuffer_add(req->buffer_out, body.c_str(), body.size());
+	evbuffer_add(req->buffer_out, "\n", 1);
+	httpJsonSend(req);
+}
 
+// body already serialized, e.g. cached
+void httpJsonReply(evhtp_request_t *req, const std::string& body)
+{
+	evbuffer_add(req->buffer_out, body.c_str(), body.size());
+	httpJsonSend(req);
+}
+
+// body already written to req->buffer_out, e.g. by a JsonWriter
+void httpJsonSend(evhtp_request_t *req)
+{
 	evhtp_headers_add_header(req->headers_out,
 		evhtp_header_new("Content-Type", "application/json; charset=utf-8", 0, 0));
-	evbuffer_add(req->buffer_out, body.c_str(), body.size());
 	evhtp_send_reply(req, EVHTP_RES_OK);
 }
 
-void build_auth_hdr(evhtp_request_t *req,
+void build_auth_msg(evhtp_request_t *req,
 		    const std::string& auth_user,
-		    const std::string& auth_secret,
-		    std::string& auth_hdr)
+		    std::string& phdr)
 {
 	evhtp_headers_t *hdrs = req->headers_in;
 
-	// build canonical pseudo-header
+	// build canonical pseudo-header, which the client signed
 
 	// phdr header: static auth method, auth user id
-	string phdr("cscpp1-sha256\n");
-	phdr += auth_user + "\n";
+	phdr.reserve(256);
+	phdr.assign("cscpp1-sha256\n");
+	phdr += auth_user;
+	phdr += '\n';
 
 	// absorb Host, X-Unixtime, ETag
 	// It is assumed ETag will guaranteed message contents
 	// ETag is signed here, checked elsewhere.
-	const char *hdr = evhtp_kv_find(hdrs, "Host");
-	if (hdr && *hdr)
-		phdr += string(hdr) + "\n";
-	hdr = evhtp_kv_find(hdrs, "X-Unixtime");
-	if (hdr && *hdr)
-		phdr += string(hdr) + "\n";
-	hdr = evhtp_kv_find(hdrs, "ETag");
-	if (hdr && *hdr)
-		phdr += string(hdr) + "\n";
-
-	// create HMAC signature
-	vector<unsigned char> md(SHA256_DIGEST_LENGTH);
-	HMAC(EVP_sha256(),
-             &auth_secret[0], auth_secret.size(),
-             (const unsigned char *) phdr.c_str(), phdr.size(),
-             &md[0], NULL);
-       string signature(HexStr(md));
-
-       // format: bbnode1-sha256 $username $signature
-       auth_hdr = "cscpp1-sha256 " + auth_user + " " + signature;
+	static const char *signedHdrs[] = { "Host", "X-Unixtime", "ETag" };
+	for (unsigned int i = 0; i < 3; i++) {
+		const char *hdr = evhtp_kv_find(hdrs, signedHdrs[i]);
+		if (hdr && *hdr) {
+			phdr += hdr;
+			phdr += '\n';
+		}
+	}
 }
 
@@ -12,10 +12,12 @@ bool query_int64_range(const evhtp_request_t *req,
 		     int64_t vMin, int64_t vMax, int64_t vDefault);
 int64_t get_content_length (const evhtp_request_t *req);
 std::string httpDateHdr(time_t t);
+bool httpPretty(const evhtp_request_t *req);
 void httpJsonReply(evhtp_request_t *req, const UniValue& jval);
-void build_auth_hdr(evhtp_request_t *req,
+void httpJsonReply(evhtp_request_t *req, const std::string& body);
+void httpJsonSend(evhtp_request_t *req);
+void build_auth_msg(evhtp_request_t *req,
 		    const std::string& auth_user,
-		    const std::string& auth_secret,
-		    std::string& auth_hdr);
+		    std::string& phdr);
 
 #endif // __HTTPUTIL_H__
@@ -0,0 +1,71 @@
+#ifndef __INTRUSIVEPTR_H__
+#define __INTRUSIVEPTR_H__
+
+#include <cstddef>
+#include <utility>
+#include <functional>
+
+// Smart pointer to an object that counts its own references, through
+// T::addRef() and T::release().  Unlike shared_ptr there is no control
+// block, and the count need not be atomic: objects owned by a matching
+// shard are only ever referenced from its thread.
+template <typename T>
+class IntrusivePtr {
+public:
+	IntrusivePtr() : p_(NULL) {}
+	IntrusivePtr(std::nullptr_t) : p_(NULL) {}
+	explicit IntrusivePtr(T *p) : p_(p) {
+		if (p_)
+			p_->addRef();
+	}
+	IntrusivePtr(const IntrusivePtr& rhs) : p_(rhs.p_) {
+		if (p_)
+			p_->addRef();
+	}
+	IntrusivePtr(IntrusivePtr&& rhs) : p_(rhs.p_) {
+		rhs.p_ = NULL;
+	}
+	~IntrusivePtr() {
+		if (p_)
+			p_->release();
+	}
+
+	IntrusivePtr& operator=(const IntrusivePtr& rhs) {
+		IntrusivePtr(rhs).swap(*this);
+		return *this;
+	}
+	IntrusivePtr& operator=(IntrusivePtr&& rhs) {
+		IntrusivePtr(std::move(rhs)).swap(*this);
+		return *this;
+	}
+
+	void reset() { IntrusivePtr().swap(*this); }
+	void swap(IntrusivePtr& rhs) {
+		T *p = p_;
+		p_ = rhs.p_;
+		rhs.p_ = p;
+	}
+
+	T *get() const { return p_; }
+	T& operator*() const { return *p_; }
+	T *operator->() const { return p_; }
+	explicit operator bool() const { return p_ != NULL; }
+
+	bool operator==(const IntrusivePtr& rhs) const { return p_ == rhs.p_; }
+	bool operator!=(const IntrusivePtr& rhs) const { return p_ != rhs.p_; }
+	bool operator<(const IntrusivePtr& rhs) const { return p_ < rhs.p_; }
+
+private:
+	T	*p_;
+};
+
+namespace std {
+template <typename T>
+struct hash<IntrusivePtr<T> > {
+	size_t operator()(const IntrusivePtr<T>& p) const {
+		return hash<T *>()(p.get());
+	}
+};
+}
+
+#endif // __INTRUSIVEPTR_H__
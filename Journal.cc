@@ -0,0 +1,312 @@
+
+#include <string>
+#include <syslog.h>
+#include <assert.h>
+#include "Journal.h"
+#include "Serialize.h"
+#include "BookUpdate.h"
+
+using namespace std;
+
+// record layout; 1 had string order ids
+static const unsigned int JOURNAL_FORMAT = 2;
+
+string Journal::key(uint64_t seq) const
+{
+	string k(prefix_);
+	serKeyU64(k, seq);
+	return k;
+}
+
+void JournalRecord::encode(std::string& s) const
+{
+	serU8(s, type);
+	serU64(s, (uint64_t) tstamp.tv_sec);
+	serU32(s, (uint32_t) tstamp.tv_usec);
+
+	switch (type) {
+	case JREC_ADD_BOOK:
+		serStr(s, symbol);
+		serU8(s, flag);
+		serU32(s, qty);		// depth levels
+		serU32(s, ladder.minPrice);
+		serU32(s, ladder.maxPrice);
+		serU32(s, ladder.tick);
+		break;
+
+	case JREC_ORDER_SUBMIT:
+		serU64(s, orderId);
+		serStr(s, alias);
+		serStr(s, symbol);
+		serU8(s, flag);
+		serU32(s, qty);
+		serU32(s, price);
+		serU32(s, stopPrice);
+		serU32(s, conditions);
+		break;
+
+	case JREC_ORDER_CANCEL:
+		serU64(s, orderId);
+		break;
+
+	case JREC_ORDER_MODIFY:
+		serU64(s, orderId);
+		serU32(s, (uint32_t) qtyDelta);
+		serU32(s, price);
+		break;
+
+	default:
+		assert(0);
+		break;
+	}
+}
+
+bool JournalRecord::decode(const char *p, size_t len)
+{
+	BinReader rd(p, len);
+
+	type = rd.u8();
+	tstamp.tv_sec = (time_t) rd.u64();
+	tstamp.tv_usec = (suseconds_t) rd.u32();
+
+	switch (type) {
+	case JREC_ADD_BOOK:
+		symbol = rd.str();
+		flag = rd.u8();
+		// older records: depth books had the default depth,
+		// and there were no ladder books
+		if (rd.eof()) {
+			qty = flag ? orderentry::BOOK_DEPTH_DEFAULT : 0;
+			break;
+		}
+		qty = rd.u32();
+		if (rd.eof())
+			break;
+		ladder.minPrice = rd.u32();
+		ladder.maxPrice = rd.u32();
+		ladder.tick = rd.u32();
+		break;
+
+	// no older layouts: open() refuses journals with string ids
+	case JREC_ORDER_SUBMIT:
+		orderId = rd.u64();
+		alias = rd.str();
+		symbol = rd.str();
+		flag = rd.u8();
+		qty = rd.u32();
+		price = rd.u32();
+		stopPrice = rd.u32();
+		conditions = rd.u32();
+		break;
+
+	case JREC_ORDER_CANCEL:
+		orderId = rd.u64();
+		break;
+
+	case JREC_ORDER_MODIFY:
+		orderId = rd.u64();
+		qtyDelta = (int32_t) rd.u32();
+		price = rd.u32();
+		break;
+
+	default:
+		return false;
+	}
+
+	return rd.ok() && rd.eof();
+}
+
+Journal::Journal(rocksdb::DB *db, JournalSyncPolicy policy,
+		 const std::string& prefix)
+	: db_(db), policy_(policy), prefix_(prefix), seq_(0), nPending_(0),
+	  failed_(false)
+{
+	assert(db_ != NULL);
+}
+
+bool Journal::open()
+{
+	// resume numbering after the last record on disk
+	rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
+	it->SeekForPrev(key(UINT64_MAX));
+
+	seq_ = 0;
+	if (it->Valid() &&
+	    it->key().starts_with(prefix_) &&
+	    it->key().size() == (prefix_.size() + 8))
+		seq_ = deserKeyU64(it->key().data() + prefix_.size());
+
+	bool ok = it->status().ok();
+	delete it;
+
+	if (!ok) {
+		syslog(LOG_DAEMON|LOG_ERR, "journal: cannot read last record");
+		return false;
+	}
+	return checkFormat();
+}
+
+// Journals written before 64-bit order ids keyed their submit, cancel
+// and modify records by UUID string, which this build has no id for.
+// Those are refused here, rather than replayed in part.  The format is
+// kept under the bare prefix: it sorts before every record, and is
+// outside trim()'s range.
+bool Journal::checkFormat()
+{
+	string val;
+	rocksdb::Status s = db_->Get(rocksdb::ReadOptions(), prefix_, &val);
+	if (s.ok()) {
+		if (val == to_string(JOURNAL_FORMAT))
+			return true;
+		syslog(LOG_DAEMON|LOG_ERR,
+		       "journal %s: format %s, this build reads format %u",
+		       prefix_.c_str(), val.c_str(), JOURNAL_FORMAT);
+		return false;
+	}
+	if (!s.IsNotFound()) {
+		syslog(LOG_DAEMON|LOG_ERR, "journal %s: cannot read format: %s",
+		       prefix_.c_str(), s.ToString().c_str());
+		return false;
+	}
+
+	// unmarked: new, or from a build that did not record its format,
+	// whose records must all decode here
+	bool ok = true;
+	rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
+	for (it->Seek(key(0));
+	     it->Valid() && it->key().starts_with(prefix_);
+	     it->Next()) {
+		JournalRecord rec;
+		if (!rec.decode(it->value().data(), it->value().size())) {
+			syslog(LOG_DAEMON|LOG_ERR,
+			       "journal %s: record %llu has string order ids "
+			       "from an earlier build, or is corrupt; this "
+			       "build cannot replay it",
+			       prefix_.c_str(),
+			       (unsigned long long) deserKeyU64(
+					it->key().data() + prefix_.size()));
+			ok = false;
+			break;
+		}
+	}
+	if (!it->status().ok())
+		ok = false;
+	delete it;
+	if (!ok)
+		return false;
+
+	s = db_->Put(rocksdb::WriteOptions(), prefix_, to_string(JOURNAL_FORMAT));
+	if (!s.ok()) {
+		syslog(LOG_DAEMON|LOG_ERR, "journal %s: cannot write format: %s",
+		       prefix_.c_str(), s.ToString().c_str());
+		return false;
+	}
+	return true;
+}
+
+uint64_t Journal::append(JournalRecord& rec)
+{
+	rec.seq = ++seq_;
+
+	string val;
+	rec.encode(val);
+
+	if (policy_ == JSYNC_REQUEST) {
+		rocksdb::WriteOptions wopt;
+		wopt.sync = true;
+		rocksdb::Status s = db_->Put(wopt, key(rec.seq), val);
+		if (!s.ok()) {
+			syslog(LOG_DAEMON|LOG_ERR, "journal: write failed: %s",
+			       s.ToString().c_str());
+			failed_ = true;
+		}
+		return rec.seq;
+	}
+
+	// group commit: batch until the owner calls commit()
+	batch_.Put(key(rec.seq), val);
+	nPending_++;
+
+	return rec.seq;
+}
+
+bool Journal::commit()
+{
+	if (failed_)
+		return false;
+	if (nPending_ == 0)
+		return true;
+
+	rocksdb::WriteOptions wopt;
+	wopt.sync = (policy_ != JSYNC_ASYNC);
+
+	rocksdb::Status s = db_->Write(wopt, &batch_);
+	batch_.Clear();
+	nPending_ = 0;
+
+	if (!s.ok()) {
+		syslog(LOG_DAEMON|LOG_ERR, "journal: commit failed: %s",
+		       s.ToString().c_str());
+		failed_ = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool Journal::replay(uint64_t afterSeq,
+		     std::function<void(const JournalRecord&)> cb)
+{
+	bool ok = true;
+	rocksdb::Iterator *it = db_->NewIterator(rocksdb::ReadOptions());
+
+	for (it->Seek(key(afterSeq + 1));
+	     it->Valid() && it->key().starts_with(prefix_);
+	     it->Next()) {
+		JournalRecord rec;
+		if (!rec.decode(it->value().data(), it->value().size())) {
+			syslog(LOG_DAEMON|LOG_ERR,
+			       "journal: corrupt record, replay stopped");
+			ok = false;
+			break;
+		}
+
+		rec.seq = deserKeyU64(it->key().data() + prefix_.size());
+		cb(rec);
+	}
+
+	if (!it->status().ok())
+		ok = false;
+	delete it;
+
+	return ok;
+}
+
+// discard records already captured by a snapshot
+bool Journal::trim(uint64_t uptoSeq)
+{
+	rocksdb::Status s = db_->DeleteRange(rocksdb::WriteOptions(),
+				db_->DefaultColumnFamily(),
+				key(0), key(uptoSeq + 1));
+	if (!s.ok()) {
+		syslog(LOG_DAEMON|LOG_ERR, "journal: trim failed: %s",
+		       s.ToString().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool Journal::parsePolicy(const std::string& name, JournalSyncPolicy& policy)
+{
+	if (name == "request")
+		policy = JSYNC_REQUEST;
+	else if (name == "interval")
+		policy = JSYNC_INTERVAL;
+	else if (name == "async")
+		policy = JSYNC_ASYNC;
+	else
+		return false;
+
+	return true;
+}
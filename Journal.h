@@ -0,0 +1,99 @@
+#ifndef __JOURNAL_H__
+#define __JOURNAL_H__
+
+#include <string>
+#include <cstdint>
+#include <functional>
+#include <sys/time.h>
+#include <book/types.h>
+#include "OrderId.h"
+#include "LadderSpec.h"
+#include "rocksdb/db.h"
+#include "rocksdb/write_batch.h"
+
+enum JournalSyncPolicy {
+	JSYNC_REQUEST,		// sync each record before returning
+	JSYNC_INTERVAL,		// group commit, synced every N usec
+	JSYNC_ASYNC,		// group commit, never synced explicitly
+};
+
+enum JournalRecType {
+	JREC_ADD_BOOK		= 1,
+	JREC_ORDER_SUBMIT	= 2,
+	JREC_ORDER_CANCEL	= 3,
+	JREC_ORDER_MODIFY	= 4,
+};
+
+// One inbound Market command.  Only the fields relevant to
+// the record type are encoded.
+struct JournalRecord {
+	uint64_t		seq;
+	uint8_t			type;
+	struct timeval		tstamp;
+
+	std::string		symbol;		// add-book, submit
+	OrderId			orderId;	// submit, cancel, modify
+	std::string		alias;		// submit, compat mode only
+	bool			flag;		// add-book: depth; submit: buy
+	liquibook::book::Quantity qty;		// add-book: depth levels
+	liquibook::book::Price	price;
+	liquibook::book::Price	stopPrice;
+	liquibook::book::OrderConditions conditions;
+	int32_t			qtyDelta;
+	orderentry::LadderSpec	ladder;		// add-book
+
+	JournalRecord(uint8_t type_ = 0)
+		: seq(0), type(type_), orderId(0), flag(false), qty(0), price(0),
+		  stopPrice(0), conditions(0), qtyDelta(0) {
+		tstamp.tv_sec = 0;
+		tstamp.tv_usec = 0;
+	}
+
+	void encode(std::string& s) const;
+	bool decode(const char *p, size_t len);
+};
+
+// Sequence-numbered, write-ahead journal of Market commands,
+// stored in RocksDB under <prefix><big-endian seq>, and its record
+// format under <prefix>.  open() refuses a format it cannot replay.
+class Journal {
+public:
+	Journal(rocksdb::DB *db, JournalSyncPolicy policy,
+		const std::string& prefix = "/journal/");
+
+	bool open();
+	void resume(uint64_t seq) { if (seq > seq_) seq_ = seq; }
+
+	// A record that could not be written, at once under JSYNC_REQUEST
+	// or by a group commit, fails this and every later commit(): the
+	// owner's state is ahead of the journal, and must not be
+	// acknowledged.
+	uint64_t append(JournalRecord& rec);
+	bool commit();
+	bool failed() const { return failed_; }
+	bool pending() const { return nPending_ > 0; }
+	uint64_t lastSeq() const { return seq_; }
+	JournalSyncPolicy policy() const { return policy_; }
+
+	bool replay(uint64_t afterSeq,
+		    std::function<void(const JournalRecord&)> cb);
+	bool trim(uint64_t uptoSeq);	// any thread: only the database
+
+	static bool parsePolicy(const std::string& name,
+				JournalSyncPolicy& policy);
+
+private:
+	rocksdb::DB		*db_;
+	JournalSyncPolicy	policy_;
+	std::string		prefix_;
+	uint64_t		seq_;
+
+	rocksdb::WriteBatch	batch_;
+	size_t			nPending_;
+	bool			failed_;	// a record was lost
+
+	std::string key(uint64_t seq) const;
+	bool checkFormat();
+};
+
+#endif // __JOURNAL_H__
@@ -0,0 +1,209 @@
+
+#include <string>
+#include <cstring>
+#include "JsonWriter.h"
+
+using namespace std;
+
+void JsonWriter::flush()
+{
+	if (len_ == 0)
+		return;
+
+	if (buf_)
+		evbuffer_add(buf_, stage_, len_);
+	else
+		str_->append(stage_, len_);
+	len_ = 0;
+}
+
+void JsonWriter::put(const char *s, size_t n)
+{
+	if (len_ + n > STAGE_SIZE) {
+		flush();
+
+		// too big to stage: straight through
+		if (n > STAGE_SIZE) {
+			if (buf_)
+				evbuffer_add(buf_, s, n);
+			else
+				str_->append(s, n);
+			return;
+		}
+	}
+
+	memcpy(stage_ + len_, s, n);
+	len_ += n;
+}
+
+void JsonWriter::indent()
+{
+	put('\n');
+	for (unsigned int i = 0; i < depth_; i++)
+		put("  ", 2);
+}
+
+// before a key, or a value that is not a member's: the comma after
+// the previous item, and in pretty output a fresh line
+void JsonWriter::separate()
+{
+	if (afterKey_) {
+		afterKey_ = false;
+		return;
+	}
+	if (depth_ == 0)
+		return;
+
+	if (!first_[depth_])
+		put(',');
+	first_[depth_] = false;
+	if (pretty_)
+		indent();
+}
+
+void JsonWriter::open(char ch)
+{
+	assert(depth_ < MAX_DEPTH);
+
+	separate();
+	put(ch);
+	first_[++depth_] = true;
+}
+
+void JsonWriter::close(char ch)
+{
+	assert(depth_ > 0 && !afterKey_);
+
+	bool empty = first_[depth_];
+	depth_--;
+	if (pretty_ && !empty)
+		indent();
+	put(ch);
+}
+
+JsonWriter& JsonWriter::key(const char *k)
+{
+	separate();
+	string(k, strlen(k));
+	put(':');
+	if (pretty_)
+		put(' ');
+	afterKey_ = true;
+	return *this;
+}
+
+void JsonWriter::string(const char *s, size_t len)
+{
+	static const char hexmap[16] = { '0', '1', '2', '3', '4', '5', '6', '7',
+					 '8', '9', 'a', 'b', 'c', 'd', 'e', 'f' };
+
+	put('"');
+
+	// runs of plain chars are copied whole
+	size_t run = 0;
+	for (size_t i = 0; i < len; i++) {
+		unsigned char ch = s[i];
+		if (ch >= 0x20 && ch != '"' && ch != '\\')
+			continue;
+
+		put(s + run, i - run);
+		run = i + 1;
+
+		switch (ch) {
+		case '"':	put("\\\"", 2); break;
+		case '\\':	put("\\\\", 2); break;
+		case '\b':	put("\\b", 2); break;
+		case '\f':	put("\\f", 2); break;
+		case '\n':	put("\\n", 2); break;
+		case '\r':	put("\\r", 2); break;
+		case '\t':	put("\\t", 2); break;
+		default: {
+			char esc[6] = { '\\', 'u', '0', '0',
+					hexmap[ch >> 4], hexmap[ch & 15] };
+			put(esc, sizeof(esc));
+			break;
+		}
+		}
+	}
+	put(s + run, len - run);
+
+	put('"');
+}
+
+JsonWriter& JsonWriter::value(const char *s)
+{
+	return value(s, strlen(s));
+}
+
+JsonWriter& JsonWriter::value(const char *s, size_t len)
+{
+	separate();
+	string(s, len);
+	return *this;
+}
+
+// digits of v, ending at end
+static char *formatU64(char *end, uint64_t v)
+{
+	char *p = end;
+	do {
+		*--p = '0' + (v % 10);
+		v /= 10;
+	} while (v);
+	return p;
+}
+
+JsonWriter& JsonWriter::value(uint64_t v)
+{
+	char tmp[24];
+	char *p = formatU64(tmp + sizeof(tmp), v);
+
+	separate();
+	put(p, tmp + sizeof(tmp) - p);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(int64_t v)
+{
+	char tmp[24];
+	char *p = formatU64(tmp + sizeof(tmp),
+			    (v < 0) ? 0 - (uint64_t) v : (uint64_t) v);
+	if (v < 0)
+		*--p = '-';
+
+	separate();
+	put(p, tmp + sizeof(tmp) - p);
+	return *this;
+}
+
+JsonWriter& JsonWriter::value(bool v)
+{
+	separate();
+	if (v)
+		put("true", 4);
+	else
+		put("false", 5);
+	return *this;
+}
+
+JsonWriter& JsonWriter::null()
+{
+	separate();
+	put("null", 4);
+	return *this;
+}
+
+JsonWriter& JsonWriter::raw(const char *s, size_t len)
+{
+	separate();
+	put(s, len);
+	return *this;
+}
+
+void JsonWriter::end()
+{
+	assert(depth_ == 0);
+
+	put('\n');
+	flush();
+}
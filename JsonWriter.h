@@ -0,0 +1,93 @@
+#ifndef __JSONWRITER_H__
+#define __JSONWRITER_H__
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <assert.h>
+#include <event2/buffer.h>
+
+// Streaming JSON output, appended to an evbuffer or a string as values
+// are written; no document is built first.  Output is compact, unless
+// pretty: then each member and element starts a line, indented two
+// spaces per level.
+//
+// Writes are staged in a small buffer inside the writer, and flushed
+// to the destination in blocks, and when the writer goes away.  The
+// caller keeps keys and values in order; nesting is checked only by
+// assertion.
+class JsonWriter {
+public:
+	enum {
+		MAX_DEPTH	= 16,
+		STAGE_SIZE	= 1024,
+	};
+
+	JsonWriter(struct evbuffer *buf, bool pretty = false)
+		: buf_(buf), str_(NULL) { init(pretty); }
+	JsonWriter(std::string& s, bool pretty = false)
+		: buf_(NULL), str_(&s) { init(pretty); }
+	~JsonWriter() { flush(); }
+
+	JsonWriter& beginObject() { open('{'); return *this; }
+	JsonWriter& endObject() { close('}'); return *this; }
+	JsonWriter& beginArray() { open('['); return *this; }
+	JsonWriter& endArray() { close(']'); return *this; }
+	JsonWriter& key(const char *k);
+
+	JsonWriter& value(const char *s);
+	JsonWriter& value(const char *s, size_t len);
+	JsonWriter& value(const std::string& s) {
+		return value(s.data(), s.size());
+	}
+	JsonWriter& value(int64_t v);
+	JsonWriter& value(uint64_t v);
+	JsonWriter& value(int v) { return value((int64_t) v); }
+	JsonWriter& value(unsigned int v) { return value((uint64_t) v); }
+	JsonWriter& value(bool v);
+	JsonWriter& null();
+
+	// a value already in JSON form
+	JsonWriter& raw(const char *s, size_t len);
+	JsonWriter& raw(const std::string& s) { return raw(s.data(), s.size()); }
+
+	template<typename T>
+	JsonWriter& kv(const char *k, const T& v) { return key(k).value(v); }
+
+	// end of document: a newline, then flush
+	void end();
+	void flush();
+
+private:
+	struct evbuffer		*buf_;
+	std::string		*str_;
+	bool			pretty_;
+	bool			afterKey_;	// value completes a member
+	unsigned int		depth_;
+	bool			first_[MAX_DEPTH + 1];	// nothing yet at level
+	size_t			len_;
+	char			stage_[STAGE_SIZE];
+
+	void init(bool pretty) {
+		pretty_ = pretty;
+		afterKey_ = false;
+		depth_ = 0;
+		first_[0] = true;
+		len_ = 0;
+	}
+
+	void put(char ch) {
+		if (len_ == STAGE_SIZE)
+			flush();
+		stage_[len_++] = ch;
+	}
+	void put(const char *s, size_t n);
+
+	void separate();
+	void indent();
+	void open(char ch);
+	void close(char ch);
+	void string(const char *s, size_t len);
+};
+
+#endif // __JSONWRITER_H__
@@ -0,0 +1,411 @@
+#include "LadderOrderBook.h"
+
+#include <algorithm>
+
+namespace orderentry
+{
+
+using liquibook::book::Price;
+using liquibook::book::Quantity;
+using liquibook::book::OrderConditions;
+using liquibook::book::MARKET_ORDER_PRICE;
+using liquibook::book::PRICE_UNCHANGED;
+
+namespace
+{
+    // vacated slots are dropped in bulk, once they are at least this
+    // many and half the queue
+    const size_t COMPACT_MIN = 32;
+}
+
+LadderOrderBook::LadderOrderBook(const std::string & symbol,
+    const LadderSpec & spec)
+: liquibook::book::OrderBook<OrderPtr>(symbol)
+, spec_(spec)
+, bidLevels_(spec.levels())
+, askLevels_(spec.levels())
+, bestBid_(-1)
+, bestAsk_(-1)
+, resting_(0)
+, flushing_(false)
+{
+}
+
+bool
+LadderOrderBook::onLadder(Price price) const
+{
+    return price >= spec_.minPrice && price <= spec_.maxPrice &&
+        (price - spec_.minPrice) % spec_.tick == 0;
+}
+
+bool
+LadderOrderBook::add(const OrderPtr& order, OrderConditions conditions)
+{
+    const char * reason = nullptr;
+    Price price = order->price();
+    if(order->order_qty() == 0)
+    {
+        reason = "size must be positive";
+    }
+    else if(conditions & liquibook::book::oc_all_or_none)
+    {
+        reason = "all or none not supported";
+    }
+    else if(order->stop_price() != 0)
+    {
+        reason = "stop orders not supported";
+    }
+    else if(price != MARKET_ORDER_PRICE && !onLadder(price))
+    {
+        reason = "price not on ladder";
+    }
+    if(reason)
+    {
+        pending_.push_back(TypedCallback::reject(order, reason));
+        flush();
+        return false;
+    }
+
+    size_t accept = pending_.size();
+    pending_.push_back(TypedCallback::accept(order));
+
+    Tracker inbound(order, conditions);
+    match(inbound, price);
+    pending_[accept].quantity = inbound.filled_qty();
+
+    if(inbound.open_qty())
+    {
+        if(inbound.immediate_or_cancel() || price == MARKET_ORDER_PRICE)
+        {
+            pending_.push_back(TypedCallback::cancel(order, 0));
+        }
+        else
+        {
+            rest(inbound, price);
+        }
+    }
+    pending_.push_back(TypedCallback::book_update(this));
+    flush();
+    return inbound.filled_qty() != 0;
+}
+
+void
+LadderOrderBook::cancel(const OrderPtr& order)
+{
+    Tracker tracker(order);
+    if(unlink(order, tracker))
+    {
+        pending_.push_back(TypedCallback::cancel(order, tracker.open_qty()));
+        pending_.push_back(TypedCallback::book_update(this));
+    }
+    else
+    {
+        pending_.push_back(TypedCallback::cancel_reject(order, "not found"));
+    }
+    flush();
+}
+
+bool
+LadderOrderBook::replace(const OrderPtr& order, int32_t size_delta,
+    Price new_price)
+{
+    Price price = (new_price == PRICE_UNCHANGED) ? order->price() : new_price;
+
+    Tracker * found = find(order);
+    const char * reason = nullptr;
+    if(!found)
+    {
+        reason = "not found";
+    }
+    else if(!onLadder(price))
+    {
+        reason = "price not on ladder";
+    }
+    else if(size_delta < 0 && int32_t(found->open_qty()) < -size_delta)
+    {
+        // get rid of as much as we can
+        size_delta = -int32_t(found->open_qty());
+        if(size_delta == 0)
+        {
+            reason = "order is already filled";
+        }
+    }
+    if(reason)
+    {
+        pending_.push_back(TypedCallback::replace_reject(order, reason));
+        flush();
+        return false;
+    }
+
+    Tracker tracker(order);
+    unlink(order, tracker);
+    pending_.push_back(TypedCallback::replace(order, tracker.open_qty(),
+                                              size_delta, price));
+    tracker.change_qty(size_delta);
+
+    Quantity filled = tracker.filled_qty();
+    if(!tracker.open_qty())
+    {
+        pending_.push_back(TypedCallback::cancel(order, 0));
+    }
+    else
+    {
+        // rematch: the new price may cross
+        match(tracker, price);
+        if(tracker.open_qty() && tracker.immediate_or_cancel())
+        {
+            pending_.push_back(TypedCallback::cancel(order, 0));
+        }
+        else if(tracker.open_qty())
+        {
+            rest(tracker, price);
+        }
+    }
+    pending_.push_back(TypedCallback::book_update(this));
+    flush();
+    return tracker.filled_qty() != filled;
+}
+
+bool
+LadderOrderBook::restore(const OrderPtr& order, Quantity open_qty,
+    OrderConditions conditions, bool stopped)
+{
+    // stop orders are never accepted, nor prices off the ladder; a
+    // snapshot holding one was not taken from this book
+    if(stopped || !onLadder(order->price()))
+    {
+        return false;
+    }
+    Tracker tracker(order, conditions);
+    tracker.change_qty(int32_t(open_qty) - int32_t(tracker.open_qty()));
+    rest(tracker, order->price());
+    return true;
+}
+
+void
+LadderOrderBook::match(Tracker & inbound, Price price)
+{
+    bool isBuy = inbound.ptr()->is_buy();
+    std::vector<Level> & side = isBuy ? askLevels_ : bidLevels_;
+    int & best = isBuy ? bestAsk_ : bestBid_;
+
+    // market orders take any price
+    int limit;
+    if(price == MARKET_ORDER_PRICE)
+    {
+        limit = isBuy ? int(side.size()) - 1 : 0;
+    }
+    else
+    {
+        limit = index(price);
+    }
+
+    while(inbound.open_qty() && best >= 0 &&
+          (isBuy ? best <= limit : best >= limit))
+    {
+        Level & level = side[best];
+        while(inbound.open_qty() && !level.empty())
+        {
+            while(!level.queue[level.head].ptr())
+            {
+                ++level.head;
+            }
+            Tracker & resting = level.queue[level.head];
+            Price cross = resting.ptr()->price();
+            Quantity qty = std::min(inbound.open_qty(), resting.open_qty());
+            inbound.fill(qty);
+            resting.fill(qty);
+            set_market_price(cross);
+
+            uint8_t flags = TypedCallback::ff_neither_filled;
+            if(!inbound.open_qty())
+            {
+                flags |= TypedCallback::ff_inbound_filled;
+            }
+            if(!resting.open_qty())
+            {
+                flags |= TypedCallback::ff_matched_filled;
+            }
+            pending_.push_back(TypedCallback::fill(inbound.ptr(),
+                resting.ptr(), qty, cross,
+                TypedCallback::FillFlags(flags)));
+
+            if(!resting.open_qty())
+            {
+                vacate(level, resting);
+                ++level.head;
+            }
+        }
+        if(level.empty())
+        {
+            settle(side, best);
+        }
+        else
+        {
+            compact(level);
+        }
+    }
+}
+
+void
+LadderOrderBook::rest(Tracker & inbound, Price price)
+{
+    int pos = index(price);
+    bool isBuy = inbound.ptr()->is_buy();
+    Level & level = (isBuy ? bidLevels_ : askLevels_)[pos];
+
+    BookHandle & handle = inbound.ptr()->bookHandle();
+    handle.resting = true;
+    handle.slot = level.base + level.queue.size();
+    level.queue.push_back(inbound);
+    ++level.live;
+
+    if(isBuy)
+    {
+        if(pos > bestBid_)
+        {
+            bestBid_ = pos;
+        }
+    }
+    else if(bestAsk_ < 0 || pos < bestAsk_)
+    {
+        bestAsk_ = pos;
+    }
+    ++resting_;
+}
+
+LadderOrderBook::Tracker *
+LadderOrderBook::find(const OrderPtr & order)
+{
+    const BookHandle & handle = order->bookHandle();
+    if(!handle.resting)
+    {
+        return nullptr;
+    }
+    Level & level =
+        (order->is_buy() ? bidLevels_ : askLevels_)[index(order->price())];
+    return &level.queue[handle.slot - level.base];
+}
+
+bool
+LadderOrderBook::unlink(const OrderPtr & order, Tracker & tracker)
+{
+    Tracker * found = find(order);
+    if(!found)
+    {
+        return false;
+    }
+    std::vector<Level> & side = order->is_buy() ? bidLevels_ : askLevels_;
+    int pos = index(order->price());
+    Level & level = side[pos];
+
+    tracker = *found;
+    vacate(level, *found);
+    if(level.empty())
+    {
+        settle(side, pos);
+    }
+    else
+    {
+        compact(level);
+    }
+    return true;
+}
+
+void
+LadderOrderBook::vacate(Level & level, Tracker & tracker)
+{
+    tracker.ptr()->bookHandle().resting = false;
+    tracker.ptr() = OrderPtr();
+    --level.live;
+    --resting_;
+}
+
+// squeeze out vacated slots, renumbering the handles of those left
+void
+LadderOrderBook::compact(Level & level)
+{
+    while(level.head < level.queue.size() && !level.queue[level.head].ptr())
+    {
+        ++level.head;
+    }
+    size_t vacant = level.queue.size() - level.live;
+    if(vacant < COMPACT_MIN || vacant * 2 < level.queue.size())
+    {
+        return;
+    }
+
+    level.base += level.queue.size();
+    size_t kept = 0;
+    for(size_t i = level.head; i < level.queue.size(); ++i)
+    {
+        if(level.queue[i].ptr())
+        {
+            level.queue[i].ptr()->bookHandle().slot = level.base + kept;
+            level.queue[kept++] = level.queue[i];
+        }
+    }
+    level.queue.erase(level.queue.begin() + kept, level.queue.end());
+    level.head = 0;
+}
+
+// an emptied level: reset it, and if it was best, find the next
+void
+LadderOrderBook::settle(std::vector<Level> & side, int pos)
+{
+    Level & level = side[pos];
+    level.base += level.queue.size();
+    level.queue.clear();
+    level.head = 0;
+
+    if(&side == &bidLevels_)
+    {
+        if(pos != bestBid_)
+        {
+            return;
+        }
+        while(bestBid_ >= 0 && bidLevels_[bestBid_].empty())
+        {
+            --bestBid_;
+        }
+    }
+    else
+    {
+        if(pos != bestAsk_)
+        {
+            return;
+        }
+        while(bestAsk_ < int(askLevels_.size()) && askLevels_[bestAsk_].empty())
+        {
+            ++bestAsk_;
+        }
+        if(bestAsk_ == int(askLevels_.size()))
+        {
+            bestAsk_ = -1;
+        }
+    }
+}
+
+// callbacks run once the book is settled, as in OrderBook; those a
+// callback causes run before this returns
+void
+LadderOrderBook::flush()
+{
+    if(flushing_)
+    {
+        return;
+    }
+    flushing_ = true;
+    while(!pending_.empty())
+    {
+        working_.swap(pending_);
+        for(auto cb = working_.begin(); cb != working_.end(); ++cb)
+        {
+            perform_callback(*cb);
+        }
+        working_.clear();
+    }
+    flushing_ = false;
+}
+
+} // namespace orderentry
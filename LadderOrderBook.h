@@ -0,0 +1,137 @@
+#pragma once
+
+#include <book/order_book.h>
+
+#include "Order.h"
+#include "LadderSpec.h"
+
+#include <vector>
+#include <cstdint>
+
+namespace orderentry
+{
+
+/// @brief order book for an instrument with a bounded tick range.
+/// Resting orders are held in one array of price levels, indexed by
+/// (price - minPrice) / tick, each a FIFO queue of trackers; the best
+/// bid and ask are tracked as indexes.  Matching, fills and callbacks
+/// follow liquibook's OrderBook, so a Market drives either alike.
+///
+/// A resting order's BookHandle holds its position in the level queue,
+/// so cancel and replace take constant time at any queue length.  A
+/// cancelled order leaves an empty slot, dropped when the queue is
+/// compacted.
+///
+/// Orders are rejected if their price is off the ladder, if all or
+/// none, or if they carry a stop price.  Market orders match what
+/// they can; any remainder is cancelled rather than left resting.
+class LadderOrderBook : public liquibook::book::OrderBook<OrderPtr>
+{
+public:
+    LadderOrderBook(const std::string & symbol, const LadderSpec & spec);
+
+    const LadderSpec & spec() const { return spec_; }
+
+    virtual bool add(const OrderPtr& order,
+                     liquibook::book::OrderConditions conditions = 0);
+    virtual void cancel(const OrderPtr& order);
+    virtual bool replace(const OrderPtr& order,
+                         int32_t size_delta = liquibook::book::SIZE_UNCHANGED,
+                         liquibook::book::Price new_price = liquibook::book::PRICE_UNCHANGED);
+    virtual bool restore(const OrderPtr& order,
+                         liquibook::book::Quantity open_qty,
+                         liquibook::book::OrderConditions conditions,
+                         bool stopped);
+
+    /// @brief visit one side's resting orders in priority order
+    template <class Visit>
+    void forEach(bool isBuy, Visit visit) const
+    {
+        const std::vector<Level> & side = isBuy ? bidLevels_ : askLevels_;
+        int best = isBuy ? bestBid_ : bestAsk_;
+        if(best < 0)
+        {
+            return;
+        }
+        int step = isBuy ? -1 : 1;
+        for(int i = best; i >= 0 && i < int(side.size()); i += step)
+        {
+            const Level & level = side[i];
+            for(size_t j = level.head; j < level.queue.size(); ++j)
+            {
+                if(level.queue[j].ptr())
+                {
+                    visit(level.queue[j]);
+                }
+            }
+        }
+    }
+
+    /// @brief resting orders on both sides
+    size_t resting() const { return resting_; }
+
+private:
+    /// @brief orders at one price, oldest first from head.  Slots of
+    /// orders that have left hold a null order until compacted.
+    struct Level
+    {
+        std::vector<Tracker> queue;
+        size_t head;
+        size_t live;        // orders still resting
+        uint64_t base;      // handle slot of queue[0]
+
+        Level() : head(0), live(0), base(0) {}
+        bool empty() const { return live == 0; }
+    };
+
+    bool onLadder(liquibook::book::Price price) const;
+    int index(liquibook::book::Price price) const
+    {
+        return int((price - spec_.minPrice) / spec_.tick);
+    }
+
+    /// @brief match inbound against the other side, up to price
+    void match(Tracker & inbound, liquibook::book::Price price);
+    void rest(Tracker & inbound, liquibook::book::Price price);
+    Tracker * find(const OrderPtr & order);
+    /// @brief take a resting order off its level
+    bool unlink(const OrderPtr & order, Tracker & tracker);
+    /// @brief drop a filled or cancelled order's slot
+    void vacate(Level & level, Tracker & tracker);
+    void compact(Level & level);
+    void settle(std::vector<Level> & side, int pos);
+    void flush();
+
+    LadderSpec spec_;
+    std::vector<Level> bidLevels_;
+    std::vector<Level> askLevels_;
+    int bestBid_;       // -1: side empty
+    int bestAsk_;
+    size_t resting_;
+
+    Callbacks pending_;
+    Callbacks working_;
+    bool flushing_;
+};
+
+/// @brief visit one side's resting orders in priority order, in a
+/// ladder book or any other
+template <class Visit>
+void forEachResting(const liquibook::book::OrderBook<OrderPtr> & book,
+                    bool isBuy, Visit visit)
+{
+    const LadderOrderBook * ladder = dynamic_cast<const LadderOrderBook *>(&book);
+    if(ladder)
+    {
+        ladder->forEach(isBuy, visit);
+        return;
+    }
+    const liquibook::book::OrderBook<OrderPtr>::TrackerMap & side =
+        isBuy ? book.bids() : book.asks();
+    for(auto pos = side.begin(); pos != side.end(); ++pos)
+    {
+        visit(pos->second);
+    }
+}
+
+} // namespace orderentry
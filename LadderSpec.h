@@ -0,0 +1,37 @@
+#pragma once
+
+#include <book/types.h>
+
+#include <cstddef>
+
+namespace orderentry
+{
+
+/// @brief price range of a ladder book: every price from minPrice to
+/// maxPrice that is a whole number of ticks above minPrice
+struct LadderSpec
+{
+    liquibook::book::Price minPrice;
+    liquibook::book::Price maxPrice;
+    liquibook::book::Price tick;        // zero: not a ladder book
+
+    enum { MAX_LEVELS = 1 << 20 };
+
+    LadderSpec()
+    : minPrice(0)
+    , maxPrice(0)
+    , tick(0)
+    {
+    }
+
+    bool isLadder() const { return tick != 0; }
+    bool valid() const
+    {
+        return tick != 0 && minPrice != 0 && minPrice <= maxPrice &&
+            (maxPrice - minPrice) % tick == 0 &&
+            (maxPrice - minPrice) / tick < MAX_LEVELS;
+    }
+    size_t levels() const { return (maxPrice - minPrice) / tick + 1; }
+};
+
+} // namespace orderentry
@@ -3,76 +3,68 @@
 // See the file license.txt for licensing information.
 #include "Market.h"
 #include "Util.h"
+#include "Journal.h"
+#include "EventLog.h"
 
 #include <functional>
 #include <cctype>
 #include <locale>
+#include <time.h>
 
 namespace {
     ///////////////////////
-    // depth display helper
-    void displayDepthLevel(std::ostream & out, const liquibook::book::DepthLevel & level)
+    // depth log helper: one record per non-empty level just published
+    void logDepthLevels(EventLog & log, const orderentry::BookUpdate & update)
     {
-        out << "\tPrice "  <<  level.price();
-        out << " Count: " << level.order_count();
-        out << " Quantity: " << level.aggregate_qty();
-        if(level.is_excess())
+        for(unsigned int i = 0; i < update.nLevels; ++i)
         {
-            out << " EXCESS";
-        }
-        out << " Change id#: " << level.last_change();
-        out << std::endl;
-    }
-
-    void publishDepth(std::ostream & out, const orderentry::BookDepth & depth)
-    {
-        liquibook::book::ChangeId published = depth.last_published_change();
-        bool needTitle = true;
-        // Iterate awkwardly
-        auto pos = depth.bids();
-        auto back = depth.last_bid_level();
-        bool more = true;
-        while(more)
-        {
-            if(pos->aggregate_qty() !=0 && pos->last_change() > published)
+            const orderentry::BookLevelUpdate & lvl = update.levels[i];
+            if(lvl.qty != 0)
             {
-                if(needTitle)
+                EventRecord rec(EV_DEPTH_LEVEL);
+                if(lvl.buy)
                 {
-                    out << "\n\tBIDS:\n";
-                    needTitle = false;
+                    rec.flags |= EVF_BUY;
                 }
-                displayDepthLevel(out, *pos);
+                rec.price = lvl.price;
+                rec.arg1 = lvl.orders;
+                rec.arg2 = lvl.qty;
+                rec.arg3 = update.change;
+                log.push(rec);
             }
-            ++pos;
-            more = pos != back;
         }
+    }
 
-        needTitle = true;
-        pos = depth.asks();
-        back = depth.last_ask_level();
-        more = true;
-        while(more)
+    ///////////////////////
+    // an order's tracker on one side of a book, or null
+    const orderentry::OrderBook::Tracker * findTracker(
+        const orderentry::OrderBook::TrackerMap & side, bool isBuy,
+        liquibook::book::Price price, const orderentry::OrderPtr & order)
+    {
+        auto range = side.equal_range(
+            liquibook::book::ComparablePrice(isBuy, price));
+        for(auto pos = range.first; pos != range.second; ++pos)
         {
-            if(pos->aggregate_qty() !=0 && pos->last_change() > published)
+            if(pos->second.ptr() == order)
             {
-                if(needTitle)
-                {
-                    out << "\n\tASKS:\n";
-                    needTitle = false;
-                }
-                displayDepthLevel(out, *pos);
+                return &pos->second;
             }
-            ++pos;
-            more = pos != back;
         }
+        return nullptr;
     }
 }
 
 namespace orderentry
 {
 
-Market::Market(std::ostream * out)
-: logFile_(out)
+Market::Market()
+: journal_(nullptr)
+, eventLog_(nullptr)
+, execListener_(nullptr)
+, bookListener_(nullptr)
+, bookCache_(nullptr)
+, orderIdShard_(0)
+, orderSeq_(0)
 {
 }
 
@@ -81,20 +73,67 @@ Market::~Market()
 }
 
 void Market::orderSubmit(OrderBookPtr book, OrderPtr order,
-			 const std::string& orderId,
 			 liquibook::book::OrderConditions conditions)
 {
     order->genTimestamp();
+
+    if(journal_)
+    {
+        JournalRecord rec(JREC_ORDER_SUBMIT);
+        rec.tstamp = order->timestamp();
+        rec.orderId = order->order_id();
+        rec.alias = order->alias();
+        rec.symbol = order->symbol();
+        rec.flag = order->is_buy();
+        rec.qty = order->order_qty();
+        rec.price = order->price();
+        rec.stopPrice = order->stop_price();
+        rec.conditions = conditions;
+        journal_->append(rec);
+    }
+
+    submitOrder(book, order, conditions);
+}
+
+void Market::submitOrder(OrderBookPtr book, OrderPtr order,
+			 liquibook::book::OrderConditions conditions)
+{
     order->onSubmitted();
-    out() << "ADDING order:  " << *order << std::endl;
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_ORDER_ADDING);
+        rec.setOrder(*order);
+        eventLog_->push(rec);
+    }
 
-    orders_[orderId] = order;
+    indexOrder(order);
     book->add(order, conditions);
 }
 
+void Market::indexOrder(const OrderPtr & order)
+{
+    OrderId orderId = order->order_id();
+    orders_.insert(orderId, order);
+    if(!order->alias().empty())
+    {
+        aliases_[order->alias()] = orderId;
+    }
+
+    // never reissue an id seen in the journal or a snapshot
+    if(orderIdShard(orderId) == orderIdShard_)
+    {
+        resumeOrderSeq(orderIdSeq(orderId));
+    }
+}
+
+void Market::restoreOrder(const OrderPtr & order)
+{
+    indexOrder(order);
+}
+
 ///////////
 // CANCEL
-bool Market::orderCancel(const std::string & orderId)
+bool Market::orderCancel(OrderId orderId)
 {
     OrderPtr order;
     OrderBookPtr book;
@@ -103,14 +142,27 @@ bool Market::orderCancel(const std::string & orderId)
         return false;
     }
 
-    out() << "Requesting Cancel: " << *order << std::endl;
+    if(journal_)
+    {
+        JournalRecord rec(JREC_ORDER_CANCEL);
+        gettimeofday(&rec.tstamp, NULL);
+        rec.orderId = orderId;
+        journal_->append(rec);
+    }
+
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_CANCEL_REQUESTED);
+        rec.setOrder(*order);
+        eventLog_->push(rec);
+    }
     book->cancel(order);
     return true;
 }
 
 ///////////
 // MODIFY
-bool Market::orderModify(const std::string & orderId,
+bool Market::orderModify(OrderId orderId,
 			 int32_t quantityChange,
 			 liquibook::book::Price price)
 {
@@ -132,17 +184,25 @@ bool Market::orderModify(const std::string & orderId,
 			return false;
 	}
 
-    book->replace(order, quantityChange, price);
-    out() << "Requested Modify" ;
-    if(quantityChange != liquibook::book::SIZE_UNCHANGED)
+    if(journal_)
     {
-        out() << " QUANTITY  += " << quantityChange;
+        JournalRecord rec(JREC_ORDER_MODIFY);
+        gettimeofday(&rec.tstamp, NULL);
+        rec.orderId = orderId;
+        rec.qtyDelta = quantityChange;
+        rec.price = price;
+        journal_->append(rec);
     }
-    if(price != liquibook::book::PRICE_UNCHANGED)
+
+    book->replace(order, quantityChange, price);
+    if(logging(EVLOG_INFO))
     {
-        out() << " PRICE " << price;
+        EventRecord rec(EV_MODIFY_REQUESTED);
+        rec.setOrderId(orderId);
+        rec.delta = quantityChange;
+        rec.arg3 = price;
+        eventLog_->push(rec);
     }
-    out() << std::endl;
     return true;
 }
 
@@ -169,29 +229,162 @@ Market::symbolIsDefined(const std::string & symbol)
 }
 
 OrderBookPtr
-Market::addBook(const std::string & symbol, bool useDepthBook)
+Market::addBook(const std::string & symbol, unsigned int depthLevels,
+    const LadderSpec & ladder)
 {
+    if(journal_)
+    {
+        JournalRecord rec(JREC_ADD_BOOK);
+        gettimeofday(&rec.tstamp, NULL);
+        rec.symbol = symbol;
+        rec.flag = (depthLevels != 0);
+        rec.qty = depthLevels;
+        rec.ladder = ladder;
+        journal_->append(rec);
+    }
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_BOOK_ADDED);
+        rec.setSymbol(symbol);
+        if(depthLevels)
+        {
+            rec.flags |= EVF_DEPTH;
+        }
+        rec.arg1 = depthLevels;
+        eventLog_->push(rec);
+    }
+
+    // depth is published from the price levels every book keeps
     OrderBookPtr result;
-    if(useDepthBook)
+    if(ladder.isLadder())
     {
-        out() << "Create new depth order book for " << symbol << std::endl;
-        DepthOrderBookPtr depthBook = std::make_shared<DepthOrderBook>(symbol);
-        depthBook->set_bbo_listener(this);
-        depthBook->set_depth_listener(this);
-        result = depthBook;
+        result = std::make_shared<LadderOrderBook>(symbol, ladder);
     }
     else
     {
-        out() << "Create new order book for " << symbol << std::endl;
         result = std::make_shared<OrderBook>(symbol);
     }
+    if(depthLevels)
+    {
+        depths_.erase(result.get());
+        depths_.emplace(result.get(), BookDepth(depthLevels));
+    }
     result->set_order_listener(this);
     result->set_trade_listener(this);
     result->set_order_book_listener(this);
     books_[symbol] = result;
+    BookMetrics * & metrics = metrics_[symbol];
+    if(!metrics)
+    {
+        metrics = bookMetrics_.add(symbol);
+    }
+    metrics->resting.set(0);
+    PriceLevels & levels = levels_[symbol];
+    levels.clear();
+    levels.setMetrics(metrics);
+    if(bookCache_)
+    {
+        cacheEntries_[result.get()] = bookCache_->add(symbol);
+    }
     return result;
 }
 
+BookCache::Entry *
+Market::cacheEntry(const OrderBookPtr & book) const
+{
+    auto entry = cacheEntries_.find(book.get());
+    return entry == cacheEntries_.end() ? nullptr : entry->second;
+}
+
+const PriceLevels *
+Market::priceLevels(const OrderBookPtr & book) const
+{
+    auto levels = levels_.find(book->symbol());
+    return levels == levels_.end() ? nullptr : &levels->second;
+}
+
+const BookDepth *
+Market::depth(const OrderBookPtr & book) const
+{
+    auto depth = depths_.find(book.get());
+    return depth == depths_.end() ? nullptr : &depth->second;
+}
+
+PriceLevels *
+Market::levelsFor(const std::string & symbol)
+{
+    auto levels = levels_.find(symbol);
+    return levels == levels_.end() ? nullptr : &levels->second;
+}
+
+void
+Market::rebuildLevels(const OrderBookPtr & book)
+{
+    PriceLevels & levels = levels_[book->symbol()];
+    levels.clear();
+    for(int buy = 0; buy < 2; ++buy)
+    {
+        forEachResting(*book, buy != 0,
+            [&levels](const OrderBook::Tracker & tracker)
+            {
+                levels.add(tracker.ptr()->is_buy(), tracker.ptr()->price(),
+                           tracker.open_qty());
+            });
+    }
+    for(auto stop = book->stopBids().begin(); stop != book->stopBids().end(); ++stop)
+    {
+        levels.stopped().insert(stop->second.ptr());
+    }
+    for(auto stop = book->stopAsks().begin(); stop != book->stopAsks().end(); ++stop)
+    {
+        levels.stopped().insert(stop->second.ptr());
+    }
+    BookMetrics * metrics = levels.metrics();
+    if(metrics)
+    {
+        metrics->resting.set(levels.restingOrders());
+    }
+
+    // depth as restored; not published
+    auto depth = depths_.find(book.get());
+    if(depth != depths_.end())
+    {
+        std::vector<BookUpdate> updates;
+        depth->second.refresh(levels, updates);
+    }
+}
+
+// Stops leave the stop maps only when a trade triggers them; each
+// then rests on the book, or is gone, filled or unfilled IOC.  Its
+// fills were skipped, so index what remains, as the book has it.
+void
+Market::indexTriggered(const OrderBook * book, PriceLevels & levels)
+{
+    PriceLevels::OrderSet & stopped = levels.stopped();
+    if(stopped.size() == book->stopBids().size() + book->stopAsks().size())
+    {
+        return;
+    }
+    for(auto pos = stopped.begin(); pos != stopped.end(); )
+    {
+        const OrderPtr & order = *pos;
+        bool isBuy = order->is_buy();
+        if(findTracker(isBuy ? book->stopBids() : book->stopAsks(),
+                       isBuy, order->stop_price(), order))
+        {
+            ++pos;
+            continue;
+        }
+        const OrderBook::Tracker * tracker = findTracker(
+            isBuy ? book->bids() : book->asks(), isBuy, order->price(), order);
+        if(tracker)
+        {
+            levels.add(isBuy, order->price(), tracker->open_qty());
+        }
+        pos = stopped.erase(pos);
+    }
+}
+
 OrderBookPtr
 Market::findBook(const std::string & symbol)
 {
@@ -204,26 +397,143 @@ Market::findBook(const std::string & symbol)
     return result;
 }
 
-bool Market::findExistingOrder(const std::string & orderId, OrderPtr & order, OrderBookPtr & book)
+bool Market::findExistingOrder(OrderId orderId, OrderPtr & order, OrderBookPtr & book)
 {
-    auto orderPosition = orders_.find(orderId);
-    if(orderPosition == orders_.end())
+    OrderPtr * orderPosition = orders_.find(orderId);
+    if(!orderPosition)
     {
-        out() << "--Can't find OrderID #" << orderId << std::endl;
+        if(logging(EVLOG_WARN))
+        {
+            EventRecord rec(EV_ORDER_NOT_FOUND);
+            rec.setOrderId(orderId);
+            eventLog_->push(rec);
+        }
         return false;
     }
 
-    order = orderPosition->second;
+    order = *orderPosition;
     std::string symbol = order->symbol();
     book = findBook(symbol);
     if(!book)
     {
-        out() << "--No order book for symbol" << symbol << std::endl;
         return false;
     }
     return true;
 }
 
+bool Market::findOrder(OrderId orderId, OrderPtr & order)
+{
+    OrderPtr * orderPosition = orders_.find(orderId);
+    if(orderPosition)
+    {
+        order = *orderPosition;
+        return true;
+    }
+    return archive_.find(orderId, order);
+}
+
+bool Market::resolveOrderId(const std::string & str, OrderId & orderId)
+{
+    if(parseOrderId(str, orderId))
+    {
+        return true;
+    }
+
+    // compatibility mode: UUID issued at submit
+    auto alias = aliases_.find(str);
+    if(alias != aliases_.end())
+    {
+        orderId = alias->second;
+        return true;
+    }
+    return archive_.findAlias(str, orderId);
+}
+
+/////////////////////////////////////
+// Terminal order retention
+
+void
+Market::retireOrder(const OrderPtr & order)
+{
+    if(orders_.erase(order->order_id()))
+    {
+        if(!order->alias().empty())
+        {
+            aliases_.erase(order->alias());
+        }
+        archive_.add(order, time(NULL));
+    }
+}
+
+size_t
+Market::liveIndexBytes() const
+{
+    return orders_.memUsage() + aliasMapBytes(aliases_);
+}
+
+/////////////////////////////////////
+// Journal recovery
+
+void
+Market::replay(const JournalRecord & rec)
+{
+    // journal_ is not attached yet, so nothing here is re-journaled
+    switch(rec.type)
+    {
+    case JREC_ADD_BOOK:
+        addBook(rec.symbol, rec.qty, rec.ladder);
+        break;
+
+    case JREC_ORDER_SUBMIT:
+    {
+        OrderBookPtr book = findBook(rec.symbol);
+        if(!book)
+        {
+            break;
+        }
+        OrderPtr order(new Order(rec.orderId, rec.flag,
+            rec.qty, rec.symbol, rec.price, rec.stopPrice,
+            (rec.conditions & liquibook::book::oc_all_or_none) != 0,
+            (rec.conditions & liquibook::book::oc_immediate_or_cancel) != 0));
+        order->setTimestamp(rec.tstamp);
+        order->setAlias(rec.alias);
+        submitOrder(book, order, rec.conditions);
+        break;
+    }
+
+    case JREC_ORDER_CANCEL:
+        orderCancel(rec.orderId);
+        break;
+
+    case JREC_ORDER_MODIFY:
+        orderModify(rec.orderId, rec.qtyDelta, rec.price);
+        break;
+
+    default:
+        break;
+    }
+}
+
+void
+Market::reportExec(const OrderPtr & order, ExecType type,
+    liquibook::book::Quantity qty, liquibook::book::Price price)
+{
+    if(!execListener_ || !order->session())
+    {
+        return;
+    }
+
+    ExecReport report;
+    report.session = order->session();
+    report.type = type;
+    report.orderId = order->order_id();
+    report.qty = qty;
+    report.price = price;
+    report.leaves = order->quantityOnMarket();
+    report.filled = order->quantityFilled();
+    execListener_->on_exec(report);
+}
+
 /////////////////////////////////////
 // Implement OrderListener interface
 
@@ -231,15 +541,58 @@ void
 Market::on_accept(const OrderPtr& order)
 {
     order->onAccepted();
-    out() << "\tEvent:Accepted: " <<*order<< std::endl;
+
+    // on the book at full size; fills that follow reduce it
+    PriceLevels * levels = levelsFor(order->symbol());
+    if(levels)
+    {
+        OrderBookPtr book;
+        bool isBuy = order->is_buy();
+        if(order->stop_price() != 0 && (book = findBook(order->symbol())) &&
+           findTracker(isBuy ? book->stopBids() : book->stopAsks(),
+                       isBuy, order->stop_price(), order))
+        {
+            levels->stopped().insert(order);
+        }
+        else
+        {
+            levels->add(isBuy, order->price(), order->order_qty());
+        }
+    }
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->accepts.inc();
+    }
+
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_ACCEPTED);
+        rec.setOrder(*order);
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_ACCEPTED);
 }
 
 void
 Market::on_reject(const OrderPtr& order, const char* reason)
 {
     order->onRejected(reason);
-    out() << "\tEvent:Rejected: " <<*order<< ' ' << reason << std::endl;
-
+    PriceLevels * levels = levelsFor(order->symbol());
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->rejects.inc();
+    }
+    if(logging(EVLOG_WARN))
+    {
+        EventRecord rec(EV_REJECTED);
+        rec.setOrder(*order);
+        rec.reason = reason;
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_REJECTED);
+    retireOrder(order);
 }
 
 void
@@ -250,47 +603,139 @@ Market::on_fill(const OrderPtr& order,
 {
     order->onFilled(fill_qty, fill_cost);
     matched_order->onFilled(fill_qty, fill_cost);
-    out() << (order->is_buy() ? "\tEvent:Fill-Bought: " : "\tEvent:Fill-Sold: ")
-        << fill_qty << " Shares for " << fill_cost << ' ' <<*order<< std::endl;
-    out() << (matched_order->is_buy() ? "\tBought: " : "\tSold: ")
-        << fill_qty << " Shares for " << fill_cost << ' ' << *matched_order << std::endl;
+
+    PriceLevels * levels = levelsFor(order->symbol());
+    if(levels)
+    {
+        if(!levels->isStopped(order))
+        {
+            levels->reduce(order->is_buy(), order->price(), fill_qty,
+                           order->quantityOnMarket() == 0);
+        }
+        if(!levels->isStopped(matched_order))
+        {
+            levels->reduce(matched_order->is_buy(), matched_order->price(),
+                           fill_qty, matched_order->quantityOnMarket() == 0);
+        }
+    }
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->fills.inc();
+    }
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_FILL);
+        rec.setOrder(*order);
+        rec.arg1 = fill_qty;
+        rec.arg2 = fill_cost;
+        eventLog_->push(rec);
+
+        EventRecord matched(EV_FILL_MATCHED);
+        matched.setOrder(*matched_order);
+        matched.arg1 = fill_qty;
+        matched.arg2 = fill_cost;
+        eventLog_->push(matched);
+    }
+    liquibook::book::Price fill_price = fill_qty ? (fill_cost / fill_qty) : 0;
+    reportExec(order, EXEC_FILL, fill_qty, fill_price);
+    reportExec(matched_order, EXEC_FILL, fill_qty, fill_price);
+
+    if(order->quantityOnMarket() == 0)
+    {
+        retireOrder(order);
+    }
+    if(matched_order->quantityOnMarket() == 0)
+    {
+        retireOrder(matched_order);
+    }
 }
 
 void
 Market::on_cancel(const OrderPtr& order)
 {
+    // zero if a replace already took it off the book
+    liquibook::book::Quantity open = order->quantityOnMarket();
+    PriceLevels * levels = levelsFor(order->symbol());
+    if(levels && open != 0 && !levels->isStopped(order))
+    {
+        levels->reduce(order->is_buy(), order->price(), open, true);
+    }
+
     order->onCancelled();
-    out() << "\tEvent:Canceled: " << *order<< std::endl;
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->cancels.inc();
+    }
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_CANCELLED);
+        rec.setOrder(*order);
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_CANCELLED);
+    retireOrder(order);
 }
 
 void Market::on_cancel_reject(const OrderPtr& order, const char* reason)
 {
     order->onCancelRejected(reason);
-    out() << "\tEvent:Cancel Reject: " <<*order<< ' ' << reason << std::endl;
+    if(logging(EVLOG_WARN))
+    {
+        EventRecord rec(EV_CANCEL_REJECTED);
+        rec.setOrder(*order);
+        rec.reason = reason;
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_CANCEL_REJECTED);
 }
 
 void Market::on_replace(const OrderPtr& order,
     const int32_t& size_delta,
     liquibook::book::Price new_price)
 {
+    PriceLevels * levels = levelsFor(order->symbol());
+    if(levels)
+    {
+        levels->reduce(order->is_buy(), order->price(),
+                       order->quantityOnMarket(), true);
+    }
+
     order->onReplaced(size_delta, new_price);
-    out() << "\tEvent:Modify " ;
-    if(size_delta != liquibook::book::SIZE_UNCHANGED)
+
+    if(levels && order->quantityOnMarket() != 0)
     {
-        out() << " QUANTITY  += " << size_delta;
+        levels->add(order->is_buy(), order->price(), order->quantityOnMarket());
     }
-    if(new_price != liquibook::book::PRICE_UNCHANGED)
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
     {
-        out() << " PRICE " << new_price;
+        metrics->replaces.inc();
     }
-    out() <<*order<< std::endl;
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_REPLACED);
+        rec.setOrder(*order);
+        rec.delta = size_delta;
+        rec.arg3 = new_price;
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_REPLACED, order->order_qty(), order->price());
 }
 
 void
 Market::on_replace_reject(const OrderPtr& order, const char* reason)
 {
     order->onReplaceRejected(reason);
-    out() << "\tEvent:Replace Reject: " <<*order<< ' ' << reason << std::endl;
+    if(logging(EVLOG_WARN))
+    {
+        EventRecord rec(EV_REPLACE_REJECTED);
+        rec.setOrder(*order);
+        rec.reason = reason;
+        eventLog_->push(rec);
+    }
+    reportExec(order, EXEC_REPLACE_REJECTED);
 }
 
 ////////////////////////////////////
@@ -301,7 +746,29 @@ Market::on_trade(const OrderBook* book,
     liquibook::book::Quantity qty,
     liquibook::book::Cost cost)
 {
-    out() << "\tEvent:Trade: " << qty <<  ' ' << book->symbol() << " Cost "  << cost  << std::endl;
+    PriceLevels * levels = levelsFor(book->symbol());
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->trades.inc();
+    }
+    if(logging(EVLOG_INFO))
+    {
+        EventRecord rec(EV_TRADE);
+        rec.setSymbol(book->symbol());
+        rec.arg1 = qty;
+        rec.arg2 = cost;
+        eventLog_->push(rec);
+    }
+    if(bookListener_)
+    {
+        BookUpdate update;
+        update.type = BOOK_UPD_TRADE;
+        update.setSymbol(book->symbol());
+        update.qty = qty;
+        update.price = qty ? cost / qty : 0;
+        bookListener_->on_book_update(update);
+    }
 }
 
 /////////////////////////////////////////
@@ -310,35 +777,88 @@ Market::on_trade(const OrderBook* book,
 void
 Market::on_order_book_change(const OrderBook* book)
 {
-    out() << "\tEvent:Book Change: " << ' ' << book->symbol() << std::endl;
+    // invalidate cached replies
+    auto entry = cacheEntries_.find(book);
+    if(entry != cacheEntries_.end())
+    {
+        entry->second->bump();
+    }
+
+    PriceLevels * levels = levelsFor(book->symbol());
+    if(levels && !levels->stopped().empty())
+    {
+        indexTriggered(book, *levels);
+    }
+    BookMetrics * metrics = levels ? levels->metrics() : nullptr;
+    if(metrics)
+    {
+        metrics->resting.set(levels->restingOrders());
+    }
+
+    auto depth = depths_.find(book);
+    if(levels && depth != depths_.end())
+    {
+        publishDepth(book, depth->second, *levels);
+    }
+
+    if(logging(EVLOG_DEBUG))
+    {
+        EventRecord rec(EV_BOOK_CHANGE);
+        rec.setSymbol(book->symbol());
+        eventLog_->push(rec);
+    }
 }
 
 
 
 /////////////////////////////////////////
-// Implement BboListener interface
+// Depth
+
 void
-Market::on_bbo_change(const DepthOrderBook * book, const BookDepth * depth)
+Market::publishDepth(const OrderBook * book, BookDepth & depth,
+    const PriceLevels & levels)
 {
-    out() << "\tEvent:BBO Change: " << ' ' << book->symbol()
-        << (depth->changed() ? " Changed" : " Unchanged")
-        << " Change Id: " << depth->last_change()
-        << " Published: " << depth->last_published_change()
-        << std::endl;
-
-}
+    std::vector<BookUpdate> & updates = depthUpdates_;
+    updates.clear();
+    if(!depth.refresh(levels, updates))
+    {
+        return;
+    }
 
-/////////////////////////////////////////
-// Implement DepthListener interface
-void
-Market::on_depth_change(const DepthOrderBook * book, const BookDepth * depth)
-{
-    out() << "\tEvent:Depth Change: " << ' ' << book->symbol();
-    out() << (depth->changed() ? " Changed" : " Unchanged")
-        << " Change Id: " << depth->last_change()
-        << " Published: " << depth->last_published_change();
-    publishDepth(out(), *depth);
-    out() << std::endl;
+    if(logging(EVLOG_DEBUG))
+    {
+        bool bbo = false;
+        for(size_t u = 0; u < updates.size(); ++u)
+        {
+            for(unsigned int i = 0; i < updates[u].nLevels; ++i)
+            {
+                bbo |= (updates[u].levels[i].level == 0);
+            }
+        }
+        EventRecord rec(bbo ? EV_BBO_CHANGE : EV_DEPTH_CHANGE);
+        rec.setSymbol(book->symbol());
+        rec.flags |= EVF_CHANGED;
+        rec.arg1 = depth.last_change();
+        rec.arg2 = depth.last_change() - 1;
+        eventLog_->push(rec);
+        if(bbo)
+        {
+            rec.type = EV_DEPTH_CHANGE;
+            eventLog_->push(rec);
+        }
+        for(size_t u = 0; u < updates.size(); ++u)
+        {
+            logDepthLevels(*eventLog_, updates[u]);
+        }
+    }
+    if(bookListener_)
+    {
+        for(size_t u = 0; u < updates.size(); ++u)
+        {
+            updates[u].setSymbol(book->symbol());
+            bookListener_->on_book_update(updates[u]);
+        }
+    }
 }
 
 }  // namespace orderentry
@@ -3,7 +3,7 @@
 // See the file license.txt for licensing information.
 #pragma once
 
-#include <book/depth_order_book.h>
+#include <book/order_book.h>
 
 #include "Order.h"
 
@@ -12,27 +12,39 @@
 #include <iostream>
 #include <algorithm>
 #include <map>
+#include <unordered_map>
 #include <memory>
 
+#include "EventLog.h"
+#include "ExecReport.h"
+#include "BookUpdate.h"
+#include "BookCache.h"
+#include "PriceLevels.h"
+#include "BookDepth.h"
+#include "LadderOrderBook.h"
+#include "OrderArchive.h"
+#include "OrderIndex.h"
+#include "Metrics.h"
+
+class Journal;
+struct JournalRecord;
+
 namespace orderentry
 {
 typedef liquibook::book::OrderBook<OrderPtr> OrderBook;
 typedef std::shared_ptr<OrderBook> OrderBookPtr;
-typedef liquibook::book::DepthOrderBook<OrderPtr> DepthOrderBook;
-typedef std::shared_ptr<DepthOrderBook> DepthOrderBookPtr;
-typedef liquibook::book::Depth<> BookDepth;
 
 class Market 
     : public liquibook::book::OrderListener<OrderPtr>
     , public liquibook::book::TradeListener<OrderBook>
     , public liquibook::book::OrderBookListener<OrderBook>
-    , public liquibook::book::BboListener<DepthOrderBook>
-    , public liquibook::book::DepthListener<DepthOrderBook>
 {
-    typedef std::map<std::string, OrderPtr> OrderMap;
+public:
+    typedef OrderIndex OrderMap;
     typedef std::map<std::string, OrderBookPtr> SymbolToBookMap;
+
 public:
-    Market(std::ostream * logFile = &std::cout);
+    Market();
     ~Market();
 
 public:
@@ -90,39 +102,147 @@ public:
     /// @brief callback for change anywhere in order book
     virtual void on_order_book_change(const OrderBook* book);
 
-    /////////////////////////////////////////
-    // Implement BboListener interface
-    void on_bbo_change(const DepthOrderBook * book, const BookDepth * depth);
-
-    /////////////////////////////////////////
-    // Implement DepthListener interface
-    void on_depth_change(const DepthOrderBook * book, const BookDepth * depth);
-
 public:
     ////////////////////////
     // Order book interactions
     bool symbolIsDefined(const std::string & symbol);
-    bool orderModify(const std::string & orderId,
+    bool orderModify(OrderId orderId,
                      int32_t quantityChange = liquibook::book::SIZE_UNCHANGED,
                      liquibook::book::Price price = liquibook::book::PRICE_UNCHANGED);
-    bool orderCancel(const std::string & orderId);
+    bool orderCancel(OrderId orderId);
     void orderSubmit(OrderBookPtr book, OrderPtr order,
-		     const std::string& orderId,
 		     liquibook::book::OrderConditions conditions);
     OrderBookPtr findBook(const std::string & symbol);
-    OrderBookPtr addBook(const std::string & symbol, bool useDepthBook);
+    /// @param depthLevels levels per side published; 0 for none
+    /// @param ladder price range of a ladder book, if one
+    OrderBookPtr addBook(const std::string & symbol, unsigned int depthLevels,
+                         const LadderSpec & ladder = LadderSpec());
     void getSymbols(std::vector<std::string> & symbols);
-    bool findExistingOrder(const std::string & orderId, OrderPtr & order, OrderBookPtr & book);
+    bool findExistingOrder(OrderId orderId, OrderPtr & order, OrderBookPtr & book);
+
+    /// @brief find a live or archived order
+    bool findOrder(OrderId orderId, OrderPtr & order);
+
+    ////////////////////////
+    // Order ids
+    /// @brief assign the next engine order id
+    OrderId nextOrderId() { return makeOrderId(orderIdShard_, ++orderSeq_); }
+
+    /// @brief shard prefix placed in the top bits of new ids
+    void setOrderIdShard(unsigned int shard) { orderIdShard_ = shard; }
+
+    uint64_t lastOrderSeq() const { return orderSeq_; }
+    void resumeOrderSeq(uint64_t seq) { if (seq > orderSeq_) orderSeq_ = seq; }
+
+    /// @brief map an API order id (decimal, or UUID alias) to an engine id
+    bool resolveOrderId(const std::string & str, OrderId & orderId);
+
+    ////////////////////////
+    // Terminal order retention
+    OrderArchive & archive() { return archive_; }
+    const OrderArchive & archive() const { return archive_; }
+
+    /// @brief approximate size of the live order index, excluding orders
+    size_t liveIndexBytes() const;
+
+    ////////////////////////
+    // Journal
+    /// @brief record every inbound command to journal (null to disable).
+    /// Commands are applied even if their record is lost; the owner
+    /// learns of it from Journal::commit, and must then stop.
+    void setJournal(Journal * journal) { journal_ = journal; }
+
+    /// @brief re-apply a journaled command, during recovery
+    void replay(const JournalRecord & rec);
+
+    ////////////////////////
+    // Snapshot access
+    const OrderMap & orders() const { return orders_; }
+    const SymbolToBookMap & books() const { return books_; }
+    void restoreOrder(const OrderPtr & order);
 
-    std::ostream & out() 
+    ////////////////////////
+    // Event logging
+    /// @brief send event records to log (null to disable)
+    void setEventLog(EventLog * eventLog) { eventLog_ = eventLog; }
+
+    ////////////////////////
+    // Execution reports
+    /// @brief receive events for session-owned orders (null to disable)
+    void setExecListener(ExecListener * listener) { execListener_ = listener; }
+
+    ////////////////////////
+    // Market data
+    /// @brief receive trades, and depth changes of depth books
+    /// (null to disable)
+    void setBookUpdateListener(BookUpdateListener * listener) { bookListener_ = listener; }
+
+    ////////////////////////
+    // Reply cache
+    /// @brief version books in cache; before any book is added
+    void setBookCache(BookCache * cache) { bookCache_ = cache; }
+    /// @brief book's cache entry, or null if not cached
+    BookCache::Entry * cacheEntry(const OrderBookPtr & book) const;
+
+    ////////////////////////
+    // Price levels
+    /// @brief book's price-level index, or null if no such book
+    const PriceLevels * priceLevels(const OrderBookPtr & book) const;
+    /// @brief re-index a book's orders, after a snapshot restore
+    void rebuildLevels(const OrderBookPtr & book);
+
+    ////////////////////////
+    // Depth
+    /// @brief book's published depth, or null if not a depth book
+    const BookDepth * depth(const OrderBookPtr & book) const;
+
+    ////////////////////////
+    // Metrics
+    /// @brief per-book event counters; readable from any thread
+    const BookMetricsList & bookMetrics() const { return bookMetrics_; }
+
+private:
+    bool logging(EventLogLevel level) const
     {
-        return *logFile_;
+        return eventLog_ && eventLog_->enabled(level);
     }
-private:
-    std::ostream * logFile_;
+
+    void submitOrder(OrderBookPtr book, OrderPtr order,
+                     liquibook::book::OrderConditions conditions);
+    void indexOrder(const OrderPtr & order);
+
+    PriceLevels * levelsFor(const std::string & symbol);
+    /// @brief index stop orders the last command triggered onto the book
+    void indexTriggered(const OrderBook * book, PriceLevels & levels);
+    void publishDepth(const OrderBook * book, BookDepth & depth,
+                      const PriceLevels & levels);
+
+    void reportExec(const OrderPtr & order, ExecType type,
+                    liquibook::book::Quantity qty = 0,
+                    liquibook::book::Price price = 0);
+
+    /// @brief move a filled, cancelled or rejected order to the archive
+    void retireOrder(const OrderPtr & order);
+
+    Journal * journal_;
+    EventLog * eventLog_;
+    ExecListener * execListener_;
+    BookUpdateListener * bookListener_;
+    BookCache * bookCache_;
+    std::unordered_map<const OrderBook *, BookCache::Entry *> cacheEntries_;
+
+    unsigned int orderIdShard_;
+    uint64_t orderSeq_;
 
     OrderMap orders_;
+    AliasMap aliases_;
+    OrderArchive archive_;
     SymbolToBookMap books_;
+    std::unordered_map<std::string, PriceLevels> levels_;
+    std::unordered_map<const OrderBook *, BookDepth> depths_;
+    std::vector<BookUpdate> depthUpdates_;  // publishDepth's records
+    BookMetricsList bookMetrics_;
+    std::unordered_map<std::string, BookMetrics *> metrics_;
 
 };
 
@@ -0,0 +1,188 @@
+#ifndef __MDPROTO_H__
+#define __MDPROTO_H__
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "BinProto.h"
+
+// Market-data feed protocol: sequenced packets over UDP multicast,
+// with a TCP service for snapshots and retransmission.
+//
+// Every multicast packet is a 16-byte little-endian header -- u32
+// session, u64 sequence number of the first message, u16 message
+// count, u16 reserved -- followed by that many messages.  Each message
+// consumes one sequence number, and begins with a 4-byte header: u16
+// total length (header included), u8 type, u8 flags.  A packet with
+// no messages is a heartbeat, carrying the next sequence number, so
+// that receivers see a gap even when the feed goes quiet.  The session
+// changes when the server restarts; sequence numbers begin again at 1.
+//
+// Depth messages give the new content of one depth slot, by position;
+// a slot with zero quantity is empty.  MD_F_LAST marks the final slot
+// of one book change: a receiver's book is consistent after it.
+//
+// On TCP, the client sends requests and the server replies with
+// frames: a u32 frame length (itself excluded), then a packet as on
+// multicast.  A snapshot is a series of frames holding every non-empty
+// depth slot of every depth book, unsequenced, ending with a
+// MD_SNAPSHOT_END message.  All snapshot frames carry the first
+// sequence number not reflected in the snapshot.  A retransmission is
+// one frame, holding as many of the requested messages as are still
+// retained; a count of zero means the range is gone, and the client
+// must take a snapshot.
+
+enum {
+	MD_PKT_HDR_SIZE		= 16,
+	MD_MSG_HDR_SIZE		= 4,
+	MD_MAX_PACKET		= 1400,		// fits an Ethernet MTU
+	MD_MAX_MSG		= 64,
+	MD_MAX_FRAME		= 65536,
+	MD_MAX_RETRANS		= 1000,		// messages per request
+	MD_SYMBOL_SIZE		= BIN_SYMBOL_SIZE,
+
+	// feed messages
+	MD_DEPTH		= 'D',
+	MD_TRADE		= 'T',
+	MD_SNAPSHOT_END		= 'E',
+
+	// TCP requests
+	MD_SNAPSHOT_REQ		= 'S',
+	MD_RETRANS_REQ		= 'R',
+
+	// message sizes, header included
+	MD_DEPTH_SIZE		= MD_MSG_HDR_SIZE + MD_SYMBOL_SIZE + 4 + 4 + 12,
+	MD_TRADE_SIZE		= MD_MSG_HDR_SIZE + MD_SYMBOL_SIZE + 8,
+	MD_SNAPSHOT_END_SIZE	= MD_MSG_HDR_SIZE + 8,
+	MD_SNAPSHOT_REQ_SIZE	= MD_MSG_HDR_SIZE,
+	MD_RETRANS_REQ_SIZE	= MD_MSG_HDR_SIZE + 8 + 4,
+
+	// message flags
+	MD_F_BUY		= (1U << 0),	// depth: bid side
+	MD_F_LAST		= (1U << 1),	// depth: end of book change
+};
+
+static inline void mdPutMsgHdr(unsigned char *p, uint16_t len,
+			       uint8_t type, uint8_t flags)
+{
+	binPutU16(p, len);
+	p[2] = type;
+	p[3] = flags;
+}
+
+struct MdPacketHdr {
+	uint32_t		session;
+	uint64_t		seq;
+	uint16_t		count;
+
+	void encode(unsigned char *p) const {
+		binPutU32(p, session);
+		binPutU64(p + 4, seq);
+		binPutU16(p + 12, count);
+		binPutU16(p + 14, 0);
+	}
+	void decode(const unsigned char *p) {
+		session = binGetU32(p);
+		seq = binGetU64(p + 4);
+		count = binGetU16(p + 12);
+	}
+};
+
+//
+// Messages, in host form.  encode() writes exactly SIZE bytes,
+// header included; decode() expects a complete message of that size.
+//
+
+struct MdDepth {
+	enum { TYPE = MD_DEPTH, SIZE = MD_DEPTH_SIZE };
+
+	uint8_t			flags;		// MD_F_xxx
+	std::string		symbol;
+	uint32_t		change;		// book's change id
+	uint8_t			level;		// 0: best
+	uint32_t		price;
+	uint32_t		qty;		// 0: slot empty
+	uint32_t		orders;
+
+	void encode(unsigned char *p) const {
+		mdPutMsgHdr(p, SIZE, TYPE, flags);
+		binPutStr(p + 4, MD_SYMBOL_SIZE, symbol);
+		binPutU32(p + 20, change);
+		binPutU32(p + 24, level);
+		binPutU32(p + 28, price);
+		binPutU32(p + 32, qty);
+		binPutU32(p + 36, orders);
+	}
+	void decode(const unsigned char *p) {
+		flags = p[3];
+		symbol = binGetStr(p + 4, MD_SYMBOL_SIZE);
+		change = binGetU32(p + 20);
+		level = (uint8_t) binGetU32(p + 24);
+		price = binGetU32(p + 28);
+		qty = binGetU32(p + 32);
+		orders = binGetU32(p + 36);
+	}
+};
+
+struct MdTrade {
+	enum { TYPE = MD_TRADE, SIZE = MD_TRADE_SIZE };
+
+	std::string		symbol;
+	uint32_t		price;
+	uint32_t		qty;
+
+	void encode(unsigned char *p) const {
+		mdPutMsgHdr(p, SIZE, TYPE, 0);
+		binPutStr(p + 4, MD_SYMBOL_SIZE, symbol);
+		binPutU32(p + 20, price);
+		binPutU32(p + 24, qty);
+	}
+	void decode(const unsigned char *p) {
+		symbol = binGetStr(p + 4, MD_SYMBOL_SIZE);
+		price = binGetU32(p + 20);
+		qty = binGetU32(p + 24);
+	}
+};
+
+struct MdSnapshotEnd {
+	enum { TYPE = MD_SNAPSHOT_END, SIZE = MD_SNAPSHOT_END_SIZE };
+
+	uint64_t		nextSeq;
+
+	void encode(unsigned char *p) const {
+		mdPutMsgHdr(p, SIZE, TYPE, 0);
+		binPutU64(p + 4, nextSeq);
+	}
+	void decode(const unsigned char *p) {
+		nextSeq = binGetU64(p + 4);
+	}
+};
+
+struct MdSnapshotReq {
+	enum { TYPE = MD_SNAPSHOT_REQ, SIZE = MD_SNAPSHOT_REQ_SIZE };
+
+	void encode(unsigned char *p) const {
+		mdPutMsgHdr(p, SIZE, TYPE, 0);
+	}
+	void decode(const unsigned char *p) {
+	}
+};
+
+struct MdRetransReq {
+	enum { TYPE = MD_RETRANS_REQ, SIZE = MD_RETRANS_REQ_SIZE };
+
+	uint64_t		seq;
+	uint32_t		count;
+
+	void encode(unsigned char *p) const {
+		mdPutMsgHdr(p, SIZE, TYPE, 0);
+		binPutU64(p + 4, seq);
+		binPutU32(p + 12, count);
+	}
+	void decode(const unsigned char *p) {
+		seq = binGetU64(p + 4);
+		count = binGetU32(p + 12);
+	}
+};
+
+#endif // __MDPROTO_H__
@@ -0,0 +1,461 @@
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <event2/buffer.h>
+#include "MdPublisher.h"
+
+using namespace std;
+using namespace orderentry;
+
+enum {
+	LISTEN_BACKLOG		= 1024,
+	HEARTBEAT_SECS		= 1,
+};
+
+MdPublisher::MdPublisher(struct event_base *base, size_t queueSize,
+			 size_t retain)
+	: base_(base), session_((uint32_t) time(NULL)), nextSeq_(1),
+	  fd_(-1), pktLen_(MD_PKT_HDR_SIZE), pktCount_(0), pktSeq_(1),
+	  sent_(false), retained_(retain ? retain : 1), listener_(NULL),
+	  ring_(queueSize), ev_(NULL), hbEv_(NULL), signaled_(false),
+	  nPackets_(0), nSnapshots_(0), nRetrans_(0)
+{
+	memset(&group_, 0, sizeof(group_));
+
+	int rc = pipe2(fds_, O_NONBLOCK | O_CLOEXEC);
+	assert(rc == 0);
+
+	ev_ = event_new(base, fds_[0], EV_READ | EV_PERSIST, wakeCb, this);
+	event_add(ev_, NULL);
+
+	struct timeval hbTv = { HEARTBEAT_SECS, 0 };
+	hbEv_ = event_new(base, -1, EV_PERSIST, heartbeatCb, this);
+	event_add(hbEv_, &hbTv);
+}
+
+MdPublisher::~MdPublisher()
+{
+	if (listener_)
+		evconnlistener_free(listener_);
+
+	for (auto it = sessions_.begin(); it != sessions_.end(); ++it) {
+		bufferevent_free((*it)->bev);
+		delete *it;
+	}
+
+	event_free(hbEv_);
+	event_free(ev_);
+	close(fds_[0]);
+	close(fds_[1]);
+	if (fd_ >= 0)
+		close(fd_);
+}
+
+bool MdPublisher::open(const std::string& group, unsigned int port,
+		       const std::string& iface, unsigned int ttl)
+{
+	group_.sin_family = AF_INET;
+	group_.sin_port = htons(port);
+	if (inet_pton(AF_INET, group.c_str(), &group_.sin_addr) != 1 ||
+	    !IN_MULTICAST(ntohl(group_.sin_addr.s_addr)))
+		return false;
+
+	fd_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd_ < 0)
+		return false;
+
+	// loopback on, so that receivers on this host see the feed
+	unsigned char ttlOpt = (unsigned char) ttl;
+	unsigned char loop = 1;
+	if (setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_TTL,
+		       &ttlOpt, sizeof(ttlOpt)) < 0 ||
+	    setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_LOOP,
+		       &loop, sizeof(loop)) < 0)
+		return false;
+
+	if (!iface.empty()) {
+		struct in_addr ifAddr;
+		if (inet_pton(AF_INET, iface.c_str(), &ifAddr) != 1 ||
+		    setsockopt(fd_, IPPROTO_IP, IP_MULTICAST_IF,
+			       &ifAddr, sizeof(ifAddr)) < 0)
+			return false;
+	}
+
+	return true;
+}
+
+bool MdPublisher::listen(const std::string& addr, unsigned int port)
+{
+	struct sockaddr_storage ss;
+	int sslen = sizeof(ss);
+	string addrPort = addr + ":" + to_string(port);
+	if (evutil_parse_sockaddr_port(addrPort.c_str(),
+				       (struct sockaddr *) &ss, &sslen) < 0)
+		return false;
+
+	listener_ = evconnlistener_new_bind(base_, acceptCb, this,
+		LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, LISTEN_BACKLOG,
+		(struct sockaddr *) &ss, sslen);
+	return listener_ != NULL;
+}
+
+// shards are idle, so their books may be read from this thread
+void MdPublisher::seed(Engine& engine)
+{
+	for (size_t i = 0; i < engine.shardCount(); i++) {
+		const Market::SymbolToBookMap& books =
+			engine.shard(i).market().books();
+		for (auto it = books.begin(); it != books.end(); ++it) {
+			const BookDepth *depth =
+				engine.shard(i).market().depth(it->second);
+			if (!depth)
+				continue;
+
+			Book& book = books_[it->first];
+			book.change = depth->last_change();
+			for (unsigned int j = 0; j < depth->size() * 2; j++) {
+				bool buy = j < depth->size();
+				unsigned int level = j % depth->size();
+				const DepthSlot *pos = depth->bids() + j;
+				BookLevelUpdate& slot = book.slot(buy, level);
+				slot.buy = buy;
+				slot.level = level;
+				slot.price = pos->price;
+				slot.qty = pos->qty;
+				slot.orders = pos->orders;
+			}
+		}
+	}
+}
+
+// the feed is sequenced: nothing may be dropped, so a full queue
+// holds up the shard until this loop catches up
+void MdPublisher::post(const std::vector<BookUpdate>& updates)
+{
+	for (size_t i = 0; i < updates.size(); i++)
+		while (!ring_.push(updates[i]))
+			std::this_thread::yield();
+
+	if (!signaled_.exchange(true)) {
+		char ch = 0;
+		ssize_t rc = write(fds_[1], &ch, 1);
+		(void) rc;
+	}
+}
+
+void MdPublisher::wakeCb(evutil_socket_t fd, short events, void *arg)
+{
+	MdPublisher *pub = (MdPublisher *) arg;
+
+	char buf[64];
+	while (read(fd, buf, sizeof(buf)) > 0)
+		;
+
+	// clear before draining; a post racing with us re-signals
+	pub->signaled_ = false;
+	pub->deliver();
+}
+
+// sequence everything queued, then send what remains in the packet
+void MdPublisher::deliver()
+{
+	BookUpdate upd;
+	while (ring_.pop(upd))
+		apply(upd);
+
+	flush();
+}
+
+void MdPublisher::apply(const BookUpdate& upd)
+{
+	unsigned char msg[MD_MAX_MSG];
+
+	if (upd.type == BOOK_UPD_TRADE) {
+		MdTrade trade;
+		trade.symbol = upd.symbol;
+		trade.price = upd.price;
+		trade.qty = upd.qty;
+		trade.encode(msg);
+		append(msg, MdTrade::SIZE);
+		return;
+	}
+
+	Book& book = books_[upd.symbol];
+	book.change = upd.change;
+
+	MdDepth depth;
+	depth.symbol = upd.symbol;
+	depth.change = upd.change;
+	for (unsigned int i = 0; i < upd.nLevels; i++) {
+		const BookLevelUpdate& lvl = upd.levels[i];
+		book.slot(lvl.buy, lvl.level) = lvl;
+
+		depth.flags = (lvl.buy ? MD_F_BUY : 0) |
+			      ((!upd.more && i + 1 == upd.nLevels) ?
+			       MD_F_LAST : 0);
+		depth.level = lvl.level;
+		depth.price = lvl.price;
+		depth.qty = lvl.qty;
+		depth.orders = lvl.orders;
+		depth.encode(msg);
+		append(msg, MdDepth::SIZE);
+	}
+}
+
+// assign the next sequence number, retain, and pack
+void MdPublisher::append(const unsigned char *msg, size_t len)
+{
+	if (pktLen_ + len > MD_MAX_PACKET)
+		flush();
+
+	uint64_t seq = nextSeq_.load();
+	nextSeq_.store(seq + 1);
+
+	Retained& r = retained_[seq % retained_.size()];
+	r.len = (uint8_t) len;
+	memcpy(r.msg, msg, len);
+
+	if (pktCount_ == 0)
+		pktSeq_ = seq;
+	memcpy(pkt_ + pktLen_, msg, len);
+	pktLen_ += len;
+	pktCount_++;
+}
+
+// send the pending packet; a lost datagram is recovered over TCP
+void MdPublisher::flush()
+{
+	if (pktCount_ == 0)
+		return;
+
+	MdPacketHdr hdr;
+	hdr.session = session_;
+	hdr.seq = pktSeq_;
+	hdr.count = pktCount_;
+	hdr.encode(pkt_);
+
+	if (fd_ >= 0)
+		sendto(fd_, pkt_, pktLen_, 0,
+		       (struct sockaddr *) &group_, sizeof(group_));
+	nPackets_++;
+	sent_ = true;
+
+	pktLen_ = MD_PKT_HDR_SIZE;
+	pktCount_ = 0;
+}
+
+void MdPublisher::heartbeatCb(evutil_socket_t fd, short events, void *arg)
+{
+	MdPublisher *pub = (MdPublisher *) arg;
+
+	if (!pub->sent_ && pub->fd_ >= 0) {
+		unsigned char pkt[MD_PKT_HDR_SIZE];
+		MdPacketHdr hdr;
+		hdr.session = pub->session_;
+		hdr.seq = pub->nextSeq_.load();
+		hdr.count = 0;
+		hdr.encode(pkt);
+
+		sendto(pub->fd_, pkt, sizeof(pkt), 0,
+		       (struct sockaddr *) &pub->group_, sizeof(pub->group_));
+	}
+	pub->sent_ = false;
+}
+
+//
+// TCP snapshot and retransmission service
+//
+
+static void sendFrame(struct bufferevent *bev, uint32_t session,
+		      uint64_t seq, uint16_t count, const string& body)
+{
+	unsigned char hdr[4 + MD_PKT_HDR_SIZE];
+	binPutU32(hdr, MD_PKT_HDR_SIZE + body.size());
+
+	MdPacketHdr pktHdr;
+	pktHdr.session = session;
+	pktHdr.seq = seq;
+	pktHdr.count = count;
+	pktHdr.encode(hdr + 4);
+
+	bufferevent_write(bev, hdr, sizeof(hdr));
+	bufferevent_write(bev, body.data(), body.size());
+}
+
+void MdPublisher::acceptCb(struct evconnlistener *listener,
+			   evutil_socket_t fd, struct sockaddr *addr,
+			   int socklen, void *arg)
+{
+	MdPublisher *pub = (MdPublisher *) arg;
+
+	int one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+	struct bufferevent *bev = bufferevent_socket_new(pub->base_, fd,
+		BEV_OPT_CLOSE_ON_FREE);
+	if (!bev) {
+		close(fd);
+		return;
+	}
+
+	Session *sess = new Session();
+	sess->pub = pub;
+	sess->bev = bev;
+	pub->sessions_.insert(sess);
+
+	bufferevent_setcb(bev, sessReadCb, NULL, sessEventCb, sess);
+	bufferevent_enable(bev, EV_READ | EV_WRITE);
+}
+
+void MdPublisher::sessReadCb(struct bufferevent *bev, void *arg)
+{
+	Session *sess = (Session *) arg;
+	MdPublisher *pub = sess->pub;
+	struct evbuffer *in = bufferevent_get_input(bev);
+
+	unsigned char msg[MD_MAX_MSG];
+	while (evbuffer_get_length(in) >= MD_MSG_HDR_SIZE) {
+		evbuffer_copyout(in, msg, MD_MSG_HDR_SIZE);
+		uint16_t len = binGetU16(msg);
+		if (len < MD_MSG_HDR_SIZE || len > MD_MAX_MSG) {
+			pub->closeSession(sess);
+			return;
+		}
+		if (evbuffer_get_length(in) < len)
+			break;
+
+		evbuffer_remove(in, msg, len);
+		if (!pub->dispatch(sess, msg, len)) {
+			pub->closeSession(sess);
+			return;
+		}
+	}
+}
+
+void MdPublisher::sessEventCb(struct bufferevent *bev, short events, void *arg)
+{
+	Session *sess = (Session *) arg;
+
+	if (events & (BEV_EVENT_EOF | BEV_EVENT_ERROR))
+		sess->pub->closeSession(sess);
+}
+
+void MdPublisher::closeSession(Session *sess)
+{
+	sessions_.erase(sess);
+	bufferevent_free(sess->bev);
+	delete sess;
+}
+
+bool MdPublisher::dispatch(Session *sess, const unsigned char *msg, size_t len)
+{
+	switch (msg[2]) {
+	case MD_SNAPSHOT_REQ:
+		if (len != MdSnapshotReq::SIZE)
+			return false;
+		sendSnapshot(sess);
+		return true;
+
+	case MD_RETRANS_REQ: {
+		if (len != MdRetransReq::SIZE)
+			return false;
+		MdRetransReq req;
+		req.decode(msg);
+		sendRetrans(sess, req.seq, req.count);
+		return true;
+	}
+
+	default:
+		return false;
+	}
+}
+
+// every non-empty slot of every depth book, as of the last message
+// sequenced; a pending packet goes out first, so none is skipped
+void MdPublisher::sendSnapshot(Session *sess)
+{
+	flush();
+
+	uint64_t nextSeq = nextSeq_.load();
+	unsigned char msg[MD_MAX_MSG];
+	string body;
+	uint16_t count = 0;
+
+	for (auto it = books_.begin(); it != books_.end(); ++it) {
+		const Book& book = it->second;
+
+		// the book's last non-empty slot carries MD_F_LAST
+		vector<const BookLevelUpdate *> filled;
+		for (unsigned int side = 0; side < 2; side++)
+			for (size_t j = 0; j < book.slots[side].size(); j++)
+				if (book.slots[side][j].qty)
+					filled.push_back(&book.slots[side][j]);
+
+		for (size_t i = 0; i < filled.size(); i++) {
+			const BookLevelUpdate& slot = *filled[i];
+
+			if (body.size() + MdDepth::SIZE + MD_PKT_HDR_SIZE >
+			    MD_MAX_FRAME || count == UINT16_MAX) {
+				sendFrame(sess->bev, session_, nextSeq,
+					  count, body);
+				body.clear();
+				count = 0;
+			}
+
+			MdDepth depth;
+			depth.flags = (slot.buy ? MD_F_BUY : 0) |
+				      ((i + 1 == filled.size()) ? MD_F_LAST : 0);
+			depth.symbol = it->first;
+			depth.change = book.change;
+			depth.level = slot.level;
+			depth.price = slot.price;
+			depth.qty = slot.qty;
+			depth.orders = slot.orders;
+			depth.encode(msg);
+			body.append((const char *) msg, MdDepth::SIZE);
+			count++;
+		}
+	}
+
+	MdSnapshotEnd end;
+	end.nextSeq = nextSeq;
+	end.encode(msg);
+	body.append((const char *) msg, MdSnapshotEnd::SIZE);
+	count++;
+	sendFrame(sess->bev, session_, nextSeq, count, body);
+
+	nSnapshots_++;
+}
+
+// retained messages from seq on, up to count; none if seq itself
+// has been overwritten or was never sent
+void MdPublisher::sendRetrans(Session *sess, uint64_t seq, uint32_t count)
+{
+	flush();
+
+	uint64_t nextSeq = nextSeq_.load();
+	uint64_t oldest = (nextSeq > retained_.size()) ?
+			  (nextSeq - retained_.size()) : 1;
+
+	string body;
+	uint16_t n = 0;
+	if (seq >= oldest && seq < nextSeq) {
+		uint64_t end = std::min(nextSeq,
+			seq + std::min(count, (uint32_t) MD_MAX_RETRANS));
+		for (uint64_t s = seq; s < end; s++) {
+			const Retained& r = retained_[s % retained_.size()];
+			body.append((const char *) r.msg, r.len);
+			n++;
+		}
+	}
+
+	sendFrame(sess->bev, session_, seq, n, body);
+	nRetrans_ += n;
+}
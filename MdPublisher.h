@@ -0,0 +1,123 @@
+#ifndef __MDPUBLISHER_H__
+#define __MDPUBLISHER_H__
+
+#include <string>
+#include <vector>
+#include <map>
+#include <set>
+#include <atomic>
+#include <cstdint>
+#include <netinet/in.h>
+#include <event2/event.h>
+#include <event2/bufferevent.h>
+#include <event2/listener.h>
+#include "Engine.h"
+#include "BookUpdate.h"
+#include "MdProto.h"
+#include "RingBuffer.h"
+
+// Multicast market-data publisher (see MdProto.h).  Runs on one event
+// loop: updates from the shards are sequenced there, packed into as
+// few datagrams as fit, and sent once to the group however many
+// receivers have joined.  The loop keeps a replica of every depth
+// book's top levels, as of the last sequence number sent, from which
+// the TCP service answers snapshot requests; recent messages are
+// retained for retransmission.
+class MdPublisher : public BookSink {
+public:
+	MdPublisher(struct event_base *base, size_t queueSize,
+		    size_t retain);
+	~MdPublisher();
+
+	// multicast group and port; interface address, TTL
+	bool open(const std::string& group, unsigned int port,
+		  const std::string& iface, unsigned int ttl);
+	bool listen(const std::string& addr, unsigned int port);
+
+	// depth books as recovered; before the engine starts
+	void seed(Engine& engine);
+
+	// BookSink; called from shard threads
+	virtual bool active() const { return true; }
+	virtual void post(const std::vector<orderentry::BookUpdate>& updates);
+
+	uint64_t messages() const { return nextSeq_ - 1; }
+	uint64_t packets() const { return nPackets_; }
+	uint64_t snapshots() const { return nSnapshots_; }
+	uint64_t retransmits() const { return nRetrans_; }
+
+private:
+	// slots by position, bids then asks; sized to the book's depth
+	struct Book {
+		liquibook::book::ChangeId change;
+		std::vector<orderentry::BookLevelUpdate> slots[2];
+
+		orderentry::BookLevelUpdate& slot(bool buy, unsigned int level) {
+			std::vector<orderentry::BookLevelUpdate>& side =
+				slots[buy ? 0 : 1];
+			if (level >= side.size())
+				side.resize(level + 1,
+					    orderentry::BookLevelUpdate());
+			return side[level];
+		}
+	};
+
+	struct Retained {
+		uint8_t			len;
+		unsigned char		msg[MD_MAX_MSG];
+	};
+
+	struct Session {
+		MdPublisher		*pub;
+		struct bufferevent	*bev;
+	};
+
+	struct event_base	*base_;
+	uint32_t		session_;
+	std::atomic<uint64_t>	nextSeq_;
+
+	int			fd_;
+	struct sockaddr_in	group_;
+	unsigned char		pkt_[MD_MAX_PACKET];
+	size_t			pktLen_;
+	uint16_t		pktCount_;
+	uint64_t		pktSeq_;
+	bool			sent_;		// since last heartbeat tick
+
+	std::vector<Retained>	retained_;
+	std::map<std::string, Book> books_;
+
+	struct evconnlistener	*listener_;
+	std::set<Session *>	sessions_;
+
+	RingBuffer<orderentry::BookUpdate> ring_;
+	int			fds_[2];
+	struct event		*ev_;
+	struct event		*hbEv_;
+	std::atomic<bool>	signaled_;
+
+	std::atomic<uint64_t>	nPackets_;
+	std::atomic<uint64_t>	nSnapshots_;
+	std::atomic<uint64_t>	nRetrans_;
+
+	void deliver();
+	void apply(const orderentry::BookUpdate& upd);
+	void append(const unsigned char *msg, size_t len);
+	void flush();
+
+	bool dispatch(Session *sess, const unsigned char *msg, size_t len);
+	void sendSnapshot(Session *sess);
+	void sendRetrans(Session *sess, uint64_t seq, uint32_t count);
+	void closeSession(Session *sess);
+
+	static void acceptCb(struct evconnlistener *listener,
+			     evutil_socket_t fd, struct sockaddr *addr,
+			     int socklen, void *arg);
+	static void sessReadCb(struct bufferevent *bev, void *arg);
+	static void sessEventCb(struct bufferevent *bev, short events,
+				void *arg);
+	static void wakeCb(evutil_socket_t fd, short events, void *arg);
+	static void heartbeatCb(evutil_socket_t fd, short events, void *arg);
+};
+
+#endif // __MDPUBLISHER_H__
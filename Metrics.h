@@ -0,0 +1,117 @@
+#ifndef __METRICS_H__
+#define __METRICS_H__
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// Counter written by the one thread that owns it, and read from any:
+// a relaxed load and store, never a locked read-modify-write.
+class MetricCounter {
+public:
+	MetricCounter() : v_(0) {}
+
+	void inc(uint64_t n = 1) {
+		v_.store(v_.load(std::memory_order_relaxed) + n,
+			 std::memory_order_relaxed);
+	}
+	void set(uint64_t v) { v_.store(v, std::memory_order_relaxed); }
+	uint64_t get() const { return v_.load(std::memory_order_relaxed); }
+
+private:
+	std::atomic<uint64_t>	v_;
+};
+
+// Latency histogram, log-linear as HDR histograms are: values below
+// 16 have a bucket each, and every power of two above is split into
+// 16 buckets, for a relative error under 1/16 from 1 to 2^36.  Larger
+// values land in the last bucket.  Single writer, as MetricCounter.
+class LatencyHistogram {
+public:
+	enum {
+		SUB_BITS	= 4,
+		SUB_COUNT	= 1 << SUB_BITS,
+		MAX_EXP		= 36,
+		BUCKETS		= (MAX_EXP - SUB_BITS + 1) * SUB_COUNT,
+	};
+
+	static unsigned int bucket(uint64_t v) {
+		if (v < SUB_COUNT)
+			return v;
+
+		unsigned int e = 63 - __builtin_clzll(v);
+		if (e >= MAX_EXP)
+			return BUCKETS - 1;
+		return (e - SUB_BITS + 1) * SUB_COUNT +
+		       ((v >> (e - SUB_BITS)) & (SUB_COUNT - 1));
+	}
+
+	// largest value counted in bucket i
+	static uint64_t upperBound(unsigned int i) {
+		if (i < SUB_COUNT)
+			return i;
+
+		unsigned int e = i / SUB_COUNT + SUB_BITS - 1;
+		uint64_t lower = (uint64_t) (SUB_COUNT + i % SUB_COUNT) <<
+				 (e - SUB_BITS);
+		return lower + ((uint64_t) 1 << (e - SUB_BITS)) - 1;
+	}
+
+	void record(uint64_t v) {
+		counts_[bucket(v)].inc();
+		count_.inc();
+		sum_.inc(v);
+	}
+
+	uint64_t count(unsigned int i) const { return counts_[i].get(); }
+	uint64_t count() const { return count_.get(); }
+	uint64_t sum() const { return sum_.get(); }
+
+private:
+	MetricCounter		counts_[BUCKETS];
+	MetricCounter		count_;
+	MetricCounter		sum_;
+};
+
+// Per-book event counters, kept by the Market from its listener
+// callbacks on the shard thread.
+struct BookMetrics {
+	std::string		symbol;
+	MetricCounter		accepts;
+	MetricCounter		rejects;
+	MetricCounter		fills;
+	MetricCounter		cancels;
+	MetricCounter		replaces;
+	MetricCounter		trades;
+	MetricCounter		resting;	// orders on the book, now
+
+	explicit BookMetrics(const std::string& sym) : symbol(sym) {}
+};
+
+// A shard's BookMetrics, one per book.  Books are only added; the lock
+// covers adding and walking the list, never the counters themselves.
+class BookMetricsList {
+public:
+	BookMetrics *add(const std::string& symbol) {
+		std::lock_guard<std::mutex> lock(mtx_);
+		books_.emplace_back(new BookMetrics(symbol));
+		return books_.back().get();
+	}
+
+	template<typename F>
+	void forEach(F fn) const {
+		std::lock_guard<std::mutex> lock(mtx_);
+		for (size_t i = 0; i < books_.size(); i++)
+			fn(*books_[i]);
+	}
+
+private:
+	mutable std::mutex				mtx_;
+	std::vector<std::unique_ptr<BookMetrics> >	books_;
+};
+
+#endif // __METRICS_H__
@@ -3,41 +3,128 @@
 // See the file license.txt for licensing information.
 #include "Order.h"
 #include <sstream>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
 #include <sys/time.h>
 
 namespace orderentry
 {
 
-Order::Order(const std::string & id,
+namespace
+{
+    // symbols are few and never forgotten.  Each thread caches those
+    // it has seen, so only a symbol new to the thread takes the lock.
+    const std::string *
+    internSymbol(const std::string & symbol)
+    {
+        static thread_local std::unordered_map<std::string,
+                                               const std::string *> seen;
+        auto pos = seen.find(symbol);
+        if(pos != seen.end())
+        {
+            return pos->second;
+        }
+
+        static std::mutex mtx;
+        static std::unordered_set<std::string> * all =
+            new std::unordered_set<std::string>;
+        const std::string * interned;
+        {
+            std::lock_guard<std::mutex> lk(mtx);
+            interned = &*all->insert(symbol).first;
+        }
+        seen[symbol] = interned;
+        return interned;
+    }
+
+    const std::string noAlias;
+}
+
+Order::Order(OrderId id,
     bool buy_side,
     liquibook::book::Quantity quantity,
-    std::string symbol,
+    const std::string & symbol,
     liquibook::book::Price price,
     liquibook::book::Price stopPrice,
     bool aon,
     bool ioc)
     : id_(id)
-    , buy_side_(buy_side)
-    , symbol_(symbol)
+    , tstamp_(0)
+    , symbol_(internSymbol(symbol))
+    , log_(nullptr)
     , quantity_(quantity)
     , price_(price)
     , stopPrice_(stopPrice)
-    , ioc_(ioc)
-    , aon_(aon)
     , quantityFilled_(0)
     , quantityOnMarket_(0)
     , fillCost_(0)
-    , verbose_(false)
+    , session_(0)
+    , refs_(0)
+    , flags_((buy_side ? F_BUY : 0) | (aon ? F_AON : 0) | (ioc ? F_IOC : 0))
+    , state_(Unknown)
+{
+}
+
+Order::~Order()
+{
+    delete log_;
+}
+
+void *
+Order::operator new(size_t size)
+{
+    if(size != sizeof(Order))
+    {
+        return ::operator new(size);
+    }
+    return FixedPool<sizeof(Order)>::alloc();
+}
 
+void
+Order::operator delete(void * p, size_t size)
 {
+    if(size != sizeof(Order))
+    {
+        ::operator delete(p);
+        return;
+    }
+    FixedPool<sizeof(Order)>::free(p);
 }
 
-std::string
+void *
+OrderLog::operator new(size_t size)
+{
+    return FixedPool<sizeof(OrderLog)>::alloc();
+}
+
+void
+OrderLog::operator delete(void * p, size_t size)
+{
+    FixedPool<sizeof(OrderLog)>::free(p);
+}
+
+OrderId
 Order::order_id() const
 {
     return id_;
 }
 
+const std::string &
+Order::alias() const
+{
+    return log_ ? log_->alias_ : noAlias;
+}
+
+void
+Order::setAlias(const std::string & alias)
+{
+    if(log_ || !alias.empty())
+    {
+        logFor().alias_ = alias;
+    }
+}
+
 bool
 Order::is_limit() const
 {
@@ -47,30 +134,26 @@ Order::is_limit() const
 bool
 Order::is_buy() const
 {
-    return buy_side_;
+    return (flags_ & F_BUY) != 0;
 }
 
 bool
 Order::all_or_none() const
 {
-    return aon_;
+    return (flags_ & F_AON) != 0;
 }
 
 bool
 Order::immediate_or_cancel() const
 {
-    return ioc_;
+    return (flags_ & F_IOC) != 0;
 }
 
 void Order::genTimestamp()
 {
-	gettimeofday(&tstamp_, NULL);
-}
-
-std::string
-Order::symbol() const
-{
-   return symbol_;
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	setTimestamp(tv);
 }
 
 liquibook::book::Price
@@ -110,60 +193,150 @@ Order::fillCost() const
     return fillCost_;
 }
 
+OrderLog &
+Order::logFor()
+{
+    if(!log_)
+    {
+        log_ = new OrderLog;
+    }
+    return *log_;
+}
+
+void
+Order::record(State state, int32_t qty, uint32_t value)
+{
+    Event event;
+    event.state = state;
+    event.hasNote = false;
+    event.qty = qty;
+    event.value = value;
+    logFor().push(event);
+    state_ = state;
+}
 
-const Order::History &
+void
+Order::recordNote(State state, const char * note)
+{
+    OrderLog & log = logFor();
+    Event event;
+    event.state = state;
+    event.hasNote = true;
+    event.qty = 0;
+    event.value = uint32_t(log.notes_.size());
+    log.notes_.push_back(note);
+    log.push(event);
+    state_ = state;
+}
+
+// the text an event was once recorded with
+Order::StateChange
+Order::describe(const Event & event) const
+{
+    State state = State(event.state);
+    if(event.hasNote)
+    {
+        return StateChange(state, log_->note(event));
+    }
+
+    std::stringstream msg;
+    switch(state)
+    {
+    case Submitted:
+        msg << (is_buy() ? "BUY " : "SELL ") << event.qty << ' '
+            << symbol() << " @";
+        if(event.value == 0)
+        {
+            msg << "MKT";
+        }
+        else
+        {
+            msg << event.value;
+        }
+        break;
+    case Filled:
+        msg << event.qty << " for " << event.value;
+        break;
+    case ModifyRequested:
+    case Modified:
+        if(event.qty != liquibook::book::SIZE_UNCHANGED)
+        {
+            msg << "Quantity change: " << event.qty << ' ';
+        }
+        if(event.value != liquibook::book::PRICE_UNCHANGED)
+        {
+            msg << "New Price " << event.value;
+        }
+        break;
+    default:
+        break;
+    }
+    return StateChange(state, msg.str());
+}
+
+Order::History
 Order::history() const
 {
-    return history_;
+    History history;
+    if(log_)
+    {
+        history.reserve(log_->size());
+        for(size_t i = 0; i < log_->size(); ++i)
+        {
+            history.push_back(describe((*log_)[i]));
+        }
+    }
+    return history;
 }
 
-const Order::StateChange &
+Order::StateChange
 Order::currentState() const
 {
-    return history_.back();
+    if(!log_ || log_->size() == 0)
+    {
+        return StateChange();
+    }
+    return describe((*log_)[log_->size() - 1]);
 }
 
 
 Order &
 Order::verbose(bool verbose)
 {
-    verbose_ = verbose;
+    if(verbose)
+    {
+        flags_ |= F_VERBOSE;
+    }
+    else
+    {
+        flags_ &= ~F_VERBOSE;
+    }
     return *this;
 }
 
 bool
 Order::isVerbose() const
 {
-    return verbose_;
+    return (flags_ & F_VERBOSE) != 0;
 }
 
 void
 Order::onSubmitted()
 {
-    std::stringstream msg;
-    msg << (is_buy() ? "BUY " : "SELL ") << quantity_ << ' ' << symbol_ << " @";
-    if( price_ == 0)
-    {
-        msg << "MKT";
-    }
-    else
-    {
-        msg << price_;
-    }
-    history_.emplace_back(Submitted, msg.str());
+    record(Submitted, int32_t(quantity_), price_);
 }
 
 void
 Order::onAccepted()
 {
     quantityOnMarket_ = quantity_;
-    history_.emplace_back(Accepted);
+    record(Accepted);
 }
 
 void
 Order::onRejected(const char * reason)
 {
-    history_.emplace_back(Rejected, reason);
+    recordNote(Rejected, reason);
 }
 
 void
@@ -172,30 +345,28 @@ Order::onFilled(
     liquibook::book::Cost fill_cost)
 {
     quantityOnMarket_ -= fill_qty;
+    quantityFilled_ += fill_qty;
     fillCost_ += fill_cost;
-
-    std::stringstream msg;
-    msg << fill_qty << " for " << fill_cost;
-    history_.emplace_back(Filled, msg.str());
+    record(Filled, int32_t(fill_qty), uint32_t(fill_cost));
 }
 
 void
 Order::onCancelRequested()
 {
-    history_.emplace_back(CancelRequested);
+    record(CancelRequested);
 }
 
 void
 Order::onCancelled()
 {
     quantityOnMarket_ = 0;
-    history_.emplace_back(Cancelled);
+    record(Cancelled);
 }
 
 void
 Order::onCancelRejected(const char * reason)
 {
-    history_.emplace_back(CancelRejected, reason);
+    recordNote(CancelRejected, reason);
 }
 
 void
@@ -203,85 +374,78 @@ Order::onReplaceRequested(
     const int32_t& size_delta,
     liquibook::book::Price new_price)
 {
-    std::stringstream msg;
-    if(size_delta != liquibook::book::SIZE_UNCHANGED)
-    {
-        msg << "Quantity change: " << size_delta << ' ';
-    }
-    if(new_price != liquibook::book::PRICE_UNCHANGED)
-    {
-        msg << "New Price " << new_price;
-    }
-    history_.emplace_back(ModifyRequested, msg.str());
+    record(ModifyRequested, size_delta, new_price);
 }
 
 void
 Order::onReplaced(const int32_t& size_delta,
     liquibook::book::Price new_price)
 {
-    std::stringstream msg;
     if(size_delta != liquibook::book::SIZE_UNCHANGED)
     {
         quantity_ += size_delta;
         quantityOnMarket_ += size_delta;
-        msg << "Quantity change: " << size_delta << ' ';
     }
     if(new_price != liquibook::book::PRICE_UNCHANGED)
     {
         price_ = new_price;
-        msg << "New Price " << new_price;
     }
-    history_.emplace_back(Modified, msg.str());
+    record(Modified, size_delta, new_price);
 }
 
 void
 Order::onReplaceRejected(const char * reason)
 {
-    history_.emplace_back(ModifyRejected, reason);
+    recordNote(ModifyRejected, reason);
 }
 
-std::ostream & operator << (std::ostream & out, const Order::StateChange & event)
+void
+Order::restore(liquibook::book::Quantity quantityFilled,
+    int32_t quantityOnMarket,
+    uint32_t fillCost)
+{
+    quantityFilled_ = quantityFilled;
+    quantityOnMarket_ = quantityOnMarket;
+    fillCost_ = fillCost;
+}
+
+void
+Order::restoreEvent(const Event & event, const std::string & note)
 {
-    out << "{";
-    switch(event.state_)
+    if(event.hasNote)
     {
-    case Order::Submitted:
-        out << "Submitted ";
-        break;
-    case Order::Rejected:
-        out << "Rejected ";
-        break;
-    case Order::Accepted:
-        out << "Accepted ";
-        break;
-    case Order::ModifyRequested:
-        out << "ModifyRequested ";
-        break;
-    case Order::ModifyRejected:
-        out << "ModifyRejected ";
-        break;
-    case Order::Modified:
-        out << "Modified ";
-        break;
-    case Order::PartialFilled:
-        out << "PartialFilled ";
-        break;
-    case Order::Filled:
-        out << "Filled ";
-        break;
-    case Order::CancelRequested:
-        out << "CancelRequested ";
-        break;
-    case Order::CancelRejected:
-        out << "CancelRejected ";
-        break;
-    case Order::Cancelled:
-        out << "Cancelled ";
-        break;
-    case Order::Unknown:
-        out << "Unknown ";
-        break;
+        recordNote(State(event.state), note.c_str());
+    }
+    else
+    {
+        record(State(event.state), event.qty, event.value);
+    }
+}
+
+const char *
+Order::stateName(State state)
+{
+    switch(state)
+    {
+    case Submitted:         return "Submitted";
+    case Rejected:          return "Rejected";
+    case Accepted:          return "Accepted";
+    case ModifyRequested:   return "ModifyRequested";
+    case ModifyRejected:    return "ModifyRejected";
+    case Modified:          return "Modified";
+    case PartialFilled:     return "PartialFilled";
+    case Filled:            return "Filled";
+    case CancelRequested:   return "CancelRequested";
+    case CancelRejected:    return "CancelRejected";
+    case Cancelled:         return "Cancelled";
+    case Unknown:           break;
     }
+    return "Unknown";
+}
+
+std::ostream & operator << (std::ostream & out, const Order::StateChange & event)
+{
+    out << "{" << Order::stateName(event.state_) << ' ';
     out << event.description_;
     out << "}";
     return out;
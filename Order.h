@@ -4,15 +4,55 @@
 #pragma once
 
 #include "OrderFwd.h"
+#include "OrderId.h"
+#include "Pool.h"
 #include <book/types.h>
+#include <book/order_book.h>
 
+#include <map>
 #include <string>
 #include <vector>
 #include <sys/time.h>
 
+namespace liquibook { namespace book {
+
+/// @brief OrderBook tracker nodes come from a pool
+template <>
+struct TrackerAllocator<orderentry::OrderPtr>
+{
+    template <class T>
+    using type = PoolAllocator<T>;
+};
+
+} }
+
 namespace orderentry
 {
 
+/// @brief where a resting order sits on its book, kept by the book so
+/// that cancel and replace go straight to it rather than searching the
+/// order's price level.  Which field applies depends on the book type.
+struct BookHandle
+{
+    typedef liquibook::book::OrderTracker<OrderPtr> Tracker;
+    typedef std::multimap<liquibook::book::ComparablePrice, Tracker,
+        std::less<liquibook::book::ComparablePrice>,
+        PoolAllocator<std::pair<const liquibook::book::ComparablePrice,
+                                Tracker> > >::iterator MapPos;
+
+    bool resting;
+    MapPos pos;         // OrderBook: position in the side's map
+    uint64_t slot;      // LadderOrderBook: position in the level queue
+
+    BookHandle() : resting(false), slot(0) {}
+};
+
+class OrderLog;
+
+/// @brief an order.  The fields matching and reporting read are packed
+/// into one small record; the alias and the order's lifecycle history
+/// are kept apart, in its OrderLog, and history is recorded as compact
+/// events, formatted only when asked for.
 class Order
 {
 public:
@@ -45,15 +85,38 @@ public:
         {}
     };    
     typedef std::vector<StateChange> History;
+
+    /// @brief one lifecycle event, as recorded
+    struct Event
+    {
+        uint8_t state;      // State
+        bool hasNote;       // value indexes the log's notes
+        int32_t qty;        // quantity submitted or filled, or size delta
+        uint32_t value;     // price, fill cost or new price
+    };
 public:
-    Order(const std::string & id,
+    Order(OrderId id,
         bool buy_side,
         liquibook::book::Quantity quantity,
-        std::string symbol,
+        const std::string & symbol,
         liquibook::book::Price price,
         liquibook::book::Price stopPrice,
         bool aon,
         bool ioc);
+    ~Order();
+
+    /// @brief orders are drawn from a pool, and counted by OrderPtr;
+    /// both belong to the thread of the shard that holds the order
+    static void * operator new(size_t size);
+    static void operator delete(void * p, size_t size);
+    void addRef() { ++refs_; }
+    void release()
+    {
+        if(--refs_ == 0)
+        {
+            delete this;
+        }
+    }
 
     //////////////////////////
     // Implement the 
@@ -79,15 +142,29 @@ public:
     /// @brief if no trades should happen until the order
     /// can be filled completely.
     /// Note: one or more trades may be used to fill the order.
-    virtual bool all_or_none() const;
+    bool all_or_none() const;
 
     /// @brief After generating as many trades as possible against
     /// orders already on the market, cancel any remaining quantity.
-    virtual bool immediate_or_cancel() const;
+    bool immediate_or_cancel() const;
+
+    /// @brief symbols are interned; every order for one shares it
+    const std::string & symbol() const { return *symbol_; }
+
+    OrderId order_id() const;
+
+    /// @brief client-visible UUID, in order id compatibility mode
+    const std::string & alias() const;
+    void setAlias(const std::string & alias);
 
-    std::string symbol() const;
+    /// @brief binary order-entry session that entered this order, or 0.
+    /// Not persisted: sessions do not survive a restart.
+    uint32_t session() const { return session_; }
+    void setSession(uint32_t session) { session_ = session; }
 
-    std::string order_id() const;
+    /// @brief the order's place on its book; for the book's use only
+    BookHandle & bookHandle() { return handle_; }
+    const BookHandle & bookHandle() const { return handle_; }
 
     uint32_t quantityFilled() const;
 
@@ -97,11 +174,29 @@ public:
 
     Order & verbose(bool verbose = true);
     bool isVerbose()const;
-    const History & history() const;
-    const StateChange & currentState() const;
+
+    /// @brief state after the latest event
+    State state() const { return State(state_); }
+    /// @brief the history, formatted
+    History history() const;
+    StateChange currentState() const;
+    /// @brief the recorded events, or null if none
+    const OrderLog * log() const { return log_; }
 
     void genTimestamp();
-    struct timeval timestamp() const { return tstamp_; }
+    void setTimestamp(const struct timeval & tv)
+    {
+        tstamp_ = uint64_t(tv.tv_sec) * 1000000 + tv.tv_usec;
+    }
+    struct timeval timestamp() const
+    {
+        struct timeval tv;
+        tv.tv_sec = time_t(tstamp_ / 1000000);
+        tv.tv_usec = suseconds_t(tstamp_ % 1000000);
+        return tv;
+    }
+
+    static const char * stateName(State state);
 
     ///////////////////////////
     // Order life cycle events
@@ -126,28 +221,131 @@ public:
 
     void onReplaceRejected(const char * reason);
 
+    /// @brief restore fill state, e.g. from a snapshot; history
+    /// follows with restoreEvent
+    void restore(liquibook::book::Quantity quantityFilled,
+        int32_t quantityOnMarket,
+        uint32_t fillCost);
+    /// @param note an event's text, if it has one
+    void restoreEvent(const Event & event, const std::string & note);
+
 private:
-    std::string id_;
-    bool buy_side_;
-    std::string symbol_;
+    enum
+    {
+        F_BUY       = 1 << 0,
+        F_AON       = 1 << 1,
+        F_IOC       = 1 << 2,
+        F_VERBOSE   = 1 << 3,
+    };
+
+    OrderLog & logFor();
+    void record(State state, int32_t qty = 0, uint32_t value = 0);
+    void recordNote(State state, const char * note);
+    StateChange describe(const Event & event) const;
+
+    OrderId id_;
+    uint64_t tstamp_;       // microseconds since the epoch
+    const std::string * symbol_;
+    OrderLog * log_;
+    BookHandle handle_;
+
     liquibook::book::Quantity quantity_;
     liquibook::book::Price price_;
     liquibook::book::Price stopPrice_;
-
-    bool ioc_;
-    bool aon_;
-
     liquibook::book::Quantity quantityFilled_;
     int32_t quantityOnMarket_;
     uint32_t fillCost_;
-    
-    std::vector<StateChange> history_;
-    bool verbose_;
+    uint32_t session_;
+    uint32_t refs_;
+    uint8_t flags_;
+    uint8_t state_;
+
+    Order(const Order &) = delete;
+    Order & operator = (const Order &) = delete;
+};
+
+/// @brief an order's alias and lifecycle events, apart from the order.
+/// The first few events are held inline.
+class OrderLog
+{
+public:
+    enum { INLINE_EVENTS = 6 };
+
+    OrderLog() : count_(0) {}
+
+    static void * operator new(size_t size);
+    static void operator delete(void * p, size_t size);
+
+    size_t size() const { return count_; }
+    const Order::Event & operator [] (size_t i) const
+    {
+        return (i < INLINE_EVENTS) ? events_[i] : more_[i - INLINE_EVENTS];
+    }
+    const std::string & note(const Order::Event & event) const
+    {
+        return notes_[event.value];
+    }
 
-    struct timeval tstamp_;
+private:
+    friend class Order;
+
+    void push(const Order::Event & event)
+    {
+        if(count_ < INLINE_EVENTS)
+        {
+            events_[count_] = event;
+        }
+        else
+        {
+            more_.push_back(event);
+        }
+        ++count_;
+    }
+
+    std::string alias_;
+    Order::Event events_[INLINE_EVENTS];
+    uint32_t count_;
+    std::vector<Order::Event> more_;
+    std::vector<std::string> notes_;
 };
 
 std::ostream & operator << (std::ostream & out, const Order & order);
 std::ostream & operator << (std::ostream & out, const Order::StateChange & event);
 
 }
+
+namespace liquibook { namespace book {
+
+/// @brief OrderBook keeps each order's position in its BookHandle
+template <>
+struct MarketPosition<orderentry::OrderPtr>
+{
+    enum { kept = true };
+
+    static bool get(const orderentry::OrderPtr & order,
+                    orderentry::BookHandle::MapPos & pos)
+    {
+        const orderentry::BookHandle & handle = order->bookHandle();
+        if(!handle.resting)
+        {
+            return false;
+        }
+        pos = handle.pos;
+        return true;
+    }
+
+    static void set(const orderentry::OrderPtr & order,
+                    const orderentry::BookHandle::MapPos & pos)
+    {
+        orderentry::BookHandle & handle = order->bookHandle();
+        handle.resting = true;
+        handle.pos = pos;
+    }
+
+    static void clear(const orderentry::OrderPtr & order)
+    {
+        order->bookHandle().resting = false;
+    }
+};
+
+} }
@@ -0,0 +1,292 @@
+
+#include <string>
+#include <syslog.h>
+#include "OrderArchive.h"
+
+using namespace std;
+using namespace orderentry;
+
+static const char spillPrefix[] = "/order/";
+static const char aliasPrefix[] = "/orderAlias/";
+
+static string spillKey(OrderId orderId)
+{
+	string key(spillPrefix);
+	serKeyU64(key, orderId);
+	return key;
+}
+
+enum {
+	ORDER_F_BUY		= (1U << 0),
+	ORDER_F_AON		= (1U << 1),
+	ORDER_F_IOC		= (1U << 2),
+};
+
+// History is a u32 event count, then the events.  Set in the count, a
+// flag marks compact events: u8 state, u8 has-note, u32 qty, u32 value,
+// and a note string if it has one.  Older records hold u8 state and
+// the event's text; those events are restored as notes.
+enum {
+	HISTORY_F_EVENTS	= (1U << 31),
+};
+
+void encodeOrder(string& s, const Order& order)
+{
+	serU64(s, order.order_id());
+	serStr(s, order.alias());
+	serStr(s, order.symbol());
+
+	uint8_t flags = 0;
+	if (order.is_buy())
+		flags |= ORDER_F_BUY;
+	if (order.all_or_none())
+		flags |= ORDER_F_AON;
+	if (order.immediate_or_cancel())
+		flags |= ORDER_F_IOC;
+	serU8(s, flags);
+
+	serU32(s, order.order_qty());
+	serU32(s, order.price());
+	serU32(s, order.stop_price());
+	serU32(s, order.quantityFilled());
+	serU32(s, order.quantityOnMarket());
+	serU32(s, order.fillCost());
+
+	struct timeval tv = order.timestamp();
+	serU64(s, (uint64_t) tv.tv_sec);
+	serU32(s, (uint32_t) tv.tv_usec);
+
+	const OrderLog *log = order.log();
+	size_t nEvents = log ? log->size() : 0;
+	serU32(s, nEvents | HISTORY_F_EVENTS);
+	for (size_t i = 0; i < nEvents; i++) {
+		const Order::Event& ev = (*log)[i];
+		serU8(s, ev.state);
+		serU8(s, ev.hasNote ? 1 : 0);
+		serU32(s, (uint32_t) ev.qty);
+		serU32(s, ev.value);
+		if (ev.hasNote)
+			serStr(s, log->note(ev));
+	}
+}
+
+OrderPtr decodeOrder(BinReader& rd)
+{
+	OrderId id = rd.u64();
+	string alias = rd.str();
+	string symbol = rd.str();
+	uint8_t flags = rd.u8();
+	liquibook::book::Quantity qty = rd.u32();
+	liquibook::book::Price price = rd.u32();
+	liquibook::book::Price stopPrice = rd.u32();
+	liquibook::book::Quantity qtyFilled = rd.u32();
+	int32_t qtyOnMarket = (int32_t) rd.u32();
+	uint32_t fillCost = rd.u32();
+
+	struct timeval tv;
+	tv.tv_sec = (time_t) rd.u64();
+	tv.tv_usec = (suseconds_t) rd.u32();
+
+	if (!rd.ok())
+		return OrderPtr();
+
+	OrderPtr order(new Order(id,
+				(flags & ORDER_F_BUY) != 0,
+				qty, symbol, price, stopPrice,
+				(flags & ORDER_F_AON) != 0,
+				(flags & ORDER_F_IOC) != 0));
+	order->setTimestamp(tv);
+	order->setAlias(alias);
+	order->restore(qtyFilled, qtyOnMarket, fillCost);
+
+	uint32_t nHistory = rd.u32();
+	bool compact = (nHistory & HISTORY_F_EVENTS) != 0;
+	nHistory &= ~HISTORY_F_EVENTS;
+	for (uint32_t i = 0; i < nHistory && rd.ok(); i++) {
+		Order::Event ev;
+		ev.state = rd.u8();
+		string note;
+		if (compact) {
+			ev.hasNote = rd.u8() != 0;
+			ev.qty = (int32_t) rd.u32();
+			ev.value = rd.u32();
+			if (ev.hasNote)
+				note = rd.str();
+		} else {
+			ev.hasNote = true;
+			ev.qty = 0;
+			ev.value = 0;
+			note = rd.str();
+		}
+		if (rd.ok())
+			order->restoreEvent(ev, note);
+	}
+
+	if (!rd.ok())
+		return OrderPtr();
+
+	return order;
+}
+
+// std::string keeps short strings inline; count only heap spill
+static size_t strHeap(const string& s)
+{
+	return (s.capacity() > 15) ? (s.capacity() + 1) : 0;
+}
+
+size_t orderMemUsage(const Order& order)
+{
+	// pooled object; its count is intrusive
+	size_t sz = sizeof(Order);
+
+	// symbols are interned, and not counted
+	const OrderLog *log = order.log();
+	if (log) {
+		sz += sizeof(OrderLog);
+		sz += strHeap(order.alias());
+		if (log->size() > OrderLog::INLINE_EVENTS)
+			sz += (log->size() - OrderLog::INLINE_EVENTS) *
+			      sizeof(Order::Event);
+		for (size_t i = 0; i < log->size(); i++)
+			if ((*log)[i].hasNote)
+				sz += sizeof(string) +
+				      strHeap(log->note((*log)[i]));
+	}
+
+	return sz;
+}
+
+OrderArchive::OrderArchive()
+	: maxOrders_(1000000), maxAge_(0), spillDb_(NULL),
+	  bytes_(0), nEvicted_(0), nSpilled_(0)
+{
+}
+
+void OrderArchive::add(const OrderPtr& order, time_t now)
+{
+	Entry ent = { now, order };
+	fifo_.push_back(ent);
+	index_.insert(order->order_id(), order);
+	if (!order->alias().empty())
+		aliases_[order->alias()] = order->order_id();
+	bytes_ += orderMemUsage(*order);
+
+	expire(now);
+}
+
+void OrderArchive::expire(time_t now)
+{
+	while (!fifo_.empty() &&
+	       ((fifo_.size() > maxOrders_) ||
+		(maxAge_ && ((now - fifo_.front().archived) > maxAge_))))
+		evictOldest();
+}
+
+// spilled orders are only queued here, and stay indexed until written
+void OrderArchive::evictOldest()
+{
+	const OrderPtr& order = fifo_.front().order;
+
+	if (spillDb_) {
+		string val;
+		encodeOrder(val, *order);
+
+		spillBatch_.Put(spillKey(order->order_id()), val);
+		if (!order->alias().empty()) {
+			string idKey;
+			serKeyU64(idKey, order->order_id());
+			spillBatch_.Put(aliasPrefix + order->alias(), idKey);
+		}
+		spilling_.push_back(fifo_.front());
+	} else
+		drop(order);
+
+	fifo_.pop_front();
+}
+
+void OrderArchive::drop(const OrderPtr& order)
+{
+	bytes_ -= orderMemUsage(*order);
+	index_.erase(order->order_id());
+	if (!order->alias().empty())
+		aliases_.erase(order->alias());
+	nEvicted_++;
+}
+
+// one write for every order evicted since the last call.  On failure
+// they return to the head of the archive, to be spilled again when
+// next evicted.
+bool OrderArchive::commitSpill()
+{
+	if (spilling_.empty())
+		return true;
+
+	rocksdb::Status s = spillDb_->Write(rocksdb::WriteOptions(),
+					    &spillBatch_);
+	spillBatch_.Clear();
+	if (!s.ok()) {
+		syslog(LOG_DAEMON|LOG_ERR,
+		       "archive: spill failed, %zu orders kept: %s",
+		       spilling_.size(), s.ToString().c_str());
+		fifo_.insert(fifo_.begin(), spilling_.begin(), spilling_.end());
+		spilling_.clear();
+		return false;
+	}
+
+	for (auto it = spilling_.begin(); it != spilling_.end(); ++it) {
+		drop(it->order);
+		nSpilled_++;
+	}
+	spilling_.clear();
+	return true;
+}
+
+bool OrderArchive::find(OrderId orderId, OrderPtr& order)
+{
+	OrderPtr *p = index_.find(orderId);
+	if (p) {
+		order = *p;
+		return true;
+	}
+
+	if (!spillDb_)
+		return false;
+
+	string val;
+	rocksdb::Status s = spillDb_->Get(rocksdb::ReadOptions(),
+				spillKey(orderId), &val);
+	if (!s.ok())
+		return false;
+
+	BinReader rd(val.data(), val.size());
+	order = decodeOrder(rd);
+	return (bool) order;
+}
+
+bool OrderArchive::findAlias(const std::string& alias, OrderId& orderId)
+{
+	auto it = aliases_.find(alias);
+	if (it != aliases_.end()) {
+		orderId = it->second;
+		return true;
+	}
+
+	if (!spillDb_)
+		return false;
+
+	string val;
+	rocksdb::Status s = spillDb_->Get(rocksdb::ReadOptions(),
+				aliasPrefix + alias, &val);
+	if (!s.ok() || val.size() != 8)
+		return false;
+
+	orderId = deserKeyU64(val.data());
+	return true;
+}
+
+// hash slots, aliases, and the eviction queue
+size_t OrderArchive::indexBytes() const
+{
+	return index_.memUsage() + aliasMapBytes(aliases_) +
+	       (fifo_.size() * sizeof(Entry));
+}
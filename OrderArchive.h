@@ -0,0 +1,76 @@
+#ifndef __ORDERARCHIVE_H__
+#define __ORDERARCHIVE_H__
+
+#include <string>
+#include <deque>
+#include <unordered_map>
+#include <cstdint>
+#include <time.h>
+#include "Order.h"
+#include "OrderIndex.h"
+#include "Serialize.h"
+#include "rocksdb/db.h"
+#include "rocksdb/write_batch.h"
+
+// Binary order encoding, shared by snapshots and archive spill.
+void encodeOrder(std::string& s, const orderentry::Order& order);
+orderentry::OrderPtr decodeOrder(BinReader& rd);
+
+// Approximate heap footprint of one order, including history.
+size_t orderMemUsage(const orderentry::Order& order);
+
+// Orders in a terminal state (filled, cancelled, rejected), moved out
+// of the live Market index.  Retention is bounded by count and by age;
+// the oldest orders are evicted first, and are written to RocksDB under
+// /order/<id> (and /orderAlias/<uuid>) when spill is enabled, or discarded otherwise.
+// Spilled orders are written together by commitSpill, between batches
+// of commands; until then, and if the write fails, they stay archived.
+class OrderArchive {
+public:
+	struct Entry {
+		time_t			archived;
+		orderentry::OrderPtr	order;
+	};
+
+	OrderArchive();
+
+	void setLimits(size_t maxOrders, time_t maxAge) {
+		maxOrders_ = maxOrders;
+		maxAge_ = maxAge;
+	}
+	void setSpill(rocksdb::DB *db) { spillDb_ = db; }
+	bool commitSpill();
+
+	void add(const orderentry::OrderPtr& order, time_t now);
+	void expire(time_t now);
+	bool find(OrderId orderId, orderentry::OrderPtr& order);
+	bool findAlias(const std::string& alias, OrderId& orderId);
+
+	// oldest first
+	const std::deque<Entry>& entries() const { return fifo_; }
+
+	size_t size() const { return fifo_.size(); }
+	size_t bytes() const { return bytes_; }
+	size_t indexBytes() const;
+	uint64_t evicted() const { return nEvicted_; }
+	uint64_t spilled() const { return nSpilled_; }
+
+private:
+	size_t			maxOrders_;
+	time_t			maxAge_;		// seconds; 0 for no limit
+	rocksdb::DB		*spillDb_;
+
+	std::deque<Entry>	fifo_;
+	std::deque<Entry>	spilling_;	// evicted, not yet written
+	rocksdb::WriteBatch	spillBatch_;
+	OrderIndex		index_;
+	AliasMap		aliases_;
+	size_t			bytes_;
+	uint64_t		nEvicted_;
+	uint64_t		nSpilled_;
+
+	void evictOldest();
+	void drop(const orderentry::OrderPtr& order);
+};
+
+#endif // __ORDERARCHIVE_H__
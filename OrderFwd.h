@@ -2,9 +2,9 @@
 // All rights reserved.
 // See the file license.txt for licensing information.
 #pragma once
-#include <memory>
+#include "IntrusivePtr.h"
 namespace orderentry
 {
     class Order;
-    typedef std::shared_ptr<Order> OrderPtr;
+    typedef IntrusivePtr<Order> OrderPtr;
 }
@@ -0,0 +1,60 @@
+#ifndef __ORDERID_H__
+#define __ORDERID_H__
+
+#include <string>
+#include <cstdint>
+#include <cstdlib>
+#include <cerrno>
+#include <inttypes.h>
+#include <stdio.h>
+
+// Engine-assigned order id: an 8-bit shard prefix above a 56-bit
+// sequence number, monotonically increasing within each shard.
+// Zero is never assigned, and serves as "no order".
+typedef uint64_t OrderId;
+
+enum {
+	ORDER_ID_SHARD_SHIFT	= 56,
+};
+
+static const uint64_t ORDER_ID_SEQ_MASK = (1ULL << ORDER_ID_SHARD_SHIFT) - 1;
+
+static inline OrderId makeOrderId(unsigned int shard, uint64_t seq)
+{
+	return ((uint64_t) shard << ORDER_ID_SHARD_SHIFT) | (seq & ORDER_ID_SEQ_MASK);
+}
+
+static inline unsigned int orderIdShard(OrderId id)
+{
+	return (unsigned int) (id >> ORDER_ID_SHARD_SHIFT);
+}
+
+static inline uint64_t orderIdSeq(OrderId id)
+{
+	return id & ORDER_ID_SEQ_MASK;
+}
+
+// external API form: decimal
+static inline std::string orderIdStr(OrderId id)
+{
+	char buf[24];
+	snprintf(buf, sizeof(buf), "%" PRIu64, id);
+	return buf;
+}
+
+static inline bool parseOrderId(const std::string& s, OrderId& id)
+{
+	if (s.empty() || s.size() > 20 ||
+	    s.find_first_not_of("0123456789") != std::string::npos)
+		return false;
+
+	errno = 0;
+	unsigned long long v = strtoull(s.c_str(), NULL, 10);
+	if (errno || v == 0)
+		return false;
+
+	id = v;
+	return true;
+}
+
+#endif // __ORDERID_H__
@@ -0,0 +1,146 @@
+#ifndef __ORDERINDEX_H__
+#define __ORDERINDEX_H__
+
+#include <vector>
+#include <string>
+#include <unordered_map>
+#include <cstddef>
+#include "OrderId.h"
+#include "OrderFwd.h"
+
+// Open-addressing hash index, OrderId -> OrderPtr.  Linear probing
+// with backward-shift deletion, so there are no tombstones; the table
+// doubles whenever it would exceed 50% load.  Id 0 marks a free slot.
+class OrderIndex {
+public:
+	explicit OrderIndex(size_t capacity = 1024) : size_(0) {
+		size_t n = 16;
+		while (n < capacity)
+			n <<= 1;
+		slots_.resize(n);
+		mask_ = n - 1;
+	}
+
+	size_t size() const { return size_; }
+	bool empty() const { return size_ == 0; }
+	size_t bucketCount() const { return slots_.size(); }
+	size_t memUsage() const { return slots_.capacity() * sizeof(Slot); }
+
+	orderentry::OrderPtr *find(OrderId id) {
+		for (size_t i = hash(id) & mask_; slots_[i].id; i = (i + 1) & mask_)
+			if (slots_[i].id == id)
+				return &slots_[i].order;
+		return NULL;
+	}
+	const orderentry::OrderPtr *find(OrderId id) const {
+		return const_cast<OrderIndex *>(this)->find(id);
+	}
+
+	void insert(OrderId id, const orderentry::OrderPtr& order) {
+		if ((size_ + 1) * 2 > slots_.size())
+			rehash(slots_.size() * 2);
+
+		size_t i = hash(id) & mask_;
+		for (; slots_[i].id; i = (i + 1) & mask_) {
+			if (slots_[i].id == id) {
+				slots_[i].order = order;
+				return;
+			}
+		}
+
+		slots_[i].id = id;
+		slots_[i].order = order;
+		size_++;
+	}
+
+	bool erase(OrderId id) {
+		size_t i = hash(id) & mask_;
+		for (; slots_[i].id != id; i = (i + 1) & mask_)
+			if (!slots_[i].id)
+				return false;
+
+		// pull later members of the probe run back into the hole
+		size_t j = i;
+		for (;;) {
+			j = (j + 1) & mask_;
+			if (!slots_[j].id)
+				break;
+			size_t home = hash(slots_[j].id) & mask_;
+			if (((j - home) & mask_) >= ((j - i) & mask_)) {
+				slots_[i].id = slots_[j].id;
+				slots_[i].order.swap(slots_[j].order);
+				i = j;
+			}
+		}
+
+		slots_[i].id = 0;
+		slots_[i].order.reset();
+		size_--;
+		return true;
+	}
+
+	template <typename Fn>
+	void forEach(Fn fn) const {
+		for (size_t i = 0; i < slots_.size(); i++)
+			if (slots_[i].id)
+				fn(slots_[i].order);
+	}
+
+private:
+	struct Slot {
+		OrderId			id;
+		orderentry::OrderPtr	order;
+
+		Slot() : id(0) {}
+	};
+
+	std::vector<Slot>	slots_;
+	size_t			mask_;
+	size_t			size_;
+
+	// ids are sequential; mix so that runs spread across the table
+	static size_t hash(OrderId id) {
+		id ^= id >> 33;
+		id *= 0xff51afd7ed558ccdULL;
+		id ^= id >> 33;
+		return (size_t) id;
+	}
+
+	void rehash(size_t n) {
+		std::vector<Slot> old;
+		old.swap(slots_);
+		slots_.resize(n);
+		mask_ = n - 1;
+
+		for (size_t i = 0; i < old.size(); i++) {
+			if (!old[i].id)
+				continue;
+			size_t j = hash(old[i].id) & mask_;
+			while (slots_[j].id)
+				j = (j + 1) & mask_;
+			slots_[j].id = old[i].id;
+			slots_[j].order.swap(old[i].order);
+		}
+	}
+};
+
+// Client aliases (compatibility-mode UUIDs) to order ids.
+typedef std::unordered_map<std::string, OrderId> AliasMap;
+
+// Approximate heap footprint of an AliasMap: its bucket array, and per
+// alias one node -- link, key and value, cached hash -- plus the UUID
+// text, too long for the string's inline buffer.
+static inline size_t aliasMapBytes(const AliasMap& aliases)
+{
+	struct Node {
+		void			*next;
+		AliasMap::value_type	value;
+		size_t			hash;
+	};
+	const size_t uuidHeap = 36 + 1;		// text and NUL
+
+	return (aliases.bucket_count() * sizeof(void *)) +
+	       (aliases.size() * (sizeof(Node) + uuidHeap));
+}
+
+#endif // __ORDERINDEX_H__
@@ -0,0 +1,111 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <new>
+#include <mutex>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Fixed-size object pool.  Objects are carved from slabs of SLAB_OBJS,
+// and freed objects go on a free list for reuse.  Each thread has its
+// own free lists, so matching shards share no allocator state and the
+// hot path takes no lock.  An object may be freed by another thread;
+// it then joins that thread's list.  Slabs are never returned, so a
+// pool's memory stays at its high-water mark.
+template <size_t Size>
+class FixedPool {
+public:
+	enum { SLAB_OBJS = 256 };
+
+	static void *alloc() {
+		Local& local = local_;
+		Node *node = local.free;
+		if (!node)
+			node = refill(local);
+		local.free = node->next;
+		local.allocs++;
+		return node;
+	}
+
+	static void free(void *p) {
+		Local& local = local_;
+		Node *node = static_cast<Node *>(p);
+		node->next = local.free;
+		local.free = node;
+		local.frees++;
+	}
+
+	// this thread's counts
+	static uint64_t allocs() { return local_.allocs; }
+	static uint64_t frees() { return local_.frees; }
+	static uint64_t slabs() { return local_.slabs; }
+
+private:
+	union Node {
+		Node		*next;
+		unsigned char	obj[Size];
+		std::max_align_t align;
+	};
+
+	struct Local {
+		Node		*free;
+		uint64_t	allocs;
+		uint64_t	frees;
+		uint64_t	slabs;
+	};
+
+	static thread_local Local local_;
+
+	static Node *refill(Local& local) {
+		Node *slab = static_cast<Node *>(
+			::operator new(SLAB_OBJS * sizeof(Node)));
+		for (size_t i = 0; i < SLAB_OBJS - 1; i++)
+			slab[i].next = &slab[i + 1];
+		slab[SLAB_OBJS - 1].next = NULL;
+		local.slabs++;
+
+		// slabs stay reachable, for leak checkers
+		static std::mutex mtx;
+		static std::vector<void *> *all = new std::vector<void *>;
+		std::lock_guard<std::mutex> lk(mtx);
+		all->push_back(slab);
+
+		return slab;
+	}
+};
+
+template <size_t Size>
+thread_local typename FixedPool<Size>::Local FixedPool<Size>::local_;
+
+// Standard allocator drawing single objects from a FixedPool, for the
+// nodes of node-based containers.  Arrays come from the heap.
+template <typename T>
+class PoolAllocator {
+public:
+	typedef T value_type;
+
+	PoolAllocator() {}
+	template <typename U>
+	PoolAllocator(const PoolAllocator<U>&) {}
+
+	T *allocate(size_t n) {
+		if (n == 1)
+			return static_cast<T *>(FixedPool<sizeof(T)>::alloc());
+		return static_cast<T *>(::operator new(n * sizeof(T)));
+	}
+
+	void deallocate(T *p, size_t n) {
+		if (n == 1)
+			FixedPool<sizeof(T)>::free(p);
+		else
+			::operator delete(p);
+	}
+
+	template <typename U>
+	bool operator==(const PoolAllocator<U>&) const { return true; }
+	template <typename U>
+	bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+#endif // __POOL_H__
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <book/types.h>
+
+#include "Order.h"
+
+#include <map>
+#include <unordered_set>
+#include <cstdint>
+
+struct BookMetrics;
+
+namespace orderentry
+{
+
+/// @brief aggregate of the resting orders at one price
+struct PriceLevel
+{
+    liquibook::book::Quantity qty;
+    uint32_t orders;
+};
+
+/// @brief price-level index of one book, kept by the Market from its
+/// order callbacks, so that top-of-book queries need not visit every
+/// resting order.  Levels are in ascending price order on both sides.
+///
+/// Orders waiting on their stop price are not on the book.  They are
+/// held aside, and indexed once triggered onto the book.
+class PriceLevels
+{
+public:
+    typedef std::map<liquibook::book::Price, PriceLevel> LevelMap;
+    typedef std::unordered_set<OrderPtr> OrderSet;
+
+    const LevelMap & bids() const { return bids_; }
+    const LevelMap & asks() const { return asks_; }
+
+    void add(bool isBuy, liquibook::book::Price price,
+             liquibook::book::Quantity qty)
+    {
+        PriceLevel & level = (isBuy ? bids_ : asks_)[price];
+        level.qty += qty;
+        level.orders++;
+        orders_++;
+    }
+
+    /// @param closed the order has left the book
+    void reduce(bool isBuy, liquibook::book::Price price,
+                liquibook::book::Quantity qty, bool closed)
+    {
+        LevelMap & side = isBuy ? bids_ : asks_;
+        auto pos = side.find(price);
+        if(pos == side.end())
+        {
+            return;
+        }
+        pos->second.qty -= qty;
+        if(closed)
+        {
+            orders_--;
+            if(--pos->second.orders == 0)
+            {
+                side.erase(pos);
+            }
+        }
+    }
+
+    /// @brief orders on the book, and waiting on a stop price
+    size_t restingOrders() const { return orders_ + stopped_.size(); }
+
+    ////////////////////////
+    // Orders waiting on a stop price
+    OrderSet & stopped() { return stopped_; }
+    const OrderSet & stopped() const { return stopped_; }
+    bool isStopped(const OrderPtr & order) const
+    {
+        return !stopped_.empty() && stopped_.count(order) != 0;
+    }
+
+    ////////////////////////
+    // The book's counters, kept here: every callback finds its levels
+    BookMetrics * metrics() const { return metrics_; }
+    void setMetrics(BookMetrics * metrics) { metrics_ = metrics; }
+
+    void clear()
+    {
+        bids_.clear();
+        asks_.clear();
+        stopped_.clear();
+        orders_ = 0;
+    }
+
+private:
+    size_t orders_ = 0;
+    BookMetrics * metrics_ = nullptr;
+    LevelMap bids_;
+    LevelMap asks_;
+    OrderSet stopped_;
+};
+
+} // namespace orderentry
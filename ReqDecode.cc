@@ -0,0 +1,450 @@
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include "ReqDecode.h"
+
+using namespace std;
+
+enum {
+	MAX_SKIP_DEPTH		= 32,	// nesting allowed in skipped values
+};
+
+namespace {
+
+enum JsonType {
+	J_STR,
+	J_NUM,
+	J_BOOL,
+	J_NULL,
+	J_OBJ,
+	J_ARR,
+};
+
+// one value, as read.  Objects and arrays are checked and skipped.
+struct JsonVal {
+	JsonType		type;
+	JsonStr			str;
+	int64_t			num;
+	bool			isInt;		// integral, and within int64
+	bool			b;
+};
+
+class JsonCursor {
+public:
+	JsonCursor(char *p, size_t len) : p_(p), end_(p + len) {}
+
+	// next non-space char, or 0 at the end
+	char peek() {
+		while (p_ < end_ &&
+		       (*p_ == ' ' || *p_ == '\t' || *p_ == '\n' || *p_ == '\r'))
+			p_++;
+		return (p_ < end_) ? *p_ : 0;
+	}
+	bool take(char ch) {
+		if (peek() != ch)
+			return false;
+		p_++;
+		return true;
+	}
+	bool atEnd() { return (peek() == 0) && (p_ == end_); }
+
+	bool value(JsonVal& v, unsigned int depth = 0);
+
+	// fn(key) reads each member's value
+	template<typename Fn> bool object(Fn fn);
+	// fn() reads each element
+	template<typename Fn> bool array(Fn fn);
+
+private:
+	char			*p_;
+	char			*end_;
+
+	bool string(JsonStr& out);
+	bool number(int64_t& v, bool& isInt);
+	bool literal(const char *word);
+	bool hex4(uint32_t& v);
+};
+
+template<typename Fn>
+bool JsonCursor::object(Fn fn)
+{
+	if (!take('{'))
+		return false;
+	if (take('}'))
+		return true;
+
+	do {
+		JsonStr key;
+		if ((peek() != '"') || !string(key) || !take(':') || !fn(key))
+			return false;
+	} while (take(','));
+
+	return take('}');
+}
+
+template<typename Fn>
+bool JsonCursor::array(Fn fn)
+{
+	if (!take('['))
+		return false;
+	if (take(']'))
+		return true;
+
+	do {
+		if (!fn())
+			return false;
+	} while (take(','));
+
+	return take(']');
+}
+
+bool JsonCursor::value(JsonVal& v, unsigned int depth)
+{
+	switch (peek()) {
+	case '"':
+		v.type = J_STR;
+		return string(v.str);
+	case '{':
+		v.type = J_OBJ;
+		return (depth < MAX_SKIP_DEPTH) &&
+		       object([this, depth](const JsonStr&) {
+				JsonVal sub;
+				return value(sub, depth + 1);
+			      });
+	case '[':
+		v.type = J_ARR;
+		return (depth < MAX_SKIP_DEPTH) &&
+		       array([this, depth]() {
+				JsonVal sub;
+				return value(sub, depth + 1);
+			     });
+	case 't':
+		v.type = J_BOOL;
+		v.b = true;
+		return literal("true");
+	case 'f':
+		v.type = J_BOOL;
+		v.b = false;
+		return literal("false");
+	case 'n':
+		v.type = J_NULL;
+		return literal("null");
+	default:
+		v.type = J_NUM;
+		return number(v.num, v.isInt);
+	}
+}
+
+bool JsonCursor::literal(const char *word)
+{
+	size_t len = strlen(word);
+	if (((size_t) (end_ - p_) < len) || (memcmp(p_, word, len) != 0))
+		return false;
+	p_ += len;
+	return true;
+}
+
+bool JsonCursor::hex4(uint32_t& v)
+{
+	if (end_ - p_ < 4)
+		return false;
+
+	v = 0;
+	for (unsigned int i = 0; i < 4; i++) {
+		char ch = *p_++;
+		v <<= 4;
+		if (ch >= '0' && ch <= '9')
+			v |= ch - '0';
+		else if (ch >= 'a' && ch <= 'f')
+			v |= ch - 'a' + 10;
+		else if (ch >= 'A' && ch <= 'F')
+			v |= ch - 'A' + 10;
+		else
+			return false;
+	}
+	return true;
+}
+
+// unescapes in place: the text never grows, so the write position
+// stays behind the read position
+bool JsonCursor::string(JsonStr& out)
+{
+	p_++;			// opening quote
+	char *w = p_;
+	out.p = p_;
+
+	while (p_ < end_) {
+		unsigned char ch = *p_++;
+		if (ch == '"') {
+			out.len = w - out.p;
+			return true;
+		}
+		if (ch < 0x20)
+			return false;
+		if (ch != '\\') {
+			*w++ = ch;
+			continue;
+		}
+
+		if (p_ == end_)
+			return false;
+		switch (*p_++) {
+		case '"':	*w++ = '"'; break;
+		case '\\':	*w++ = '\\'; break;
+		case '/':	*w++ = '/'; break;
+		case 'b':	*w++ = '\b'; break;
+		case 'f':	*w++ = '\f'; break;
+		case 'n':	*w++ = '\n'; break;
+		case 'r':	*w++ = '\r'; break;
+		case 't':	*w++ = '\t'; break;
+		case 'u': {
+			uint32_t cp, lo;
+			if (!hex4(cp))
+				return false;
+			if (cp >= 0xD800 && cp <= 0xDBFF) {
+				if ((end_ - p_ < 2) ||
+				    (p_[0] != '\\') || (p_[1] != 'u'))
+					return false;
+				p_ += 2;
+				if (!hex4(lo) || lo < 0xDC00 || lo > 0xDFFF)
+					return false;
+				cp = 0x10000 + ((cp - 0xD800) << 10) +
+				     (lo - 0xDC00);
+			} else if (cp >= 0xDC00 && cp <= 0xDFFF)
+				return false;
+
+			// UTF-8
+			if (cp < 0x80)
+				*w++ = cp;
+			else if (cp < 0x800) {
+				*w++ = 0xC0 | (cp >> 6);
+				*w++ = 0x80 | (cp & 0x3F);
+			} else if (cp < 0x10000) {
+				*w++ = 0xE0 | (cp >> 12);
+				*w++ = 0x80 | ((cp >> 6) & 0x3F);
+				*w++ = 0x80 | (cp & 0x3F);
+			} else {
+				*w++ = 0xF0 | (cp >> 18);
+				*w++ = 0x80 | ((cp >> 12) & 0x3F);
+				*w++ = 0x80 | ((cp >> 6) & 0x3F);
+				*w++ = 0x80 | (cp & 0x3F);
+			}
+			break;
+		}
+		default:
+			return false;
+		}
+	}
+
+	return false;		// unterminated
+}
+
+static bool isDigit(char ch)
+{
+	return (ch >= '0') && (ch <= '9');
+}
+
+// JSON number grammar; only integers within int64 are kept
+bool JsonCursor::number(int64_t& v, bool& isInt)
+{
+	bool neg = false;
+	if (p_ < end_ && *p_ == '-') {
+		neg = true;
+		p_++;
+	}
+	if (p_ == end_ || !isDigit(*p_))
+		return false;
+
+	uint64_t mag = 0;
+	bool over = false;
+	if (*p_ == '0')
+		p_++;
+	else {
+		while (p_ < end_ && isDigit(*p_)) {
+			unsigned int d = *p_++ - '0';
+			if (mag > (UINT64_MAX - d) / 10)
+				over = true;
+			else
+				mag = (mag * 10) + d;
+		}
+	}
+
+	isInt = true;
+	if (p_ < end_ && *p_ == '.') {
+		p_++;
+		if (p_ == end_ || !isDigit(*p_))
+			return false;
+		while (p_ < end_ && isDigit(*p_))
+			p_++;
+		isInt = false;
+	}
+	if (p_ < end_ && (*p_ == 'e' || *p_ == 'E')) {
+		p_++;
+		if (p_ < end_ && (*p_ == '+' || *p_ == '-'))
+			p_++;
+		if (p_ == end_ || !isDigit(*p_))
+			return false;
+		while (p_ < end_ && isDigit(*p_))
+			p_++;
+		isInt = false;
+	}
+
+	if (over || mag > (neg ? (1ULL << 63) : (uint64_t) INT64_MAX))
+		isInt = false;
+	v = neg ? (int64_t) (0 - mag) : (int64_t) mag;
+
+	return true;
+}
+
+// Field setters: each sets the field and its bit if the value has the
+// field's type, and marks the request bad if not.
+
+template<typename Req>
+void setStr(Req& req, uint32_t bit, JsonStr& out, const JsonVal& v)
+{
+	if (v.type != J_STR) {
+		req.bad = true;
+		return;
+	}
+	out = v.str;
+	req.have |= bit;
+}
+
+template<typename Req>
+void setBool(Req& req, uint32_t bit, bool& out, const JsonVal& v)
+{
+	if (v.type != J_BOOL) {
+		req.bad = true;
+		return;
+	}
+	out = v.b;
+	req.have |= bit;
+}
+
+template<typename Req, typename T>
+void setInt(Req& req, uint32_t bit, T& out, const JsonVal& v,
+	    int64_t vMin, int64_t vMax)
+{
+	if ((v.type != J_NUM) || !v.isInt ||
+	    (v.num < vMin) || (v.num > vMax)) {
+		req.bad = true;
+		return;
+	}
+	out = (T) v.num;
+	req.have |= bit;
+}
+
+// one member of an order op
+bool orderField(JsonCursor& cur, const JsonStr& key, OrderReq& req)
+{
+	JsonVal v;
+	if (!cur.value(v))
+		return false;
+
+	if (key.equals("symbol"))
+		setStr(req, OrderReq::F_SYMBOL, req.symbol, v);
+	else if (key.equals("qty"))
+		setInt(req, OrderReq::F_QTY, req.qty, v, 0, UINT32_MAX);
+	else if (key.equals("price"))
+		setInt(req, OrderReq::F_PRICE, req.price, v, 0, UINT32_MAX);
+	else if (key.equals("is_buy"))
+		setBool(req, OrderReq::F_IS_BUY, req.isBuy, v);
+	else if (key.equals("oid"))
+		setStr(req, OrderReq::F_OID, req.oid, v);
+	else if (key.equals("qtyDelta"))
+		setInt(req, OrderReq::F_QTY_DELTA, req.qtyDelta, v,
+		       INT32_MIN, INT32_MAX);
+	else if (key.equals("aon"))
+		setBool(req, OrderReq::F_AON, req.aon, v);
+	else if (key.equals("ioc"))
+		setBool(req, OrderReq::F_IOC, req.ioc, v);
+	else if (key.equals("stop"))
+		setInt(req, OrderReq::F_STOP, req.stop, v, 0, UINT32_MAX);
+	else if (key.equals("op"))
+		setStr(req, OrderReq::F_OP, req.op, v);
+
+	return true;
+}
+
+} // namespace
+
+bool decodeOrderReq(char *body, size_t len, OrderReq& req)
+{
+	JsonCursor cur(body, len);
+
+	return cur.object([&cur, &req](const JsonStr& key) {
+			return orderField(cur, key, req);
+		}) && cur.atEnd();
+}
+
+bool decodeMarketAddReq(char *body, size_t len, MarketAddReq& req)
+{
+	JsonCursor cur(body, len);
+
+	return cur.object([&cur, &req](const JsonStr& key) {
+			JsonVal v;
+			if (!cur.value(v))
+				return false;
+
+			if (key.equals("symbol"))
+				setStr(req, MarketAddReq::F_SYMBOL,
+				       req.symbol, v);
+			else if (key.equals("booktype"))
+				setStr(req, MarketAddReq::F_BOOKTYPE,
+				       req.booktype, v);
+			else if (key.equals("minPrice"))
+				setInt(req, MarketAddReq::F_MIN_PRICE,
+				       req.minPrice, v, INT64_MIN, INT64_MAX);
+			else if (key.equals("maxPrice"))
+				setInt(req, MarketAddReq::F_MAX_PRICE,
+				       req.maxPrice, v, INT64_MIN, INT64_MAX);
+			else if (key.equals("tick"))
+				setInt(req, MarketAddReq::F_TICK,
+				       req.tick, v, INT64_MIN, INT64_MAX);
+			else if (key.equals("depth"))
+				setInt(req, MarketAddReq::F_DEPTH,
+				       req.depth, v, INT64_MIN, INT64_MAX);
+			return true;
+		}) && cur.atEnd();
+}
+
+bool decodeBatchReq(char *body, size_t len, BatchReq& req, size_t maxOps)
+{
+	JsonCursor cur(body, len);
+
+	// one item: an order op, or a bad placeholder
+	auto item = [&cur, &req, maxOps]() {
+		if (req.ops.size() >= maxOps)
+			return false;
+		req.ops.push_back(OrderReq());
+		OrderReq& op = req.ops.back();
+
+		if (cur.peek() != '{') {
+			JsonVal v;
+			op.bad = true;
+			return cur.value(v);
+		}
+		return cur.object([&cur, &op](const JsonStr& key) {
+				return orderField(cur, key, op);
+			});
+	};
+
+	return cur.object([&cur, &req, &item](const JsonStr& key) {
+			if (key.equals("ops") && (cur.peek() == '[')) {
+				req.ops.clear();
+				req.have |= BatchReq::F_OPS;
+				return cur.array(item);
+			}
+
+			JsonVal v;
+			if (!cur.value(v))
+				return false;
+
+			if (key.equals("ops"))
+				req.bad = true;		// not an array
+			else if (key.equals("atomic"))
+				setBool(req, BatchReq::F_ATOMIC, req.atomic, v);
+			return true;
+		}) && cur.atEnd();
+}
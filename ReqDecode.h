@@ -0,0 +1,123 @@
+#ifndef __REQDECODE_H__
+#define __REQDECODE_H__
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <cstddef>
+
+// Single-pass decoders for the fixed JSON request bodies of the order
+// entry endpoints.  Each parses straight into a plain request struct,
+// checking field types as it goes; there is no DOM and no schema.
+//
+// Strings are unescaped in place and referenced, not copied, so the
+// body must outlive the decoded request.  Unknown keys are skipped.
+// A known key holding the wrong type, or a number out of its field's
+// range, marks the request (or batch item) bad, rather than failing
+// the parse: the caller decides what a bad item means.
+
+// a decoded string, within the request body
+struct JsonStr {
+	const char		*p;
+	size_t			len;
+
+	JsonStr() : p(""), len(0) {}
+
+	bool equals(const char *s) const {
+		return (strlen(s) == len) && (memcmp(p, s, len) == 0);
+	}
+	std::string str() const { return std::string(p, len); }
+};
+
+// one order op: the body of /orderAdd, /orderCancel or /orderModify,
+// or one /orderBatch item.  'have' records the fields present.
+struct OrderReq {
+	enum {
+		F_OP		= (1U << 0),
+		F_SYMBOL	= (1U << 1),
+		F_QTY		= (1U << 2),
+		F_PRICE		= (1U << 3),
+		F_IS_BUY	= (1U << 4),
+		F_AON		= (1U << 5),
+		F_IOC		= (1U << 6),
+		F_STOP		= (1U << 7),
+		F_OID		= (1U << 8),
+		F_QTY_DELTA	= (1U << 9),
+	};
+
+	uint32_t		have;
+	bool			bad;		// wrong type or out of range
+
+	JsonStr			op;		// batch items only
+	JsonStr			symbol;
+	JsonStr			oid;
+	uint32_t		qty;
+	uint32_t		price;
+	uint32_t		stop;
+	int32_t			qtyDelta;
+	bool			isBuy;
+	bool			aon;
+	bool			ioc;
+
+	OrderReq()
+		: have(0), bad(false), qty(0), price(0), stop(0),
+		  qtyDelta(0), isBuy(false), aon(false), ioc(false) {}
+
+	bool has(uint32_t fields) const { return (have & fields) == fields; }
+};
+
+// the body of /marketAdd
+struct MarketAddReq {
+	enum {
+		F_SYMBOL	= (1U << 0),
+		F_BOOKTYPE	= (1U << 1),
+		F_MIN_PRICE	= (1U << 2),
+		F_MAX_PRICE	= (1U << 3),
+		F_TICK		= (1U << 4),
+		F_DEPTH		= (1U << 5),
+	};
+
+	uint32_t		have;
+	bool			bad;
+
+	JsonStr			symbol;
+	JsonStr			booktype;
+	int64_t			minPrice;
+	int64_t			maxPrice;
+	int64_t			tick;
+	int64_t			depth;
+
+	MarketAddReq()
+		: have(0), bad(false), minPrice(0), maxPrice(0), tick(0),
+		  depth(0) {}
+
+	bool has(uint32_t fields) const { return (have & fields) == fields; }
+};
+
+// the body of /orderBatch.  Items that are not objects are kept, bad,
+// so that results stay in client order.
+struct BatchReq {
+	enum {
+		F_OPS		= (1U << 0),
+		F_ATOMIC	= (1U << 1),
+	};
+
+	uint32_t		have;
+	bool			bad;
+
+	bool			atomic;
+	std::vector<OrderReq>	ops;
+
+	BatchReq() : have(0), bad(false), atomic(false) {}
+
+	bool has(uint32_t fields) const { return (have & fields) == fields; }
+};
+
+// Each returns false if the body is not a well-formed JSON object;
+// the batch decoder also fails beyond maxOps items.
+bool decodeOrderReq(char *body, size_t len, OrderReq& req);
+bool decodeMarketAddReq(char *body, size_t len, MarketAddReq& req);
+bool decodeBatchReq(char *body, size_t len, BatchReq& req, size_t maxOps);
+
+#endif // __REQDECODE_H__
@@ -0,0 +1,98 @@
+#ifndef __RINGBUFFER_H__
+#define __RINGBUFFER_H__
+
+#include <atomic>
+#include <memory>
+#include <cstddef>
+
+// Bounded lock-free queue, safe for any number of producer and
+// consumer threads (D. Vyukov's sequenced-cell design).  push() and
+// pop() never block; push() fails when the ring is full.
+template <typename T>
+class RingBuffer {
+public:
+	explicit RingBuffer(size_t capacity)
+		: enqPos_(0), deqPos_(0) {
+		size_t n = 2;
+		while (n < capacity)
+			n <<= 1;
+		mask_ = n - 1;
+
+		cells_.reset(new Cell[n]);
+		for (size_t i = 0; i < n; i++)
+			cells_[i].seq.store(i, std::memory_order_relaxed);
+	}
+
+	size_t capacity() const { return mask_ + 1; }
+
+	// consumer-side hint; may be stale by the time it returns
+	bool empty() const {
+		size_t pos = deqPos_.load(std::memory_order_acquire);
+		const Cell *cell = &cells_[pos & mask_];
+		return cell->seq.load(std::memory_order_acquire) != (pos + 1);
+	}
+
+	bool push(const T& v) {
+		Cell *cell;
+		size_t pos = enqPos_.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+			if (diff == 0) {
+				if (enqPos_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;		// full
+			} else {
+				pos = enqPos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		cell->data = v;
+		cell->seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	bool pop(T& v) {
+		Cell *cell;
+		size_t pos = deqPos_.load(std::memory_order_relaxed);
+		for (;;) {
+			cell = &cells_[pos & mask_];
+			size_t seq = cell->seq.load(std::memory_order_acquire);
+			intptr_t diff = (intptr_t) seq - (intptr_t) (pos + 1);
+			if (diff == 0) {
+				if (deqPos_.compare_exchange_weak(pos, pos + 1,
+						std::memory_order_relaxed))
+					break;
+			} else if (diff < 0) {
+				return false;		// empty
+			} else {
+				pos = deqPos_.load(std::memory_order_relaxed);
+			}
+		}
+
+		v = cell->data;
+		cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+		return true;
+	}
+
+private:
+	struct Cell {
+		std::atomic<size_t>	seq;
+		T			data;
+	};
+
+	std::unique_ptr<Cell[]>	cells_;
+	size_t			mask_;
+
+	// keep producer and consumer cursors on separate cache lines
+	char			pad0_[64];
+	std::atomic<size_t>	enqPos_;
+	char			pad1_[64 - sizeof(std::atomic<size_t>)];
+	std::atomic<size_t>	deqPos_;
+	char			pad2_[64 - sizeof(std::atomic<size_t>)];
+};
+
+#endif // __RINGBUFFER_H__
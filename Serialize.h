@@ -0,0 +1,120 @@
+#ifndef __SERIALIZE_H__
+#define __SERIALIZE_H__
+
+#include <string>
+#include <cstdint>
+#include <cstring>
+
+// Compact little-endian binary encoding, shared by the on-disk formats.
+
+static inline void serU8(std::string& s, uint8_t v)
+{
+	s.push_back((char) v);
+}
+
+static inline void serU32(std::string& s, uint32_t v)
+{
+	char buf[4];
+	for (unsigned int i = 0; i < sizeof(buf); i++)
+		buf[i] = (char) (v >> (i * 8));
+	s.append(buf, sizeof(buf));
+}
+
+static inline void serU64(std::string& s, uint64_t v)
+{
+	char buf[8];
+	for (unsigned int i = 0; i < sizeof(buf); i++)
+		buf[i] = (char) (v >> (i * 8));
+	s.append(buf, sizeof(buf));
+}
+
+// strings: 16-bit length prefix, followed by raw bytes
+static inline void serStr(std::string& s, const std::string& v)
+{
+	uint16_t len = (v.size() > UINT16_MAX) ? UINT16_MAX : v.size();
+	s.push_back((char) (len & 0xff));
+	s.push_back((char) (len >> 8));
+	s.append(v, 0, len);
+}
+
+// big-endian u64, for database keys that must sort numerically
+static inline void serKeyU64(std::string& s, uint64_t v)
+{
+	char buf[8];
+	for (unsigned int i = 0; i < sizeof(buf); i++)
+		buf[i] = (char) (v >> ((7 - i) * 8));
+	s.append(buf, sizeof(buf));
+}
+
+static inline uint64_t deserKeyU64(const char *p)
+{
+	uint64_t v = 0;
+	for (unsigned int i = 0; i < 8; i++)
+		v = (v << 8) | (unsigned char) p[i];
+	return v;
+}
+
+// Bounds-checked reader.  Once a read runs past the end of input,
+// ok() returns false and all further reads return zero.
+class BinReader {
+public:
+	BinReader(const char *p, size_t len)
+		: p_(p), end_(p + len), ok_(true) {}
+
+	bool ok() const { return ok_; }
+	bool eof() const { return p_ == end_; }
+
+	uint8_t u8() {
+		if (!need(1))
+			return 0;
+		return (unsigned char) *p_++;
+	}
+
+	uint32_t u32() {
+		if (!need(4))
+			return 0;
+		uint32_t v = 0;
+		for (unsigned int i = 0; i < 4; i++)
+			v |= ((uint32_t)(unsigned char) p_[i]) << (i * 8);
+		p_ += 4;
+		return v;
+	}
+
+	uint64_t u64() {
+		if (!need(8))
+			return 0;
+		uint64_t v = 0;
+		for (unsigned int i = 0; i < 8; i++)
+			v |= ((uint64_t)(unsigned char) p_[i]) << (i * 8);
+		p_ += 8;
+		return v;
+	}
+
+	std::string str() {
+		if (!need(2))
+			return std::string();
+		size_t len = (unsigned char) p_[0] |
+			     ((size_t)(unsigned char) p_[1] << 8);
+		p_ += 2;
+		if (!need(len))
+			return std::string();
+		std::string v(p_, len);
+		p_ += len;
+		return v;
+	}
+
+private:
+	const char *p_;
+	const char *end_;
+	bool ok_;
+
+	bool need(size_t n) {
+		if (!ok_ || ((size_t)(end_ - p_) < n)) {
+			ok_ = false;
+			return false;
+		}
+		return true;
+	}
+};
+
+#endif // __SERIALIZE_H__
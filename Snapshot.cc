@@ -0,0 +1,333 @@
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <syslog.h>
+#include <sys/stat.h>
+#include <openssl/sha.h>
+#include "Snapshot.h"
+#include "Serialize.h"
+#include "OrderArchive.h"
+
+using namespace std;
+using namespace orderentry;
+
+// File layout (all integers little-endian):
+//
+//	magic[8], u64 journal seq, u64 last order id sequence
+//	u32 order count, order records
+//	u32 book count, book records
+//	u32 archived order count, (u64 archive time, order record)
+//	sha256 of all preceding bytes
+//
+// A book record is its symbol, depth levels, ladder range (u32 min
+// price, max price, tick; tick 0 if not a ladder) and market price,
+// followed by four tracker lists (bids, asks, stop bids, stop asks) in
+// priority order.  Trackers refer to orders by id.
+
+static const char snapMagic[8] = { 'O','B','S','N','A','P','0','6' };
+
+// format 05 differs only in its order history, which decodeOrder reads
+static const char snapMagic05[8] = { 'O','B','S','N','A','P','0','5' };
+
+typedef vector<const OrderBook::Tracker *> TrackerList;
+
+static TrackerList listTrackers(const OrderBook::TrackerMap& trackers)
+{
+	TrackerList list;
+	for (auto it = trackers.begin(); it != trackers.end(); ++it)
+		list.push_back(&it->second);
+	return list;
+}
+
+static TrackerList listResting(const OrderBook& book, bool isBuy)
+{
+	TrackerList list;
+	forEachResting(book, isBuy, [&list](const OrderBook::Tracker& tracker) {
+		list.push_back(&tracker);
+	});
+	return list;
+}
+
+static void encodeTrackers(string& s, const TrackerList& trackers)
+{
+	serU32(s, trackers.size());
+	for (size_t i = 0; i < trackers.size(); i++) {
+		const OrderBook::Tracker& tracker = *trackers[i];
+
+		liquibook::book::OrderConditions conditions = 0;
+		if (tracker.all_or_none())
+			conditions |= liquibook::book::oc_all_or_none;
+		if (tracker.immediate_or_cancel())
+			conditions |= liquibook::book::oc_immediate_or_cancel;
+
+		serU64(s, tracker.ptr()->order_id());
+		serU32(s, tracker.open_qty());
+		serU32(s, conditions);
+	}
+}
+
+static bool decodeTrackers(BinReader& rd, Market& market,
+			   OrderBookPtr book, bool stopped,
+			   SnapshotInfo& info)
+{
+	const Market::OrderMap& orders = market.orders();
+
+	uint32_t count = rd.u32();
+	for (uint32_t i = 0; i < count; i++) {
+		OrderId id = rd.u64();
+		liquibook::book::Quantity openQty = rd.u32();
+		liquibook::book::OrderConditions conditions = rd.u32();
+		if (!rd.ok())
+			return false;
+
+		const OrderPtr *order = orders.find(id);
+		if (!order)
+			return false;
+
+		if (!book->restore(*order, openQty, conditions, stopped))
+			return false;
+		info.resting++;
+	}
+
+	return true;
+}
+
+// the rename is durable once the directory holding it is synced
+static bool syncDir(const string& filename)
+{
+	size_t slash = filename.rfind('/');
+	string dir = (slash == string::npos) ? "." :
+		     (slash == 0) ? "/" : filename.substr(0, slash);
+
+	int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return false;
+	bool ok = (fsync(fd) == 0);
+	close(fd);
+	return ok;
+}
+
+static bool writeFile(const string& filename, const string& data)
+{
+	string tmpFn = filename + ".tmp";
+
+	int fd = open(tmpFn.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0)
+		return false;
+
+	const char *p = data.data();
+	size_t bytes = data.size();
+	while (bytes > 0) {
+		ssize_t rc = write(fd, p, bytes);
+		if (rc < 0) {
+			if (errno == EINTR)
+				continue;
+			goto err_out;
+		}
+
+		bytes -= rc;
+		p += rc;
+	}
+
+	// snapshot must be on disk before it replaces the previous one
+	if (fsync(fd) < 0)
+		goto err_out;
+	close(fd);
+
+	if (rename(tmpFn.c_str(), filename.c_str()) < 0)
+		return false;
+	return syncDir(filename);
+
+err_out:
+	close(fd);
+	unlink(tmpFn.c_str());
+	return false;
+}
+
+static bool readFile(const string& filename, string& data, bool& found)
+{
+	found = false;
+
+	FILE *f = fopen(filename.c_str(), "rb");
+	if (!f)
+		return (errno == ENOENT);
+	found = true;
+
+	char buf[65536];
+	size_t bread;
+	while ((bread = fread(buf, 1, sizeof(buf), f)) > 0)
+		data.append(buf, bread);
+
+	bool ok = !ferror(f);
+	fclose(f);
+	return ok;
+}
+
+// everything but the checksum; the market is only read
+void snapshotCapture(const Market& market, uint64_t seq,
+		     std::string& s, SnapshotInfo& info)
+{
+	info = SnapshotInfo();
+	info.seq = seq;
+
+	s.assign(snapMagic, sizeof(snapMagic));
+	serU64(s, seq);
+	serU64(s, market.lastOrderSeq());
+
+	// live orders, including stops not yet triggered
+	const Market::OrderMap& orders = market.orders();
+	serU32(s, orders.size());
+	orders.forEach([&s](const OrderPtr& order) {
+		encodeOrder(s, *order);
+	});
+	info.orders = orders.size();
+
+	// each book, with its resting and stopped orders in priority order
+	const Market::SymbolToBookMap& books = market.books();
+	serU32(s, books.size());
+	for (auto it = books.begin(); it != books.end(); ++it) {
+		const OrderBookPtr& book = it->second;
+		const BookDepth *depth = market.depth(book);
+		LadderSpec ladder;
+		auto ladderBook = std::dynamic_pointer_cast<LadderOrderBook>(book);
+		if (ladderBook)
+			ladder = ladderBook->spec();
+
+		serStr(s, it->first);
+		serU32(s, depth ? depth->size() : 0);
+		serU32(s, ladder.minPrice);
+		serU32(s, ladder.maxPrice);
+		serU32(s, ladder.tick);
+		serU32(s, book->market_price());
+
+		TrackerList bids = listResting(*book, true);
+		TrackerList asks = listResting(*book, false);
+		encodeTrackers(s, bids);
+		encodeTrackers(s, asks);
+		encodeTrackers(s, listTrackers(book->stopBids()));
+		encodeTrackers(s, listTrackers(book->stopAsks()));
+
+		info.resting += bids.size() + asks.size() +
+			book->stopBids().size() + book->stopAsks().size();
+	}
+	info.books = books.size();
+
+	// retained terminal orders, oldest first
+	const std::deque<OrderArchive::Entry>& archived =
+		market.archive().entries();
+	serU32(s, archived.size());
+	for (auto it = archived.begin(); it != archived.end(); ++it) {
+		serU64(s, (uint64_t) it->archived);
+		encodeOrder(s, *it->order);
+	}
+	info.archived = archived.size();
+}
+
+// checksum a captured snapshot, and replace filename with it
+bool snapshotSave(std::string& s, const std::string& filename,
+		  SnapshotInfo& info)
+{
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	SHA256((const unsigned char *) s.data(), s.size(), md);
+	s.append((const char *) md, sizeof(md));
+	info.bytes = s.size();
+
+	if (!writeFile(filename, s)) {
+		syslog(LOG_DAEMON|LOG_ERR, "snapshot %s write failed: %s",
+		       filename.c_str(), strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+bool snapshotWrite(const Market& market, uint64_t seq,
+		   const std::string& filename, SnapshotInfo& info)
+{
+	string s;
+	snapshotCapture(market, seq, s, info);
+	return snapshotSave(s, filename, info);
+}
+
+bool snapshotLoad(Market& market, const std::string& filename,
+		  bool& found, SnapshotInfo& info)
+{
+	info = SnapshotInfo();
+
+	string s;
+	if (!readFile(filename, s, found))
+		return false;
+	if (!found)
+		return true;
+	info.bytes = s.size();
+
+	// verify magic and checksum before touching the market
+	if ((s.size() < (sizeof(snapMagic) + SHA256_DIGEST_LENGTH)) ||
+	    ((memcmp(s.data(), snapMagic, sizeof(snapMagic)) != 0) &&
+	     (memcmp(s.data(), snapMagic05, sizeof(snapMagic05)) != 0)))
+		return false;
+
+	size_t bodyLen = s.size() - SHA256_DIGEST_LENGTH;
+	unsigned char md[SHA256_DIGEST_LENGTH];
+	SHA256((const unsigned char *) s.data(), bodyLen, md);
+	if (memcmp(md, s.data() + bodyLen, sizeof(md)) != 0)
+		return false;
+
+	BinReader rd(s.data() + sizeof(snapMagic),
+		     bodyLen - sizeof(snapMagic));
+	info.seq = rd.u64();
+	market.resumeOrderSeq(rd.u64());
+
+	uint32_t nOrders = rd.u32();
+	for (uint32_t i = 0; i < nOrders; i++) {
+		OrderPtr order = decodeOrder(rd);
+		if (!order)
+			return false;
+		market.restoreOrder(order);
+	}
+	info.orders = nOrders;
+
+	uint32_t nBooks = rd.u32();
+	for (uint32_t i = 0; i < nBooks; i++) {
+		string symbol = rd.str();
+		uint32_t depthLevels = rd.u32();
+		LadderSpec ladder;
+		ladder.minPrice = rd.u32();
+		ladder.maxPrice = rd.u32();
+		ladder.tick = rd.u32();
+		liquibook::book::Price marketPrice = rd.u32();
+		if (!rd.ok() || depthLevels > BOOK_DEPTH_MAX ||
+		    (ladder.isLadder() && !ladder.valid()))
+			return false;
+
+		OrderBookPtr book = market.addBook(symbol, depthLevels, ladder);
+		if (marketPrice != liquibook::book::MARKET_ORDER_PRICE)
+			book->set_market_price(marketPrice);
+
+		if (!decodeTrackers(rd, market, book, false, info) ||
+		    !decodeTrackers(rd, market, book, false, info) ||
+		    !decodeTrackers(rd, market, book, true, info) ||
+		    !decodeTrackers(rd, market, book, true, info))
+			return false;
+		market.rebuildLevels(book);
+	}
+	info.books = nBooks;
+
+	uint32_t nArchived = rd.u32();
+	for (uint32_t i = 0; i < nArchived && rd.ok(); i++) {
+		time_t archived = (time_t) rd.u64();
+		OrderPtr order = decodeOrder(rd);
+		if (!order)
+			return false;
+		market.archive().add(order, archived);
+	}
+	info.archived = nArchived;
+
+	return rd.ok() && rd.eof();
+}
@@ -0,0 +1,32 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include <string>
+#include <cstdint>
+#include "Market.h"
+
+struct SnapshotInfo {
+	uint64_t	seq;		// last journal record included
+	uint64_t	books;
+	uint64_t	orders;
+	uint64_t	resting;	// orders on book, or waiting on stop
+	uint64_t	archived;	// terminal orders retained
+	uint64_t	bytes;
+
+	SnapshotInfo() : seq(0), books(0), orders(0), resting(0),
+			 archived(0), bytes(0) {}
+};
+
+// A snapshot is captured on the thread that owns the market, then
+// checksummed and written to disk from any thread.  snapshotWrite
+// does both.
+void snapshotCapture(const orderentry::Market& market, uint64_t seq,
+		     std::string& data, SnapshotInfo& info);
+bool snapshotSave(std::string& data, const std::string& filename,
+		  SnapshotInfo& info);
+bool snapshotWrite(const orderentry::Market& market, uint64_t seq,
+		   const std::string& filename, SnapshotInfo& info);
+bool snapshotLoad(orderentry::Market& market, const std::string& filename,
+		  bool& found, SnapshotInfo& info);
+
+#endif // __SNAPSHOT_H__
@@ -230,6 +230,21 @@ ApiClient.prototype.orderModify = function(orderInfo, callback) {
 	});
 };
 
+ApiClient.prototype.orderBatch = function(batchInfo, callback) {
+	var opts = JSON.parse(JSON.stringify(this.httpOpts));
+	opts.method = 'POST';
+	opts.path = '/orderBatch';
+	opts.postData = JSON.stringify(batchInfo);
+	opts.apiJson = true;
+	opts.auth256 = true;
+
+	callHttp(opts, function(err, res) {
+		if (err) { throw new Error(err); }
+
+		callback(null, res);
+	});
+};
+
 ApiClient.prototype.orderGetInfo = function(orderId, callback) {
 	var opts = JSON.parse(JSON.stringify(this.httpOpts));
 	opts.method = 'GET';
@@ -0,0 +1,194 @@
+#include <book/order_book.h>
+
+#include <algorithm>
+#include <vector>
+#include <memory>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "Order.h"
+#include "LadderOrderBook.h"
+
+using namespace std;
+using namespace orderentry;
+using liquibook::book::Price;
+using liquibook::book::Quantity;
+
+#define PROGRAM_NAME "bookbench"
+
+// Order insertion rate of the multimap book against the price ladder,
+// on the order flow of liquibook's pt_order_book: buys at 1880-1889,
+// sells at 1884-1893, so about half of all orders cross.  Each order
+// is created as it is added, as the server does, and heap allocations
+// and per-operation latency are counted.  Then the cost of a cancel
+// against the length of the order's price level.
+
+typedef liquibook::book::OrderBook<OrderPtr> MapBook;
+
+// every heap allocation in the process
+static uint64_t heapAllocs;
+
+void *operator new(size_t size)
+{
+	heapAllocs++;
+	void *p = malloc(size ? size : 1);
+	if (!p)
+		throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void *p) noexcept
+{
+	free(p);
+}
+
+struct OrderSpec {
+	bool		is_buy;
+	Price		price;
+	Quantity	qty;
+};
+
+static vector<OrderSpec> make_flow(size_t count)
+{
+	vector<OrderSpec> flow(count);
+	for (size_t i = 0; i < count; i++) {
+		flow[i].is_buy = (i % 2) == 0;
+		flow[i].price = (rand() % 10) + (flow[i].is_buy ? 1880 : 1884);
+		flow[i].qty = ((rand() % 10) + 1) * 100;
+	}
+	return flow;
+}
+
+static uint64_t now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// orders kept for cancels; older ones are released
+enum { RECENT = 4096 };
+
+// add orders until the time runs out; every cancelEvery'th step
+// instead cancels a recent order, if still resting
+static long run(MapBook& book, const vector<OrderSpec>& flow,
+		unsigned int cancelEvery, clock_t end,
+		vector<uint32_t>& lat)
+{
+	vector<OrderPtr> recent(RECENT);
+	size_t next = 0;
+	long ops = 0;
+	while (clock() < end) {
+		if (next == flow.size())
+			return -1;
+
+		uint64_t t0 = now_ns();
+		if (cancelEvery && next && (ops % cancelEvery) == 0)
+			book.cancel(recent[rand() % min<size_t>(next, RECENT)]);
+		else {
+			const OrderSpec& spec = flow[next];
+			OrderPtr order(new Order(OrderId(next + 1),
+					spec.is_buy, spec.qty, "BENCH",
+					spec.price, 0, false, false));
+			book.add(order);
+			recent[next++ % RECENT] = order;
+		}
+		lat.push_back((uint32_t) (now_ns() - t0));
+		ops++;
+	}
+	return ops;
+}
+
+static MapBook *new_book(bool ladder)
+{
+	if (!ladder)
+		return new MapBook("BENCH");
+
+	LadderSpec spec;
+	spec.minPrice = 1800;
+	spec.maxPrice = 2000;
+	spec.tick = 1;
+	return new LadderOrderBook("BENCH", spec);
+}
+
+static void bench(const char *name, bool ladder, unsigned int dur_sec,
+		  unsigned int cancelEvery)
+{
+	size_t count = dur_sec * 250000;
+	while (true) {
+		vector<OrderSpec> flow = make_flow(count);
+		vector<uint32_t> lat;
+		lat.reserve(count * 2);
+
+		unique_ptr<MapBook> book(new_book(ladder));
+
+		uint64_t allocs = heapAllocs;
+		clock_t end = clock() + dur_sec * CLOCKS_PER_SEC;
+		long ops = run(*book, flow, cancelEvery, end, lat);
+		allocs = heapAllocs - allocs;
+		if (ops < 0) {
+			count *= 2;
+			continue;
+		}
+
+		sort(lat.begin(), lat.end());
+		printf("%-8s %-10s %9ld ops/sec  %5.2f allocs/op  "
+		       "p50 %5u ns  p99 %6u ns\n",
+		       name, cancelEvery ? "add+cancel" : "add",
+		       ops / dur_sec, (double) allocs / ops,
+		       lat[lat.size() / 2], lat[lat.size() * 99 / 100]);
+		break;
+	}
+}
+
+// rest depth orders at one price, then cancel them in random order
+static void bench_cancel(const char *name, bool ladder, size_t depth)
+{
+	unique_ptr<MapBook> book(new_book(ladder));
+	vector<OrderPtr> orders;
+	orders.reserve(depth);
+	for (size_t i = 0; i < depth; i++) {
+		orders.push_back(OrderPtr(new Order(OrderId(i + 1), true,
+					100, "BENCH", 1880, 0, false, false)));
+		book->add(orders.back());
+	}
+	random_shuffle(orders.begin(), orders.end());
+
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (size_t i = 0; i < depth; i++)
+		book->cancel(orders[i]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	double ns = (end.tv_sec - start.tv_sec) * 1e9 +
+		    (end.tv_nsec - start.tv_nsec);
+	printf("%-8s cancel at level depth %7zu: %8.0f ns/cancel\n",
+	       name, depth, ns / depth);
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int dur_sec = 3;
+	if (argc > 1 && atoi(argv[1]) > 0)
+		dur_sec = atoi(argv[1]);
+
+	printf(PROGRAM_NAME ": %u sec per run\n", dur_sec);
+
+	for (unsigned int i = 0; i < 2; i++) {
+		unsigned int cancelEvery = i ? 3 : 0;
+
+		srand(dur_sec);
+		bench("multimap", false, dur_sec, cancelEvery);
+		srand(dur_sec);
+		bench("ladder", true, dur_sec, cancelEvery);
+	}
+
+	for (size_t depth = 1000; depth <= 100000; depth *= 10) {
+		bench_cancel("multimap", false, depth);
+		bench_cancel("ladder", true, depth);
+	}
+
+	return 0;
+}
@@ -17,12 +17,13 @@ if (cli_cmd == "help") {
 	"Commands:\n" +
 	"info\t\t\t\tShow server info\n" +
 	"market.list\t\t\tShow all markets\n" +
-	"market.add SYMBOL [booktype]\tAdd new market\n" +
+	"market.add SYMBOL [booktype] [levels]\tAdd new market\n" +
 	"book SYMBOL [depth]\t\tShow order book\n" +
 	"order order-id\t\t\tShow info on a single order\n" +
 	"order.cancel order-id\t\tCancel a single order\n" +
 	"order.modify order-id\t\tModify a single order\n" +
-	"order.add [json order info]\tAdd new order\n";
+	"order.add [json order info]\tAdd new order\n" +
+	"order.batch [json batch]\tAdd/cancel/modify orders in one call\n";
 
 	console.log(msg);
 } else if (cli_cmd == "info") {
@@ -40,7 +41,7 @@ if (cli_cmd == "help") {
 	});
 
 } else if (cli_cmd == "market.add") {
-	if (cli_args.length != 1) {
+	if (cli_args.length < 1) {
 		console.log("missing symbol argument");
 		process.exit(1);
 	}
@@ -52,6 +53,19 @@ if (cli_cmd == "help") {
 
 	if (cli_args.length > 1)
 		marketInfo.booktype = cli_args[1];
+	var levelsArg = 2;
+	if (marketInfo.booktype == "ladder") {
+		if (cli_args.length < 5) {
+			console.log("ladder needs MIN-PRICE MAX-PRICE TICK");
+			process.exit(1);
+		}
+		marketInfo.minPrice = parseInt(cli_args[2], 10);
+		marketInfo.maxPrice = parseInt(cli_args[3], 10);
+		marketInfo.tick = parseInt(cli_args[4], 10);
+		levelsArg = 5;
+	}
+	if (cli_args.length > levelsArg)
+		marketInfo.depth = parseInt(cli_args[levelsArg], 10);
 
 	cli.marketAdd(marketInfo, function(err, res) {
 		if (err) { throw new Error(err); }
@@ -146,6 +160,20 @@ if (cli_cmd == "help") {
 		console.dir(res);
 	});
 
+} else if (cli_cmd == "order.batch") {
+	if (cli_args.length != 1) {
+		console.log("missing json-batch argument");
+		process.exit(1);
+	}
+
+	var batchInfo = JSON.parse(cli_args[0]);
+
+	cli.orderBatch(batchInfo, function(err, res) {
+		if (err) { throw new Error(err); }
+
+		console.dir(res);
+	});
+
 } else {
 	console.log("unknown command");
 	process.exit(1);
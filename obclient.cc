@@ -0,0 +1,849 @@
+#include "cscpp-config.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <argp.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <poll.h>
+#include <assert.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <openssl/sha.h>
+#include <openssl/hmac.h>
+#include "BinProto.h"
+#include "MdProto.h"
+#include "ExecReport.h"
+#include "Util.h"
+
+using namespace std;
+
+#define PROGRAM_NAME "obclient"
+
+static const char doc[] =
+PROGRAM_NAME " - binary order-entry and market-data test client\n"
+"\n"
+"Commands:\n"
+"  order SYMBOL buy|sell QTY PRICE   submit one order, print replies\n"
+"  cancel ORDER-ID                   cancel one order, print replies\n"
+"  bench                             binary vs. HTTP order-entry benchmark\n"
+"  md                                follow the multicast depth feed";
+
+static struct argp_option options[] = {
+	{ "host", 'H', "HOST", 0,
+	  "Server host (default: 127.0.0.1)" },
+
+	{ "port", 'p', "PORT", 0,
+	  "Binary order-entry port (default: 7980)" },
+
+	{ "http-port", 1001, "PORT", 0,
+	  "HTTP API port, for bench (default: 7979)" },
+
+	{ "user", 'u', "USER", 0,
+	  "API user (default: testuser)" },
+
+	{ "secret", 's', "SECRET", 0,
+	  "API secret (default: testpass)" },
+
+	{ "symbol", 1002, "SYMBOL", 0,
+	  "Market for bench; created if missing (default: BENCH)" },
+
+	{ "count", 'n', "N", 0,
+	  "Orders sent by bench, per path; md messages shown (default: 100000)" },
+
+	{ "window", 'w', "N", 0,
+	  "Binary orders in flight during bench (default: 256)" },
+
+	{ "no-http", 1003, NULL, 0,
+	  "Bench the binary path only; the market must exist" },
+
+	{ "md-group", 1004, "ADDR", 0,
+	  "Market-data multicast group (default: 239.192.79.79)" },
+
+	{ "md-port", 1005, "PORT", 0,
+	  "Market-data multicast port (default: 7981)" },
+
+	{ "md-snapshot-port", 1006, "PORT", 0,
+	  "Market-data snapshot/retransmit port (default: 7982)" },
+
+	{ }
+};
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state);
+static const struct argp argp = { options, parse_opt, "COMMAND [ARG...]", doc };
+
+static string opt_host = "127.0.0.1";
+static string opt_port = "7980";
+static string opt_http_port = "7979";
+static string opt_user = "testuser";
+static string opt_secret = "testpass";
+static string opt_symbol = "BENCH";
+static uint64_t opt_count = 100000;
+static uint64_t opt_window = 256;
+static bool opt_http = true;
+static string opt_md_group = "239.192.79.79";
+static string opt_md_port = "7981";
+static string opt_md_snapshot_port = "7982";
+static vector<string> opt_args;
+
+static error_t parse_opt (int key, char *arg, struct argp_state *state)
+{
+	switch (key) {
+
+	case 'H':
+		opt_host = arg;
+		break;
+	case 'p':
+		opt_port = arg;
+		break;
+	case 1001:	// --http-port
+		opt_http_port = arg;
+		break;
+	case 'u':
+		opt_user = arg;
+		break;
+	case 's':
+		opt_secret = arg;
+		break;
+	case 1002:	// --symbol
+		opt_symbol = arg;
+		break;
+	case 'n':
+		opt_count = strtoull(arg, NULL, 10);
+		break;
+	case 'w':
+		opt_window = std::max(1ULL, strtoull(arg, NULL, 10));
+		break;
+	case 1003:	// --no-http
+		opt_http = false;
+		break;
+	case 1004:	// --md-group
+		opt_md_group = arg;
+		break;
+	case 1005:	// --md-port
+		opt_md_port = arg;
+		break;
+	case 1006:	// --md-snapshot-port
+		opt_md_snapshot_port = arg;
+		break;
+
+	case ARGP_KEY_ARG:
+		opt_args.push_back(arg);
+		break;
+
+	case ARGP_KEY_END:
+		if (opt_args.empty())
+			argp_usage(state);
+		break;
+
+	default:
+		return ARGP_ERR_UNKNOWN;
+	}
+
+	return 0;
+}
+
+static int64_t monoUsec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int tcpConnect(const string& host, const string& port)
+{
+	struct addrinfo hints, *res;
+	memset(&hints, 0, sizeof(hints));
+	hints.ai_family = AF_UNSPEC;
+	hints.ai_socktype = SOCK_STREAM;
+	if (getaddrinfo(host.c_str(), port.c_str(), &hints, &res) != 0)
+		return -1;
+
+	int fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+	if (fd >= 0 && connect(fd, res->ai_addr, res->ai_addrlen) < 0) {
+		close(fd);
+		fd = -1;
+	}
+	freeaddrinfo(res);
+
+	if (fd >= 0) {
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	return fd;
+}
+
+static bool writeAll(int fd, const void *buf, size_t len)
+{
+	const char *p = (const char *) buf;
+	while (len > 0) {
+		ssize_t rc = write(fd, p, len);
+		if (rc <= 0)
+			return false;
+		p += rc;
+		len -= rc;
+	}
+	return true;
+}
+
+//
+// Binary session
+//
+
+class BinClient {
+public:
+	BinClient() : fd_(-1) {}
+	~BinClient() { if (fd_ >= 0) close(fd_); }
+
+	bool connect(const string& host, const string& port) {
+		fd_ = tcpConnect(host, port);
+		return (fd_ >= 0);
+	}
+
+	bool login(const string& user, const string& secret) {
+		BinLogin req;
+		req.user = user;
+		req.unixtime = time(NULL);
+		BinLogin::sign(user, req.unixtime, secret, req.mac);
+
+		unsigned char buf[BinLogin::SIZE];
+		req.encode(buf);
+		if (!writeAll(fd_, buf, sizeof(buf)))
+			return false;
+
+		unsigned char msg[BIN_MAX_MSG];
+		if (!next(msg) || msg[2] != BIN_LOGIN_ACK)
+			return false;
+
+		BinLoginAck ack;
+		ack.decode(msg);
+		return (ack.status == BIN_OK);
+	}
+
+	bool send(const unsigned char *buf, size_t len) {
+		return writeAll(fd_, buf, len);
+	}
+
+	// next complete server message; blocks
+	bool next(unsigned char *msg) {
+		for (;;) {
+			if (in_.size() >= BIN_HDR_SIZE) {
+				uint16_t len = binGetU16((const unsigned char *) in_.data());
+				if (len < BIN_HDR_SIZE || len > BIN_MAX_MSG)
+					return false;
+				if (in_.size() >= len) {
+					memcpy(msg, in_.data(), len);
+					in_.erase(0, len);
+					return true;
+				}
+			}
+
+			char buf[65536];
+			ssize_t rc = read(fd_, buf, sizeof(buf));
+			if (rc <= 0)
+				return false;
+			in_.append(buf, rc);
+		}
+	}
+
+	// wait up to ms for more input
+	bool readable(int ms) {
+		struct pollfd pfd = { fd_, POLLIN, 0 };
+		return (poll(&pfd, 1, ms) > 0);
+	}
+
+	// true if a complete message is already buffered
+	bool buffered() const {
+		return (in_.size() >= BIN_HDR_SIZE) &&
+		       (in_.size() >= binGetU16((const unsigned char *) in_.data()));
+	}
+
+private:
+	int fd_;
+	string in_;
+};
+
+static const char *execTypeStr(uint8_t type)
+{
+	switch (type) {
+	case orderentry::EXEC_ACCEPTED:		return "accepted";
+	case orderentry::EXEC_REJECTED:		return "rejected";
+	case orderentry::EXEC_FILL:		return "fill";
+	case orderentry::EXEC_CANCELLED:	return "cancelled";
+	case orderentry::EXEC_CANCEL_REJECTED:	return "cancel-rejected";
+	case orderentry::EXEC_REPLACED:		return "replaced";
+	case orderentry::EXEC_REPLACE_REJECTED:	return "replace-rejected";
+	default:				return "unknown";
+	}
+}
+
+static void printMsg(const unsigned char *msg)
+{
+	if (msg[2] == BIN_ACK) {
+		BinAck ack;
+		ack.decode(msg);
+		printf("ack ref %llu order %llu status %u\n",
+		       (unsigned long long) ack.clientRef,
+		       (unsigned long long) ack.orderId, ack.status);
+	} else if (msg[2] == BIN_EXEC) {
+		BinExec exec;
+		exec.decode(msg);
+		printf("exec order %llu %s qty %u price %u leaves %u filled %u\n",
+		       (unsigned long long) exec.orderId,
+		       execTypeStr(exec.execType), exec.qty, exec.price,
+		       exec.leaves, exec.filled);
+	} else
+		printf("message type '%c'\n", msg[2]);
+}
+
+// print the ack, then any events that arrive shortly after it
+static void printReplies(BinClient& cli)
+{
+	unsigned char msg[BIN_MAX_MSG];
+	if (!cli.next(msg))
+		return;
+	printMsg(msg);
+
+	while ((cli.buffered() || cli.readable(100)) && cli.next(msg))
+		printMsg(msg);
+}
+
+static BinClient *sessionOpen()
+{
+	BinClient *cli = new BinClient();
+	if (!cli->connect(opt_host, opt_port)) {
+		perror(opt_host.c_str());
+		exit(EXIT_FAILURE);
+	}
+	if (!cli->login(opt_user, opt_secret)) {
+		fprintf(stderr, "%s: login refused\n", PROGRAM_NAME);
+		exit(EXIT_FAILURE);
+	}
+	return cli;
+}
+
+static int cmdOrder()
+{
+	if (opt_args.size() != 5) {
+		fprintf(stderr, "usage: order SYMBOL buy|sell QTY PRICE\n");
+		return EXIT_FAILURE;
+	}
+
+	BinNewOrder req;
+	req.clientRef = 1;
+	req.symbol = opt_args[1];
+	req.flags = (opt_args[2] == "buy") ? BIN_F_BUY : 0;
+	req.qty = strtoul(opt_args[3].c_str(), NULL, 10);
+	req.price = strtoul(opt_args[4].c_str(), NULL, 10);
+	req.stopPrice = 0;
+
+	BinClient *cli = sessionOpen();
+	unsigned char buf[BinNewOrder::SIZE];
+	req.encode(buf);
+	cli->send(buf, sizeof(buf));
+	printReplies(*cli);
+	delete cli;
+
+	return 0;
+}
+
+static int cmdCancel()
+{
+	if (opt_args.size() != 2) {
+		fprintf(stderr, "usage: cancel ORDER-ID\n");
+		return EXIT_FAILURE;
+	}
+
+	BinCancel req;
+	req.clientRef = 1;
+	req.orderId = strtoull(opt_args[1].c_str(), NULL, 10);
+
+	BinClient *cli = sessionOpen();
+	unsigned char buf[BinCancel::SIZE];
+	req.encode(buf);
+	cli->send(buf, sizeof(buf));
+	printReplies(*cli);
+	delete cli;
+
+	return 0;
+}
+
+//
+// HTTP keep-alive session, signed as obsrv expects (see build_auth_hdr)
+//
+
+class HttpClient {
+public:
+	HttpClient() : fd_(-1) {}
+	~HttpClient() { if (fd_ >= 0) close(fd_); }
+
+	bool connect(const string& host, const string& port) {
+		hostHdr_ = host + ":" + port;
+		fd_ = tcpConnect(host, port);
+		return (fd_ >= 0);
+	}
+
+	// POST a signed JSON body; returns HTTP status, or -1
+	int post(const string& path, const string& body, string& reply) {
+		vector<unsigned char> md(SHA256_DIGEST_LENGTH);
+		SHA256((const unsigned char *) body.data(), body.size(), &md[0]);
+		string etag = HexStr(md);
+		string unixtime = to_string((long long) time(NULL));
+
+		string phdr = "cscpp1-sha256\n" + opt_user + "\n" +
+			      hostHdr_ + "\n" + unixtime + "\n" + etag + "\n";
+		HMAC(EVP_sha256(), opt_secret.data(), opt_secret.size(),
+		     (const unsigned char *) phdr.data(), phdr.size(),
+		     &md[0], NULL);
+
+		string req = "POST " + path + " HTTP/1.1\r\n"
+			"Host: " + hostHdr_ + "\r\n"
+			"Content-Type: application/json\r\n"
+			"Content-Length: " + to_string(body.size()) + "\r\n"
+			"X-Unixtime: " + unixtime + "\r\n"
+			"ETag: " + etag + "\r\n"
+			"Authorization: cscpp1-sha256 " + opt_user + " " +
+				HexStr(md) + "\r\n"
+			"\r\n" + body;
+		if (!writeAll(fd_, req.data(), req.size()))
+			return -1;
+
+		return readReply(reply);
+	}
+
+private:
+	int fd_;
+	string hostHdr_;
+	string in_;
+
+	bool fill() {
+		char buf[65536];
+		ssize_t rc = read(fd_, buf, sizeof(buf));
+		if (rc <= 0)
+			return false;
+		in_.append(buf, rc);
+		return true;
+	}
+
+	int readReply(string& body) {
+		size_t hdrEnd;
+		while ((hdrEnd = in_.find("\r\n\r\n")) == string::npos)
+			if (!fill())
+				return -1;
+
+		string hdrs = in_.substr(0, hdrEnd);
+		std::transform(hdrs.begin(), hdrs.end(), hdrs.begin(), ::tolower);
+		int status = atoi(hdrs.c_str() + hdrs.find(' ') + 1);
+
+		size_t clen = 0;
+		size_t pos = hdrs.find("\r\ncontent-length:");
+		if (pos != string::npos)
+			clen = strtoul(hdrs.c_str() + pos + 17, NULL, 10);
+
+		in_.erase(0, hdrEnd + 4);
+		while (in_.size() < clen)
+			if (!fill())
+				return -1;
+
+		body = in_.substr(0, clen);
+		in_.erase(0, clen);
+		return status;
+	}
+};
+
+struct BenchResult {
+	uint64_t		count;
+	int64_t			usec;
+	vector<int64_t>		latency;	// per order, usec
+};
+
+static void benchPrint(const char *name, BenchResult& res)
+{
+	std::sort(res.latency.begin(), res.latency.end());
+	size_t n = res.latency.size();
+	double secs = res.usec / 1000000.0;
+
+	printf("%-8s %10llu orders  %8.3f s  %10.0f orders/s  "
+	       "latency p50 %lld us  p99 %lld us\n",
+	       name, (unsigned long long) res.count, secs,
+	       secs > 0 ? res.count / secs : 0.0,
+	       n ? (long long) res.latency[n / 2] : 0LL,
+	       n ? (long long) res.latency[(n * 99) / 100] : 0LL);
+}
+
+// crossing buy/sell pairs: every second order fills, so the book
+// stays small and each order produces execution reports
+static bool benchBinary(BenchResult& res)
+{
+	BinClient *cli = sessionOpen();
+
+	vector<int64_t> sentAt(opt_count + 1);
+	res.latency.reserve(opt_count);
+	uint64_t sent = 0, acked = 0, events = 0;
+
+	int64_t t0 = monoUsec();
+	while (acked < opt_count) {
+		// top up the window, in one write
+		string out;
+		while (sent < opt_count && (sent - acked) < opt_window) {
+			BinNewOrder req;
+			req.clientRef = ++sent;
+			req.symbol = opt_symbol;
+			req.flags = (sent & 1) ? BIN_F_BUY : 0;
+			req.qty = 1;
+			req.price = 100;
+			req.stopPrice = 0;
+
+			unsigned char buf[BinNewOrder::SIZE];
+			req.encode(buf);
+			out.append((const char *) buf, sizeof(buf));
+			sentAt[sent] = monoUsec();
+		}
+		if (!out.empty() && !cli->send((const unsigned char *) out.data(),
+					       out.size()))
+			return false;
+
+		// drain at least one reply, then whatever is buffered
+		do {
+			unsigned char msg[BIN_MAX_MSG];
+			if (!cli->next(msg))
+				return false;
+
+			if (msg[2] == BIN_ACK) {
+				BinAck ack;
+				ack.decode(msg);
+				if (ack.status != BIN_OK) {
+					fprintf(stderr, "bench: order %llu "
+						"refused, status %u\n",
+						(unsigned long long) ack.clientRef,
+						ack.status);
+					return false;
+				}
+				res.latency.push_back(monoUsec() - sentAt[ack.clientRef]);
+				acked++;
+			} else
+				events++;
+		} while (cli->buffered());
+	}
+	res.usec = monoUsec() - t0;
+	res.count = acked;
+
+	printf("binary: %llu execution reports received\n",
+	       (unsigned long long) events);
+	delete cli;
+	return true;
+}
+
+// one request at a time, as an HTTP/1.1 client without pipelining
+static bool benchHttp(HttpClient& cli, BenchResult& res)
+{
+	res.latency.reserve(opt_count);
+
+	int64_t t0 = monoUsec();
+	for (uint64_t i = 1; i <= opt_count; i++) {
+		string body = "{\"symbol\":\"" + opt_symbol + "\",\"qty\":1,"
+			"\"price\":100,\"is_buy\":" +
+			((i & 1) ? "true" : "false") + "}";
+
+		int64_t start = monoUsec();
+		string reply;
+		int status = cli.post("/orderAdd", body, reply);
+		if (status != 200) {
+			fprintf(stderr, "bench: /orderAdd returned %d\n", status);
+			return false;
+		}
+		res.latency.push_back(monoUsec() - start);
+	}
+	res.usec = monoUsec() - t0;
+	res.count = opt_count;
+	return true;
+}
+
+static int cmdBench()
+{
+	// both paths need the market; HTTP is the only way to add one
+	HttpClient http;
+	if (opt_http) {
+		if (!http.connect(opt_host, opt_http_port)) {
+			perror(opt_host.c_str());
+			return EXIT_FAILURE;
+		}
+		string reply;
+		http.post("/marketAdd", "{\"symbol\":\"" + opt_symbol +
+			  "\",\"booktype\":\"simple\"}", reply);
+	}
+
+	BenchResult binRes;
+	if (!benchBinary(binRes))
+		return EXIT_FAILURE;
+	benchPrint("binary", binRes);
+
+	if (opt_http) {
+		BenchResult httpRes;
+		if (!benchHttp(http, httpRes))
+			return EXIT_FAILURE;
+		benchPrint("http", httpRes);
+	}
+
+	return 0;
+}
+
+//
+// Market-data feed
+//
+
+static bool readAll(int fd, void *buf, size_t len)
+{
+	char *p = (char *) buf;
+	while (len > 0) {
+		ssize_t rc = read(fd, p, len);
+		if (rc <= 0)
+			return false;
+		p += rc;
+		len -= rc;
+	}
+	return true;
+}
+
+// one TCP reply frame: packet header, then its messages
+static bool mdReadFrame(int fd, MdPacketHdr& hdr, string& body)
+{
+	unsigned char lenBuf[4];
+	if (!readAll(fd, lenBuf, sizeof(lenBuf)))
+		return false;
+	uint32_t len = binGetU32(lenBuf);
+	if (len < MD_PKT_HDR_SIZE || len > MD_MAX_FRAME)
+		return false;
+
+	string frame(len, '\0');
+	if (!readAll(fd, &frame[0], len))
+		return false;
+
+	hdr.decode((const unsigned char *) frame.data());
+	body = frame.substr(MD_PKT_HDR_SIZE);
+	return true;
+}
+
+static void mdPrintMsg(uint64_t seq, const unsigned char *msg)
+{
+	if (seq)
+		printf("%llu ", (unsigned long long) seq);
+	else
+		printf("snapshot ");
+
+	if (msg[2] == MD_DEPTH) {
+		MdDepth depth;
+		depth.decode(msg);
+		printf("depth %s %s %u: %u @ %u (%u orders)%s\n",
+		       depth.symbol.c_str(),
+		       (depth.flags & MD_F_BUY) ? "bid" : "ask",
+		       depth.level, depth.qty, depth.price, depth.orders,
+		       (depth.flags & MD_F_LAST) ? "" : " ...");
+	} else if (msg[2] == MD_TRADE) {
+		MdTrade trade;
+		trade.decode(msg);
+		printf("trade %s %u @ %u\n", trade.symbol.c_str(),
+		       trade.qty, trade.price);
+	} else
+		printf("message type '%c'\n", msg[2]);
+}
+
+// walk the messages of a packet body; false if malformed
+static bool mdEachMsg(const string& body, uint16_t count, uint64_t seq,
+		      uint64_t& expected)
+{
+	const unsigned char *p = (const unsigned char *) body.data();
+	size_t left = body.size();
+	for (uint16_t i = 0; i < count; i++, seq++) {
+		if (left < MD_MSG_HDR_SIZE)
+			return false;
+		uint16_t len = binGetU16(p);
+		if (len < MD_MSG_HDR_SIZE || len > left)
+			return false;
+
+		// duplicates of what was already applied
+		if (seq >= expected) {
+			mdPrintMsg(seq, p);
+			expected = seq + 1;
+		}
+		p += len;
+		left -= len;
+	}
+	return true;
+}
+
+class MdClient {
+public:
+	MdClient() : fd_(-1), session_(0), expected_(0) {}
+	~MdClient() { if (fd_ >= 0) close(fd_); }
+
+	bool connect(const string& host, const string& port) {
+		fd_ = tcpConnect(host, port);
+		return (fd_ >= 0);
+	}
+
+	uint64_t expected() const { return expected_; }
+
+	// full book state; the feed resumes at its sequence number
+	bool snapshot() {
+		unsigned char req[MdSnapshotReq::SIZE];
+		MdSnapshotReq().encode(req);
+		if (!writeAll(fd_, req, sizeof(req)))
+			return false;
+
+		for (;;) {
+			MdPacketHdr hdr;
+			string body;
+			if (!mdReadFrame(fd_, hdr, body))
+				return false;
+
+			const unsigned char *p = (const unsigned char *) body.data();
+			size_t left = body.size();
+			for (uint16_t i = 0; i < hdr.count; i++) {
+				uint16_t len = binGetU16(p);
+				if (len < MD_MSG_HDR_SIZE || len > left)
+					return false;
+				if (p[2] == MD_SNAPSHOT_END) {
+					session_ = hdr.session;
+					expected_ = hdr.seq;
+					return true;
+				}
+				mdPrintMsg(0, p);
+				p += len;
+				left -= len;
+			}
+		}
+	}
+
+	// one multicast packet: fill any gap before it, then apply it
+	bool apply(const MdPacketHdr& hdr, const string& body) {
+		// server restarted: its sequence began again
+		if (hdr.session != session_) {
+			printf("session changed\n");
+			if (!snapshot())
+				return false;
+		}
+
+		if (hdr.seq > expected_ && !retransmit(hdr.seq) && !snapshot())
+			return false;
+
+		return mdEachMsg(body, hdr.count, hdr.seq, expected_);
+	}
+
+private:
+	int fd_;
+	uint32_t session_;
+	uint64_t expected_;
+
+	// messages from expected_ up to seq; false if no longer held
+	bool retransmit(uint64_t seq) {
+		while (expected_ < seq) {
+			MdRetransReq req;
+			req.seq = expected_;
+			req.count = seq - expected_;
+
+			unsigned char buf[MdRetransReq::SIZE];
+			req.encode(buf);
+			if (!writeAll(fd_, buf, sizeof(buf)))
+				return false;
+
+			MdPacketHdr hdr;
+			string body;
+			if (!mdReadFrame(fd_, hdr, body) || hdr.count == 0) {
+				printf("gap %llu-%llu lost\n",
+				       (unsigned long long) expected_,
+				       (unsigned long long) (seq - 1));
+				return false;
+			}
+			if (!mdEachMsg(body, hdr.count, hdr.seq, expected_))
+				return false;
+		}
+		return true;
+	}
+};
+
+static int cmdMarketData()
+{
+	// join first, so nothing after the snapshot is missed
+	int ufd = socket(AF_INET, SOCK_DGRAM, 0);
+	int one = 1;
+	setsockopt(ufd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in sin;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(atoi(opt_md_port.c_str()));
+	sin.sin_addr.s_addr = htonl(INADDR_ANY);
+	if (bind(ufd, (struct sockaddr *) &sin, sizeof(sin)) < 0) {
+		perror("bind");
+		return EXIT_FAILURE;
+	}
+
+	struct ip_mreq mreq;
+	memset(&mreq, 0, sizeof(mreq));
+	mreq.imr_interface.s_addr = htonl(INADDR_ANY);
+	if (inet_pton(AF_INET, opt_md_group.c_str(), &mreq.imr_multiaddr) != 1 ||
+	    setsockopt(ufd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+		       &mreq, sizeof(mreq)) < 0) {
+		perror(opt_md_group.c_str());
+		return EXIT_FAILURE;
+	}
+
+	MdClient cli;
+	if (!cli.connect(opt_host, opt_md_snapshot_port) || !cli.snapshot()) {
+		perror(opt_host.c_str());
+		return EXIT_FAILURE;
+	}
+
+	uint64_t start = cli.expected();
+	while (cli.expected() - start < opt_count) {
+		unsigned char pkt[MD_MAX_PACKET];
+		ssize_t rc = recv(ufd, pkt, sizeof(pkt), 0);
+		if (rc < (ssize_t) MD_PKT_HDR_SIZE)
+			continue;
+
+		MdPacketHdr hdr;
+		hdr.decode(pkt);
+		string body((const char *) pkt + MD_PKT_HDR_SIZE,
+			    rc - MD_PKT_HDR_SIZE);
+		if (!cli.apply(hdr, body)) {
+			fprintf(stderr, "%s: feed recovery failed\n", PROGRAM_NAME);
+			return EXIT_FAILURE;
+		}
+		fflush(stdout);
+	}
+
+	close(ufd);
+	return 0;
+}
+
+int main(int argc, char ** argv)
+{
+	// parse command line
+	error_t argp_rc = argp_parse(&argp, argc, argv, 0, NULL, NULL);
+	if (argp_rc) {
+		fprintf(stderr, "%s: argp_parse failed: %s\n",
+			argv[0], strerror(argp_rc));
+		return EXIT_FAILURE;
+	}
+
+	const string& cmd = opt_args[0];
+	if (cmd == "order")
+		return cmdOrder();
+	if (cmd == "cancel")
+		return cmdCancel();
+	if (cmd == "bench")
+		return cmdBench();
+	if (cmd == "md")
+		return cmdMarketData();
+
+	fprintf(stderr, "%s: unknown command \"%s\"\n", PROGRAM_NAME, cmd.c_str());
+	return EXIT_FAILURE;
+}
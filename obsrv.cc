@@ -5,23 +5,41 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <unordered_map>
+#include <mutex>
 #include <locale>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
 #include <signal.h>
 #include <time.h>
 #include <sys/time.h>
 #include <argp.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <syslog.h>
 #include <evhtp.h>
+#include <event2/thread.h>
 #include <ctype.h>
 #include <assert.h>
 #include <univalue.h>
 #include "Market.h"
 #include "Util.h"
 #include "HttpUtil.h"
+#include "JsonWriter.h"
 #include "srvapi.h"
 #include "srv.h"
+#include "Journal.h"
+#include "Snapshot.h"
+#include "EventLog.h"
+#include "AccessLog.h"
+#include "Metrics.h"
+#include "AuthStore.h"
+#include "BinServer.h"
+#include "MdPublisher.h"
+#include "rocksdb/db.h"
 
 using namespace std;
 using namespace orderentry;
@@ -45,6 +63,9 @@ static struct argp_option options[] = {
 
 	{ "pid-file", 'p', "FILE", 0,
 	  "Pathname to which process PID is written (default: " DEFAULT_PID_FILE "; empty string to disable)" },
+
+	{ "bench-startup", 1003, NULL, 0,
+	  "Recover market from snapshot and journal, report timings, then exit." },
 	{ }
 };
 
@@ -56,60 +77,137 @@ static std::string opt_pid_file = DEFAULT_PID_FILE;
 static bool opt_daemon = false;
 static UniValue serverCfg;
 static evbase_t *evbase = NULL;
+static rocksdb::DB *db = NULL;
+static struct event *snapshotEv = NULL;
+static bool opt_bench_startup = false;
+static EventLog *eventLog = NULL;
+static CompletionQueue *completionQueue = NULL;
+static unsigned int frontendThreads = 0;
+static BinServer *binServer = NULL;
+static BookFeed bookFeed;
+static BookStream *bookStream = NULL;
+static MdPublisher *mdPublisher = NULL;
+
+// API credentials, shared by the HTTP and binary order-entry paths
+static AuthStore authStore;
+
+// Per-connection state: the peer's address, formatted once, and the
+// user bound by /login for sessionTtl seconds (0: no sessions).  A
+// connection lives on one loop, so each loop keeps its own index.
+// The state is owned by the connection's fini hook, which frees it
+// and its index entry together.
+struct ConnState {
+	char			peer[sizeof(((AccessRecord *) 0)->peer)];
+	const AuthKey		*user;		// NULL if not logged in
+	time_t			expires;
+};
+typedef std::unordered_map<evhtp_connection_t *, ConnState *> ConnStateMap;
+static time_t sessionTtl = 0;
+static __thread ConnStateMap *threadConns = NULL;
+static AccessLog *accessLog = NULL;
+
+// completion queue of the loop serving the current request; each
+// front-end thread owns one, the main loop uses completionQueue
+static __thread CompletionQueue *threadCq = NULL;
+static __thread BookStream *threadStream = NULL;
+static __thread struct event_base *threadBase = NULL;
+
+// routes every API path; built before the server starts
+static HttpRouter apiRouter;
+
+// Per-loop request metrics, one per apiRegistry route: written by
+// the loop, summed by /metrics.  Kept until exit, so that a reader
+// never sees one freed.
+struct RouteMetrics {
+	LatencyHistogram	latency;	// usec, request to finish
+	MetricCounter		status[6];	// 1xx-5xx, other
+};
+static std::mutex routeMetricsLock;
+static std::vector<RouteMetrics *> routeMetrics;
+static __thread RouteMetrics *threadMetrics = NULL;
 
-Market market;
-
-static void
-logRequest(evhtp_request_t *req, ReqState *state)
-{
-	assert(req && state);
-
-	// IP address
-	string addrStr = addressToStr(req->conn->saddr,
-				      sizeof(struct sockaddr)); // TODO verify
+static void recordRequest(evhtp_request_t *req, ReqState *state);
+static void reqMetrics(evhtp_request_t *req, void *arg);
 
-	// request timestamp.  use request-completion (not request-start)
-	// time instead?
-	struct tm tm;
-	gmtime_r(&state->tstamp.tv_sec, &tm);
+Engine *engine = NULL;
+bool orderIdCompat = false;
 
-	// get http method, build timestamp str
-	string timeStr = isoTimeStr(state->tstamp.tv_sec);
-	htp_method method = evhtp_request_get_method(req);
-	const char *method_name = htparser_get_methodstr_m(method);
+static evhtp_res
+conn_finish_cb(evhtp_connection_t *conn, void *arg)
+{
+	ConnState *state = (ConnState *) arg;
 
-	// output log line
-	printf("%s - - [%s] \"%s %s\" ? %lld\n",
-		addrStr.c_str(),
-		timeStr.c_str(),
-		method_name,
-		req->uri->path->full,
-		(long long) get_content_length(req));
+	threadConns->erase(conn);
+	delete state;
+	return EVHTP_RES_OK;
 }
 
-static evhtp_res
-upload_read_cb(evhtp_request_t * req, evbuf_t * buf, void * arg)
+static void formatPeer(const evhtp_connection_t *conn, char *buf, size_t len)
 {
-	assert(req && buf && arg);
-
-	ReqState *state = (ReqState *) arg;
+	const struct sockaddr *sa = conn->saddr;
+	string addrStr = addressToStr(sa, (sa->sa_family == AF_INET6) ?
+				      sizeof(struct sockaddr_in6) :
+				      sizeof(struct sockaddr_in));
+	snprintf(buf, len, "%s", addrStr.c_str());
+}
 
-	// remove data from evbuffer to malloc'd buffer
-	size_t bufsz = evbuffer_get_length(buf);
-	char *chunk = (char *) malloc(bufsz);
-	int rc = evbuffer_remove(buf, chunk, bufsz);
-	assert(rc == (int) bufsz);
+// the connection's state, if it has any and is still open
+static ConnState *findConnState(evhtp_request_t *req)
+{
+	if (!threadConns)
+		return NULL;
 
-	// append chunk to total body
-	state->body.append(chunk, bufsz);
+	ConnStateMap::iterator it = threadConns->find(req->conn);
+	return (it == threadConns->end()) ? NULL : it->second;
+}
 
-	// update in-progress content hash
-	SHA256_Update(&state->bodyHash, chunk, bufsz);
+// the connection's state, created by its first request.  Not from
+// request fini hooks: the connection may already be finished.
+static ConnState& connState(evhtp_request_t *req)
+{
+	ConnState *conn = findConnState(req);
+	if (conn)
+		return *conn;
+
+	if (!threadConns)
+		threadConns = new ConnStateMap();
+
+	// first request on this connection
+	conn = new ConnState();
+	formatPeer(req->conn, conn->peer, sizeof(conn->peer));
+	conn->user = NULL;
+	conn->expires = 0;
+	(*threadConns)[req->conn] = conn;
+
+	evhtp_connection_set_hook(req->conn, evhtp_hook_on_connection_fini,
+				  (evhtp_hook) conn_finish_cb, conn);
+	return *conn;
+}
 
-	// release malloc'd buffer
-	free(chunk);
+static void
+logRequest(evhtp_request_t *req, ReqState *state)
+{
+	assert(req && state);
 
-	return EVHTP_RES_OK;
+	if (!accessLog || !accessLog->sampled())
+		return;
+
+	// copied out; formatted and written by the log's own thread
+	AccessRecord rec;
+	rec.tstamp = ((uint64_t) state->tstamp.tv_sec * 1000000) +
+		     state->tstamp.tv_usec;
+	rec.contentLen = get_content_length(req);
+	rec.method = evhtp_request_get_method(req);
+
+	// a dropped connection is finished before its last request
+	ConnState *conn = findConnState(req);
+	if (conn)
+		memcpy(rec.peer, conn->peer, sizeof(rec.peer));
+	else
+		formatPeer(req->conn, rec.peer, sizeof(rec.peer));
+	snprintf(rec.path, sizeof(rec.path), "%s", req->uri->path->full);
+
+	accessLog->push(rec);
 }
 
 static evhtp_res
@@ -119,8 +217,17 @@ req_finish_cb(evhtp_request_t * req, void * arg)
 
 	ReqState *state = (ReqState *) arg;
 
+	// client went away mid-command; drop the reply when it returns
+	if (state->pending)
+		state->pending->req = NULL;
+
+	// streams end with their request
+	if (state->stream)
+		state->stream->hub->release(state->stream);
+
 	// log request, following processing
 	logRequest(req, state);
+	recordRequest(req, state);
 
 	// release our per-request state
 	delete state;
@@ -135,11 +242,19 @@ static void reqInit(evhtp_request_t *req, ReqState *state,
 
 	state->apiEnt = apiEnt;
 
-	// standard Date header
+	// the loop's time, as of its last wakeup
+	event_base_gettimeofday_cached(threadBase, &state->tstamp);
+
+	// standard Date header, formatted once a second per loop
+	static __thread time_t dateSecs = 0;
+	static __thread char dateHdr[64];
+	if (state->tstamp.tv_sec != dateSecs) {
+		dateSecs = state->tstamp.tv_sec;
+		snprintf(dateHdr, sizeof(dateHdr), "%s",
+			 httpDateHdr(dateSecs).c_str());
+	}
 	evhtp_headers_add_header(req->headers_out,
-		evhtp_header_new("Date",
-			 httpDateHdr(state->tstamp.tv_sec).c_str(),
-			 0, 1));
+		evhtp_header_new("Date", dateHdr, 0, 1));
 
 	// standard Server header
 	const char *serverVer = PROGRAM_NAME "/" PACKAGE_VERSION;
@@ -153,16 +268,30 @@ static void reqInit(evhtp_request_t *req, ReqState *state,
 	evhtp_request_set_hook (req, evhtp_hook_on_request_fini, (evhtp_hook) req_finish_cb, state);
 }
 
+// the user logged in on this connection; NULL if none, or expired
+static const AuthKey *connSession(evhtp_request_t *req, time_t now)
+{
+	ConnState& conn = connState(req);
+	if (conn.user && now >= conn.expires)
+		conn.user = NULL;
+	return conn.user;
+}
+
 static bool reqVerify(evhtp_request_t *req, ReqState *state,
-		      const struct HttpApiEntry *apiEnt,
-		      const std::string& authUser,
-		      const std::string& authSecret)
+		      const struct HttpApiEntry *apiEnt)
 {
 	assert(req && state && apiEnt);
 
 	if (!apiEnt->authReq)
 		return true;
 
+	// unsigned, on a logged-in connection: no headers, no hashing
+	const char *authcstr = evhtp_kv_find (req->headers_in, "Authorization");
+	if (!authcstr) {
+		state->user = connSession(req, state->tstamp.tv_sec);
+		return (state->user != NULL);
+	}
+
 	// required headers ETag, X-Unixtime
 	const char *etagCstr = evhtp_kv_find (req->headers_in, "ETag");
 	const char *unixtimeCstr = evhtp_kv_find (req->headers_in, "X-Unixtime");
@@ -176,18 +305,30 @@ static bool reqVerify(evhtp_request_t *req, ReqState *state,
 	if (timeDiff > MAX_CLIENT_DRIFT)
 		return false;
 
-	// input remote Auth hdr
-	const char *authcstr = evhtp_kv_find (req->headers_in, "Authorization");
-	if (!authcstr)
+	// input remote Auth hdr: "cscpp1-sha256 $username $signature"
+	static const char authMethod[] = "cscpp1-sha256 ";
+	if (strncmp(authcstr, authMethod, sizeof(authMethod) - 1))
+		return false;
+	const char *userp = authcstr + sizeof(authMethod) - 1;
+	const char *sigp = strchr(userp, ' ');
+	if (!sigp)
 		return false;
-	string authHdr(authcstr);
 
-	// generate local Auth hdr
-	string authCanonical;
-	build_auth_hdr(req, authUser, authSecret, authCanonical);
+	const AuthKey *key = authStore.find(string(userp, sigp - userp));
+	if (!key)
+		return false;
+	sigp++;
+
+	// sign the canonical pseudo-header with the user's key; verify match
+	static __thread string *phdr = NULL;
+	if (!phdr)
+		phdr = new string();
+	build_auth_msg(req, key->user(), *phdr);
+	if (!key->verifyHex(phdr->data(), phdr->size(), sigp, strlen(sigp)))
+		return false;
 
-	// verify match
-	return (authHdr == authCanonical);
+	state->user = key;
+	return true;
 }
 
 bool reqPreProcessing(evhtp_request_t *req, ReqState *state)
@@ -195,8 +336,7 @@ bool reqPreProcessing(evhtp_request_t *req, ReqState *state)
 	assert(req && state && state->apiEnt);
 
 	// check authorization, if method requires it
-	if (!reqVerify(req, state, state->apiEnt,
-		       "testuser", "testpass")) {
+	if (!reqVerify(req, state, state->apiEnt)) {
 		evhtp_send_reply(req, EVHTP_RES_FORBIDDEN);
 		return false;
 	}
@@ -206,11 +346,22 @@ bool reqPreProcessing(evhtp_request_t *req, ReqState *state)
 	if (etagCstr) {
 		string etagRemote(etagCstr);
 
-		// finalize content hash
-		SHA256_Final(&state->md[0], &state->bodyHash);
+		// content hash, over the body where it lies
+		SHA256_CTX bodyHash;
+		SHA256_Init(&bodyHash);
+		struct evbuffer_iovec vec[16];
+		int n = evbuffer_peek(req->buffer_in, -1, NULL, vec, 16);
+		if (n > 16) {
+			evbuffer_pullup(req->buffer_in, -1);
+			n = evbuffer_peek(req->buffer_in, -1, NULL, vec, 16);
+		}
+		for (int i = 0; i < n; i++)
+			SHA256_Update(&bodyHash, vec[i].iov_base, vec[i].iov_len);
+		vector<unsigned char> md(SHA256_DIGEST_LENGTH);
+		SHA256_Final(&md[0], &bodyHash);
 
 		// canonical ETag, calculated from input content
-		string etagCanon = HexStr(state->md);
+		string etagCanon = HexStr(md);
 
 		// verify ETag matches expected
 		if (etagRemote != etagCanon) {
@@ -219,54 +370,183 @@ bool reqPreProcessing(evhtp_request_t *req, ReqState *state)
 		}
 	}
 
+	// the body, contiguous; usually one chain already
+	static char noBody[1];
+	state->bodyLen = evbuffer_get_length(req->buffer_in);
+	state->body = state->bodyLen ?
+		(char *) evbuffer_pullup(req->buffer_in, -1) : noBody;
+
 	return true;
 }
 
-static evhtp_res
-upload_headers_cb(evhtp_request_t * req, evhtp_headers_t * hdrs, void *arg)
+// a command's reply, on the request's loop
+static void reqReply(evhtp_request_t *req, const EngineCmd *cmd)
+{
+	if (cmd->status != EVHTP_RES_OK)
+		evhtp_send_reply(req, cmd->status);
+	else if (cmd->reply)
+		httpJsonReply(req, *cmd->reply);
+	else if (cmd->writeReply) {
+		JsonWriter w(req->buffer_out, httpPretty(req));
+		cmd->writeReply(w, *cmd);
+		w.end();
+		httpJsonSend(req);
+	} else
+		httpJsonReply(req, cmd->result);
+}
+
+// hand a decoded command to its matching shard; the request is
+// paused until the shard's result comes back through reqComplete()
+void reqSubmit(evhtp_request_t *req, ReqState *state,
+	       unsigned int shard, EngineCmd *cmd)
 {
-	assert(req && hdrs && arg);
+	assert(req && state && cmd && !state->pending);
 
-	const struct HttpApiEntry *apiEnt = (const struct HttpApiEntry *) arg;
+	cmd->req = req;
+	cmd->cq = threadCq;
 
-	// handle OPTIONS
-	if (evhtp_request_get_method(req) == htp_method_OPTIONS) {
-		return EVHTP_RES_OK;
+	// shard overloaded: shed load rather than block this loop
+	if (!engine->shard(shard).post(cmd)) {
+		delete cmd;
+		evhtp_send_reply(req, EVHTP_RES_SERVUNAVAIL);
+		return;
 	}
 
-	// alloc new per-request state
-	ReqState *state = new ReqState();
-	assert(state != NULL);
+	state->pending = cmd;
+	evhtp_request_pause(req);
+}
 
-	// common per-request state
-	reqInit(req, state, apiEnt);
+// hand a batch to its shards, one part per shard touched; the
+// request is paused until the last part comes back
+void reqSubmitBatch(evhtp_request_t *req, ReqState *state, EngineCmd *cmd,
+		    std::vector<EngineCmd *>& parts)
+{
+	assert(req && state && cmd && !state->pending);
 
-	// special incoming-data hook
-	evhtp_request_set_hook (req, evhtp_hook_on_read, (evhtp_hook) upload_read_cb, state);
+	cmd->req = req;
+	cmd->cq = threadCq;
 
-	return EVHTP_RES_OK;
+	for (size_t i = 0; i < parts.size(); i++) {
+		EngineCmd *part = parts[i];
+		if (!part)
+			continue;
+
+		part->parent = cmd;
+		part->cq = threadCq;
+
+		// shard overloaded: its items are reported unexecuted
+		if (!engine->shard(i).post(part)) {
+			for (size_t j = 0; j < part->batch.size(); j++)
+				part->batch[j]->status = EVHTP_RES_SERVUNAVAIL;
+			delete part;
+			continue;
+		}
+
+		cmd->pending++;
+	}
+
+	// parts complete on this loop, so none has returned yet
+	if (cmd->pending == 0) {
+		reqReply(req, cmd);
+		delete cmd;
+		return;
+	}
+
+	state->pending = cmd;
+	evhtp_request_pause(req);
 }
 
-static evhtp_res
-no_upload_headers_cb(evhtp_request_t * req, evhtp_headers_t * hdrs, void *arg)
+// subscribe to a depth book's updates on this loop, then ask its
+// shard for the snapshot they follow
+void reqSubscribe(evhtp_request_t *req, ReqState *state,
+		  unsigned int shard, EngineCmd *cmd)
 {
-	assert(req && hdrs && arg);
+	assert(req && state && cmd && !state->pending && !state->stream);
+
+	cmd->req = req;
+	cmd->cq = threadCq;
+
+	state->stream = threadStream->subscribe(req, cmd->symbol, cmd->depth);
+
+	// shard overloaded: shed load rather than block this loop
+	if (!engine->shard(shard).post(cmd)) {
+		threadStream->release(state->stream);
+		state->stream = NULL;
+		delete cmd;
+		evhtp_send_reply(req, EVHTP_RES_SERVUNAVAIL);
+		return;
+	}
+
+	state->pending = cmd;
+	evhtp_request_pause(req);
+}
+
+static void reqComplete(EngineCmd *cmd)
+{
+	// one shard's part of a batch: reply once every part is back
+	if (cmd->parent) {
+		EngineCmd *parent = cmd->parent;
+		delete cmd;
+		if (--parent->pending > 0)
+			return;
+
+		cmd = parent;
+	}
+
+	evhtp_request_t *req = cmd->req;
+	if (req) {
+		ReqState *state = (ReqState *) req->cbarg;
+		state->pending = NULL;
+
+		evhtp_request_resume(req);
 
-	const struct HttpApiEntry *apiEnt = (const struct HttpApiEntry *) arg;
+		// snapshot in hand: the reply becomes the stream
+		if (state->stream && cmd->status == EVHTP_RES_OK &&
+		    state->stream->hub->start(state->stream, cmd->change,
+					      *cmd->reply)) {
+			delete cmd;
+			return;
+		}
+		if (state->stream) {
+			state->stream->hub->release(state->stream);
+			state->stream = NULL;
+			if (cmd->status == EVHTP_RES_OK)
+				cmd->status = EVHTP_RES_SERVUNAVAIL;
+		}
+
+		reqReply(req, cmd);
+	}
+
+	delete cmd;
+}
+
+// every request: route it, then hand it to its API entry
+static void reqDispatch(evhtp_request_t *req, void *arg)
+{
+	const char *match = NULL;
+	size_t matchLen = 0;
+	const struct HttpApiEntry *apiEnt =
+		apiRouter.route(req->uri->path->full, match, matchLen);
+	if (!apiEnt) {
+		evhtp_send_reply(req, EVHTP_RES_NOTFOUND);
+		return;
+	}
 
 	// handle OPTIONS
 	if (evhtp_request_get_method(req) == htp_method_OPTIONS) {
-		return EVHTP_RES_OK;
+		evhtp_send_reply(req, EVHTP_RES_OK);
+		return;
 	}
 
-	// alloc new per-request state
+	// new per-request state, from this loop's pool
 	ReqState *state = new ReqState();
-	assert(state != NULL);
+	state->match = match;
+	state->matchLen = matchLen;
 
 	// common per-request state
 	reqInit(req, state, apiEnt);
 
-	return EVHTP_RES_OK;
+	apiEnt->cb(req, state);
 }
 
 void reqInfo(evhtp_request_t * req, void * arg)
@@ -290,11 +570,112 @@ void reqInfo(evhtp_request_t * req, void * arg)
 	obj.pushKV("name", "obsrv");
 	obj.pushKV("apiversion", 100);
 	obj.pushKV("time", timeObj);
+	obj.pushKV("frontendThreads", (int64_t) frontendThreads);
+
+	// order index sizing, summed over shards, and per-shard load
+	uint64_t live = 0, liveIndexBytes = 0, archived = 0;
+	uint64_t archivedBytes = 0, archiveIndexBytes = 0;
+	uint64_t evicted = 0, spilled = 0;
+	UniValue shardsArr(UniValue::VARR);
+	for (size_t i = 0; i < engine->shardCount(); i++) {
+		const ShardStats& st = engine->shard(i).stats();
+		live += st.liveOrders;
+		liveIndexBytes += st.liveIndexBytes;
+		archived += st.archived;
+		archivedBytes += st.archivedBytes;
+		archiveIndexBytes += st.archiveIndexBytes;
+		evicted += st.evicted;
+		spilled += st.spilled;
+
+		UniValue shardObj(UniValue::VOBJ);
+		shardObj.pushKV("commands", (int64_t) st.commands);
+		shardObj.pushKV("batches", (int64_t) st.batches);
+		shardObj.pushKV("liveOrders", (int64_t) st.liveOrders);
+		shardsArr.push_back(shardObj);
+	}
+
+	UniValue ordersObj(UniValue::VOBJ);
+	ordersObj.pushKV("live", (int64_t) live);
+	ordersObj.pushKV("liveIndexBytes", (int64_t) liveIndexBytes);
+	ordersObj.pushKV("archived", (int64_t) archived);
+	ordersObj.pushKV("archivedBytes", (int64_t) archivedBytes);
+	ordersObj.pushKV("archiveIndexBytes", (int64_t) archiveIndexBytes);
+	ordersObj.pushKV("bytesPerOrder", (int64_t)
+		(archived ? (archivedBytes / archived) : 0));
+	ordersObj.pushKV("evicted", (int64_t) evicted);
+	ordersObj.pushKV("spilled", (int64_t) spilled);
+	obj.pushKV("orders", ordersObj);
+	obj.pushKV("shards", shardsArr);
+
+	// binary order entry
+	if (binServer) {
+		UniValue binObj(UniValue::VOBJ);
+		binObj.pushKV("sessions", (int64_t) binServer->sessions());
+		binObj.pushKV("messages", (int64_t) binServer->messages());
+		binObj.pushKV("reports", (int64_t) binServer->reports());
+		obj.pushKV("binary", binObj);
+	}
+
+	// multicast market data
+	if (mdPublisher) {
+		UniValue mdObj(UniValue::VOBJ);
+		mdObj.pushKV("messages", (int64_t) mdPublisher->messages());
+		mdObj.pushKV("packets", (int64_t) mdPublisher->packets());
+		mdObj.pushKV("snapshots", (int64_t) mdPublisher->snapshots());
+		mdObj.pushKV("retransmits", (int64_t) mdPublisher->retransmits());
+		obj.pushKV("marketData", mdObj);
+	}
+
+	// streaming book subscribers
+	obj.pushKV("streamSubscribers", (int64_t) bookFeed.subscribers());
+
+	// event log health
+	if (eventLog) {
+		UniValue logObj(UniValue::VOBJ);
+		logObj.pushKV("written", (int64_t) eventLog->written());
+		logObj.pushKV("dropped", (int64_t) eventLog->dropped());
+		obj.pushKV("log", logObj);
+	}
+	if (accessLog) {
+		UniValue logObj(UniValue::VOBJ);
+		logObj.pushKV("written", (int64_t) accessLog->written());
+		logObj.pushKV("dropped", (int64_t) accessLog->dropped());
+		obj.pushKV("accessLog", logObj);
+	}
 
 	// successful operation.  Return JSON output.
 	httpJsonReply(req, obj);
 }
 
+// signed request; later unsigned requests on this connection act as
+// its user, until the session expires or the connection closes
+void reqLogin(evhtp_request_t * req, void * arg)
+{
+	assert(req && arg);
+	ReqState *state = (ReqState *) arg;
+
+	// global pre-request processing
+	if (!reqPreProcessing(req, state))
+		return;		// pre-processing failed; response already sent
+
+	// a session cannot renew itself
+	if (!sessionTtl ||
+	    !evhtp_kv_find(req->headers_in, "Authorization")) {
+		evhtp_send_reply(req, EVHTP_RES_FORBIDDEN);
+		return;
+	}
+
+	ConnState& conn = connState(req);
+	conn.user = state->user;
+	conn.expires = state->tstamp.tv_sec + sessionTtl;
+
+	UniValue obj(UniValue::VOBJ);
+	obj.pushKV("user", conn.user->user());
+	obj.pushKV("expires", (int64_t) conn.expires);
+
+	httpJsonReply(req, obj);
+}
+
 static error_t parse_opt (int key, char *arg, struct argp_state *state)
 {
 	switch (key) {
@@ -310,6 +691,10 @@ static error_t parse_opt (int key, char *arg, struct argp_state *state)
 		opt_daemon = true;
 		break;
 
+	case 1003:
+		opt_bench_startup = true;
+		break;
+
 	case ARGP_KEY_END:
 		break;
 
@@ -335,10 +720,298 @@ static bool read_config_init()
 		opt_daemon = serverCfg["daemon"].getBool();
 	if (serverCfg.exists("pidFile"))
 		opt_pid_file = serverCfg["pidFile"].getValStr();
+	if (!serverCfg.exists("datastore"))
+		serverCfg.pushKV("datastore", DEFAULT_DATASTORE_FN);
+
+	// journal sync policy: request, interval, async
+	if (!serverCfg.exists("journalSync"))
+		serverCfg.pushKV("journalSync", "interval");
+	if (!serverCfg.exists("journalSyncUsec"))
+		serverCfg.pushKV("journalSyncUsec", (int64_t) 0);
+
+	// snapshot interval in seconds; 0 to disable
+	if (!serverCfg.exists("snapshotFile"))
+		serverCfg.pushKV("snapshotFile", DEFAULT_SNAPSHOT_FN);
+	if (!serverCfg.exists("snapshotInterval"))
+		serverCfg.pushKV("snapshotInterval", (int64_t) 300);
+
+	// terminal order retention: count limit, age limit (seconds,
+	// 0 for none), and whether evicted orders are kept in datastore
+	if (!serverCfg.exists("orderArchiveMax"))
+		serverCfg.pushKV("orderArchiveMax", (int64_t) 1000000);
+	if (!serverCfg.exists("orderArchiveAge"))
+		serverCfg.pushKV("orderArchiveAge", (int64_t) 0);
+	if (!serverCfg.exists("orderArchiveSpill"))
+		serverCfg.pushKV("orderArchiveSpill", false);
+
+	// whether clients are issued UUIDs as in earlier releases
+	if (!serverCfg.exists("orderIdCompat"))
+		serverCfg.pushKV("orderIdCompat", false);
+	orderIdCompat = serverCfg["orderIdCompat"].getBool();
+
+	// matching shards (1-256), and per-shard command queue size
+	if (!serverCfg.exists("matchThreads"))
+		serverCfg.pushKV("matchThreads", (int64_t) 1);
+	if (!serverCfg.exists("matchQueueSize"))
+		serverCfg.pushKV("matchQueueSize", (int64_t) 65536);
+
+	// accept testuser/testpass when no credentials are loaded;
+	// for test setups only
+	if (!serverCfg.exists("authTestUser"))
+		serverCfg.pushKV("authTestUser", false);
+
+	// lifetime of a /login session, in seconds; 0 to disable
+	if (!serverCfg.exists("sessionTtl"))
+		serverCfg.pushKV("sessionTtl", (int64_t) 0);
+	sessionTtl = atoll(serverCfg["sessionTtl"].getValStr().c_str());
+
+	// binary order-entry port, on bindAddress; 0 to disable
+	if (!serverCfg.exists("binaryPort"))
+		serverCfg.pushKV("binaryPort", (int64_t) 0);
+
+	// per-loop queue of depth-book updates for streaming clients
+	if (!serverCfg.exists("streamQueueSize"))
+		serverCfg.pushKV("streamQueueSize", (int64_t) 4096);
+
+	// multicast market-data feed: group, port (0 to disable), sending
+	// interface (empty for default), TTL; TCP snapshot/retransmit port
+	// on bindAddress (0 to disable), and messages kept for retransmit
+	if (!serverCfg.exists("mdGroup"))
+		serverCfg.pushKV("mdGroup", "239.192.79.79");
+	if (!serverCfg.exists("mdPort"))
+		serverCfg.pushKV("mdPort", (int64_t) 0);
+	if (!serverCfg.exists("mdInterface"))
+		serverCfg.pushKV("mdInterface", "");
+	if (!serverCfg.exists("mdTtl"))
+		serverCfg.pushKV("mdTtl", (int64_t) 1);
+	if (!serverCfg.exists("mdSnapshotPort"))
+		serverCfg.pushKV("mdSnapshotPort", (int64_t) 0);
+	if (!serverCfg.exists("mdRetain"))
+		serverCfg.pushKV("mdRetain", (int64_t) 65536);
+
+	// HTTP front-end threads; 0 serves requests on the main loop
+	if (!serverCfg.exists("frontendThreads"))
+		serverCfg.pushKV("frontendThreads", (int64_t) 0);
+
+	int64_t nFrontend = atoll(serverCfg["frontendThreads"].getValStr().c_str());
+	if (nFrontend < 0 || nFrontend > 256) {
+		fprintf(stderr, "%s: frontendThreads must be 0-256\n",
+			opt_configfn.c_str());
+		return false;
+	}
+	frontendThreads = nFrontend;
+
+	int64_t nShards = atoll(serverCfg["matchThreads"].getValStr().c_str());
+	if (nShards < 1 || nShards > 256) {
+		fprintf(stderr, "%s: matchThreads must be 1-256\n",
+			opt_configfn.c_str());
+		return false;
+	}
+
+	// event log verbosity: off, warn, info, debug
+	if (!serverCfg.exists("logLevel"))
+		serverCfg.pushKV("logLevel", "info");
+	if (!serverCfg.exists("logQueueSize"))
+		serverCfg.pushKV("logQueueSize", (int64_t) 65536);
+
+	EventLogLevel level;
+	if (!EventLog::parseLevel(serverCfg["logLevel"].getValStr(), level)) {
+		fprintf(stderr, "%s: invalid logLevel \"%s\"\n",
+			opt_configfn.c_str(),
+			serverCfg["logLevel"].getValStr().c_str());
+		return false;
+	}
+
+	// HTTP access log: off, text or binary; file (empty for stdout),
+	// one in every accessLogSample requests, and queue size
+	if (!serverCfg.exists("accessLog"))
+		serverCfg.pushKV("accessLog", "text");
+	if (!serverCfg.exists("accessLogFile"))
+		serverCfg.pushKV("accessLogFile", "");
+	if (!serverCfg.exists("accessLogSample"))
+		serverCfg.pushKV("accessLogSample", (int64_t) 1);
+	if (!serverCfg.exists("accessLogQueueSize"))
+		serverCfg.pushKV("accessLogQueueSize", (int64_t) 65536);
+
+	AccessLogFormat alogFormat;
+	if (!AccessLog::parseFormat(serverCfg["accessLog"].getValStr(),
+				    alogFormat)) {
+		fprintf(stderr, "%s: invalid accessLog \"%s\"\n",
+			opt_configfn.c_str(),
+			serverCfg["accessLog"].getValStr().c_str());
+		return false;
+	}
+
+	JournalSyncPolicy policy;
+	if (!Journal::parsePolicy(serverCfg["journalSync"].getValStr(), policy)) {
+		fprintf(stderr, "%s: invalid journalSync policy \"%s\"\n",
+			opt_configfn.c_str(),
+			serverCfg["journalSync"].getValStr().c_str());
+		return false;
+	}
+
+	return true;
+}
+
+static void snapshot_cb(evutil_socket_t fd, short events, void *arg)
+{
+	// each shard snapshots between batches, on its own thread
+	engine->snapshot();
+}
+
+static int64_t monoUsec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((int64_t) ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static bool datastore_open()
+{
+	rocksdb::Options options;
+	options.create_if_missing = true;
+
+	const string& dbFn = serverCfg["datastore"].getValStr();
+	rocksdb::Status status = rocksdb::DB::Open(options, dbFn, &db);
+	if (!status.ok()) {
+		fprintf(stderr, "%s: %s\n", dbFn.c_str(),
+			status.ToString().c_str());
+		return false;
+	}
+
+	// symbols are hashed to shards; the count cannot change
+	// without rebuilding the journals
+	unsigned int nShards = atoi(serverCfg["matchThreads"].getValStr().c_str());
+	const string shardsKey = "/config/matchThreads";
+	string val;
+	status = db->Get(rocksdb::ReadOptions(), shardsKey, &val);
+	if (status.ok()) {
+		if (val != to_string(nShards)) {
+			fprintf(stderr, "%s: datastore has %s matchThreads, "
+				"config has %u\n",
+				dbFn.c_str(), val.c_str(), nShards);
+			return false;
+		}
+	} else if (status.IsNotFound()) {
+		status = db->Put(rocksdb::WriteOptions(), shardsKey,
+				 to_string(nShards));
+		if (!status.ok())
+			return false;
+	} else
+		return false;
+
+	// API credentials, from obdb --load-auth
+	if (!authStore.load(db))
+		return false;
+	if (authStore.size() == 0) {
+		if (serverCfg["authTestUser"].getBool()) {
+			syslog(LOG_DAEMON|LOG_WARNING,
+			       "no /auth/ credentials; using testuser/testpass");
+			authStore.add("testuser", "testpass");
+		} else
+			syslog(LOG_DAEMON|LOG_WARNING,
+			       "no /auth/ credentials; signed requests refused");
+	}
+
+	JournalSyncPolicy policy;
+	Journal::parsePolicy(serverCfg["journalSync"].getValStr(), policy);
+
+	engine = new Engine(db, nShards, policy,
+		atoll(serverCfg["journalSyncUsec"].getValStr().c_str()),
+		serverCfg["snapshotFile"].getValStr(),
+		atoll(serverCfg["matchQueueSize"].getValStr().c_str()));
+
+	// terminal order retention; evicted orders optionally kept on disk
+	for (unsigned int i = 0; i < nShards; i++) {
+		OrderArchive& archive = engine->shard(i).market().archive();
+		archive.setLimits(
+			atoll(serverCfg["orderArchiveMax"].getValStr().c_str()),
+			atoll(serverCfg["orderArchiveAge"].getValStr().c_str()));
+		if (serverCfg["orderArchiveSpill"].getBool())
+			archive.setSpill(db);
+	}
 
 	return true;
 }
 
+// rebuild each shard from its newest snapshot plus journal tail,
+// before accepting requests
+static bool market_recover()
+{
+	for (size_t i = 0; i < engine->shardCount(); i++) {
+		MatchShard& shard = engine->shard(i);
+
+		int64_t t0 = monoUsec();
+		SnapshotInfo info;
+		uint64_t nReplay;
+		if (!shard.recover(info, nReplay)) {
+			fprintf(stderr, "shard %u: recovery failed\n",
+				shard.index());
+			return false;
+		}
+		int64_t t1 = monoUsec();
+
+		double ms = (t1 - t0) / 1000.0;
+		double replayRate = (t1 > t0) ?
+			(nReplay * 1000000.0 / (t1 - t0)) : 0.0;
+
+		char msg[512];
+		snprintf(msg, sizeof(msg),
+			 "recovery: shard %u snapshot seq %llu (%llu books, "
+			 "%llu orders, %llu resting, %llu archived, %llu bytes), "
+			 "replayed %llu journal records, in %.3f ms (%.0f rec/s)",
+			 shard.index(),
+			 (unsigned long long) info.seq,
+			 (unsigned long long) info.books,
+			 (unsigned long long) info.orders,
+			 (unsigned long long) info.resting,
+			 (unsigned long long) info.archived,
+			 (unsigned long long) info.bytes,
+			 (unsigned long long) nReplay,
+			 ms, replayRate);
+		syslog(LOG_DAEMON|LOG_INFO, "%s", msg);
+		if (opt_bench_startup)
+			printf("%s\n", msg);
+	}
+
+	return true;
+}
+
+static void engine_start()
+{
+	engine->start();
+
+	// periodic point-in-time snapshots
+	int64_t snapSecs = atoll(serverCfg["snapshotInterval"].getValStr().c_str());
+	if (snapSecs > 0) {
+		struct timeval snapTv = { (time_t) snapSecs, 0 };
+		snapshotEv = event_new(evbase, -1, EV_PERSIST, snapshot_cb, NULL);
+		event_add(snapshotEv, &snapTv);
+	}
+}
+
+// each front-end thread runs its own loop; shard results for requests
+// it accepted come back through a completion queue on that loop
+static void frontend_thread_init(evhtp_t *htp, evthr_t *thr, void *arg)
+{
+	threadBase = evthr_get_base(thr);
+	threadCq = new CompletionQueue(evthr_get_base(thr), reqComplete,
+		atoll(serverCfg["matchQueueSize"].getValStr().c_str()));
+	threadStream = new BookStream(evthr_get_base(thr), &bookFeed,
+		atoll(serverCfg["streamQueueSize"].getValStr().c_str()));
+	bookFeed.addStream(threadStream);
+}
+
+static void frontend_thread_exit(evhtp_t *htp, evthr_t *thr, void *arg)
+{
+	delete threadCq;
+	threadCq = NULL;
+	delete threadStream;
+	threadStream = NULL;
+	delete threadConns;
+	threadConns = NULL;
+}
+
 static void pid_file_cleanup(void)
 {
 	if (!opt_pid_file.empty())
@@ -350,19 +1023,225 @@ static void shutdown_signal(int signo)
 	event_base_loopbreak(evbase);
 }
 
+#define API_ENTRY(auth, path, match, cb, input, json)	\
+	{ auth, path, match, cb, input, json },
+
 static std::vector<struct HttpApiEntry> apiRegistry = {
-	// auth? path			regex? cb	input? json-input?
-	{ false, "/info",		false, reqInfo, false, false },
+	API_ROUTES(API_ENTRY)
+};
 
-	{ false, "/marketList",		false, reqMarketList, false, false },
-	{ true,  "/marketAdd",		false, reqMarketAdd, true, true },
+static void recordRequest(evhtp_request_t *req, ReqState *state)
+{
+	if (!threadMetrics) {
+		threadMetrics = new RouteMetrics[apiRegistry.size()];
 
-	{ false, "^/book/([A-Z]+)",	true,  reqOrderBookList, false, false },
-	{ true,  "/orderAdd",		false, reqOrderAdd, true, true },
-	{ true,  "/orderCancel",	false, reqOrderCancel, true, true },
-	{ true,  "/orderModify",	false, reqOrderModify, true, true },
-	{ true,  "^/order/([a-z0-9-]+)", true, reqOrderInfo, true, true },
-};
+		std::lock_guard<std::mutex> lock(routeMetricsLock);
+		routeMetrics.push_back(threadMetrics);
+	}
+	RouteMetrics& m = threadMetrics[state->apiEnt - &apiRegistry[0]];
+
+	// from the loop's time at request; streams, to their end
+	struct timeval now;
+	gettimeofday(&now, NULL);
+	int64_t usec = ((int64_t) (now.tv_sec - state->tstamp.tv_sec) * 1000000) +
+		       (now.tv_usec - state->tstamp.tv_usec);
+	m.latency.record(usec > 0 ? usec : 0);
+
+	unsigned int cls = req->status / 100;
+	m.status[(cls >= 1 && cls <= 5) ? cls - 1 : 5].inc();
+}
+
+static void metricHeader(string& s, const char *name, const char *type,
+			 const char *help)
+{
+	s += "# HELP ";
+	s += name;
+	s += ' ';
+	s += help;
+	s += "\n# TYPE ";
+	s += name;
+	s += ' ';
+	s += type;
+	s += '\n';
+}
+
+static void metricLine(string& s, const char *name, const char *labels,
+		       uint64_t v)
+{
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), "%s{%s} %" PRIu64 "\n", name, labels, v);
+	s += tmp;
+}
+
+static void metricSecs(string& s, const char *name, const char *labels,
+		       uint64_t usec)
+{
+	char tmp[256];
+	snprintf(tmp, sizeof(tmp), "%s{%s} %" PRIu64 ".%06u\n", name, labels,
+		 usec / 1000000, (unsigned int) (usec % 1000000));
+	s += tmp;
+}
+
+// request metrics, summed over loops
+static void writeRouteMetrics(string& s)
+{
+	static const char *statusNames[] = { "1xx", "2xx", "3xx", "4xx", "5xx", "other" };
+	static const double quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+	const size_t nRoutes = apiRegistry.size();
+	char labels[192];
+
+	vector<vector<uint64_t> > buckets(nRoutes,
+		vector<uint64_t>(LatencyHistogram::BUCKETS));
+	vector<uint64_t> counts(nRoutes), sums(nRoutes), status(nRoutes * 6);
+	{
+		std::lock_guard<std::mutex> lock(routeMetricsLock);
+		for (size_t t = 0; t < routeMetrics.size(); t++) {
+			for (size_t r = 0; r < nRoutes; r++) {
+				const RouteMetrics& m = routeMetrics[t][r];
+				for (unsigned int i = 0; i < LatencyHistogram::BUCKETS; i++)
+					buckets[r][i] += m.latency.count(i);
+				counts[r] += m.latency.count();
+				sums[r] += m.latency.sum();
+				for (unsigned int i = 0; i < 6; i++)
+					status[r * 6 + i] += m.status[i].get();
+			}
+		}
+	}
+
+	metricHeader(s, "obsrv_http_requests_total", "counter",
+		     "HTTP requests, by route and status class.");
+	for (size_t r = 0; r < nRoutes; r++)
+		for (unsigned int i = 0; i < 6; i++) {
+			snprintf(labels, sizeof(labels), "route=\"%s\",code=\"%s\"",
+				 apiRegistry[r].path, statusNames[i]);
+			metricLine(s, "obsrv_http_requests_total", labels,
+				   status[r * 6 + i]);
+		}
+
+	// exported at power-of-two bounds, 16us to 16s; each is a
+	// bucket edge, so the counts below it are exact
+	metricHeader(s, "obsrv_http_request_duration_seconds", "histogram",
+		     "HTTP request latency, from request to finish, by route.");
+	for (size_t r = 0; r < nRoutes; r++) {
+		uint64_t cum = 0;
+		unsigned int i = 0;
+		for (unsigned int e = 4; e <= 24; e++) {
+			uint64_t le = (uint64_t) 1 << e;
+			for (; i < LatencyHistogram::BUCKETS &&
+			       LatencyHistogram::upperBound(i) < le; i++)
+				cum += buckets[r][i];
+			snprintf(labels, sizeof(labels),
+				 "route=\"%s\",le=\"%g\"",
+				 apiRegistry[r].path, le / 1e6);
+			metricLine(s, "obsrv_http_request_duration_seconds_bucket",
+				   labels, cum);
+		}
+		snprintf(labels, sizeof(labels), "route=\"%s\",le=\"+Inf\"",
+			 apiRegistry[r].path);
+		metricLine(s, "obsrv_http_request_duration_seconds_bucket",
+			   labels, counts[r]);
+
+		snprintf(labels, sizeof(labels), "route=\"%s\"",
+			 apiRegistry[r].path);
+		metricSecs(s, "obsrv_http_request_duration_seconds_sum",
+			   labels, sums[r]);
+		metricLine(s, "obsrv_http_request_duration_seconds_count",
+			   labels, counts[r]);
+	}
+
+	// quantiles at the histogram's full resolution
+	metricHeader(s, "obsrv_http_request_duration_quantile_seconds", "gauge",
+		     "HTTP request latency quantiles since start, by route.");
+	for (size_t r = 0; r < nRoutes; r++) {
+		if (!counts[r])
+			continue;
+		for (unsigned int q = 0; q < 4; q++) {
+			uint64_t rank = (uint64_t) (quantiles[q] * counts[r]);
+			uint64_t cum = 0;
+			unsigned int i = 0;
+			for (; i < LatencyHistogram::BUCKETS - 1; i++) {
+				cum += buckets[r][i];
+				if (cum > rank)
+					break;
+			}
+			snprintf(labels, sizeof(labels),
+				 "route=\"%s\",quantile=\"%g\"",
+				 apiRegistry[r].path, quantiles[q]);
+			metricSecs(s, "obsrv_http_request_duration_quantile_seconds",
+				   labels, LatencyHistogram::upperBound(i));
+		}
+	}
+}
+
+// matching engine metrics, per shard and per book
+static void writeEngineMetrics(string& s)
+{
+	char labels[128];
+
+	metricHeader(s, "obsrv_shard_commands_total", "counter",
+		     "Commands executed, by shard.");
+	for (size_t i = 0; i < engine->shardCount(); i++) {
+		snprintf(labels, sizeof(labels), "shard=\"%zu\"", i);
+		metricLine(s, "obsrv_shard_commands_total", labels,
+			   engine->shard(i).stats().commands.load(std::memory_order_relaxed));
+	}
+	metricHeader(s, "obsrv_shard_live_orders", "gauge",
+		     "Orders in the live index, by shard.");
+	for (size_t i = 0; i < engine->shardCount(); i++) {
+		snprintf(labels, sizeof(labels), "shard=\"%zu\"", i);
+		metricLine(s, "obsrv_shard_live_orders", labels,
+			   engine->shard(i).stats().liveOrders.load(std::memory_order_relaxed));
+	}
+
+	metricHeader(s, "obsrv_book_events_total", "counter",
+		     "Order book events, by symbol and event.");
+	string resting;
+	for (size_t i = 0; i < engine->shardCount(); i++) {
+		engine->shard(i).market().bookMetrics().forEach(
+			[&s, &resting, &labels](const BookMetrics& bm) {
+			static const char *names[] = { "accept", "reject", "fill",
+				"cancel", "replace", "trade" };
+			const MetricCounter *ctrs[] = { &bm.accepts, &bm.rejects,
+				&bm.fills, &bm.cancels, &bm.replaces, &bm.trades };
+			for (unsigned int j = 0; j < 6; j++) {
+				snprintf(labels, sizeof(labels),
+					 "symbol=\"%s\",event=\"%s\"",
+					 bm.symbol.c_str(), names[j]);
+				metricLine(s, "obsrv_book_events_total", labels,
+					   ctrs[j]->get());
+			}
+
+			snprintf(labels, sizeof(labels), "symbol=\"%s\"",
+				 bm.symbol.c_str());
+			metricLine(resting, "obsrv_book_resting_orders", labels,
+				   bm.resting.get());
+		});
+	}
+	metricHeader(s, "obsrv_book_resting_orders", "gauge",
+		     "Orders resting on the book, by symbol.");
+	s += resting;
+}
+
+// Prometheus text exposition format
+static void reqMetrics(evhtp_request_t *req, void *arg)
+{
+	assert(req && arg);
+	ReqState *state = (ReqState *) arg;
+
+	// global pre-request processing
+	if (!reqPreProcessing(req, state))
+		return;		// pre-processing failed; response already sent
+
+	string body;
+	body.reserve(65536);
+	writeRouteMetrics(body);
+	writeEngineMetrics(body);
+
+	evbuffer_add(req->buffer_out, body.data(), body.size());
+	evhtp_headers_add_header(req->headers_out,
+		evhtp_header_new("Content-Type", "text/plain; version=0.0.4", 0, 0));
+	evhtp_send_reply(req, EVHTP_RES_OK);
+}
 
 int main(int argc, char ** argv)
 {
@@ -378,32 +1257,31 @@ int main(int argc, char ** argv)
 	if (!read_config_init())
 		return EXIT_FAILURE;
 
+	// measure recovery only; do not serve
+	if (opt_bench_startup) {
+		if (!datastore_open() || !market_recover())
+			return EXIT_FAILURE;
+		delete engine;
+		delete db;
+		return 0;
+	}
+
 	// Process auto-cleanup
 	signal(SIGTERM, shutdown_signal);
 	signal(SIGINT, shutdown_signal);
 	atexit(pid_file_cleanup);
 
-	// initialize libevent, libevhtp
+	// initialize libevent, libevhtp; locking is needed once
+	// front-end threads share the listener and the engine
+	evthread_use_pthreads();
 	evbase = event_base_new();
 	evhtp_t  * htp    = evhtp_new(evbase, NULL);
-	evhtp_callback_t *cb = NULL;
-
-	// register our list of API calls and their handlers
-	for (size_t i = 0; i < apiRegistry.size(); i++) {
-		const struct HttpApiEntry *apiEnt = &apiRegistry[i];
+	threadBase = evbase;
 
-		// register evhtp hook
-		if (apiEnt->pathIsRegex)
-			cb = evhtp_set_regex_cb(htp, apiEnt->path, apiEnt->cb, (void *) apiEnt);
-		else
-			cb = evhtp_set_cb(htp, apiEnt->path, apiEnt->cb, (void *) apiEnt);
-
-		// set standard per-callback initialization hook
-		evhtp_callback_set_hook(cb, evhtp_hook_on_headers,
-			apiEnt->wantInput ?
-				((evhtp_hook) upload_headers_cb) :
-				((evhtp_hook) no_upload_headers_cb), (void *) apiEnt);
-	}
+	// register our list of API calls; one callback routes them all
+	for (size_t i = 0; i < apiRegistry.size(); i++)
+		apiRouter.add(&apiRegistry[i]);
+	evhtp_set_gencb(htp, reqDispatch, NULL);
 
 	// Daemonize
 	if (opt_daemon && daemon(0, 0) < 0) {
@@ -416,11 +1294,128 @@ int main(int argc, char ** argv)
 	if (pid_fd < 0)
 		return EXIT_FAILURE;
 
+	// open datastore, recover shards from snapshot + journal
+	if (!datastore_open() || !market_recover())
+		return EXIT_FAILURE;
+
+	// asynchronous event log; attached after recovery, so that
+	// replayed commands are not logged a second time
+	EventLogLevel logLevel;
+	EventLog::parseLevel(serverCfg["logLevel"].getValStr(), logLevel);
+	size_t logQueueSize = atoll(serverCfg["logQueueSize"].getValStr().c_str());
+	eventLog = new EventLog(&std::cout, logQueueSize);
+	eventLog->setLevel(logLevel);
+	eventLog->start();
+	engine->setEventLog(eventLog);
+
+	// asynchronous access log, fed by the front-end loops
+	AccessLogFormat alogFormat;
+	AccessLog::parseFormat(serverCfg["accessLog"].getValStr(), alogFormat);
+	if (alogFormat != ALOG_OFF) {
+		const string& alogFn = serverCfg["accessLogFile"].getValStr();
+		int alogFd = STDOUT_FILENO;
+		if (!alogFn.empty()) {
+			alogFd = open(alogFn.c_str(),
+				      O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+				      0644);
+			if (alogFd < 0) {
+				perror(alogFn.c_str());
+				return EXIT_FAILURE;
+			}
+		}
+		accessLog = new AccessLog(alogFd, alogFormat,
+			atoi(serverCfg["accessLogSample"].getValStr().c_str()),
+			atoll(serverCfg["accessLogQueueSize"].getValStr().c_str()));
+		accessLog->start();
+	}
+
+	// binary sessions share the main loop; shards report to it
+	int binaryPort = atoi(serverCfg["binaryPort"].getValStr().c_str());
+	if (binaryPort > 0) {
+		binServer = new BinServer(evbase, engine, &authStore,
+			atoll(serverCfg["matchQueueSize"].getValStr().c_str()));
+		engine->setExecSink(binServer);
+
+		if (!binServer->listen(serverCfg["bindAddress"].getValStr(),
+				       binaryPort)) {
+			fprintf(stderr, "binary listener: bind to port %d failed\n",
+				binaryPort);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// shard results return to this loop
+	completionQueue = new CompletionQueue(evbase, reqComplete,
+		atoll(serverCfg["matchQueueSize"].getValStr().c_str()));
+	threadCq = completionQueue;
+
+	// depth-book updates, streamed from every loop
+	bookStream = new BookStream(evbase, &bookFeed,
+		atoll(serverCfg["streamQueueSize"].getValStr().c_str()));
+	threadStream = bookStream;
+	bookFeed.addStream(bookStream);
+	engine->setBookSink(&bookFeed);
+
+	// multicast feed, sequenced on the main loop; seeded with the
+	// recovered books before the shards start changing them
+	int mdPort = atoi(serverCfg["mdPort"].getValStr().c_str());
+	if (mdPort > 0) {
+		mdPublisher = new MdPublisher(evbase,
+			atoll(serverCfg["streamQueueSize"].getValStr().c_str()),
+			atoll(serverCfg["mdRetain"].getValStr().c_str()));
+		if (!mdPublisher->open(serverCfg["mdGroup"].getValStr(), mdPort,
+				       serverCfg["mdInterface"].getValStr(),
+				       atoi(serverCfg["mdTtl"].getValStr().c_str()))) {
+			fprintf(stderr, "market data: cannot send to group %s\n",
+				serverCfg["mdGroup"].getValStr().c_str());
+			return EXIT_FAILURE;
+		}
+
+		int mdSnapshotPort = atoi(serverCfg["mdSnapshotPort"].getValStr().c_str());
+		if (mdSnapshotPort > 0 &&
+		    !mdPublisher->listen(serverCfg["bindAddress"].getValStr(),
+					 mdSnapshotPort)) {
+			fprintf(stderr, "market data: bind to port %d failed\n",
+				mdSnapshotPort);
+			return EXIT_FAILURE;
+		}
+
+		mdPublisher->seed(*engine);
+		bookFeed.setPublisher(mdPublisher);
+	}
+
+	engine_start();
+
+	// parse, authenticate and serialize on a pool of front-end
+	// threads; the main loop then only accepts connections.
+	// Started after fork and recovery, so requests find the engine.
+	if (frontendThreads > 0)
+		evhtp_use_threads_wexit(htp, frontend_thread_init,
+					frontend_thread_exit,
+					frontendThreads, NULL);
+
 	// bind to socket and start server main loop
 	evhtp_bind_socket(htp,
 			  serverCfg["bindAddress"].getValStr().c_str(),
 			  atoi(serverCfg["bindPort"].getValStr().c_str()),
 			  1024);
 	event_base_loop(evbase, 0);
+
+	// finish queued commands, flush batched journal records;
+	// front-end threads stay up to deliver the final replies
+	engine->stop();
+	evhtp_free(htp);
+	delete engine;
+	delete binServer;
+	delete completionQueue;
+	delete bookStream;
+	delete mdPublisher;
+	delete db;
+
+	// drain remaining log records
+	eventLog->stop();
+	delete eventLog;
+	delete accessLog;
+
 	return 0;
 }
@@ -6,41 +6,86 @@
 #include <vector>
 #include <cstdint>
 #include <evhtp.h>
-#include <openssl/sha.h>
 #include "Market.h"
+#include "Engine.h"
+#include "BookStream.h"
+#include "HttpRouter.h"
+#include "AuthStore.h"
+#include "Pool.h"
 
 #define DEFAULT_DATASTORE_FN "obsrv.rocks"
+#define DEFAULT_SNAPSHOT_FN "obsrv.snapshot"
 
 struct HttpApiEntry {
 	bool			authReq;	// authentication req'd?
 
 	const char		*path;
-	bool			pathIsRegex;
+	HttpPathMatch		match;
 
 	evhtp_callback_cb	cb;
 	bool			wantInput;
 	bool			jsonInput;
 };
 
+// The server's API routes, in apiRegistry order.  Each is expanded by
+// R(auth?, path, match, cb, input?, json-input?): obsrv.cc builds its
+// table from them, and test-router routes against the same list.
+#define API_ROUTES(R)							\
+	R(false, "/info",	PATH_EXACT,	reqInfo, false, false)		\
+	R(false, "/metrics",	PATH_EXACT,	reqMetrics, false, false)	\
+	R(true,  "/login",	PATH_EXACT,	reqLogin, false, false)		\
+									\
+	R(false, "/marketList",	PATH_EXACT,	reqMarketList, false, false)	\
+	R(true,  "/marketAdd",	PATH_EXACT,	reqMarketAdd, true, true)	\
+									\
+	R(false, "/book/",	PATH_SYMBOL,	reqOrderBookList, false, false)	\
+	R(false, "/stream/",	PATH_SYMBOL,	reqBookStream, false, false)	\
+	R(true,  "/orderAdd",	PATH_EXACT,	reqOrderAdd, true, true)	\
+	R(true,  "/orderCancel", PATH_EXACT,	reqOrderCancel, true, true)	\
+	R(true,  "/orderModify", PATH_EXACT,	reqOrderModify, true, true)	\
+	R(true,  "/orderBatch",	PATH_EXACT,	reqOrderBatch, true, true)	\
+	R(true,  "/order/",	PATH_ORDER_ID,	reqOrderInfo, true, true)
+
+// Per-request state.  Drawn from a per-thread pool: a request's
+// state is allocated and freed on the loop serving it.
 class ReqState {
 public:
-	std::string		body;
-	SHA256_CTX		bodyHash;
-	std::vector<unsigned char> md;
+	// request body, left in req->buffer_in and made contiguous by
+	// reqPreProcessing; decoders may rewrite it in place
+	char			*body;
+	size_t			bodyLen;
+
+	// path capture of the matched route, within the request path
+	const char		*match;
+	size_t			matchLen;
 
-	std::string		path;
 	struct timeval		tstamp;
 
 	const struct HttpApiEntry *apiEnt;
+	const AuthKey		*user;		// verified caller, if any
+
+	EngineCmd		*pending;	// in flight on a shard
+	BookSubscriber		*stream;	// streaming book updates
 
-	ReqState() : md(SHA256_DIGEST_LENGTH) {
-		SHA256_Init(&bodyHash);
-		gettimeofday(&tstamp, NULL);
+	ReqState() : body(NULL), bodyLen(0), match(NULL), matchLen(0),
+		     apiEnt(NULL), user(NULL), pending(NULL), stream(NULL) {}
+
+	static void *operator new(size_t size) {
+		return FixedPool<sizeof(ReqState)>::alloc();
+	}
+	static void operator delete(void *p, size_t size) {
+		FixedPool<sizeof(ReqState)>::free(p);
 	}
 };
 
-extern orderentry::Market market;
-extern uint32_t nextOrderId;
+extern Engine *engine;
+extern bool orderIdCompat;
 bool reqPreProcessing(evhtp_request_t *req, ReqState *state);
+void reqSubmit(evhtp_request_t *req, ReqState *state,
+	       unsigned int shard, EngineCmd *cmd);
+void reqSubmitBatch(evhtp_request_t *req, ReqState *state, EngineCmd *cmd,
+		    std::vector<EngineCmd *>& parts);
+void reqSubscribe(evhtp_request_t *req, ReqState *state,
+		  unsigned int shard, EngineCmd *cmd);
 
 #endif // __SRV_H__
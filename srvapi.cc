@@ -4,6 +4,8 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <algorithm>
 #include <locale>
 #include <stdio.h>
 #include <stdlib.h>
@@ -16,11 +18,17 @@
 #include <assert.h>
 #include "Market.h"
 #include "HttpUtil.h"
+#include "ReqDecode.h"
+#include "JsonWriter.h"
 #include "srv.h"
 
 using namespace std;
 using namespace orderentry;
 
+enum {
+	MAX_BATCH_OPS		= 1000,	// max items per /orderBatch
+};
+
 static UniValue uvFromTv(const struct timeval *tv)
 {
 	string tmp = to_string(tv->tv_sec) + "." + to_string(tv->tv_usec);
@@ -31,17 +39,6 @@ static UniValue uvFromTv(const struct timeval *tv)
 	return ret;
 }
 
-static bool parseBySchema(ReqState *state,
-			  const std::map<std::string,UniValue::VType>& schema,
-			  UniValue& jval)
-{
-	if (!jval.read(state->body) ||
-	    !jval.checkObject(schema))
-		return false;
-
-	return true;
-}
-
 static bool validSymbol(const std::string& sym)
 {
 	// between 1 and 16 chars
@@ -61,33 +58,30 @@ static bool validSymbol(const std::string& sym)
 static bool validBookType(const std::string& btype)
 {
 	if ((btype != "simple") &&
-	    (btype != "depth"))
+	    (btype != "depth") &&
+	    (btype != "ladder"))
 		return false;
 
 	return true;
 }
 
-void reqOrderInfo(evhtp_request_t * req, void *arg)
+// runs on the shard owning the order
+static void execOrderInfo(MatchShard& shard, EngineCmd& cmd)
 {
-	assert(req && arg);
-	ReqState *state = (ReqState *) arg;
-
-	// global pre-request processing
-	if (!reqPreProcessing(req, state))
-		return;		// pre-processing failed; response already sent
-
-	string orderId(req->uri->path->match_start);
+	Market& market = shard.market();
 
+	// live orders first, then filled/cancelled/rejected archive
+	OrderId id;
 	OrderPtr order;
-	OrderBookPtr book;
-	if (!market.findExistingOrder(orderId, order, book))
+	if (!market.resolveOrderId(cmd.oid, id) ||
+	    !market.findOrder(id, order))
 	{
-		evhtp_send_reply(req, EVHTP_RES_NOTFOUND);
+		cmd.status = EVHTP_RES_NOTFOUND;
 		return;
 	}
 
 	UniValue res(UniValue::VOBJ);
-	res.pushKV("id", orderId);
+	res.pushKV("id", cmd.oid);
 	res.pushKV("side", order->is_buy() ? "buy" : "sell");
 	res.pushKV("qty", (uint64_t) order->order_qty());
 	res.pushKV("price", (uint64_t) order->price());
@@ -113,11 +107,22 @@ void reqOrderInfo(evhtp_request_t * req, void *arg)
 	}
 	res.pushKV("type", orderType);
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, res);
+	// lifecycle history, formatted on demand
+	UniValue history(UniValue::VARR);
+	Order::History hist = order->history();
+	for (auto it = hist.begin(); it != hist.end(); ++it) {
+		UniValue ev(UniValue::VOBJ);
+		ev.pushKV("state", Order::stateName(it->state_));
+		if (!it->description_.empty())
+			ev.pushKV("detail", it->description_);
+		history.push_back(ev);
+	}
+	res.pushKV("history", history);
+
+	cmd.result = res;
 }
 
-void reqOrderAdd(evhtp_request_t * req, void * arg)
+void reqOrderInfo(evhtp_request_t * req, void *arg)
 {
 	assert(req && arg);
 	ReqState *state = (ReqState *) arg;
@@ -126,64 +131,158 @@ void reqOrderAdd(evhtp_request_t * req, void * arg)
 	if (!reqPreProcessing(req, state))
 		return;		// pre-processing failed; response already sent
 
-	// required JSON parameters and their types
-	std::map<std::string,UniValue::VType> apiSchema;
-	apiSchema["symbol"] = UniValue::VSTR;
-	apiSchema["qty"] = UniValue::VNUM;
-	apiSchema["price"] = UniValue::VNUM;
-	apiSchema["is_buy"] = UniValue::VBOOL;
+	string orderId(state->match, state->matchLen);
 
-	// parse input into JSON + preliminary input validation
-	UniValue jval;
-	if (!parseBySchema(state, apiSchema, jval)) {
-		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+	unsigned int shard;
+	if (!engine->shardForOrder(orderId, shard)) {
+		evhtp_send_reply(req, EVHTP_RES_NOTFOUND);
 		return;
 	}
 
-	// copy JSON input params into more manageable temporary variables
-	string symbol = jval["symbol"].getValStr();
-	liquibook::book::Quantity quantity = atoll(jval["qty"].getValStr().c_str());
-	liquibook::book::Price price = atoll(jval["price"].getValStr().c_str());
-	bool isBuy = jval["is_buy"].getBool();
-	bool aon = jval["aon"].getBool();
-	bool ioc = jval["ioc"].getBool();
-	liquibook::book::Price stopPrice = 0;
-	if (jval.exists("stop"))
-		stopPrice = atoll(jval["stop"].getValStr().c_str());
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execOrderInfo;
+	cmd->oid = orderId;
+
+	// query shard; reply is sent on completion
+	reqSubmit(req, state, shard, cmd);
+}
+
+// reply writers, run on the front-end thread
+static void writeOrderAddReply(JsonWriter& w, const EngineCmd& cmd)
+{
+	w.beginObject().kv("orderId", cmd.oid).endObject();
+}
+
+static void writeBoolReply(JsonWriter& w, const EngineCmd& cmd)
+{
+	w.value(cmd.flag);
+}
+
+// runs on the shard owning the symbol
+static void execOrderAdd(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
 
 	// lookup order book from symbol
-	auto book = market.findBook(symbol);
+	auto book = market.findBook(cmd.symbol);
 	if (!book) {
-		evhtp_send_reply(req, EVHTP_RES_NOTFOUND);
+		cmd.status = EVHTP_RES_NOTFOUND;
 		return;
 	}
 
-	// generate new order id
-	uuid_t id;
-	char id_str[42];
-	uuid_generate_random(id);
-	uuid_unparse_lower(id, id_str);
-	std::string orderId(id_str);
-
 	// build new order instance, given input params above
-	OrderPtr order = std::make_shared<Order>(orderId, isBuy, quantity, symbol, price, stopPrice, aon, ioc);
+	OrderPtr order(new Order(market.nextOrderId(),
+		cmd.flag, cmd.qty, cmd.symbol, cmd.price, cmd.stopPrice,
+		(cmd.conditions & liquibook::book::oc_all_or_none) != 0,
+		(cmd.conditions & liquibook::book::oc_immediate_or_cancel) != 0));
+
+	if (!cmd.oid.empty())
+		order->setAlias(cmd.oid);
+	else
+		cmd.oid = orderIdStr(order->order_id());
+
+	// submit order to order book
+	market.orderSubmit(book, order, cmd.conditions);
+
+	// return order data
+	cmd.writeReply = writeOrderAddReply;
+}
+
+// check one decoded order-add into cmd, and route it
+static int decodeOrderAdd(const OrderReq& in, EngineCmd *cmd,
+			  unsigned int& shard)
+{
+	// required JSON parameters
+	if (in.bad ||
+	    !in.has(OrderReq::F_SYMBOL | OrderReq::F_QTY |
+		    OrderReq::F_PRICE | OrderReq::F_IS_BUY))
+		return EVHTP_RES_BADREQ;
 
 	const liquibook::book::OrderConditions AON(liquibook::book::oc_all_or_none);
 	const liquibook::book::OrderConditions IOC(liquibook::book::oc_immediate_or_cancel);
 	const liquibook::book::OrderConditions NOC(liquibook::book::oc_no_conditions);
 
-	const liquibook::book::OrderConditions conditions =
-	    (aon ? AON : NOC) | (ioc ? IOC : NOC);
+	cmd->exec = execOrderAdd;
+	cmd->symbol.assign(in.symbol.p, in.symbol.len);
+	cmd->flag = in.isBuy;
+	cmd->qty = in.qty;
+	cmd->price = in.price;
+	cmd->stopPrice = in.stop;
+	cmd->conditions = (in.aon ? AON : NOC) | (in.ioc ? IOC : NOC);
+
+	shard = engine->shardForSymbol(cmd->symbol);
+
+	// compatibility mode: clients see a UUID, as in earlier releases.
+	// Its first byte routes later cancel/modify to this shard.
+	if (orderIdCompat) {
+		uuid_t uuid;
+		char uuid_str[42];
+		uuid_generate_random(uuid);
+		uuid[0] = (unsigned char) shard;
+		uuid_unparse_lower(uuid, uuid_str);
+		cmd->oid = uuid_str;
+	}
 
-	// submit order to order book
-	market.orderSubmit(book, order, orderId, conditions);
+	return EVHTP_RES_OK;
+}
 
-	// return order data
-	UniValue res(UniValue::VOBJ);
-	res.pushKV("orderId", orderId);
+void reqOrderAdd(evhtp_request_t * req, void * arg)
+{
+	assert(req && arg);
+	ReqState *state = (ReqState *) arg;
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, res);
+	// global pre-request processing
+	if (!reqPreProcessing(req, state))
+		return;		// pre-processing failed; response already sent
+
+	// decode input + preliminary input validation
+	OrderReq in;
+	EngineCmd *cmd = new EngineCmd();
+	unsigned int shard;
+	if (!decodeOrderReq(state->body, state->bodyLen, in) ||
+	    decodeOrderAdd(in, cmd, shard) != EVHTP_RES_OK) {
+		delete cmd;
+		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+		return;
+	}
+
+	// submit order to owning shard; reply is sent on completion
+	reqSubmit(req, state, shard, cmd);
+}
+
+static void execOrderModify(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
+	OrderId id;
+	cmd.flag = market.resolveOrderId(cmd.oid, id) &&
+		   market.orderModify(id, cmd.qtyDelta, cmd.price);
+	cmd.writeReply = writeBoolReply;
+}
+
+// check one decoded order-modify into cmd, and route it
+static int decodeOrderModify(const OrderReq& in, EngineCmd *cmd,
+			     unsigned int& shard)
+{
+	// required JSON parameters
+	if (in.bad || !in.has(OrderReq::F_OID))
+		return EVHTP_RES_BADREQ;
+
+	if (!in.has(OrderReq::F_PRICE) &&
+	    !in.has(OrderReq::F_QTY_DELTA))
+		return EVHTP_RES_BADREQ;
+
+	cmd->oid.assign(in.oid.p, in.oid.len);
+	if (!engine->shardForOrder(cmd->oid, shard))
+		return EVHTP_RES_NOTFOUND;
+
+	cmd->exec = execOrderModify;
+	cmd->qtyDelta = in.has(OrderReq::F_QTY_DELTA) ?
+		in.qtyDelta : liquibook::book::SIZE_UNCHANGED;
+	cmd->price = in.has(OrderReq::F_PRICE) ?
+		in.price : liquibook::book::PRICE_UNCHANGED;
+
+	return EVHTP_RES_OK;
 }
 
 void reqOrderModify(evhtp_request_t * req, void * arg)
@@ -195,39 +294,55 @@ void reqOrderModify(evhtp_request_t * req, void * arg)
 	if (!reqPreProcessing(req, state))
 		return;		// pre-processing failed; response already sent
 
-	// required JSON parameters and their types
-	std::map<std::string,UniValue::VType> apiSchema;
-	apiSchema["oid"] = UniValue::VSTR;
-
-	// parse input into JSON + preliminary input validation
-	UniValue jval;
-	if (!parseBySchema(state, apiSchema, jval)) {
+	// decode input + preliminary input validation
+	OrderReq in;
+	if (!decodeOrderReq(state->body, state->bodyLen, in)) {
 		evhtp_send_reply(req, EVHTP_RES_BADREQ);
 		return;
 	}
 
-	if (!jval.exists("price") &&
-	    !jval.exists("qtyDelta")) {
-		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+	EngineCmd *cmd = new EngineCmd();
+	unsigned int shard;
+	int status = decodeOrderModify(in, cmd, shard);
+	if (status != EVHTP_RES_OK) {
+		delete cmd;
+		if (status == EVHTP_RES_NOTFOUND) {
+			UniValue res(false);
+			httpJsonReply(req, res);
+		} else
+			evhtp_send_reply(req, status);
 		return;
 	}
 
-	// copy JSON input params into more manageable temporary variables
-	string orderId = jval["oid"].getValStr();
-	int32_t qtyDelta = liquibook::book::SIZE_UNCHANGED;
-	if (jval.exists("qtyDelta"))
-		qtyDelta = atoll(jval["qtyDelta"].getValStr().c_str());
-	liquibook::book::Price price = liquibook::book::PRICE_UNCHANGED;
-	if (jval.exists("price"))
-		price = atoll(jval["price"].getValStr().c_str());
+	// submit modification request to owning shard
+	reqSubmit(req, state, shard, cmd);
+}
 
-	// submit modification request to order book
-	bool rc = market.orderModify(orderId, qtyDelta, price);
+static void execOrderCancel(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
 
-	UniValue res(rc);
+	OrderId id;
+	cmd.flag = market.resolveOrderId(cmd.oid, id) &&
+		   market.orderCancel(id);
+	cmd.writeReply = writeBoolReply;
+}
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, res);
+// check one decoded order-cancel into cmd, and route it
+static int decodeOrderCancel(const OrderReq& in, EngineCmd *cmd,
+			     unsigned int& shard)
+{
+	// required JSON parameters
+	if (in.bad || !in.has(OrderReq::F_OID))
+		return EVHTP_RES_BADREQ;
+
+	cmd->oid.assign(in.oid.p, in.oid.len);
+	if (!engine->shardForOrder(cmd->oid, shard))
+		return EVHTP_RES_NOTFOUND;
+
+	cmd->exec = execOrderCancel;
+
+	return EVHTP_RES_OK;
 }
 
 void reqOrderCancel(evhtp_request_t * req, void * arg)
@@ -239,143 +354,294 @@ void reqOrderCancel(evhtp_request_t * req, void * arg)
 	if (!reqPreProcessing(req, state))
 		return;		// pre-processing failed; response already sent
 
-	// required JSON parameters and their types
-	std::map<std::string,UniValue::VType> apiSchema;
-	apiSchema["oid"] = UniValue::VSTR;
-
-	// parse input into JSON + preliminary input validation
-	UniValue jval;
-	if (!parseBySchema(state, apiSchema, jval)) {
+	// decode input + preliminary input validation
+	OrderReq in;
+	if (!decodeOrderReq(state->body, state->bodyLen, in)) {
 		evhtp_send_reply(req, EVHTP_RES_BADREQ);
 		return;
 	}
 
-	// copy JSON input params into more manageable temporary variables
-	string orderId = jval["oid"].getValStr();
+	EngineCmd *cmd = new EngineCmd();
+	unsigned int shard;
+	int status = decodeOrderCancel(in, cmd, shard);
+	if (status != EVHTP_RES_OK) {
+		delete cmd;
+		if (status == EVHTP_RES_NOTFOUND) {
+			UniValue res(false);
+			httpJsonReply(req, res);
+		} else
+			evhtp_send_reply(req, status);
+		return;
+	}
 
-	// submit cancellation request to order book
-	bool rc = market.orderCancel(orderId);
+	// submit cancellation request to owning shard
+	reqSubmit(req, state, shard, cmd);
+}
 
-	UniValue res(rc);
+// runs on one shard: this shard's share of an /orderBatch, in order.
+// Atomic batches are checked against the book state first, and run
+// only if every item would find its book or live order.  The check
+// follows the batch's own cancels: an order cancelled by one item is
+// gone for the items after it.  Ids of the batch's adds are assigned
+// as they run, so no item can name them.  Matching is not simulated:
+// an order filled by an earlier add still passes the check, and its
+// cancel or modify then fails in the results.
+static void execOrderBatch(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
+	if (cmd.flag) {
+		std::set<OrderId> cancelled;
+
+		for (size_t i = 0; i < cmd.batch.size(); i++) {
+			EngineCmd *item = cmd.batch[i];
+
+			OrderId id;
+			bool found;
+			if (item->exec == execOrderAdd)
+				found = (bool) market.findBook(item->symbol);
+			else {
+				found = market.resolveOrderId(item->oid, id) &&
+					market.orders().find(id) &&
+					!cancelled.count(id);
+				if (found && item->exec == execOrderCancel)
+					cancelled.insert(id);
+			}
+			if (!found) {
+				item->status = EVHTP_RES_NOTFOUND;
+				return;
+			}
+		}
+	}
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, res);
+	for (size_t i = 0; i < cmd.batch.size(); i++) {
+		EngineCmd *item = cmd.batch[i];
+		item->exec(shard, *item);
+	}
 }
 
-void reqOrderBookList(evhtp_request_t * req, void * arg)
+// all parts returned: per-item results, in client order
+static void writeBatchReply(JsonWriter& w, const EngineCmd& cmd)
+{
+	w.beginObject();
+
+	// atomic batch refused: name the item that failed
+	bool ok = true;
+	for (size_t i = 0; cmd.flag && i < cmd.batch.size(); i++) {
+		if (cmd.batch[i]->status != EVHTP_RES_OK) {
+			ok = false;
+			w.kv("failed", (uint64_t) i);
+			w.kv("status", cmd.batch[i]->status);
+			break;
+		}
+	}
+
+	w.kv("ok", ok);
+	if (ok) {
+		w.key("results").beginArray();
+		for (size_t i = 0; i < cmd.batch.size(); i++) {
+			const EngineCmd *item = cmd.batch[i];
+
+			w.beginObject();
+			w.kv("status", item->status);
+			if (item->status == EVHTP_RES_OK) {
+				w.key("result");
+				if (item->writeReply)
+					item->writeReply(w, *item);
+				else
+					w.raw(item->result.write());
+			}
+			w.endObject();
+		}
+		w.endArray();
+	}
+
+	w.endObject();
+}
+
+void reqOrderBatch(evhtp_request_t * req, void * arg)
 {
 	assert(req && arg);
 	ReqState *state = (ReqState *) arg;
 
-	// global pre-request processing
+	// global pre-request processing; one signature covers the batch
 	if (!reqPreProcessing(req, state))
 		return;		// pre-processing failed; response already sent
 
-	// obtain symbol from uri regex matched substring
-	string inSymbol(req->uri->path->match_start);
+	// decode input + preliminary input validation
+	BatchReq in;
+	if (!decodeBatchReq(state->body, state->bodyLen, in,
+			    MAX_BATCH_OPS) ||
+	    in.bad || !in.has(BatchReq::F_OPS)) {
+		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+		return;
+	}
 
-	// depth=N query param.  valid: 1-3, default 1.
-	int64_t depth;
-	if (!query_int64_range(req, "depth", depth, 1, 3, 1)) {
+	const std::vector<OrderReq>& ops = in.ops;
+	bool atomic = in.atomic;
+	if (ops.size() == 0) {
+		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+		return;
+	}
+
+	EngineCmd *cmd = new EngineCmd();
+	cmd->flag = atomic;
+	cmd->writeReply = writeBatchReply;
+	cmd->batch.reserve(ops.size());
+
+	// decode every item up front; items are grouped per shard,
+	// keeping client order within each group
+	std::vector<EngineCmd *> parts(engine->shardCount(), NULL);
+	unsigned int nParts = 0;
+	for (size_t i = 0; i < ops.size(); i++) {
+		const OrderReq& op = ops[i];
+
+		EngineCmd *item = new EngineCmd();
+		cmd->batch.push_back(item);
+
+		unsigned int shard = 0;
+		if (op.op.equals("add"))
+			item->status = decodeOrderAdd(op, item, shard);
+		else if (op.op.equals("cancel"))
+			item->status = decodeOrderCancel(op, item, shard);
+		else if (op.op.equals("modify"))
+			item->status = decodeOrderModify(op, item, shard);
+		else
+			item->status = EVHTP_RES_BADREQ;
+
+		// all-or-nothing: malformed items refuse the whole batch
+		if (item->status != EVHTP_RES_OK) {
+			if (atomic)
+				break;
+			continue;
+		}
+
+		EngineCmd *part = parts[shard];
+		if (!part) {
+			part = new EngineCmd();
+			part->exec = execOrderBatch;
+			part->flag = atomic;
+			parts[shard] = part;
+			nParts++;
+		}
+		part->batch.push_back(item);
+	}
+
+	// an atomic batch must be malformed-free, and run on a single
+	// shard: shards cannot check each other's books
+	bool refused = false;
+	if (atomic) {
+		for (size_t i = 0; i < cmd->batch.size(); i++)
+			if (cmd->batch[i]->status != EVHTP_RES_OK)
+				refused = true;
+		if (nParts > 1)
+			refused = true;
+	}
+	if (refused) {
+		for (size_t i = 0; i < parts.size(); i++) {
+			if (parts[i])
+				parts[i]->batch.clear();	// borrowed
+			delete parts[i];
+		}
+		delete cmd;
 		evhtp_send_reply(req, EVHTP_RES_BADREQ);
 		return;
 	}
 
+	// submit each shard's part; reply once all have returned
+	reqSubmitBatch(req, state, cmd, parts);
+}
+
+static void writeLevel(JsonWriter& w, liquibook::book::Price price,
+		       liquibook::book::Quantity qty)
+{
+	w.beginObject();
+	w.kv("price", price);
+	w.kv("qty", qty);
+	w.endObject();
+}
+
+// one side of the aggregated book, as /book lists it
+static void writeLevels(JsonWriter& w, int64_t depth,
+			const PriceLevels::LevelMap& levels, bool buy)
+{
+	w.beginArray();
+	if (depth == 1) {
+		// best bid/ask
+		if (!levels.empty() && buy)
+			writeLevel(w, levels.rbegin()->first,
+				   levels.rbegin()->second.qty);
+		else if (!levels.empty())
+			writeLevel(w, levels.begin()->first,
+				   levels.begin()->second.qty);
+	} else {
+		for (auto lvl = levels.begin(); lvl != levels.end(); ++lvl)
+			writeLevel(w, lvl->first, lvl->second.qty);
+	}
+	w.endArray();
+}
+
+// one side's orders, highest priority first
+static void writeOrders(JsonWriter& w, const OrderBook& book, bool buy)
+{
+	vector<const OrderBook::Tracker *> trackers;
+	forEachResting(book, buy,
+		       [&trackers](const OrderBook::Tracker& t) {
+			       trackers.push_back(&t);
+		       });
+
+	w.beginArray();
+	for (auto t = trackers.rbegin(); t != trackers.rend(); ++t)
+		writeLevel(w, (*t)->ptr()->price(), (*t)->open_qty());
+	w.endArray();
+}
+
+// runs on the shard owning the symbol
+static void execOrderBookList(MatchShard& shard, EngineCmd& cmd)
+{
 	// lookup order book from symbol
-	auto book = market.findBook(inSymbol);
+	auto book = shard.market().findBook(cmd.symbol);
 	if (!book) {
-		evhtp_send_reply(req, EVHTP_RES_NOTFOUND);
+		cmd.status = EVHTP_RES_NOTFOUND;
 		return;
 	}
+	int64_t depth = cmd.depth;
+
+	// another request may have filled the cache since this was
+	// queued.  Only compact replies are cached.
+	BookCache::Entry *cacheEnt = NULL;
+	if (!cmd.pretty) {
+		cacheEnt = shard.market().cacheEntry(book);
+		if (cacheEnt && cacheEnt->get(depth, cmd.reply))
+			return;
+	}
 
-	UniValue asksArr(UniValue::VARR);
-	UniValue bidsArr(UniValue::VARR);
-	const OrderBook::TrackerMap& asks_ = book->asks();
-	const OrderBook::TrackerMap& bids_ = book->bids();
+	// serialize once, for this and later requests
+	std::shared_ptr<std::string> body = std::make_shared<std::string>();
+	JsonWriter w(*body, cmd.pretty);
+	w.beginObject();
 
 	switch (depth) {
 		case 1:
 		case 2:
 			{
-			map<liquibook::book::Price,liquibook::book::Quantity> agg_bids;
-			map<liquibook::book::Price,liquibook::book::Quantity> agg_asks;
-
-			// aggregate list of asks from order book
-			for (auto ask = asks_.rbegin(); ask != asks_.rend(); ++ask) {
-				liquibook::book::Price price = ask->first.price();
-				liquibook::book::Quantity qty = ask->second.open_qty();
-				if (agg_asks.count(price))
-					agg_asks[price] += qty;
-				else
-					agg_asks[price] = qty;
-			}
-
-			// aggregate list of bids from order book
-			for (auto bid = bids_.rbegin(); bid != bids_.rend(); ++bid) {
-				liquibook::book::Price price = bid->first.price();
-				liquibook::book::Quantity qty = bid->second.open_qty();
-				if (agg_bids.count(price))
-					agg_bids[price] += qty;
-				else
-					agg_bids[price] = qty;
-			}
-
-			// output best bid/ask
-			if (depth == 1) {
-				auto ask = agg_asks.begin();
-				UniValue askObj(UniValue::VOBJ);
-				askObj.pushKV("price", (int64_t) ask->first);
-				askObj.pushKV("qty", (int64_t) ask->second);
-				asksArr.push_back(askObj);
-
-				auto bid = agg_bids.rbegin();
-				UniValue bidObj(UniValue::VOBJ);
-				bidObj.pushKV("price", (int64_t) bid->first);
-				bidObj.pushKV("qty", (int64_t) bid->second);
-				bidsArr.push_back(bidObj);
-
-			// output aggregated order book
-			} else {
-				// gather list of aggregate asks from order book
-				for (auto ask = agg_asks.begin();
-				     ask != agg_asks.end(); ++ask) {
-					UniValue askObj(UniValue::VOBJ);
-					askObj.pushKV("price", (int64_t) ask->first);
-					askObj.pushKV("qty", (int64_t) ask->second);
-					asksArr.push_back(askObj);
-				}
-
-				// gather list of aggregate bids from order book
-				for (auto bid = agg_bids.begin();
-				     bid != agg_bids.end(); ++bid) {
-					UniValue bidObj(UniValue::VOBJ);
-					bidObj.pushKV("price", (int64_t) bid->first);
-					bidObj.pushKV("qty", (int64_t) bid->second);
-					bidsArr.push_back(bidObj);
-				}
-			}
+			// aggregates kept by the market as orders come and go
+			const PriceLevels *levels = shard.market().priceLevels(book);
+			assert(levels != NULL);
+
+			w.key("bids");
+			writeLevels(w, depth, levels->bids(), true);
+			w.key("asks");
+			writeLevels(w, depth, levels->asks(), false);
 			break;
 			}
 
 		case 3:
-			{
-			// gather list of asks from order book
-			for (auto ask = asks_.rbegin(); ask != asks_.rend(); ++ask) {
-				UniValue askObj(UniValue::VOBJ);
-				askObj.pushKV("price", (int64_t) ask->first.price());
-				askObj.pushKV("qty", (int64_t) ask->second.open_qty());
-				asksArr.push_back(askObj);
-			}
-
-			// gather list of bids from order book
-			for (auto bid = bids_.rbegin(); bid != bids_.rend(); ++bid) {
-				UniValue bidObj(UniValue::VOBJ);
-				bidObj.pushKV("price", (int64_t) bid->first.price());
-				bidObj.pushKV("qty", (int64_t) bid->second.open_qty());
-				bidsArr.push_back(bidObj);
-			}
+			w.key("bids");
+			writeOrders(w, *book, true);
+			w.key("asks");
+			writeOrders(w, *book, false);
 			break;
-			}
 
 		default:
 			// should not happen
@@ -383,16 +649,15 @@ void reqOrderBookList(evhtp_request_t * req, void * arg)
 			break;
 	}
 
-	// build return object
-	UniValue obj(UniValue::VOBJ);
-	obj.pushKV("bids", bidsArr);
-	obj.pushKV("asks", asksArr);
+	w.endObject();
+	w.end();
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, obj);
+	cmd.reply = body;
+	if (cacheEnt)
+		cacheEnt->put(depth, cacheEnt->version(), cmd.reply);
 }
 
-void reqMarketAdd(evhtp_request_t * req, void * arg)
+void reqOrderBookList(evhtp_request_t * req, void * arg)
 {
 	assert(req && arg);
 	ReqState *state = (ReqState *) arg;
@@ -401,42 +666,212 @@ void reqMarketAdd(evhtp_request_t * req, void * arg)
 	if (!reqPreProcessing(req, state))
 		return;		// pre-processing failed; response already sent
 
-	// required JSON parameters and their types
-	std::map<std::string,UniValue::VType> apiSchema;
-	apiSchema["symbol"] = UniValue::VSTR;
-	apiSchema["booktype"] = UniValue::VSTR;
+	// obtain symbol from the route's path capture
+	string inSymbol(state->match, state->matchLen);
 
-	// parse input into JSON + preliminary input validation
-	UniValue jval;
-	if (!parseBySchema(state, apiSchema, jval)) {
+	// depth=N query param.  valid: 1-3, default 1.
+	int64_t depth;
+	if (!query_int64_range(req, "depth", depth, 1, 3, 1)) {
 		evhtp_send_reply(req, EVHTP_RES_BADREQ);
 		return;
 	}
 
-	// copy JSON input params into more manageable temporary variables
-	string inSymbol = jval["symbol"].getValStr();
-	string inBookType = jval["booktype"].getValStr();
+	// unchanged since last served: reply from cache
+	bool pretty = httpPretty(req);
+	BookCache::Entry *cacheEnt = NULL;
+	if (!pretty)
+		cacheEnt = engine->bookCache().find(inSymbol);
+	BookCache::Body body;
+	if (cacheEnt && cacheEnt->get(depth, body)) {
+		httpJsonReply(req, *body);
+		return;
+	}
 
-	// validate symbol name and book type
-	if (!validSymbol(inSymbol) ||
-	    !validBookType(inBookType)) {
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execOrderBookList;
+	cmd->symbol = inSymbol;
+	cmd->depth = depth;
+	cmd->pretty = pretty;
+
+	// query owning shard; reply is sent on completion
+	reqSubmit(req, state, engine->shardForSymbol(inSymbol), cmd);
+}
+
+// runs on the shard owning the symbol; the snapshot's change id
+// places it in the book's update stream
+static void execBookSnapshot(MatchShard& shard, EngineCmd& cmd)
+{
+	auto book = shard.market().findBook(cmd.symbol);
+	if (!book) {
+		cmd.status = EVHTP_RES_NOTFOUND;
+		return;
+	}
+
+	// only depth books publish levels
+	const BookDepth *depth = shard.market().depth(book);
+	if (!depth) {
+		cmd.status = EVHTP_RES_BADREQ;
+		return;
+	}
+	int64_t levels = std::min(cmd.depth, (int64_t) depth->size());
+
+	// the stream's first message, whole; it is always seq 0
+	std::shared_ptr<std::string> msg = std::make_shared<std::string>();
+	JsonWriter w(*msg);
+	w.beginObject();
+	w.kv("type", "snapshot");
+	w.kv("seq", 0);
+	w.kv("symbol", cmd.symbol);
+	w.kv("change", (uint64_t) depth->last_change());
+
+	const DepthSlot *sides[2] = { depth->bids(), depth->asks() };
+	const char *names[2] = { "bids", "asks" };
+	for (unsigned int side = 0; side < 2; side++) {
+		w.key(names[side]).beginArray();
+		for (int64_t i = 0; i < levels; i++) {
+			const DepthSlot *slot = sides[side] + i;
+			if (slot->qty == 0)
+				break;
+			w.beginObject();
+			w.kv("price", slot->price);
+			w.kv("qty", slot->qty);
+			w.kv("orders", slot->orders);
+			w.endObject();
+		}
+		w.endArray();
+	}
+
+	w.endObject();
+	w.end();
+
+	cmd.change = depth->last_change();
+	cmd.reply = msg;
+}
+
+void reqBookStream(evhtp_request_t * req, void * arg)
+{
+	assert(req && arg);
+	ReqState *state = (ReqState *) arg;
+
+	// global pre-request processing
+	if (!reqPreProcessing(req, state))
+		return;		// pre-processing failed; response already sent
+
+	// obtain symbol from the route's path capture
+	string inSymbol(state->match, state->matchLen);
+
+	// depth=N query param: levels per side.  1 follows the BBO;
+	// by default, all the book publishes.
+	int64_t depth;
+	if (!query_int64_range(req, "depth", depth, 1, BOOK_DEPTH_MAX,
+			       BOOK_DEPTH_MAX)) {
 		evhtp_send_reply(req, EVHTP_RES_BADREQ);
 		return;
 	}
 
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execBookSnapshot;
+	cmd->symbol = inSymbol;
+	cmd->depth = depth;
+
+	// subscribe, then snapshot; updates stream after the snapshot
+	reqSubscribe(req, state, engine->shardForSymbol(inSymbol), cmd);
+}
+
+static void execMarketAdd(MatchShard& shard, EngineCmd& cmd)
+{
+	Market& market = shard.market();
+
 	// verify this is not a duplicate
-	if (market.symbolIsDefined(inSymbol)) {
-		evhtp_send_reply(req, EVHTP_RES_NACCEPTABLE);
+	if (market.symbolIsDefined(cmd.symbol)) {
+		cmd.status = EVHTP_RES_NACCEPTABLE;
 		return;
 	}
 
 	// create new order book
-	market.addBook(inSymbol, (inBookType == "depth"));
+	market.addBook(cmd.symbol, cmd.depth, cmd.ladder);
+	engine->addSymbol(cmd.symbol);
 
-	UniValue bobj(true);
+	cmd.result = UniValue(true);
+}
 
-	// successful operation.  Return JSON output.
-	httpJsonReply(req, bobj);
+void reqMarketAdd(evhtp_request_t * req, void * arg)
+{
+	assert(req && arg);
+	ReqState *state = (ReqState *) arg;
+
+	// global pre-request processing
+	if (!reqPreProcessing(req, state))
+		return;		// pre-processing failed; response already sent
+
+	// decode input + preliminary input validation
+	MarketAddReq in;
+	if (!decodeMarketAddReq(state->body, state->bodyLen, in) ||
+	    in.bad ||
+	    !in.has(MarketAddReq::F_SYMBOL | MarketAddReq::F_BOOKTYPE)) {
+		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+		return;
+	}
+
+	string inSymbol = in.symbol.str();
+	string inBookType = in.booktype.str();
+
+	// validate symbol name and book type
+	if (!validSymbol(inSymbol) ||
+	    !validBookType(inBookType)) {
+		evhtp_send_reply(req, EVHTP_RES_BADREQ);
+		return;
+	}
+
+	// ladder: fixed price range, required
+	LadderSpec ladder;
+	if (inBookType == "ladder") {
+		const uint32_t keys[] = { MarketAddReq::F_MIN_PRICE,
+					  MarketAddReq::F_MAX_PRICE,
+					  MarketAddReq::F_TICK };
+		const int64_t vals[] = { in.minPrice, in.maxPrice, in.tick };
+		for (unsigned int i = 0; i < 3; i++) {
+			if (!in.has(keys[i]) ||
+			    vals[i] <= 0 ||
+			    vals[i] > (int64_t) UINT32_MAX) {
+				evhtp_send_reply(req, EVHTP_RES_BADREQ);
+				return;
+			}
+		}
+		ladder.minPrice = vals[0];
+		ladder.maxPrice = vals[1];
+		ladder.tick = vals[2];
+		if (!ladder.valid()) {
+			evhtp_send_reply(req, EVHTP_RES_BADREQ);
+			return;
+		}
+	}
+
+	// optional depth: levels per side a depth or ladder book
+	// publishes
+	int64_t depth = 0;
+	if (inBookType == "depth")
+		depth = BOOK_DEPTH_DEFAULT;
+	if (in.has(MarketAddReq::F_DEPTH)) {
+		if (inBookType == "simple") {
+			evhtp_send_reply(req, EVHTP_RES_BADREQ);
+			return;
+		}
+		depth = in.depth;
+		if ((depth < 1) || (depth > BOOK_DEPTH_MAX)) {
+			evhtp_send_reply(req, EVHTP_RES_BADREQ);
+			return;
+		}
+	}
+
+	EngineCmd *cmd = new EngineCmd();
+	cmd->exec = execMarketAdd;
+	cmd->symbol = inSymbol;
+	cmd->depth = depth;
+	cmd->ladder = ladder;
+
+	// create book on owning shard; reply is sent on completion
+	reqSubmit(req, state, engine->shardForSymbol(inSymbol), cmd);
 }
 
 void reqMarketList(evhtp_request_t * req, void *arg)
@@ -450,9 +885,9 @@ void reqMarketList(evhtp_request_t * req, void *arg)
 
 	UniValue res(UniValue::VARR);
 
-	// request list of symbols from market
+	// request list of symbols from all shards
 	vector<string> symbols;
-	market.getSymbols(symbols);
+	engine->getSymbols(symbols);
 
 	// copy vector of symbols to JSON result array
 	for (auto t = symbols.begin(); t != symbols.end(); t++) {
@@ -7,7 +7,9 @@ void reqOrderInfo(evhtp_request_t * req, void * arg);
 void reqOrderAdd(evhtp_request_t * req, void * arg);
 void reqOrderModify(evhtp_request_t * req, void * arg);
 void reqOrderCancel(evhtp_request_t * req, void * arg);
+void reqOrderBatch(evhtp_request_t * req, void * arg);
 void reqOrderBookList(evhtp_request_t * req, void * arg);
+void reqBookStream(evhtp_request_t * req, void * arg);
 void reqMarketAdd(evhtp_request_t * req, void * arg);
 void reqMarketList(evhtp_request_t * req, void * a);
 
@@ -0,0 +1,316 @@
+#include <book/order_book.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "Order.h"
+#include "LadderOrderBook.h"
+
+using namespace std;
+using namespace orderentry;
+using liquibook::book::Price;
+using liquibook::book::Quantity;
+using liquibook::book::Cost;
+using liquibook::book::OrderConditions;
+
+#define PROGRAM_NAME "test-book"
+#include "test-util.h"
+
+// Random order flow through the books that keep each order's position
+// in its BookHandle -- liquibook's OrderBook over Order, and the
+// LadderOrderBook -- and through liquibook's OrderBook over a plain
+// order type, which finds orders by scanning their price level.  Every
+// callback, and the resting orders after every step, must match.
+
+// liquibook's order concept, and nothing more: no BookHandle
+class RefOrder {
+public:
+	RefOrder(OrderId id, bool buy, Quantity qty, Price price,
+		 Price stopPrice, bool aon, bool ioc)
+		: id_(id), buy_(buy), qty_(qty), price_(price),
+		  stopPrice_(stopPrice), aon_(aon), ioc_(ioc) {}
+
+	bool is_limit() const { return price_ != 0; }
+	bool is_buy() const { return buy_; }
+	Price price() const { return price_; }
+	Price stop_price() const { return stopPrice_; }
+	Quantity order_qty() const { return qty_; }
+	bool all_or_none() const { return aon_; }
+	bool immediate_or_cancel() const { return ioc_; }
+	OrderId order_id() const { return id_; }
+
+	// as Order::onReplaced
+	void onReplaced(int32_t delta, Price price) {
+		qty_ += delta;
+		if (price != liquibook::book::PRICE_UNCHANGED)
+			price_ = price;
+	}
+
+private:
+	OrderId		id_;
+	bool		buy_;
+	Quantity	qty_;
+	Price		price_;
+	Price		stopPrice_;
+	bool		aon_;
+	bool		ioc_;
+};
+
+typedef shared_ptr<RefOrder> RefPtr;
+
+// the books leave the order's new size and price to their listener, as
+// Market applies them
+template <class Ptr>
+static void applyReplace(const Ptr& order, int32_t delta, Price price)
+{
+	order->onReplaced(delta, price);
+}
+
+// a book that records its callbacks as text
+template <class Book, class Ptr>
+class Recorder : public Book {
+public:
+	template <class... Args>
+	Recorder(Args&&... args) : Book(std::forward<Args>(args)...) {}
+
+	vector<string>	events;
+
+protected:
+	void log(const char *what, const Ptr& order, uint64_t a = 0,
+		 uint64_t b = 0, uint64_t c = 0)
+	{
+		char buf[128];
+		snprintf(buf, sizeof(buf), "%s %llu %llu %llu %llu", what,
+			 (unsigned long long) order->order_id(),
+			 (unsigned long long) a, (unsigned long long) b,
+			 (unsigned long long) c);
+		events.push_back(buf);
+	}
+
+	void on_accept(const Ptr& order, Quantity qty) {
+		log("accept", order, qty);
+	}
+	void on_reject(const Ptr& order, const char *reason) {
+		log("reject", order);
+	}
+	void on_fill(const Ptr& order, const Ptr& matched, Quantity qty,
+		     Cost cost, bool inFilled, bool matchedFilled) {
+		log("fill", order, matched->order_id(), qty, cost);
+	}
+	void on_cancel(const Ptr& order, Quantity qty) {
+		log("cancel", order, qty);
+	}
+	void on_cancel_reject(const Ptr& order, const char *reason) {
+		log("cancel-reject", order);
+	}
+	void on_replace(const Ptr& order, Quantity cur, Quantity qty,
+			Price price) {
+		log("replace", order, cur, qty, price);
+		applyReplace(order, int32_t(qty) - int32_t(cur), price);
+	}
+	void on_replace_reject(const Ptr& order, const char *reason) {
+		log("replace-reject", order);
+	}
+};
+
+typedef liquibook::book::OrderBook<OrderPtr> MapBook;
+typedef liquibook::book::OrderBook<RefPtr> RefBook;
+
+// one side's resting orders in priority order, as "id:open" pairs
+template <class Map>
+static string restingOf(const Map& side)
+{
+	string s;
+	for (typename Map::const_iterator it = side.begin();
+	     it != side.end(); ++it) {
+		s += to_string(it->second.ptr()->order_id()) + ":" +
+		     to_string(it->second.open_qty()) + " ";
+	}
+	return s;
+}
+
+static string restingOf(const LadderOrderBook& book, bool isBuy)
+{
+	string s;
+	book.forEach(isBuy, [&s](const MapBook::Tracker& t) {
+		s += to_string(t.ptr()->order_id()) + ":" +
+		     to_string(t.open_qty()) + " ";
+	});
+	return s;
+}
+
+static string restingOf(const MapBook& book, bool isBuy)
+{
+	return restingOf(isBuy ? book.bids() : book.asks());
+}
+
+static string restingOf(const RefBook& book, bool isBuy)
+{
+	return restingOf(isBuy ? book.bids() : book.asks());
+}
+
+// the same order as both types, live while it may be on the books
+struct Pair {
+	OrderPtr	order;
+	RefPtr		ref;
+};
+
+struct FlowSpec {
+	const char	*name;
+	bool		ladder;		// only orders the ladder accepts
+	Price		lowBuy;		// buys at lowBuy .. lowBuy+spread-1
+	Price		lowSell;
+	unsigned int	spread;
+	size_t		steps;
+};
+
+template <class Book>
+static void run(Book& book, const FlowSpec& spec, unsigned int seed)
+{
+	Recorder<RefBook, RefPtr> ref("TEST");
+	srand(seed);
+
+	vector<Pair> live;
+	OrderId nextId = 1;
+	size_t maxDepth = 0;
+
+	for (size_t step = 0; step < spec.steps; step++) {
+		int op = rand() % 10;
+		if (op < 6 || live.empty()) {
+			bool buy = rand() % 2;
+			Price price = (buy ? spec.lowBuy : spec.lowSell) +
+				      rand() % spec.spread;
+			Quantity qty = (rand() % 10 + 1) * 100;
+			Price stopPrice = 0;
+			bool aon = false, ioc = false;
+			int kind = rand() % 20;
+			if (kind == 0)
+				ioc = true;
+			else if (!spec.ladder && kind == 1)
+				price = 0;
+			else if (!spec.ladder && kind == 2)
+				aon = true;
+			else if (!spec.ladder && kind == 3)
+				stopPrice = spec.lowSell + rand() % spec.spread;
+
+			OrderConditions cond =
+				(aon ? liquibook::book::oc_all_or_none : 0) |
+				(ioc ? liquibook::book::oc_immediate_or_cancel : 0);
+			Pair p;
+			p.order = OrderPtr(new Order(nextId, buy, qty, "TEST",
+						price, stopPrice, aon, ioc));
+			p.ref = RefPtr(new RefOrder(nextId, buy, qty, price,
+						stopPrice, aon, ioc));
+			nextId++;
+			book.add(p.order, cond);
+			ref.add(p.ref, cond);
+			live.push_back(p);
+		} else {
+			size_t i = rand() % live.size();
+			Pair p = live[i];
+			if (op < 8) {
+				book.cancel(p.order);
+				ref.cancel(p.ref);
+				live[i] = live.back();
+				live.pop_back();
+			} else {
+				int32_t delta = (rand() % 5 - 2) * 100;
+				Price price = liquibook::book::PRICE_UNCHANGED;
+				if (rand() % 2)
+					price = (p.order->is_buy() ? spec.lowBuy :
+						 spec.lowSell) + rand() % spec.spread;
+				book.replace(p.order, delta, price);
+				ref.replace(p.ref, delta, price);
+			}
+		}
+
+		REQUIRE(book.events == ref.events);
+		book.events.clear();
+		ref.events.clear();
+
+		// the whole book now and then: it grows deep
+		if (step % 16 == 0 || step == spec.steps - 1) {
+			REQUIRE(restingOf(book, true) == restingOf(ref, true));
+			REQUIRE(restingOf(book, false) == restingOf(ref, false));
+			REQUIRE(book.stopBids().size() == ref.stopBids().size());
+			REQUIRE(book.stopAsks().size() == ref.stopAsks().size());
+		}
+
+		if (ref.bids().size() > maxDepth)
+			maxDepth = ref.bids().size();
+
+		// cancel and replace recent orders; older ones rest on
+		if (live.size() > 4096)
+			live.erase(live.begin(), live.begin() + 2048);
+	}
+
+	printf(PROGRAM_NAME ": %-8s %zu steps, up to %zu bids resting: ok\n",
+	       spec.name, spec.steps, maxDepth);
+}
+
+// restore puts an order back as a snapshot held it, or refuses it
+static void test_restore(const LadderSpec& ladder)
+{
+	LadderOrderBook lbook("TEST", ladder);
+	MapBook mbook("TEST");
+
+	// each book keeps its own orders' handles
+	for (int i = 0; i < 2; i++) {
+		OrderPtr rests(new Order(1, true, 300, "TEST", 1880, 0,
+					 false, false));
+		OrderPtr off(new Order(2, true, 300, "TEST", 2500, 0,
+				       false, false));
+		OrderPtr stop(new Order(3, true, 300, "TEST", 1890, 1885,
+					false, false));
+		if (i == 0) {
+			CHECK(lbook.restore(rests, 200, 0, false));
+			CHECK(!lbook.restore(off, 300, 0, false));
+			CHECK(!lbook.restore(stop, 300, 0, true));
+		} else {
+			CHECK(mbook.restore(rests, 200, 0, false));
+			CHECK(mbook.restore(off, 300, 0, false));
+			CHECK(mbook.restore(stop, 300, 0, true));
+		}
+	}
+	CHECK(restingOf(lbook, true) == "1:200 ");
+	CHECK(restingOf(mbook, true) == "2:300 1:200 ");
+	CHECK(mbook.stopBids().size() == 1);
+
+	printf(PROGRAM_NAME ": restore: ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int seed = 1;
+	if (argc > 1)
+		seed = atoi(argv[1]);
+
+	// both sides cross; a wide range keeps the book deep
+	static const FlowSpec flows[] = {
+		{ "crossing", false, 1880, 1884, 10, 20000 },
+		{ "deep",     false, 1880, 1890, 3,  20000 },
+		{ "crossing", true,  1880, 1884, 10, 20000 },
+		{ "deep",     true,  1880, 1890, 3,  20000 },
+	};
+
+	LadderSpec ladder;
+	ladder.minPrice = 1800;
+	ladder.maxPrice = 2000;
+	ladder.tick = 1;
+
+	for (size_t i = 0; i < sizeof(flows) / sizeof(flows[0]); i++) {
+		if (flows[i].ladder) {
+			Recorder<LadderOrderBook, OrderPtr> book("TEST", ladder);
+			run(book, flows[i], seed + i);
+		} else {
+			Recorder<MapBook, OrderPtr> book("TEST");
+			run(book, flows[i], seed + i);
+		}
+	}
+	test_restore(ladder);
+
+	return testResult();
+}
@@ -0,0 +1,308 @@
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "ReqDecode.h"
+
+using namespace std;
+
+#define PROGRAM_NAME "test-decode"
+#include "test-util.h"
+
+// The request decoders on bodies at the edges: numbers at and beyond
+// their field's range, escapes and surrogate pairs, known keys with
+// the wrong type, unknown keys holding any value, and malformed JSON.
+
+// the decoders work in place, and the request points into the body,
+// which must stay put until the request is checked
+struct Body {
+	vector<char>	buf;
+
+	explicit Body(const string& s) : buf(s.begin(), s.end()) {}
+	char *data() { return buf.empty() ? NULL : &buf[0]; }
+	size_t size() const { return buf.size(); }
+};
+
+static bool order(Body& body, OrderReq& req)
+{
+	return decodeOrderReq(body.data(), body.size(), req);
+}
+
+// decodes, and is not bad
+static bool orderOk(const string& s)
+{
+	Body body(s);
+	OrderReq req;
+	return order(body, req) && !req.bad;
+}
+
+// decodes, but is bad
+static bool orderBad(const string& s)
+{
+	Body body(s);
+	OrderReq req;
+	return order(body, req) && req.bad;
+}
+
+static bool orderMalformed(const string& s)
+{
+	Body body(s);
+	OrderReq req;
+	return !order(body, req);
+}
+
+static void test_fields()
+{
+	Body body("{\"symbol\":\"IBM\",\"qty\":100,\"price\":1880,"
+		  "\"is_buy\":true,\"aon\":false,\"ioc\":true,\"stop\":0,"
+		  "\"oid\":\"12\",\"qtyDelta\":-5,\"op\":\"add\"}");
+	OrderReq req;
+	CHECK(order(body, req));
+	CHECK(!req.bad);
+	CHECK(req.has(OrderReq::F_SYMBOL | OrderReq::F_QTY |
+		      OrderReq::F_PRICE | OrderReq::F_IS_BUY |
+		      OrderReq::F_AON | OrderReq::F_IOC | OrderReq::F_STOP |
+		      OrderReq::F_OID | OrderReq::F_QTY_DELTA |
+		      OrderReq::F_OP));
+	CHECK(req.symbol.equals("IBM"));
+	CHECK(req.qty == 100 && req.price == 1880 && req.stop == 0);
+	CHECK(req.isBuy && !req.aon && req.ioc);
+	CHECK(req.oid.equals("12"));
+	CHECK(req.qtyDelta == -5);
+	CHECK(req.op.equals("add"));
+
+	// only what is present is marked
+	Body part(" { \"qty\" : 1 } ");
+	OrderReq req2;
+	CHECK(order(part, req2));
+	CHECK(req2.have == OrderReq::F_QTY);
+
+	Body empty("{}");
+	OrderReq req3;
+	CHECK(order(empty, req3));
+	CHECK(req3.have == 0 && !req3.bad);
+}
+
+static void test_numbers()
+{
+	// each field's range, and one beyond
+	CHECK(orderOk("{\"qty\":0}"));
+	CHECK(orderOk("{\"qty\":4294967295}"));
+	CHECK(orderBad("{\"qty\":4294967296}"));
+	CHECK(orderBad("{\"qty\":-1}"));
+	CHECK(orderOk("{\"price\":4294967295}"));
+	CHECK(orderBad("{\"price\":4294967296}"));
+	CHECK(orderBad("{\"stop\":-1}"));
+	CHECK(orderOk("{\"qtyDelta\":-2147483648}"));
+	CHECK(orderOk("{\"qtyDelta\":2147483647}"));
+	CHECK(orderBad("{\"qtyDelta\":-2147483649}"));
+	CHECK(orderBad("{\"qtyDelta\":2147483648}"));
+
+	// beyond int64, and beyond uint64
+	CHECK(orderBad("{\"qty\":9223372036854775808}"));
+	CHECK(orderBad("{\"qty\":18446744073709551616}"));
+	CHECK(orderBad("{\"qty\":99999999999999999999999999}"));
+	CHECK(orderBad("{\"qtyDelta\":-99999999999999999999999999}"));
+
+	// not integers
+	CHECK(orderBad("{\"qty\":1.5}"));
+	CHECK(orderBad("{\"qty\":1.0}"));
+	CHECK(orderBad("{\"qty\":1e2}"));
+	CHECK(orderBad("{\"qty\":1E+2}"));
+
+	// not numbers
+	CHECK(orderMalformed("{\"qty\":01}"));
+	CHECK(orderMalformed("{\"qty\":+1}"));
+	CHECK(orderMalformed("{\"qty\":-}"));
+	CHECK(orderMalformed("{\"qty\":1.}"));
+	CHECK(orderMalformed("{\"qty\":.5}"));
+	CHECK(orderMalformed("{\"qty\":1e}"));
+	CHECK(orderMalformed("{\"qty\":0x10}"));
+
+	Body body("{\"minPrice\":-9223372036854775808,"
+		  "\"maxPrice\":9223372036854775807}");
+	MarketAddReq mreq;
+	CHECK(decodeMarketAddReq(body.data(), body.size(), mreq));
+	CHECK(!mreq.bad);
+	CHECK(mreq.minPrice == INT64_MIN && mreq.maxPrice == INT64_MAX);
+
+	Body over("{\"tick\":9223372036854775808}");
+	MarketAddReq mreq2;
+	CHECK(decodeMarketAddReq(over.data(), over.size(), mreq2));
+	CHECK(mreq2.bad);
+}
+
+// the symbol, unescaped
+static string symbolOf(const string& s, bool& ok)
+{
+	Body body(s);
+	OrderReq req;
+	ok = order(body, req) && !req.bad;
+	return req.symbol.str();
+}
+
+static void test_strings()
+{
+	bool ok;
+	CHECK(symbolOf("{\"symbol\":\"a\\\"b\\\\c\\/d\"}", ok) == "a\"b\\c/d" &&
+	      ok);
+	CHECK(symbolOf("{\"symbol\":\"\\b\\f\\n\\r\\t\"}", ok) ==
+	      "\b\f\n\r\t" && ok);
+	CHECK(symbolOf("{\"symbol\":\"\\u0041\"}", ok) == "A" && ok);
+	CHECK(symbolOf("{\"symbol\":\"\\u00e9\"}", ok) == "\xc3\xa9" && ok);
+	CHECK(symbolOf("{\"symbol\":\"\\u20AC\"}", ok) == "\xe2\x82\xac" && ok);
+
+	// a surrogate pair is one code point
+	CHECK(symbolOf("{\"symbol\":\"\\ud83d\\ude00\"}", ok) ==
+	      "\xf0\x9f\x98\x80" && ok);
+	CHECK(symbolOf("{\"symbol\":\"\\uDBFF\\uDFFF\"}", ok) ==
+	      "\xf4\x8f\xbf\xbf" && ok);
+
+	// lone or misordered surrogates
+	CHECK(orderMalformed("{\"symbol\":\"\\ud83d\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\ud83dx\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\ud83d\\u0041\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\ude00\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\ude00\\ud83d\"}"));
+
+	// bad escapes, raw control chars, unterminated
+	CHECK(orderMalformed("{\"symbol\":\"\\x\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\u12\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"\\u12g4\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"a\nb\"}"));
+	CHECK(orderMalformed("{\"symbol\":\"abc"));
+	CHECK(orderMalformed("{\"symbol\":\"abc\\"));
+
+	// escaped keys still match
+	CHECK(symbolOf("{\"sym\\u0062ol\":\"X\"}", ok) == "X" && ok);
+}
+
+static void test_types()
+{
+	// known keys holding the wrong type mark the request bad
+	CHECK(orderBad("{\"symbol\":1}"));
+	CHECK(orderBad("{\"symbol\":null}"));
+	CHECK(orderBad("{\"qty\":\"100\"}"));
+	CHECK(orderBad("{\"qty\":true}"));
+	CHECK(orderBad("{\"stop\":\"0\"}"));
+	CHECK(orderBad("{\"is_buy\":1}"));
+	CHECK(orderBad("{\"aon\":\"false\"}"));
+	CHECK(orderBad("{\"ioc\":null}"));
+	CHECK(orderBad("{\"oid\":12}"));
+	CHECK(orderBad("{\"price\":[1]}"));
+	CHECK(orderBad("{\"price\":{\"v\":1}}"));
+
+	// ...but the rest still decodes
+	Body body("{\"qty\":\"100\",\"price\":5}");
+	OrderReq req;
+	CHECK(order(body, req));
+	CHECK(req.bad && req.have == OrderReq::F_PRICE && req.price == 5);
+}
+
+static void test_unknown()
+{
+	// unknown keys are skipped, whatever they hold
+	CHECK(orderOk("{\"x\":1,\"qty\":1}"));
+	CHECK(orderOk("{\"x\":\"\\ud83d\\ude00\",\"qty\":1}"));
+	CHECK(orderOk("{\"x\":null,\"y\":true,\"z\":-1.5e-3,\"qty\":1}"));
+	CHECK(orderOk("{\"x\":{\"a\":[1,{\"b\":[]}],\"c\":{}},\"qty\":1}"));
+	CHECK(orderOk("{\"Qty\":\"x\",\"qty \":[],\"qty\":1}"));
+
+	// but must be well formed
+	CHECK(orderMalformed("{\"x\":[1,,2],\"qty\":1}"));
+	CHECK(orderMalformed("{\"x\":{\"a\"},\"qty\":1}"));
+	CHECK(orderMalformed("{\"x\":tru,\"qty\":1}"));
+	CHECK(orderMalformed("{\"x\":nul}"));
+
+	// and not too deeply nested
+	string deep = "{\"x\":" + string(31, '[') + string(31, ']') + "}";
+	CHECK(orderOk(deep));
+	deep = "{\"x\":" + string(40, '[') + string(40, ']') + "}";
+	CHECK(orderMalformed(deep));
+	deep = "{\"x\":" + string(100000, '[');
+	CHECK(orderMalformed(deep));
+}
+
+static void test_malformed()
+{
+	CHECK(orderMalformed(""));
+	CHECK(orderMalformed("   "));
+	CHECK(orderMalformed("[]"));
+	CHECK(orderMalformed("\"qty\""));
+	CHECK(orderMalformed("{"));
+	CHECK(orderMalformed("{\"qty\":1"));
+	CHECK(orderMalformed("{\"qty\":1,}"));
+	CHECK(orderMalformed("{,\"qty\":1}"));
+	CHECK(orderMalformed("{qty:1}"));
+	CHECK(orderMalformed("{'qty':1}"));
+	CHECK(orderMalformed("{\"qty\" 1}"));
+	CHECK(orderMalformed("{\"qty\":}"));
+	CHECK(orderMalformed("{\"qty\":1}{}"));
+	CHECK(orderMalformed("{\"qty\":1} x"));
+	CHECK(orderOk("{\"qty\":1}\r\n"));
+
+	// a body cut anywhere short is malformed
+	string full = "{\"symbol\":\"\\u00e9\",\"qty\":[1,{\"a\":true}]}";
+	for (size_t len = 0; len < full.size(); len++)
+		CHECK(orderMalformed(full.substr(0, len)));
+	CHECK(!orderMalformed(full));
+
+	// NUL within the body is not whitespace
+	CHECK(orderMalformed(string("{\"qty\":1}\0", 10)));
+}
+
+static void test_batch()
+{
+	Body body("{\"atomic\":true,\"ops\":[{\"op\":\"add\",\"qty\":1},"
+		  "7,{\"op\":\"cancel\",\"oid\":\"3\"},{\"qty\":\"x\"}]}");
+	BatchReq req;
+	CHECK(decodeBatchReq(body.data(), body.size(), req, 10));
+	CHECK(!req.bad && req.atomic);
+	CHECK(req.has(BatchReq::F_OPS | BatchReq::F_ATOMIC));
+
+	// every item kept, in order; non-objects are bad placeholders
+	CHECK(req.ops.size() == 4);
+	CHECK(!req.ops[0].bad && req.ops[0].op.equals("add"));
+	CHECK(req.ops[1].bad);
+	CHECK(!req.ops[2].bad && req.ops[2].oid.equals("3"));
+	CHECK(req.ops[3].bad);
+
+	// too many items
+	Body many("{\"ops\":[{},{},{}]}");
+	BatchReq req2;
+	CHECK(decodeBatchReq(many.data(), many.size(), req2, 3));
+	Body tooMany("{\"ops\":[{},{},{},{}]}");
+	BatchReq req3;
+	CHECK(!decodeBatchReq(tooMany.data(), tooMany.size(), req3, 3));
+
+	// "ops" of the wrong type; a later "ops" replaces an earlier one
+	Body notArray("{\"ops\":{}}");
+	BatchReq req4;
+	CHECK(decodeBatchReq(notArray.data(), notArray.size(), req4, 3));
+	CHECK(req4.bad && !req4.has(BatchReq::F_OPS));
+	Body twice("{\"ops\":[{},{}],\"ops\":[{}]}");
+	BatchReq req5;
+	CHECK(decodeBatchReq(twice.data(), twice.size(), req5, 3));
+	CHECK(req5.ops.size() == 1);
+
+	Body atomicStr("{\"atomic\":\"yes\",\"ops\":[]}");
+	BatchReq req6;
+	CHECK(decodeBatchReq(atomicStr.data(), atomicStr.size(), req6, 3));
+	CHECK(req6.bad && req6.ops.empty());
+
+	Body cut("{\"ops\":[{\"qty\":1},");
+	BatchReq req7;
+	CHECK(!decodeBatchReq(cut.data(), cut.size(), req7, 3));
+}
+
+int main(int argc, char *argv[])
+{
+	test_fields();
+	test_numbers();
+	test_strings();
+	test_types();
+	test_unknown();
+	test_malformed();
+	test_batch();
+	return testResult();
+}
@@ -0,0 +1,128 @@
+#include <map>
+#include <set>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include "Order.h"
+#include "OrderIndex.h"
+
+using namespace std;
+using namespace orderentry;
+
+#define PROGRAM_NAME "test-index"
+#include "test-util.h"
+
+// OrderIndex against std::map under random inserts, erases and finds:
+// sequential ids from several shards, as the engine assigns them, and
+// ids that all probe from a few home slots, so that erases shift long
+// runs back.
+
+typedef map<OrderId, OrderPtr> Model;
+
+static OrderPtr newOrder(OrderId id)
+{
+	return OrderPtr(new Order(id, true, 100, "TEST", 1880, 0,
+				  false, false));
+}
+
+// every member found, none missing, and each visited once
+static void verify(const OrderIndex& index, const Model& model,
+		   const vector<OrderId>& gone)
+{
+	CHECK(index.size() == model.size());
+	CHECK(index.empty() == model.empty());
+	CHECK(index.size() * 2 <= index.bucketCount());
+
+	for (Model::const_iterator it = model.begin(); it != model.end(); ++it) {
+		const OrderPtr *p = index.find(it->first);
+		REQUIRE(p != NULL);
+		CHECK(*p == it->second);
+	}
+	for (size_t i = 0; i < gone.size(); i++)
+		if (!model.count(gone[i]))
+			CHECK(index.find(gone[i]) == NULL);
+
+	set<OrderId> seen;
+	index.forEach([&seen](const OrderPtr& order) {
+		REQUIRE(order);
+		CHECK(seen.insert(order->order_id()).second);
+	});
+	CHECK(seen.size() == model.size());
+}
+
+static void run(const char *name, const vector<OrderId>& ids, size_t steps,
+		unsigned int seed)
+{
+	OrderIndex index(16);
+	Model model;
+	vector<OrderId> gone;
+	srand(seed);
+
+	for (size_t step = 0; step < steps; step++) {
+		OrderId id = ids[rand() % ids.size()];
+		switch (rand() % 3) {
+		case 0:
+		case 1: {
+			OrderPtr order = newOrder(id);
+			index.insert(id, order);
+			model[id] = order;
+			break;
+		}
+		default: {
+			bool had = model.erase(id) != 0;
+			REQUIRE(index.erase(id) == had);
+			gone.push_back(id);
+			break;
+		}
+		}
+
+		REQUIRE((index.find(id) != NULL) == (model.count(id) != 0));
+		if (step % 256 == 0) {
+			verify(index, model, gone);
+			gone.clear();
+		}
+	}
+	verify(index, model, gone);
+
+	// drain: nothing left, and the slots are reusable
+	while (!model.empty()) {
+		CHECK(index.erase(model.begin()->first));
+		model.erase(model.begin());
+	}
+	CHECK(index.empty());
+	CHECK(!index.erase(ids[0]));
+	index.insert(ids[0], newOrder(ids[0]));
+	CHECK(index.size() == 1 && index.find(ids[0]));
+
+	printf(PROGRAM_NAME ": %-10s %zu steps, %zu buckets: ok\n", name,
+	       steps, index.bucketCount());
+}
+
+int main(int argc, char *argv[])
+{
+	vector<OrderId> ids;
+
+	// a few thousand live at once, across four shards
+	for (unsigned int shard = 0; shard < 4; shard++)
+		for (uint64_t seq = 1; seq <= 2000; seq++)
+			ids.push_back(makeOrderId(shard, seq));
+	run("sequential", ids, 200000, 1);
+
+	// a handful of ids: insert over an existing id, erase a missing one
+	ids.resize(8);
+	run("few", ids, 20000, 2);
+
+	// ids whose home slots, in a 4096-slot table, are all below 8
+	ids.clear();
+	for (OrderId id = 1; ids.size() < 1500; id++) {
+		OrderId h = id;
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		if ((h & 4095) < 8)
+			ids.push_back(id);
+	}
+	run("colliding", ids, 100000, 3);
+
+	return testResult();
+}
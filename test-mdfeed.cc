@@ -0,0 +1,425 @@
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <event2/event.h>
+#include "MdPublisher.h"
+#include "MdProto.h"
+
+using namespace std;
+using namespace orderentry;
+
+#define PROGRAM_NAME "test-mdfeed"
+#include "test-util.h"
+
+// MdPublisher over loopback: a receiver joins the multicast group and
+// checks the sequenced feed, then asks the TCP service for a snapshot
+// and for retransmissions, as obclient md does.  The publisher's loop
+// runs on this thread, between reads.
+
+#define MD_GROUP	"239.255.83.1"
+#define MD_IFACE	"127.0.0.1"
+
+enum {
+	RETAIN		= 64,		// messages kept for retransmission
+	WAIT_SECS	= 3,
+};
+
+static struct event_base *base;
+
+// one message as received, header included
+struct Msg {
+	uint64_t	seq;
+	string		bytes;
+
+	uint8_t type() const { return bytes[2]; }
+};
+
+static time_t deadline()
+{
+	return time(NULL) + WAIT_SECS;
+}
+
+static BookLevelUpdate level(bool buy, unsigned int pos, uint32_t price,
+			     uint32_t qty, uint32_t orders)
+{
+	BookLevelUpdate lvl;
+	lvl.buy = buy;
+	lvl.level = pos;
+	lvl.price = price;
+	lvl.qty = qty;
+	lvl.orders = orders;
+	return lvl;
+}
+
+// one change's records, as BookDepth splits them
+static void depthUpdate(vector<BookUpdate>& out, const char *symbol,
+			liquibook::book::ChangeId change,
+			const vector<BookLevelUpdate>& levels)
+{
+	for (size_t i = 0; i < levels.size(); i++) {
+		if (i % BOOK_UPD_LEVELS == 0) {
+			BookUpdate upd;
+			upd.type = BOOK_UPD_DEPTH;
+			upd.setSymbol(symbol);
+			upd.change = change;
+			upd.more = true;
+			out.push_back(upd);
+		}
+		out.back().levels[out.back().nLevels++] = levels[i];
+	}
+	out.back().more = false;
+}
+
+static BookUpdate tradeUpdate(const char *symbol, uint32_t price,
+			      uint32_t qty)
+{
+	BookUpdate upd;
+	upd.type = BOOK_UPD_TRADE;
+	upd.setSymbol(symbol);
+	upd.price = price;
+	upd.qty = qty;
+	return upd;
+}
+
+// split a packet or frame body into its messages
+static void splitMsgs(const unsigned char *p, size_t len, uint64_t seq,
+		      uint16_t count, vector<Msg>& out)
+{
+	for (uint16_t i = 0; i < count; i++) {
+		REQUIRE(len >= MD_MSG_HDR_SIZE);
+		uint16_t msgLen = binGetU16(p);
+		REQUIRE(msgLen >= MD_MSG_HDR_SIZE && msgLen <= len);
+
+		Msg msg;
+		msg.seq = seq + i;
+		msg.bytes.assign((const char *) p, msgLen);
+		out.push_back(msg);
+		p += msgLen;
+		len -= msgLen;
+	}
+	CHECK(len == 0);
+}
+
+static int joinGroup(unsigned int port)
+{
+	int fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	REQUIRE(fd >= 0);
+
+	int one = 1;
+	setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, MD_GROUP, &addr.sin_addr);
+	REQUIRE(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+
+	struct ip_mreq mreq;
+	inet_pton(AF_INET, MD_GROUP, &mreq.imr_multiaddr);
+	inet_pton(AF_INET, MD_IFACE, &mreq.imr_interface);
+	REQUIRE(setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP,
+		&mreq, sizeof(mreq)) == 0);
+	return fd;
+}
+
+// packets until n messages have arrived; heartbeats are counted apart
+static void recvFeed(int fd, uint32_t session, size_t n, vector<Msg>& out,
+		     unsigned int *heartbeats = NULL)
+{
+	unsigned char pkt[MD_MAX_PACKET + 1];
+	time_t end = deadline();
+	size_t want = out.size() + n;
+
+	while (out.size() < want || (heartbeats && !*heartbeats)) {
+		REQUIRE(time(NULL) <= end);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+
+		ssize_t len = recv(fd, pkt, sizeof(pkt), 0);
+		if (len < 0) {
+			REQUIRE(errno == EAGAIN || errno == EWOULDBLOCK);
+			usleep(1000);
+			continue;
+		}
+		REQUIRE(len >= MD_PKT_HDR_SIZE && len <= MD_MAX_PACKET);
+
+		MdPacketHdr hdr;
+		hdr.decode(pkt);
+		CHECK(hdr.session == session);
+		if (hdr.count == 0) {
+			// carries the next sequence number
+			REQUIRE(hdr.seq == (out.empty() ? 1 : out.back().seq + 1));
+			if (heartbeats)
+				(*heartbeats)++;
+			continue;
+		}
+
+		// in order, no gaps, on loopback
+		REQUIRE(hdr.seq == (out.empty() ? 1 : out.back().seq + 1));
+		splitMsgs(pkt + MD_PKT_HDR_SIZE, len - MD_PKT_HDR_SIZE,
+			  hdr.seq, hdr.count, out);
+	}
+	REQUIRE(out.size() == want);
+}
+
+static int connectTo(unsigned int port)
+{
+	int fd = socket(AF_INET, SOCK_STREAM, 0);
+	REQUIRE(fd >= 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_port = htons(port);
+	inet_pton(AF_INET, MD_IFACE, &addr.sin_addr);
+
+	// the listener accepts from the loop; the kernel completes the
+	// handshake first
+	REQUIRE(connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	fcntl(fd, F_SETFL, O_NONBLOCK);
+	return fd;
+}
+
+// one reply frame
+static void recvFrame(int fd, MdPacketHdr& hdr, vector<Msg>& out)
+{
+	string buf;
+	size_t want = 4;		// the length, then the frame
+	time_t end = deadline();
+
+	while (buf.size() < want) {
+		REQUIRE(time(NULL) <= end);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+
+		char tmp[4096];
+		ssize_t len = recv(fd, tmp, min(sizeof(tmp), want - buf.size()), 0);
+		if (len < 0) {
+			REQUIRE(errno == EAGAIN || errno == EWOULDBLOCK);
+			usleep(1000);
+			continue;
+		}
+		REQUIRE(len > 0);
+		buf.append(tmp, len);
+
+		if (want == 4 && buf.size() == 4) {
+			uint32_t frameLen =
+				binGetU32((const unsigned char *) buf.data());
+			REQUIRE(frameLen >= MD_PKT_HDR_SIZE &&
+				frameLen <= MD_MAX_FRAME);
+			want += frameLen;
+		}
+	}
+
+	const unsigned char *p = (const unsigned char *) buf.data();
+	hdr.decode(p + 4);
+	out.clear();
+	splitMsgs(p + 4 + MD_PKT_HDR_SIZE, want - 4 - MD_PKT_HDR_SIZE,
+		  hdr.seq, hdr.count, out);
+}
+
+static void sendReq(int fd, const unsigned char *msg, size_t len)
+{
+	REQUIRE(send(fd, msg, len, 0) == (ssize_t) len);
+}
+
+static MdDepth depthOf(const Msg& msg)
+{
+	REQUIRE(msg.type() == MD_DEPTH && msg.bytes.size() == MdDepth::SIZE);
+	MdDepth depth;
+	depth.decode((const unsigned char *) msg.bytes.data());
+	return depth;
+}
+
+static void checkDepth(const Msg& msg, const char *symbol, uint32_t change,
+		       const BookLevelUpdate& lvl, bool last)
+{
+	MdDepth depth = depthOf(msg);
+	CHECK(depth.symbol == symbol);
+	CHECK(depth.change == change);
+	CHECK(((depth.flags & MD_F_BUY) != 0) == lvl.buy);
+	CHECK(((depth.flags & MD_F_LAST) != 0) == last);
+	CHECK(depth.level == lvl.level);
+	CHECK(depth.price == lvl.price);
+	CHECK(depth.qty == lvl.qty);
+	CHECK(depth.orders == lvl.orders);
+}
+
+// a free port, by binding to port 0
+static unsigned int freePort(int type)
+{
+	int fd = socket(AF_INET, type, 0);
+	REQUIRE(fd >= 0);
+
+	struct sockaddr_in addr;
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	inet_pton(AF_INET, MD_IFACE, &addr.sin_addr);
+	REQUIRE(bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+	socklen_t len = sizeof(addr);
+	REQUIRE(getsockname(fd, (struct sockaddr *) &addr, &len) == 0);
+	close(fd);
+	return ntohs(addr.sin_port);
+}
+
+int main(int argc, char *argv[])
+{
+	base = event_base_new();
+	REQUIRE(base != NULL);
+
+	unsigned int feedPort = freePort(SOCK_DGRAM);
+	unsigned int tcpPort = freePort(SOCK_STREAM);
+
+	MdPublisher pub(base, 1024, RETAIN);
+	REQUIRE(pub.open(MD_GROUP, feedPort, MD_IFACE, 0));
+	REQUIRE(pub.listen(MD_IFACE, tcpPort));
+	int feed = joinGroup(feedPort);
+
+	// the first packet gives the session
+	vector<BookLevelUpdate> aaa1;
+	aaa1.push_back(level(true, 0, 1880, 300, 2));
+	aaa1.push_back(level(true, 1, 1879, 100, 1));
+	aaa1.push_back(level(false, 0, 1884, 500, 3));
+	vector<BookUpdate> updates;
+	depthUpdate(updates, "AAA", 1, aaa1);
+	updates.push_back(tradeUpdate("AAA", 1882, 200));
+	pub.post(updates);
+
+	unsigned char pkt[MD_MAX_PACKET];
+	time_t end = deadline();
+	ssize_t len;
+	while ((len = recv(feed, pkt, sizeof(pkt), MSG_PEEK)) < 0) {
+		REQUIRE(time(NULL) <= end);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+		usleep(1000);
+	}
+	MdPacketHdr first;
+	first.decode(pkt);
+	uint32_t session = first.session;
+
+	// one message per slot, the last flagged, then the trade
+	vector<Msg> msgs;
+	recvFeed(feed, session, 4, msgs);
+	for (size_t i = 0; i < 3; i++)
+		checkDepth(msgs[i], "AAA", 1, aaa1[i], i == 2);
+	REQUIRE(msgs[3].type() == MD_TRADE);
+	MdTrade trade;
+	trade.decode((const unsigned char *) msgs[3].bytes.data());
+	CHECK(trade.symbol == "AAA" && trade.price == 1882 && trade.qty == 200);
+
+	// more than a packet holds: split, sequenced without gaps
+	updates.clear();
+	vector<BookLevelUpdate> bbb;
+	for (unsigned int i = 0; i < 50; i++)
+		bbb.push_back(level(true, i, 2000 - i, 100 + i, 1));
+	for (unsigned int i = 0; i < 50; i++)
+		bbb.push_back(level(false, i, 2001 + i, 200 + i, 2));
+	depthUpdate(updates, "BBB", 7, bbb);
+
+	// empty AAA's second bid
+	vector<BookLevelUpdate> aaa2;
+	aaa2.push_back(level(true, 1, 0, 0, 0));
+	depthUpdate(updates, "AAA", 2, aaa2);
+	uint64_t packets = pub.packets();
+	pub.post(updates);
+	recvFeed(feed, session, 101, msgs);
+	CHECK(pub.packets() - packets >= 3);
+	for (size_t i = 0; i < 100; i++)
+		checkDepth(msgs[4 + i], "BBB", 7, bbb[i], i == 99);
+	checkDepth(msgs[104], "AAA", 2, aaa2[0], true);
+	CHECK(pub.messages() == 105);
+
+	// snapshot: every non-empty slot, as of the next sequence number
+	int tcp = connectTo(tcpPort);
+	unsigned char req[MD_MAX_MSG];
+	MdSnapshotReq snapReq;
+	snapReq.encode(req);
+	sendReq(tcp, req, MdSnapshotReq::SIZE);
+
+	vector<Msg> snap, frame;
+	MdPacketHdr hdr;
+	do {
+		recvFrame(tcp, hdr, frame);
+		CHECK(hdr.session == session && hdr.seq == 106);
+		snap.insert(snap.end(), frame.begin(), frame.end());
+	} while (snap.back().type() != MD_SNAPSHOT_END);
+
+	MdSnapshotEnd snapEnd;
+	snapEnd.decode((const unsigned char *) snap.back().bytes.data());
+	CHECK(snapEnd.nextSeq == 106);
+	snap.pop_back();
+
+	// books in symbol order, bids then asks, by position
+	REQUIRE(snap.size() == 2 + 100);
+	checkDepth(snap[0], "AAA", 2, aaa1[0], false);
+	checkDepth(snap[1], "AAA", 2, aaa1[2], true);
+	for (size_t i = 0; i < 100; i++)
+		checkDepth(snap[2 + i], "BBB", 7, bbb[i], i == 99);
+
+	// retransmission: the same bytes as first sent
+	MdRetransReq rtReq;
+	rtReq.seq = 50;
+	rtReq.count = 10;
+	rtReq.encode(req);
+	sendReq(tcp, req, MdRetransReq::SIZE);
+	recvFrame(tcp, hdr, frame);
+	REQUIRE(hdr.seq == 50 && hdr.count == 10);
+	for (size_t i = 0; i < 10; i++)
+		CHECK(frame[i].bytes == msgs[49 + i].bytes);
+
+	// clipped at the last message sent
+	rtReq.seq = 100;
+	rtReq.count = 100;
+	rtReq.encode(req);
+	sendReq(tcp, req, MdRetransReq::SIZE);
+	recvFrame(tcp, hdr, frame);
+	REQUIRE(hdr.seq == 100 && hdr.count == 6);
+	CHECK(frame.back().bytes == msgs.back().bytes);
+
+	// no longer retained, or not yet sent: none
+	rtReq.seq = 105 - RETAIN;
+	rtReq.count = 1;
+	rtReq.encode(req);
+	sendReq(tcp, req, MdRetransReq::SIZE);
+	recvFrame(tcp, hdr, frame);
+	CHECK(hdr.count == 0);
+	rtReq.seq = 106;
+	rtReq.encode(req);
+	sendReq(tcp, req, MdRetransReq::SIZE);
+	recvFrame(tcp, hdr, frame);
+	CHECK(hdr.count == 0);
+	CHECK(pub.retransmits() == 16 && pub.snapshots() == 1);
+
+	// a quiet feed sends heartbeats with the next sequence number
+	unsigned int heartbeats = 0;
+	recvFeed(feed, session, 0, msgs, &heartbeats);
+
+	// a malformed request closes the session
+	unsigned char bad[MD_MSG_HDR_SIZE];
+	mdPutMsgHdr(bad, MD_MSG_HDR_SIZE, 'X', 0);
+	sendReq(tcp, bad, sizeof(bad));
+	end = deadline();
+	while (true) {
+		REQUIRE(time(NULL) <= end);
+		event_base_loop(base, EVLOOP_NONBLOCK);
+		char tmp[16];
+		if (recv(tcp, tmp, sizeof(tmp), 0) == 0)
+			break;
+		usleep(1000);
+	}
+
+	close(tcp);
+	close(feed);
+	printf(PROGRAM_NAME ": %llu messages in %llu packets: ok\n",
+	       (unsigned long long) pub.messages(),
+	       (unsigned long long) pub.packets());
+	return testResult();
+}
@@ -0,0 +1,320 @@
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include "Market.h"
+#include "Journal.h"
+#include "Snapshot.h"
+#include "Serialize.h"
+
+using namespace std;
+using namespace orderentry;
+using liquibook::book::Price;
+using liquibook::book::Quantity;
+
+#define PROGRAM_NAME "test-recovery"
+#include "test-util.h"
+
+// Recovery round trip: random commands through a journaled Market,
+// then a second Market rebuilt from the journal alone, and a third from
+// a snapshot plus the journal written after it.  Each must match the
+// live market: books, resting and stopped orders in priority order,
+// price levels, live order state, archived orders and the order id
+// sequence.  And journals in a format this build cannot replay must
+// be refused when opened.
+
+static const char *symbols[] = { "MAP", "DEPTH", "LADDER" };
+
+static void addBooks(Market& market)
+{
+	LadderSpec ladder;
+	ladder.minPrice = 1800;
+	ladder.maxPrice = 2000;
+	ladder.tick = 1;
+
+	market.addBook("MAP", 0);
+	market.addBook("DEPTH", 10);
+	market.addBook("LADDER", 5, ladder);
+}
+
+static string trackerStr(const OrderBook::Tracker& tracker)
+{
+	return to_string(tracker.ptr()->order_id()) + ":" +
+	       to_string(tracker.open_qty()) + ":" +
+	       to_string(tracker.all_or_none()) + " ";
+}
+
+static string levelsStr(const PriceLevels::LevelMap& levels)
+{
+	string s;
+	for (auto it = levels.begin(); it != levels.end(); ++it)
+		s += to_string(it->first) + "=" + to_string(it->second.qty) +
+		     "/" + to_string(it->second.orders) + " ";
+	return s;
+}
+
+static string orderStr(const Order& order)
+{
+	char buf[256];
+	snprintf(buf, sizeof(buf), "%llu %s %d %u %u %u %u %u %u %s\n",
+		 (unsigned long long) order.order_id(),
+		 order.symbol().c_str(), (int) order.state(),
+		 order.order_qty(), order.price(), order.stop_price(),
+		 order.quantityOnMarket(), order.quantityFilled(),
+		 order.fillCost(), order.alias().c_str());
+	return buf;
+}
+
+// everything recovery must restore, as text
+static string describe(Market& market)
+{
+	string s = "seq " + to_string(market.lastOrderSeq()) + "\n";
+
+	const Market::SymbolToBookMap& books = market.books();
+	for (auto it = books.begin(); it != books.end(); ++it) {
+		const OrderBookPtr& book = it->second;
+		s += "book " + it->first + " " +
+		     to_string(book->market_price()) + "\n bids ";
+		forEachResting(*book, true, [&s](const OrderBook::Tracker& t) {
+			s += trackerStr(t);
+		});
+		s += "\n asks ";
+		forEachResting(*book, false, [&s](const OrderBook::Tracker& t) {
+			s += trackerStr(t);
+		});
+		s += "\n stops ";
+		for (auto st = book->stopBids().begin();
+		     st != book->stopBids().end(); ++st)
+			s += trackerStr(st->second);
+		s += "| ";
+		for (auto st = book->stopAsks().begin();
+		     st != book->stopAsks().end(); ++st)
+			s += trackerStr(st->second);
+
+		const PriceLevels *levels = market.priceLevels(book);
+		REQUIRE(levels != NULL);
+		s += "\n levels " + levelsStr(levels->bids()) + "| " +
+		     levelsStr(levels->asks()) + "\n";
+	}
+
+	// live orders, by id
+	vector<OrderPtr> live;
+	market.orders().forEach([&live](const OrderPtr& order) {
+		live.push_back(order);
+	});
+	sort(live.begin(), live.end(), [](const OrderPtr& a, const OrderPtr& b) {
+		return a->order_id() < b->order_id();
+	});
+	for (size_t i = 0; i < live.size(); i++)
+		s += "live " + orderStr(*live[i]);
+
+	// archived orders, oldest first
+	const deque<OrderArchive::Entry>& archived = market.archive().entries();
+	for (auto it = archived.begin(); it != archived.end(); ++it)
+		s += "archived " + orderStr(*it->order);
+
+	return s;
+}
+
+// one random command, as the API handlers issue them
+static void command(Market& market, vector<OrderId>& ids)
+{
+	int op = rand() % 10;
+	if (op < 6 || ids.empty()) {
+		const char *symbol = symbols[rand() % 3];
+		OrderBookPtr book = market.findBook(symbol);
+		REQUIRE(book);
+
+		bool buy = rand() % 2;
+		Price price = (buy ? 1880 : 1884) + rand() % 10;
+		Quantity qty = (rand() % 10 + 1) * 100;
+		Price stop = 0;
+		bool aon = false, ioc = false;
+		switch (rand() % 20) {
+		case 0: price = 0; break;
+		case 1: aon = true; break;
+		case 2: ioc = true; break;
+		case 3: stop = 1884 + rand() % 10; break;
+		case 4: price = 2500; break;	// off the ladder
+		default: break;
+		}
+
+		liquibook::book::OrderConditions conditions =
+			(aon ? liquibook::book::oc_all_or_none : 0) |
+			(ioc ? liquibook::book::oc_immediate_or_cancel : 0);
+		OrderId id = market.nextOrderId();
+		OrderPtr order(new Order(id, buy, qty, symbol, price, stop,
+					 aon, ioc));
+		if (rand() % 4 == 0)
+			order->setAlias("alias-" + to_string(id));
+		market.orderSubmit(book, order, conditions);
+		ids.push_back(id);
+	} else if (op < 8) {
+		market.orderCancel(ids[rand() % ids.size()]);
+	} else {
+		int32_t delta = (rand() % 5 - 2) * 100;
+		Price price = liquibook::book::PRICE_UNCHANGED;
+		if (rand() % 2)
+			price = 1880 + rand() % 14;
+		market.orderModify(ids[rand() % ids.size()], delta, price);
+	}
+
+	// cancel and modify recent orders, and some long gone
+	if (ids.size() > 2000)
+		ids.erase(ids.begin(), ids.begin() + 1000);
+}
+
+// run n commands, committing the journal as the shard does
+static void runCommands(Market& market, Journal& journal,
+			vector<OrderId>& ids, size_t n)
+{
+	for (size_t i = 0; i < n; i++) {
+		command(market, ids);
+		if (i % 64 == 63)
+			CHECK(journal.commit());
+	}
+	CHECK(journal.commit());
+}
+
+// a new market, from the snapshot if any and the journal after it,
+// as MatchShard::recover rebuilds one
+static void recover(Market& market, rocksdb::DB *db, const string& snapFn,
+		    bool wantSnapshot)
+{
+	market.archive().setLimits(500, 0);
+
+	Journal journal(db, JSYNC_ASYNC);
+	REQUIRE(journal.open());
+
+	bool found;
+	SnapshotInfo info;
+	REQUIRE(snapshotLoad(market, snapFn, found, info));
+	CHECK(found == wantSnapshot);
+	journal.resume(info.seq);
+
+	REQUIRE(journal.replay(info.seq, [&market](const JournalRecord& rec) {
+		market.replay(rec);
+	}));
+}
+
+// a record in the layout before 64-bit order ids: add-book had no
+// depth, and submit named its order by UUID
+static void putOldRecord(rocksdb::DB *db, const string& prefix,
+			 uint64_t seq, uint8_t type)
+{
+	string k(prefix), v;
+	serKeyU64(k, seq);
+	serU8(v, type);
+	serU64(v, 0);
+	serU32(v, 0);
+	if (type == JREC_ORDER_SUBMIT)
+		serStr(v, "6f1d3a52-8c1e-4c5b-9a43-0e2f6d7b8a91");
+	serStr(v, "MAP");
+	serU8(v, 1);
+	if (type == JREC_ORDER_SUBMIT) {
+		serU32(v, 100);
+		serU32(v, 1880);
+		serU32(v, 0);
+		serU32(v, 0);
+	}
+	REQUIRE(db->Put(rocksdb::WriteOptions(), k, v).ok());
+}
+
+// journals this build cannot replay are refused at open
+static void test_formats(rocksdb::DB *db)
+{
+	// older add-book records are read, and the journal marked
+	putOldRecord(db, "/add/", 1, JREC_ADD_BOOK);
+	{
+		Journal journal(db, JSYNC_ASYNC, "/add/");
+		CHECK(journal.open() && journal.lastSeq() == 1);
+		string val;
+		CHECK(db->Get(rocksdb::ReadOptions(), "/add/", &val).ok());
+		CHECK(val == "2");
+	}
+
+	// string order ids are not, nor is the journal marked
+	putOldRecord(db, "/old/", 1, JREC_ADD_BOOK);
+	putOldRecord(db, "/old/", 2, JREC_ORDER_SUBMIT);
+	for (int i = 0; i < 2; i++) {
+		Journal journal(db, JSYNC_ASYNC, "/old/");
+		CHECK(!journal.open());
+	}
+
+	// nor is a later build's format
+	REQUIRE(db->Put(rocksdb::WriteOptions(), "/new/", "9").ok());
+	Journal journal(db, JSYNC_ASYNC, "/new/");
+	CHECK(!journal.open());
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int seed = 1;
+	if (argc > 1)
+		seed = atoi(argv[1]);
+	srand(seed);
+
+	char dir[] = "/tmp/test-recovery.XXXXXX";
+	REQUIRE(mkdtemp(dir) != NULL);
+	string dbFn = string(dir) + "/db";
+	string snapFn = string(dir) + "/snapshot";
+
+	rocksdb::Options options;
+	options.create_if_missing = true;
+	rocksdb::DB *db = NULL;
+	REQUIRE(rocksdb::DB::Open(options, dbFn, &db).ok());
+
+	Market live;
+	live.archive().setLimits(500, 0);
+	Journal journal(db, JSYNC_ASYNC);
+	REQUIRE(journal.open());
+	live.setJournal(&journal);
+
+	// the books' creation is journaled too
+	addBooks(live);
+	vector<OrderId> ids;
+	runCommands(live, journal, ids, 5000);
+
+	// from the journal alone
+	string want = describe(live);
+	{
+		Market m;
+		recover(m, db, snapFn, false);
+		CHECK(describe(m) == want);
+	}
+
+	// snapshot, drop the journal it covers, and carry on
+	SnapshotInfo info;
+	REQUIRE(snapshotWrite(live, journal.lastSeq(), snapFn, info));
+	CHECK(info.seq == journal.lastSeq());
+	CHECK(journal.trim(info.seq));
+	{
+		Market m;
+		recover(m, db, snapFn, true);
+		CHECK(describe(m) == want);
+	}
+
+	runCommands(live, journal, ids, 5000);
+	want = describe(live);
+	{
+		Market m;
+		recover(m, db, snapFn, true);
+		CHECK(describe(m) == want);
+
+		// and new ids follow on from the recovered ones
+		CHECK(m.nextOrderId() == live.nextOrderId());
+	}
+
+	printf(PROGRAM_NAME ": %zu orders live, %zu archived: ok\n",
+	       live.orders().size(), live.archive().size());
+
+	test_formats(db);
+
+	delete db;
+	rocksdb::DestroyDB(dbFn, options);
+	unlink(snapFn.c_str());
+	rmdir(dir);
+	return testResult();
+}
@@ -0,0 +1,158 @@
+#include <string.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "srv.h"
+#include "HttpRouter.h"
+
+#define PROGRAM_NAME "test-router"
+#include "test-util.h"
+
+// HttpRouter over the server's API routes, as obsrv.cc builds them
+// from API_ROUTES, and over paths that overlap: exact against
+// capture, and a capture within a longer capturing path.
+
+// the server's routes; handlers are not needed to route
+#define API_ENTRY(auth, path, match, cb, input, json)	\
+	{ auth, path, match, NULL, input, json },
+
+static const struct HttpApiEntry apiRegistry[] = {
+	API_ROUTES(API_ENTRY)
+};
+static const size_t nRoutes = sizeof(apiRegistry) / sizeof(apiRegistry[0]);
+
+// the server's route for path; it must have one
+static const HttpApiEntry *apiRoute(const char *path)
+{
+	for (size_t i = 0; i < nRoutes; i++)
+		if (!strcmp(apiRegistry[i].path, path))
+			return &apiRegistry[i];
+	fprintf(stderr, PROGRAM_NAME ": no route %s\n", path);
+	exit(1);
+}
+
+static const struct HttpApiEntry overlapping[] = {
+	{ false, "/a/",		PATH_SYMBOL,	NULL, false, false },
+	{ false, "/a/B",	PATH_EXACT,	NULL, false, false },
+	{ false, "/a/X/",	PATH_SYMBOL,	NULL, false, false },
+	{ false, "/a/x/",	PATH_ORDER_ID,	NULL, false, false },
+};
+
+// path routes to ent, with capture cap (NULL: none)
+static void expect(const HttpRouter& router, const char *path,
+		   const HttpApiEntry *ent, const char *cap)
+{
+	const char *match = NULL;
+	size_t matchLen = 0;
+	const HttpApiEntry *found = router.route(path, match, matchLen);
+	if (found != ent) {
+		fprintf(stderr, PROGRAM_NAME ": %s: routed to %s, not %s\n",
+			path, found ? found->path : "nothing",
+			ent ? ent->path : "nothing");
+		exit(1);
+	}
+	if (!ent)
+		return;
+	if (!cap) {
+		CHECK(match == NULL && matchLen == 0);
+		return;
+	}
+	REQUIRE(match != NULL);
+	CHECK(match >= path && match + matchLen <= path + strlen(path));
+	if (matchLen != strlen(cap) || memcmp(match, cap, matchLen)) {
+		fprintf(stderr, PROGRAM_NAME ": %s: captured %.*s, not %s\n",
+			path, (int) matchLen, match, cap);
+		exit(1);
+	}
+}
+
+static void test_api()
+{
+	HttpRouter router;
+	for (size_t i = 0; i < nRoutes; i++)
+		router.add(&apiRegistry[i]);
+
+	const HttpApiEntry *info = apiRoute("/info");
+	const HttpApiEntry *book = apiRoute("/book/");
+	const HttpApiEntry *stream = apiRoute("/stream/");
+	const HttpApiEntry *orderAdd = apiRoute("/orderAdd");
+	const HttpApiEntry *order = apiRoute("/order/");
+
+	// every route: an exact path, and nothing either side of it; a
+	// capture of its class, and nothing without one
+	for (size_t i = 0; i < nRoutes; i++) {
+		const HttpApiEntry *ent = &apiRegistry[i];
+		std::string path = ent->path;
+		switch (ent->match) {
+		case PATH_EXACT:
+			expect(router, path.c_str(), ent, NULL);
+			expect(router, (path + "x").c_str(), NULL, NULL);
+			expect(router, path.substr(0, path.size() - 1).c_str(),
+			       NULL, NULL);
+			break;
+		case PATH_SYMBOL:
+			expect(router, (path + "ABC").c_str(), ent, "ABC");
+			expect(router, path.c_str(), NULL, NULL);
+			break;
+		case PATH_ORDER_ID:
+			expect(router, (path + "12ab").c_str(), ent, "12ab");
+			expect(router, path.c_str(), NULL, NULL);
+			break;
+		default:
+			CHECK(!"unknown match type");
+		}
+	}
+	expect(router, "/info", info, NULL);
+	expect(router, "/info/", NULL, NULL);
+	expect(router, "/orderAdd", orderAdd, NULL);
+	expect(router, "", NULL, NULL);
+	expect(router, "/", NULL, NULL);
+	expect(router, "info", NULL, NULL);
+
+	// captures: one or more chars of the class; the rest is ignored
+	expect(router, "/book/IBM", book, "IBM");
+	expect(router, "/book/IBM/x?y", book, "IBM");
+	expect(router, "/book/IBMx", book, "IBM");
+	expect(router, "/book/", NULL, NULL);
+	expect(router, "/book/ibm", NULL, NULL);
+	expect(router, "/book", NULL, NULL);
+	expect(router, "/stream/A", stream, "A");
+	expect(router, "/order/123", order, "123");
+	expect(router, "/order/0a1b-2c3d", order, "0a1b-2c3d");
+	expect(router, "/order/ab/cd", order, "ab");
+	expect(router, "/order/AB", NULL, NULL);
+	expect(router, "/order/", NULL, NULL);
+	expect(router, "/order", NULL, NULL);
+}
+
+static void test_overlap()
+{
+	HttpRouter router;
+	for (size_t i = 0; i < sizeof(overlapping) / sizeof(overlapping[0]); i++)
+		router.add(&overlapping[i]);
+
+	const HttpApiEntry *a = &overlapping[0];
+	const HttpApiEntry *aB = &overlapping[1];
+	const HttpApiEntry *aX = &overlapping[2];
+	const HttpApiEntry *ax = &overlapping[3];
+
+	// an exact match wins over a capture
+	expect(router, "/a/B", aB, NULL);
+	expect(router, "/a/BC", a, "BC");
+	expect(router, "/a/C", a, "C");
+
+	// a longer capturing path wins; else the shorter one captures
+	expect(router, "/a/X/YZ", aX, "YZ");
+	expect(router, "/a/X/", a, "X");
+	expect(router, "/a/X", a, "X");
+	expect(router, "/a/XY", a, "XY");
+	expect(router, "/a/x/y-1", ax, "y-1");
+	expect(router, "/a/x/", NULL, NULL);
+	expect(router, "/a/", NULL, NULL);
+}
+
+int main(int argc, char *argv[])
+{
+	test_api();
+	test_overlap();
+	return testResult();
+}
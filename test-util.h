@@ -0,0 +1,49 @@
+#ifndef __TEST_UTIL_H__
+#define __TEST_UTIL_H__
+
+#include <stdio.h>
+#include <stdlib.h>
+
+// Checks for the test programs.  Each defines PROGRAM_NAME before
+// including this.  CHECK reports a failed condition and carries on, so
+// one run shows every independent failure; REQUIRE stops the test, for
+// conditions the rest of it depends on: a socket that must be open, a
+// pointer about to be followed, or books that must not have diverged.
+// main returns testResult().
+
+static unsigned int testFailures;
+
+#define TEST_FAIL(cond)							\
+	do {								\
+		fprintf(stderr, PROGRAM_NAME ": %s:%d: %s\n",		\
+			__FILE__, __LINE__, cond);			\
+		testFailures++;						\
+	} while (0)
+
+#define CHECK(cond)							\
+	do {								\
+		if (!(cond))						\
+			TEST_FAIL(#cond);				\
+	} while (0)
+
+#define REQUIRE(cond)							\
+	do {								\
+		if (!(cond)) {						\
+			TEST_FAIL(#cond);				\
+			exit(1);					\
+		}							\
+	} while (0)
+
+// the exit status, and a last line saying so
+static inline int testResult()
+{
+	if (testFailures) {
+		fprintf(stderr, PROGRAM_NAME ": %u check%s failed\n",
+			testFailures, testFailures == 1 ? "" : "s");
+		return 1;
+	}
+	printf(PROGRAM_NAME ": ok\n");
+	return 0;
+}
+
+#endif // __TEST_UTIL_H__